@@ -3,7 +3,15 @@
 #include <cstddef>
 #include <string_view>
 #include <memory>
+#include <utility>
+#include <vector>
 
+#include "diagnostic_store.h"
+#include "fold_map.h"
+#include "language_server_paths.h"
+#include "large_file.h"
+#include "semantic_token_store.h"
+#include "symbol_index.h"
 #include "text_buffer.h"
 #include "undo_stack.h"
 #include "lsp_manager.h"
@@ -35,25 +43,130 @@ public:
   size_t delete_backward(size_t offset);
 
   void set_text(std::string text);
+  // Replaces the buffer with a file; files over the map threshold are
+  // memory-mapped rather than read.
+  bool load_file(const std::string &path);
   size_t line_count() const;
   std::string line_text(size_t line_index) const;
   size_t line_grapheme_count(size_t line_index) const;
   Position position_at(size_t offset) const;
   size_t offset_at(const Position &pos) const;
 
+  // Folding. Renderers and scrolling work in visible lines and map them to
+  // buffer lines through fold_map().
+  const std::vector<FoldRange> &fold_ranges() const;
+  bool toggle_fold(size_t line_index);
+  FoldMap &fold_map();
+  const FoldMap &fold_map() const;
+
+  // Structural selection and bracket matching over the retained syntax tree.
+  // shrink_selection() first retraces earlier expansions, then falls back to
+  // the tree. All return false when nothing changes.
+  bool expand_selection(size_t &start, size_t &end);
+  bool shrink_selection(size_t &start, size_t &end);
+  bool matching_bracket(size_t offset, size_t &match) const;
+
+  // Large-file mode. Past the configured thresholds the buffer is mapped, the
+  // document is not synced to language servers and only a window around the
+  // viewport is highlighted; folds are unavailable and structural selection
+  // is limited to that window. The status is re-evaluated after every edit.
+  void set_large_file_thresholds(const LargeFileThresholds &thresholds);
+  const LargeFileStatus &large_file_status() const;
+  // Buffer lines about to be drawn. In viewport-only mode this re-highlights
+  // a window around them once they leave the current one.
+  void set_viewport(size_t first_line, size_t last_line);
+  // Style runs intersecting buffer bytes [start, end), with columns relative
+  // to start. Renderers use this instead of the highlighter's runs so that
+  // viewport-only highlighting is transparent to them. Semantic tokens whose
+  // type the theme styles take precedence over the tree-sitter runs.
+  std::vector<RenderSpan> highlight_spans(size_t start, size_t end) const;
+
+  // Semantic tokens from the language server, shifted through edits until
+  // the server sends new ones. They are requested after edits and, from
+  // servers that only serve ranges, for the viewport.
+  const SemanticTokenStore &semantic_tokens() const;
+
+  // Diagnostics published for the open document, located by byte range and
+  // shifted through edits until the server publishes again.
+  const DiagnosticStore &diagnostics() const;
+  // Diagnostics overlapping buffer lines [first_line, last_line], for drawing.
+  std::vector<Diagnostic> diagnostics_in_lines(size_t first_line, size_t last_line) const;
+
+  // Workspace symbols from tree-sitter tags queries, available before any
+  // language server has started. initialize_lsp() starts indexing the root.
+  void index_workspace(const std::string& root_path);
+  std::vector<WorkspaceSymbol> find_symbols(std::string_view query, size_t limit = 100) const;
+  std::shared_ptr<SymbolIndex> symbol_index() const;
+
   // File management
   void open_file(const std::string& uri, const std::string& language_id);
   void close_file(const std::string& uri);
+  // Called after edits. Edits themselves reach the language server as
+  // incremental changes queued by insert()/erase(); this closes documents
+  // that grew over the LSP size threshold and reopens them should they
+  // shrink below it.
+  void change_file(const std::string& uri);
   void save_file(const std::string& uri);
 
   // Process LSP messages
   void tick();
+  // Readable when LSP messages are waiting; call tick() when it fires.
+  int lsp_wakeup_fd() const;
+  // Milliseconds until tick() has timed work (debounced edits and requests,
+  // server restarts, response deadlines), rounded up: 0 when it is due, -1
+  // when nothing is scheduled. Together with lsp_wakeup_fd() this is all a
+  // main loop needs to call tick() exactly when there is something to do.
+  int next_tick_ms() const;
+  // Per-server, per-method LSP request counts, traffic and latency
+  // histograms as JSON, for diagnosing slow language features.
+  std::string lsp_stats_json() const;
 
 private:
+  void apply_edit(const Edit &edit, size_t start_line);
+  lsp::TextDocumentContentChangeEvent lsp_change(const Edit &edit, size_t start_line) const;
+  size_t lsp_offset(const lsp::LSPPosition &position) const;
+  void set_lsp_diagnostics(const std::vector<lsp::Diagnostic> &diagnostics);
+  void request_semantic_tokens();
+  void set_lsp_semantic_tokens(const lsp::SemanticTokens &tokens, const lsp::ServerCapabilities &legend);
+  void clear_semantic_tokens();
+  const RenderStyle *semantic_style(const SemanticToken &token) const;
+  void overlay_semantic_tokens(size_t start, size_t end, std::vector<RenderSpan> &spans) const;
+  void update_large_file_status();
+  void edit_highlight_window(const Edit &edit);
+  bool to_highlight_window(size_t &start, size_t &end) const;
+
   TextBuffer m_buffer;
   UndoStack m_undo;
+  FoldMap m_folds;
+  DiagnosticStore m_diagnostics;
+  SemanticTokenStore m_semantic_tokens;
+  std::vector<std::string> m_semantic_types; // the server's legend
+  uint32_t m_semantic_readonly = 0;          // modifier bit for "readonly"
+  bool m_semantic_stale = true;              // edited since tokens were requested
+  // Lines last requested from a range-only server, and the lines drawn
+  bool m_semantic_ranged = false;
+  size_t m_semantic_first = 0;
+  size_t m_semantic_last = 0;
+  size_t m_viewport_first = 0;
+  size_t m_viewport_last = 0;
+  // Ranges replaced by expand_selection(), innermost first, and the range the
+  // last expansion produced.
+  std::vector<std::pair<size_t, size_t>> m_selection_history;
+  std::pair<size_t, size_t> m_expanded_selection{0, 0};
   std::unique_ptr<lsp::LSPManager> m_lsp_manager;
+  LanguageServerPaths m_server_paths;
+  std::shared_ptr<SymbolIndex> m_symbol_index;
   TreeSitterHighlighter m_syntax_highlighter;
+  LargeFileThresholds m_large_file_thresholds;
+  LargeFileStatus m_large_file;
+  // In viewport-only mode the highlighter holds buffer bytes
+  // [m_highlight_start, m_highlight_end).
+  size_t m_highlight_start = 0;
+  size_t m_highlight_end = 0;
+  bool m_highlight_window_valid = false;
+  std::string m_lsp_uri;
+  std::string m_lsp_language_id;
+  bool m_lsp_open = false;
 };
 
 } // namespace prodigeetor
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include "text_types.h"
+
+namespace prodigeetor {
+
+// The diagnostics of one document, located by byte range. Edits shift them
+// until the server publishes a new set, so they stay on the text they were
+// reported for.
+//
+// Diagnostics are kept in start order under a segment tree holding each
+// range's largest start and end and its most severe diagnostic. An edit
+// shifts everything after it with one lazy range update and fixes up only the
+// diagnostics it overlaps, and range and next/previous queries descend the
+// tree, so both cost O(log n) plus the diagnostics touched or returned.
+class DiagnosticStore {
+public:
+  // Replaces every diagnostic; they need not be sorted.
+  void set(std::vector<Diagnostic> diagnostics);
+  void clear();
+
+  size_t size() const { return m_diagnostics.size(); }
+  bool empty() const { return m_diagnostics.empty(); }
+  // Diagnostics of a severity (1 error, 2 warning, 3 information, 4 hint).
+  size_t count(int severity) const;
+
+  // Shifts diagnostics through an edit that replaced `removed_length` bytes
+  // at `offset` with `inserted_length` bytes. Text typed at a diagnostic's
+  // start pushes it along; text typed at its end does not extend it. Parts
+  // inside the removed text collapse onto `offset`.
+  void apply_edit(size_t offset, size_t removed_length, size_t inserted_length);
+
+  // Diagnostics overlapping bytes [start, end), in start order. An empty
+  // diagnostic overlaps the range if its position lies inside it.
+  std::vector<Diagnostic> in_range(size_t start, size_t end) const;
+  // The first diagnostic starting after `offset` (or the last starting
+  // before it) whose severity is at least as serious as `max_severity`,
+  // wrapping around the document.
+  std::optional<Diagnostic> next(size_t offset, int max_severity = 1) const;
+  std::optional<Diagnostic> previous(size_t offset, int max_severity = 1) const;
+
+private:
+  std::vector<Diagnostic> m_diagnostics; // start order; offsets live in the tree
+  std::array<size_t, 5> m_counts{};
+  // Segment tree over m_diagnostics, rooted at node 1. Leaf aggregates are the
+  // diagnostic's own start and end; m_shift is an offset still to be added
+  // to everything below a node.
+  std::vector<int64_t> m_max_start;
+  std::vector<int64_t> m_max_end;
+  std::vector<int> m_min_severity;
+  std::vector<int64_t> m_shift;
+
+  void build(size_t node, size_t low, size_t high);
+  void pull(size_t node);
+  void push(size_t node);
+  void shift(size_t node, size_t low, size_t high, size_t from, int64_t delta);
+  void set_range(size_t node, size_t low, size_t high, size_t index, int64_t start, int64_t end);
+  size_t lower_bound(int64_t offset) const; // first index with start >= offset
+  void collect(size_t node, size_t low, size_t high, size_t limit, int64_t start, int64_t shift,
+               std::vector<size_t> &indices) const;
+  size_t first_at_least(size_t node, size_t low, size_t high, size_t from, int max_severity) const;
+  size_t last_below(size_t node, size_t low, size_t high, size_t limit, int max_severity) const;
+  Diagnostic resolve(size_t index) const;
+};
+
+} // namespace prodigeetor
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace prodigeetor {
+
+// Reports files created, written, moved or deleted anywhere below a directory,
+// from the OS's change notifications: inotify on Linux, FSEvents on macOS.
+// Changes arrive in batches on the watcher's own thread.
+class DirectoryWatcher {
+public:
+  // Absolute paths of changed files. A directory moved away is reported once,
+  // with a trailing '/', since its files are not reported one by one. When
+  // `overflowed` is set the OS dropped events and the tree must be rescanned.
+  using Callback = std::function<void(std::vector<std::string> paths, bool overflowed)>;
+  // Directories (and everything below them) that are not watched.
+  using SkipDirectory = std::function<bool(const std::filesystem::path &)>;
+
+  DirectoryWatcher();
+  ~DirectoryWatcher();
+  DirectoryWatcher(const DirectoryWatcher &) = delete;
+  DirectoryWatcher &operator=(const DirectoryWatcher &) = delete;
+
+  // Watches `root` until stop() or destruction. Returns false where the tree
+  // cannot be watched (no notification API, or out of inotify watches); the
+  // caller then has to poll.
+  bool start(const std::string &root, SkipDirectory skip, Callback callback);
+  // Returns once no callback runs any more.
+  void stop();
+
+private:
+  struct Impl;
+  std::unique_ptr<Impl> m_impl;
+};
+
+} // namespace prodigeetor
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace prodigeetor {
+
+// A foldable region. Folding keeps start_line visible and hides the lines
+// (start_line, end_line]. Bytes are the syntax node's extent in the document.
+struct FoldRange {
+  uint32_t start_line = 0;
+  uint32_t end_line = 0;
+  uint32_t start_byte = 0;
+  uint32_t end_byte = 0;
+};
+
+// Maps between buffer lines and visible lines for the collapsed folds of a
+// document. Lookups are binary searches over the collapsed folds, so drawing
+// and scrolling cost depends on the visible lines, not on the hidden ones.
+class FoldMap {
+public:
+  // Collapses a range. Returns false if it is empty or already hidden by an
+  // enclosing collapsed fold. Collapsed folds nested inside it are absorbed.
+  bool fold(const FoldRange &range);
+  // Expands the collapsed fold whose header is, or which hides, buffer_line.
+  bool unfold(size_t buffer_line);
+  void unfold_all();
+  bool is_folded(size_t buffer_line) const;
+  const std::vector<FoldRange> &folded() const;
+
+  // Shifts folds after an edit covering buffer lines [start_line, old_end_line]
+  // that now ends at new_end_line. Folds whose hidden lines were touched open.
+  void apply_edit(size_t start_line, size_t old_end_line, size_t new_end_line);
+
+  size_t visible_line_count(size_t buffer_line_count) const;
+  size_t buffer_line(size_t visible_line) const;
+  // Hidden lines map to the visible header line of their fold.
+  size_t visible_line(size_t buffer_line) const;
+
+private:
+  std::vector<FoldRange> m_folded;  // sorted by start_line, never nested
+  std::vector<size_t> m_hidden_before; // m_hidden_before[i] = lines hidden by m_folded[0..i)
+
+  void rebuild_index();
+};
+
+} // namespace prodigeetor
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace prodigeetor {
+
+// One bit per letter, digit and '_' (case-insensitive). A candidate can only
+// match a pattern whose bits it contains, which rejects most candidates
+// before scoring.
+uint64_t fuzzy_char_mask(std::string_view text);
+
+// A lower-cased pattern and its character mask, prepared once per query.
+struct FuzzyPattern {
+  FuzzyPattern() = default;
+  explicit FuzzyPattern(std::string_view pattern);
+
+  std::string text;
+  uint64_t mask = 0;
+};
+
+// Case-insensitive subsequence match. Matches at word starts (after '_', '-',
+// '.', '$' or at a lower-to-upper case change) and runs of consecutive
+// characters score higher, as do exact-length matches; longer candidates
+// score lower, down to 0. Returns -1 when the pattern is not a subsequence
+// and 0 for an empty pattern.
+//
+// Candidates of up to 64 bytes are matched on bitmasks: each pattern
+// character's occurrences are found 16 bytes at a time, and positions are
+// chosen among those from which the rest of the pattern can still match,
+// preferring runs, then word starts.
+int fuzzy_score(std::string_view candidate, const FuzzyPattern &pattern);
+// The same, rejecting candidates by their precomputed fuzzy_char_mask first.
+int fuzzy_score(std::string_view candidate, uint64_t candidate_mask, const FuzzyPattern &pattern);
+
+} // namespace prodigeetor
@@ -2,10 +2,15 @@
 
 #include <cstddef>
 #include <string_view>
+#include <vector>
 
 namespace prodigeetor {
 
 size_t grapheme_count(std::string_view text);
 size_t grapheme_byte_offset(std::string_view text, size_t grapheme_index);
+// Byte offset at which each grapheme of `text` starts.
+std::vector<size_t> grapheme_boundaries(std::string_view text);
+// Length of UTF-8 `text` in UTF-16 code units, the unit of LSP columns.
+size_t utf16_length(std::string_view text);
 
 } // namespace prodigeetor
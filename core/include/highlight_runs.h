@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "rendering.h"
+
+namespace prodigeetor {
+
+// Sorted, non-overlapping style runs over a document, kept as parallel arrays
+// (run i covers bytes [starts[i], ends[i]) and uses styles[style_ids[i]]).
+class HighlightRuns {
+public:
+  // Flattens possibly overlapping spans. Where spans overlap the narrower one
+  // wins; between identical ranges the later span wins. Adjacent runs with the
+  // same style are merged.
+  void build(const std::vector<RenderSpan> &spans);
+  // Rebuilds the runs within [start, end) only, from `spans`, which must hold
+  // every span intersecting it. Runs outside are kept.
+  void rebuild(uint32_t start, uint32_t end, const std::vector<RenderSpan> &spans);
+  // Moves the runs for an edit that replaced [start, old_end) with
+  // [start, new_end). Runs inside the replaced bytes collapse and are dropped.
+  void apply_edit(uint32_t start, uint32_t old_end, uint32_t new_end);
+  void clear();
+
+  size_t size() const;
+  bool empty() const;
+
+  // Runs intersecting [start, end), clipped and with columns relative to start.
+  std::vector<RenderSpan> slice(size_t start, size_t end) const;
+
+  const std::vector<uint32_t> &starts() const { return m_starts; }
+  const std::vector<uint32_t> &ends() const { return m_ends; }
+  const std::vector<uint16_t> &style_ids() const { return m_style_ids; }
+  const std::vector<RenderStyle> &styles() const { return m_styles; }
+
+private:
+  std::vector<uint32_t> m_starts;
+  std::vector<uint32_t> m_ends;
+  std::vector<uint16_t> m_style_ids;
+  std::vector<RenderStyle> m_styles;
+
+  uint16_t style_id(const RenderStyle &style);
+  // Appends the runs of `spans` clipped to [start, end).
+  void sweep(const std::vector<RenderSpan> &spans, uint32_t start, uint32_t end, std::vector<uint32_t> &starts,
+             std::vector<uint32_t> &ends, std::vector<uint16_t> &style_ids);
+};
+
+} // namespace prodigeetor
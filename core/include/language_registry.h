@@ -0,0 +1,77 @@
+#pragma once
+
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace prodigeetor {
+
+// A language as described in languages/languages.json. Query lists are
+// repo-relative files concatenated in order (TypeScript extends JavaScript).
+struct LanguageInfo {
+  std::string name; // LSP document languageId, also matched by injections
+  std::vector<std::string> aliases;
+  std::vector<std::string> extensions; // with the leading dot
+  std::string grammar; // tree_sitter_<grammar>(); empty for LSP-only languages
+  std::vector<std::string> highlights;
+  std::vector<std::string> injections;
+  std::vector<std::string> folds;
+  std::vector<std::string> tags;
+  // Names of LanguageServerInfo entries, in priority order; may be empty
+  std::vector<std::string> language_servers;
+};
+
+struct LanguageServerInfo {
+  std::string name;
+  std::string command;
+  std::vector<std::string> args;
+  std::string language_id;
+  std::vector<std::string> extensions; // collected from the languages it serves
+  int deadline_ms = 0; // wait for its share of a merged result; 0 = default
+};
+
+// Data-driven language metadata plus lazy grammar loading. Nothing about a
+// language is touched until a document of that language needs it: grammars
+// built as modules are dlopen'd on first use, statically linked grammars are
+// only initialised then.
+class LanguageRegistry {
+public:
+  // Process-wide registry, loaded from languages/languages.json on first use.
+  static LanguageRegistry &instance();
+
+  static void set_resource_base_path(std::string path);
+  // Finds a repo-relative resource (query files, language data) under the
+  // resource base path, the working directory or the development checkout.
+  static std::string resolve_path(const std::string &relative_path);
+
+  bool load_from_file(const std::string &path);
+  void load_from_string(std::string_view content);
+
+  const std::vector<LanguageInfo> &languages() const;
+  const std::vector<LanguageServerInfo> &language_servers() const;
+  // Lookup by name or alias, ignoring case.
+  const LanguageInfo *find(std::string_view name) const;
+  const LanguageInfo *for_path(std::string_view path) const;
+
+  // The grammar as a `const TSLanguage *`, or nullptr if it is unavailable.
+  // Thread-safe; the result is cached for the life of the process.
+  const void *grammar(const LanguageInfo &language);
+  // Concatenated source of a language's query files.
+  static std::string query_source(const std::vector<std::string> &files);
+
+private:
+  LanguageRegistry();
+
+  std::vector<LanguageInfo> m_languages;
+  std::vector<LanguageServerInfo> m_servers;
+  std::unordered_map<std::string, size_t> m_by_name;      // lower-case name or alias -> index
+  std::unordered_map<std::string, size_t> m_by_extension; // lower-case extension -> index
+
+  std::mutex m_grammar_mutex;
+  std::unordered_map<std::string, const void *> m_grammars;
+  std::vector<void *> m_modules; // dlopen handles, never closed
+};
+
+} // namespace prodigeetor
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+
+namespace prodigeetor {
+
+// Resolves language server commands to executables. Resolved paths are kept
+// in a cache file, so later runs check one path per server instead of
+// probing every install location; a cached path that is no longer executable
+// is resolved again.
+class LanguageServerPaths {
+public:
+  // Uses language-servers.cache in the user cache directory.
+  LanguageServerPaths();
+  explicit LanguageServerPaths(std::string cache_path);
+
+  // The executable for `command`: an absolute path as given, else the first
+  // match among the usual install locations (nvm, npm, Homebrew, /usr/bin).
+  // Unresolved commands are returned unchanged for execvp to look up on PATH.
+  std::string resolve(const std::string &command);
+
+private:
+  std::string m_cache_path;
+  std::unordered_map<std::string, std::string> m_paths; // command -> path
+  bool m_loaded = false;
+
+  void load();
+  void save() const;
+};
+
+} // namespace prodigeetor
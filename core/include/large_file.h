@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace prodigeetor {
+
+// Document sizes at which the editor sheds work (see EditorSettings). Zero
+// disables a threshold.
+struct LargeFileThresholds {
+  size_t large_file_size = 16 * 1024 * 1024; // highlight only around the viewport
+  size_t map_size = 64 * 1024 * 1024;        // memory-map the file instead of reading it
+  size_t lsp_max_size = 4 * 1024 * 1024;     // do not sync the document to language servers
+};
+
+// Which features are throttled for the current document.
+struct LargeFileStatus {
+  size_t size = 0;
+  bool large_file = false;
+  bool buffer_mapped = false;
+  bool lsp_sync = true;
+  bool highlight_viewport_only = false;
+
+  // One line for a status bar or tooltip; empty when nothing is throttled.
+  std::string summary() const;
+};
+
+LargeFileStatus evaluate_large_file(size_t size, bool buffer_mapped, const LargeFileThresholds &thresholds);
+
+} // namespace prodigeetor
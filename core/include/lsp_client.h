@@ -1,32 +1,50 @@
 #pragma once
 
+#include <chrono>
 #include <string>
 #include <functional>
 #include <memory>
 #include <unordered_map>
 #include <optional>
+#include <string_view>
+#include "lsp_json.h"
+#include "lsp_metrics.h"
 #include "lsp_types.h"
+#include "text_buffer.h"
+#include "wakeup.h"
 
 namespace prodigeetor {
 namespace lsp {
 
-// Forward declaration
-class JSONValue;
-
 // LSP Client interface
+//
+// The server's pipes are serviced by an I/O thread; messages are framed and
+// parsed there and handed over through a lock-free queue. All callbacks run
+// on the thread that calls processMessages(), which is also the only thread
+// that may send. The JSONValues handed to callbacks view the message and are
+// only valid for the duration of the call.
 class LSPClient {
 public:
-  using MessageCallback = std::function<void(const std::string& method, const std::string& params)>;
-  using ResponseCallback = std::function<void(const std::string& result)>;
+  using MessageCallback = std::function<void(const std::string& method, const JSONValue& params)>;
+  using ResponseCallback = std::function<void(const JSONValue& result)>;
   using ErrorCallback = std::function<void(int code, const std::string& message)>;
+  // One batch of a streamed result, shaped like the result itself
+  using PartialResultCallback = std::function<void(const JSONValue& value)>;
 
   LSPClient();
   virtual ~LSPClient();
 
   // Lifecycle methods
   bool start(const std::string& command, const std::vector<std::string>& args);
+  // Sends the shutdown request and returns at once; a thread of its own
+  // waits a bounded time for the answer, sends exit and reaps the process,
+  // terminating it if it does not exit in time.
   void shutdown();
   bool is_running() const;
+  // The server closed its output, usually because it exited or crashed.
+  // Messages it sent before that are still delivered by processMessages();
+  // shutdown() then has the process reaped.
+  bool hasExited() const;
 
   // Initialize the LSP server
   void initialize(const std::string& rootUri, ResponseCallback onSuccess, ErrorCallback onError);
@@ -34,26 +52,51 @@ public:
   // Document lifecycle
   void didOpen(const TextDocumentItem& document);
   void didChange(const std::string& uri, int version, const std::vector<TextDocumentContentChangeEvent>& changes);
+  // Full-text variants that stream the buffer into the message
+  void didOpen(const std::string& uri, const std::string& languageId, int version, const TextBuffer& text);
+  void didChange(const std::string& uri, int version, const TextBuffer& text);
   void didClose(const std::string& uri);
   void didSave(const std::string& uri);
 
-  // Language features
-  void completion(const std::string& uri, LSPPosition position, ResponseCallback onSuccess, ErrorCallback onError);
-  void hover(const std::string& uri, LSPPosition position, ResponseCallback onSuccess, ErrorCallback onError);
-  void gotoDefinition(const std::string& uri, LSPPosition position, ResponseCallback onSuccess, ErrorCallback onError);
-  void references(const std::string& uri, LSPPosition position, ResponseCallback onSuccess, ErrorCallback onError);
-  void documentSymbols(const std::string& uri, ResponseCallback onSuccess, ErrorCallback onError);
+  // Language features; each returns the request id
+  int completion(const std::string& uri, LSPPosition position, ResponseCallback onSuccess, ErrorCallback onError);
+  int hover(const std::string& uri, LSPPosition position, ResponseCallback onSuccess, ErrorCallback onError);
+  int gotoDefinition(const std::string& uri, LSPPosition position, ResponseCallback onSuccess, ErrorCallback onError);
+  int documentSymbols(const std::string& uri, ResponseCallback onSuccess, ErrorCallback onError);
+  // Semantic tokens for the whole document, as edits to the result named
+  // `previousResultId`, or for a range; see readUIntArray() for the data.
+  int semanticTokensFull(const std::string& uri, ResponseCallback onSuccess, ErrorCallback onError);
+  int semanticTokensDelta(const std::string& uri, const std::string& previousResultId,
+                          ResponseCallback onSuccess, ErrorCallback onError);
+  int semanticTokensRange(const std::string& uri, LSPRange range, ResponseCallback onSuccess, ErrorCallback onError);
+  // Requests that may stream. With onPartial they carry a partialResultToken:
+  // servers that support it send batches as $/progress notifications, each
+  // parsed and passed to onPartial as it arrives, before the final result
+  // (often empty). Other servers just answer with everything.
+  int references(const std::string& uri, LSPPosition position, PartialResultCallback onPartial,
+                 ResponseCallback onSuccess, ErrorCallback onError);
+  int workspaceSymbols(const std::string& query, PartialResultCallback onPartial,
+                       ResponseCallback onSuccess, ErrorCallback onError);
+  // Sends $/cancelRequest and forgets the callbacks; whatever the server
+  // still answers is ignored.
+  void cancelRequest(int id);
 
   // Notification handlers
   void onNotification(MessageCallback callback);
   void onDiagnostics(std::function<void(const std::string& uri, const std::vector<Diagnostic>&)> callback);
 
-  // Process incoming messages
+  // Signaled from the I/O thread whenever messages are ready, so a main loop
+  // can call processMessages() right away instead of polling.
+  void setWakeup(Wakeup* wakeup);
+  // Handles the messages received so far; never blocks.
   void processMessages();
 
   // Server capabilities
   const ServerCapabilities& capabilities() const { return m_capabilities; }
 
+  // Counts, sizes and timings of the messages exchanged so far, by method.
+  LSPMetrics metrics() const;
+
 private:
   struct Impl;
   std::unique_ptr<Impl> m_impl;
@@ -62,16 +105,36 @@ private:
   ServerCapabilities m_capabilities;
   std::unordered_map<int, ResponseCallback> m_responseCallbacks;
   std::unordered_map<int, ErrorCallback> m_errorCallbacks;
+  std::unordered_map<int, PartialResultCallback> m_partialCallbacks; // the token is the request id
   MessageCallback m_notificationCallback;
   std::function<void(const std::string&, const std::vector<Diagnostic>&)> m_diagnosticsCallback;
 
+  // Metrics. Requests are timed from sendMessage() until answered or
+  // cancelled; m_sending is the method of the message being built.
+  struct PendingRequest {
+    MethodMetrics* metrics;
+    std::chrono::steady_clock::time_point sentAt;
+  };
+  // When and how a message arrived: read from the pipe at readAt, then parsed
+  struct Arrival {
+    std::chrono::steady_clock::time_point readAt;
+    uint64_t parseMicros = 0;
+    size_t bytes = 0;
+  };
+  LSPMetrics m_metrics;
+  std::unordered_map<int, PendingRequest> m_pending;
+  MethodMetrics* m_sending = nullptr;
+  int m_sendingRequest = 0;
+
   // Internal methods
-  void sendRequest(const std::string& method, const std::string& params,
-                   ResponseCallback onSuccess, ErrorCallback onError);
-  void sendNotification(const std::string& method, const std::string& params);
-  void handleMessage(const std::string& message);
-  std::string readMessage();
-  void writeMessage(const std::string& message);
+  // Outgoing messages are built in one reusable writer: begin*() writes the
+  // envelope up to "params", the caller writes the params value, and
+  // sendMessage() closes and sends it.
+  JSONWriter& beginRequest(std::string_view method, ResponseCallback onSuccess, ErrorCallback onError);
+  JSONWriter& beginNotification(std::string_view method);
+  void sendMessage();
+  void handleMessage(const JSONValue& root, const Arrival& arrival);
+  void handleServerRequest(const JSONValue& id, std::string_view method, const JSONValue& params);
 };
 
 } // namespace lsp
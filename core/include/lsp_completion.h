@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "fuzzy_match.h"
+#include "lsp_types.h"
+
+namespace prodigeetor {
+namespace lsp {
+
+// A server's completion list kept on the client, so the popup can be
+// re-filtered and re-ranked locally on each keystroke instead of asking the
+// server again.
+//
+// Items are ranked by fuzzy score against the typed prefix (matched on
+// filterText, or the label), then by sortText. Filtering is incremental: when
+// the prefix only grew, only the items that matched the previous prefix are
+// scored again.
+class CompletionCache {
+public:
+  // Replaces the cached list; `prefix` is what the server was asked with.
+  void store(CompletionList list, std::string prefix);
+  void clear();
+
+  bool empty() const { return m_items.empty(); }
+  bool isIncomplete() const { return m_incomplete; }
+  // Whether the list holds every candidate for `prefix`: it was complete and
+  // requested for a prefix that `prefix` extends.
+  bool covers(std::string_view prefix) const;
+
+  // The best `limit` items for `prefix`, best first.
+  std::vector<CompletionItem> filter(std::string_view prefix, size_t limit);
+
+private:
+  struct Entry {
+    uint64_t mask;        // fuzzy_char_mask of the filter text
+    std::string_view key; // filterText, or the label
+  };
+  struct Match {
+    int score;
+    uint32_t index;
+  };
+
+  std::vector<CompletionItem> m_items;
+  std::vector<Entry> m_entries;
+  bool m_incomplete = false;
+  std::string m_requestPrefix;
+  // Items matching m_lastPrefix, in item order
+  std::string m_lastPrefix;
+  std::vector<uint32_t> m_survivors;
+  bool m_filtered = false;
+  std::vector<Match> m_matches;
+};
+
+} // namespace lsp
+} // namespace prodigeetor
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+
+namespace prodigeetor {
+namespace lsp {
+
+// Splits a JSON-RPC byte stream ("Content-Length: N\r\n\r\n" + N bytes) into
+// message bodies. Bytes pass through a fixed staging ring; headers are parsed
+// there incrementally, and once a header announces a large body the rest of
+// it is read from the descriptor straight into the body's own storage.
+//
+// Malformed input never stalls the stream: a header block without a usable
+// Content-Length is skipped, junk before a header is dropped (the last
+// Content-Length in a block wins), and a header that outgrows the ring is
+// discarded.
+class MessageFramer {
+public:
+  // Receives each complete body. The handler may swap the string with one of
+  // its own; the framer reuses whatever it is left with.
+  using Handler = std::function<void(std::string &body)>;
+
+  MessageFramer();
+
+  // Reads until the non-blocking descriptor would block. Returns false once
+  // it reached end of file or failed.
+  bool read(int fd, const Handler &onMessage);
+  // Frames bytes that were read elsewhere.
+  void feed(std::string_view bytes, const Handler &onMessage);
+  void reset();
+
+  size_t skippedBytes() const { return m_skipped; }
+
+private:
+  static constexpr size_t kRingSize = 64 * 1024;
+  static constexpr size_t kDirectReadMin = 16 * 1024; // remaining body read in place
+
+  std::unique_ptr<char[]> m_ring;
+  size_t m_start = 0;       // first unconsumed byte in the ring
+  size_t m_end = 0;         // one past the last byte read
+  size_t m_scanned = 0;     // ring bytes already searched for the header end
+  bool m_inBody = false;
+  std::string m_body;
+  size_t m_bodyFilled = 0;
+  size_t m_skipped = 0;     // bytes dropped while recovering
+
+  void consume(const Handler &onMessage);
+  bool parseHeader(std::string_view block);
+  void finishBody(const Handler &onMessage);
+};
+
+} // namespace lsp
+} // namespace prodigeetor
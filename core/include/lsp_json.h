@@ -0,0 +1,195 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "lsp_types.h"
+
+namespace prodigeetor {
+namespace lsp {
+
+class JSONDocument;
+
+// A read-only view of one value in a parsed JSONDocument. Values are cheap to
+// copy and only valid while the document and the text it parsed are alive.
+// Lookups on a missing member or a value of the wrong type yield an invalid
+// value (or the fallback), so chains like doc.root()["result"]["items"] are safe.
+class JSONValue {
+public:
+  enum class Type : uint8_t { Invalid, Null, Bool, Number, String, Array, Object };
+
+  class Iterator;
+  struct Member;
+  class MemberIterator;
+  template <typename It>
+  struct Range {
+    It first;
+    It last;
+    It begin() const { return first; }
+    It end() const { return last; }
+  };
+
+  JSONValue() = default;
+
+  Type type() const;
+  bool isValid() const { return type() != Type::Invalid; }
+  bool isNull() const { return type() == Type::Null; }
+  bool isBool() const { return type() == Type::Bool; }
+  bool isNumber() const { return type() == Type::Number; }
+  bool isString() const { return type() == Type::String; }
+  bool isArray() const { return type() == Type::Array; }
+  bool isObject() const { return type() == Type::Object; }
+  explicit operator bool() const { return isValid(); }
+
+  // Object member lookup. Members are scanned in order; LSP objects are small.
+  JSONValue operator[](std::string_view key) const;
+  // Element or member count of a container, 0 otherwise. Counting skips
+  // over each child's subtree in one step.
+  size_t size() const;
+
+  Range<Iterator> items() const;           // array elements
+  Range<MemberIterator> members() const;   // object members
+
+  bool asBool(bool fallback = false) const;
+  int64_t asInt(int64_t fallback = 0) const;
+  double asDouble(double fallback = 0.0) const;
+  // Unescaped string contents. Strings without escapes are returned without
+  // decoding; use stringView() to avoid the copy altogether.
+  std::string asString(std::string_view fallback = {}) const;
+  // Raw contents of a string that has no escape sequences, empty otherwise.
+  std::string_view stringView() const;
+  bool hasEscapes() const;
+  // The value's JSON text, exactly as received.
+  std::string_view raw() const;
+
+private:
+  friend class JSONDocument;
+  JSONValue(const JSONDocument *document, uint32_t index) : m_document(document), m_index(index) {}
+
+  const JSONDocument *m_document = nullptr;
+  uint32_t m_index = 0;
+};
+
+class JSONValue::Iterator {
+public:
+  JSONValue operator*() const { return JSONValue(m_document, m_index); }
+  Iterator &operator++();
+  bool operator!=(const Iterator &other) const { return m_index != other.m_index; }
+
+private:
+  friend class JSONValue;
+  Iterator(const JSONDocument *document, uint32_t index) : m_document(document), m_index(index) {}
+  const JSONDocument *m_document;
+  uint32_t m_index;
+};
+
+struct JSONValue::Member {
+  std::string_view key; // raw key; LSP keys never contain escapes
+  JSONValue value;
+};
+
+class JSONValue::MemberIterator {
+public:
+  Member operator*() const;
+  MemberIterator &operator++();
+  bool operator!=(const MemberIterator &other) const { return m_index != other.m_index; }
+
+private:
+  friend class JSONValue;
+  MemberIterator(const JSONDocument *document, uint32_t index) : m_document(document), m_index(index) {}
+  const JSONDocument *m_document;
+  uint32_t m_index;
+};
+
+// Parses a JSON text once into a flat tape of nodes that point back into the
+// text, so strings are never copied and skipping a subtree is a single jump.
+// The text must outlive the document and every JSONValue taken from it. A
+// document can be reused; parse() keeps the tape's capacity.
+class JSONDocument {
+public:
+  bool parse(std::string_view text);
+  JSONValue root() const;
+  // Byte offset and description of the first syntax error.
+  size_t errorOffset() const { return m_errorOffset; }
+  const char *error() const { return m_error; }
+
+private:
+  friend class JSONValue;
+
+  // 16 bytes; a 5,000 item completion list is around 100,000 nodes.
+  struct Node {
+    JSONValue::Type type = JSONValue::Type::Invalid;
+    bool escaped = false;  // strings: contains backslash escapes
+    uint32_t start = 0;    // strings: first byte after the quote; others: first byte
+    uint32_t length = 0;   // bytes of the value (string contents without quotes)
+    uint32_t next = 0;     // index of the node after this value's subtree
+  };
+
+  std::string_view m_text;
+  std::vector<Node> m_nodes;
+  std::vector<uint32_t> m_stack;
+  size_t m_errorOffset = 0;
+  const char *m_error = nullptr;
+
+  bool fail(size_t offset, const char *message);
+};
+
+// Writes `text` as a JSON string body (without quotes) onto `out`.
+void appendEscaped(std::string &out, std::string_view text);
+
+// Serializes one JSON text into a buffer that is reused from message to
+// message. Separators are inserted automatically; keys and values are written
+// in document order. Long strings can be streamed in pieces between
+// beginString() and endString(), each piece escaped straight into the buffer.
+class JSONWriter {
+public:
+  // Empties the buffer, keeping its capacity up to `keep_capacity` bytes.
+  void clear(size_t keep_capacity = 1024 * 1024);
+  const std::string &str() const { return m_out; }
+  size_t size() const { return m_out.size(); }
+  void reserve(size_t bytes) { m_out.reserve(bytes); }
+  // Moves the text out, leaving the writer empty.
+  std::string take() { m_needsComma = false; return std::move(m_out); }
+
+  JSONWriter &beginObject();
+  JSONWriter &endObject();
+  JSONWriter &beginArray();
+  JSONWriter &endArray();
+  JSONWriter &key(std::string_view name); // name is written unescaped
+
+  JSONWriter &value(std::string_view text);
+  JSONWriter &value(const char *text) { return value(std::string_view(text)); }
+  JSONWriter &value(int64_t number);
+  JSONWriter &value(int number) { return value(static_cast<int64_t>(number)); }
+  JSONWriter &value(bool flag);
+  JSONWriter &null();
+  JSONWriter &raw(std::string_view json); // pre-serialized value
+
+  JSONWriter &beginString();
+  JSONWriter &stringPart(std::string_view text);
+  JSONWriter &endString();
+
+private:
+  std::string m_out;
+  bool m_needsComma = false;
+
+  void separate();
+};
+
+// Protocol structures shared by the client's requests.
+void writePosition(JSONWriter &writer, const LSPPosition &position);
+void writeRange(JSONWriter &writer, const LSPRange &range);
+
+// Readers for protocol structures shared by the client and the manager.
+LSPPosition readPosition(const JSONValue &value);
+LSPRange readRange(const JSONValue &value);
+LSPLocation readLocation(const JSONValue &value); // Location or LocationLink
+// Appends an array of unsigned integers (semantic token data) to `out`,
+// reading the numbers straight from the array's text.
+void readUIntArray(const JSONValue &value, std::vector<uint32_t> &out);
+
+} // namespace lsp
+} // namespace prodigeetor
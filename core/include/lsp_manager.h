@@ -1,10 +1,14 @@
 #pragma once
 
+#include <array>
+#include <chrono>
+#include <cstdint>
 #include <string>
 #include <memory>
 #include <unordered_map>
 #include <functional>
 #include "lsp_client.h"
+#include "lsp_completion.h"
 #include "lsp_types.h"
 
 namespace prodigeetor {
@@ -16,62 +20,265 @@ struct LanguageServerConfig {
   std::vector<std::string> args;
   std::vector<std::string> extensions; // e.g., {".ts", ".tsx", ".js", ".jsx"}
   std::string languageId; // e.g., "typescript", "javascript"
+  // A request sent to several servers waits this long for this one's answer
+  // once another has answered; past it, the merged result goes without it.
+  std::chrono::milliseconds deadline{250};
 };
 
+// Interactive requests; each kind is scheduled through its own slot.
+enum class RequestKind { Completion, Hover, Definition, DocumentSymbols, SemanticTokens, References, WorkspaceSymbols };
+
 // LSP Manager - handles multiple language servers
 class LSPManager {
 public:
   LSPManager();
   ~LSPManager();
 
-  // Configuration
+  // Configuration. A document is served by every server whose languageId or
+  // extensions match it, in the order they were registered; the first is its
+  // primary server.
   void registerLanguageServer(const std::string& name, const LanguageServerConfig& config);
 
-  // Initialize all registered servers
+  // Sets the workspace root. Servers are not started here but on the first
+  // didOpen() for their language, each without waiting on the others.
   void initializeServers(const std::string& rootUri);
+  // Maps a configured command to the executable to run, when its server is
+  // first started.
+  using CommandResolver = std::function<std::string(const std::string& command)>;
+  void setCommandResolver(CommandResolver resolver);
 
-  // Document lifecycle
-  void didOpen(const std::string& uri, const std::string& languageId, const std::string& text);
-  void didChange(const std::string& uri, const std::string& text);
+  // Document lifecycle. The buffer passed to didOpen() must stay alive until
+  // didClose(); it is read whenever the server needs the full text.
+  //
+  // Documents opened while their server is starting are sent once it has
+  // initialized. A server that exits is restarted after a delay that doubles
+  // with each consecutive failure, and its open documents are sent again; it
+  // is given up on after five failures in a row.
+  void didOpen(const std::string& uri, const std::string& languageId, const TextBuffer& text);
+  // Queues one edit, with its range in positions of the document before the
+  // edit. Edits are sent together, as a single didChange with the next
+  // version, once none has arrived for the debounce interval, and before any
+  // request on the document. Servers that only take full text get the buffer.
+  void didChange(const std::string& uri, const TextDocumentContentChangeEvent& change);
+  // The whole buffer was replaced; the next didChange carries the full text.
+  void didReplace(const std::string& uri);
+  void flushChanges(const std::string& uri);
+  void setChangeDebounce(std::chrono::milliseconds delay);
   void didClose(const std::string& uri);
   void didSave(const std::string& uri);
 
   // Language features
+  //
+  // completion() answers from the cached list of the word at the position
+  // when it can, calling back right away with the best completionLimit items
+  // for the typed prefix; otherwise it requests a new list. Call it on every
+  // keystroke while the popup is open and endCompletion() when it closes.
+  // Edits outside the word end the session.
   void completion(const std::string& uri, int line, int character,
                  std::function<void(const std::vector<CompletionItem>&)> callback);
+  void endCompletion();
+  void setCompletionLimit(size_t limit);
   void hover(const std::string& uri, int line, int character,
             std::function<void(const std::optional<Hover>&)> callback);
   void gotoDefinition(const std::string& uri, int line, int character,
                      std::function<void(const std::vector<LSPLocation>&)> callback);
   void documentSymbols(const std::string& uri,
                       std::function<void(const std::vector<DocumentSymbol>&)> callback);
+  // References and workspace symbols stream. The callback gets each batch
+  // as a server produces it, without locations already passed on, and a last
+  // time with done set once the request has finished; batches cannot be
+  // taken back, so results for a document that changed meanwhile are kept.
+  // Workspace symbols come from the servers of the document at `uri`.
+  void references(const std::string& uri, int line, int character,
+                  std::function<void(const std::vector<LSPLocation>& batch, bool done)> callback);
+  void workspaceSymbols(const std::string& uri, const std::string& query,
+                        std::function<void(const std::vector<WorkspaceSymbol>& batch, bool done)> callback);
+  // Semantic tokens. The whole document is requested, as edits to the last
+  // result when the server supports deltas; servers that only serve ranges,
+  // and documents over 20,000 lines on servers without deltas, are
+  // asked for lines [firstLine, lastLine]. The callback gets the document's
+  // complete data (or the range's) and the server's legend; responses for an
+  // outdated version are dropped. Returns false when no initialized server
+  // for the document provides tokens, so the caller can ask again later.
+  bool semanticTokens(const std::string& uri, int firstLine, int lastLine,
+                      std::function<void(const SemanticTokens&, const ServerCapabilities&)> callback);
+
+  // Request scheduling. A request waits out its kind's debounce interval and
+  // supersedes the previous request of that kind: one still waiting is
+  // dropped without a callback, one in flight is cancelled. Responses to a
+  // document version that has since changed are dropped, and each server has
+  // at most maxRequestsPerServer requests in flight.
+  //
+  // Completion, hover, definition, references and workspace symbols go to
+  // every server of the document that advertises the feature (or the primary
+  // one if none does) and call back once with the merged results, when all
+  // have answered or, after the first answer, each of the others is past its
+  // deadline. Document symbols and semantic tokens come from the first
+  // capable server.
+  void setRequestDebounce(RequestKind kind, std::chrono::milliseconds delay);
+  void setMaxRequestsPerServer(int limit);
 
-  // Diagnostics callback
+  // Adds a listener for published diagnostics; every listener is called, in
+  // the order they were added. With several servers on a document, each
+  // publish replaces that server's share and listeners get all of them.
   void onDiagnostics(std::function<void(const std::string& uri, const std::vector<Diagnostic>&)> callback);
 
   // Process incoming messages from all servers
   void processMessages();
+  // Readable whenever a server has messages waiting for processMessages().
+  int wakeupFd() const { return m_wakeup.fd(); }
+  // When processMessages() next has timed work: queued edits or a request
+  // whose debounce interval ends, a server restart, or a fanned-out request
+  // whose deadlines pass. Nothing when all that is left waits on a server.
+  // With wakeupFd(), this lets a main loop sleep until there is work.
+  std::optional<std::chrono::steady_clock::time_point> nextDeadline() const;
 
   // Shutdown all servers
   void shutdown();
 
+  // Message counts, sizes and timings of a server, across its restarts; see
+  // LSPMetrics for what is measured.
+  LSPMetrics metrics(const std::string& server) const;
+  // Every configured server's metrics and state as one JSON object:
+  // {"servers": {"<name>": {"running", "initialized", "failures", "metrics"}}}
+  std::string metricsJSON() const;
+
 private:
   struct ServerInfo {
-    std::unique_ptr<LSPClient> client;
+    std::unique_ptr<LSPClient> client;  // set while the process runs
     LanguageServerConfig config;
+    std::string executable;             // resolved command, once started
     bool initialized = false;
+    bool initializeFailed = false;
+    int inFlight = 0; // scheduled requests awaiting a response
+    // Supervision: consecutive failures, and when the process was started or
+    // is due to be restarted
+    int failures = 0;
+    bool restartPending = false;
+    bool gaveUp = false;
+    std::chrono::steady_clock::time_point startedAt;
+    std::chrono::steady_clock::time_point restartAt;
+    LSPMetrics pastMetrics; // of the processes that exited
+  };
+
+  // One server a request is sent to; rank is its position among the
+  // document's servers, which orders merged results.
+  struct RequestTarget {
+    const std::string& server;
+    size_t rank;
+    LSPClient& client;
+    uint64_t ticket;
+  };
+  // Sends the request on the client and returns its id
+  using RequestIssuer = std::function<int(const RequestTarget& target)>;
+  using CapabilityFilter = bool (*)(const ServerCapabilities& capabilities);
+
+  struct InFlightRequest {
+    std::string server;
+    int id = 0;
+    std::chrono::steady_clock::time_point deadline;
+  };
+
+  struct RequestSlot {
+    uint64_t ticket = 0;  // latest request of this kind
+    std::string uri;
+    std::chrono::steady_clock::time_point due;
+    CapabilityFilter filter = nullptr;
+    RequestIssuer issue;  // set while waiting to be sent
+    // Reports the merged responses; requests with one fan out to every
+    // capable server
+    std::function<void()> merge;
+    uint64_t inFlightTicket = 0;
+    std::vector<InFlightRequest> inFlight; // servers yet to answer
+    std::string inFlightUri;
+    int inFlightVersion = 0;
+    bool answered = false;         // a wanted response has arrived
+    std::function<void()> deliver; // the merge of the request in flight
+  };
+
+  struct CompletionSession {
+    bool active = false;
+    bool waiting = false;       // the list has been requested
+    std::string uri;
+    int line = 0;
+    int wordStart = 0;          // UTF-16 column of the word's first character
+    std::string requestPrefix;  // word prefix the server was asked with
+    std::string prefix;         // word prefix typed since
+    std::function<void(const std::vector<CompletionItem>&)> callback;
+  };
+
+  struct DocumentServer {
+    std::string name;
+    bool opened = false;  // didOpen sent to the running server
+    std::vector<Diagnostic> diagnostics; // last published, if shared
+  };
+
+  struct DocumentState {
+    std::vector<DocumentServer> servers; // in priority order
+    std::string languageId;
+    const TextBuffer* text = nullptr;
+    int version = 1;
+    // Last whole-document semantic tokens, kept for applying deltas, and the
+    // server that computed them
+    SemanticTokens tokens;
+    std::string tokensResultId;
+    std::string tokensServer;
+    std::vector<TextDocumentContentChangeEvent> pending;
+    LSPPosition pendingEnd;  // end of the last queued change's text
+    bool replaced = false;   // full text is due instead of pending
+    std::chrono::steady_clock::time_point firstChange;
+    std::chrono::steady_clock::time_point lastChange;
   };
 
   std::unordered_map<std::string, ServerInfo> m_servers;
-  std::unordered_map<std::string, std::string> m_documentToServer; // uri -> server name
-  std::function<void(const std::string&, const std::vector<Diagnostic>&)> m_diagnosticsCallback;
+  std::vector<std::string> m_serverOrder; // registration order
+  std::unordered_map<std::string, DocumentState> m_documents; // by uri
+  std::chrono::milliseconds m_changeDebounce{50};
+  Wakeup m_wakeup;
+  std::array<RequestSlot, 7> m_requests;
+  std::array<std::chrono::milliseconds, 7> m_requestDebounce{
+    std::chrono::milliseconds(30),   // completion
+    std::chrono::milliseconds(150),  // hover
+    std::chrono::milliseconds(0),    // definition
+    std::chrono::milliseconds(200),  // document symbols
+    std::chrono::milliseconds(100),  // semantic tokens
+    std::chrono::milliseconds(0),    // references
+    std::chrono::milliseconds(100),  // workspace symbols
+  };
+  static constexpr size_t kRangeTokensLines = 20000;
+  uint64_t m_nextTicket = 0;
+  CompletionSession m_completion;
+  CompletionCache m_completionCache;
+  size_t m_completionLimit = 200;
+  int m_maxRequestsPerServer = 2;
+  std::vector<std::function<void(const std::string&, const std::vector<Diagnostic>&)>> m_diagnosticsCallbacks;
   std::string m_rootUri;
+  bool m_serversEnabled = false; // initializeServers() was called
+  CommandResolver m_commandResolver;
 
   // Helper methods
-  LSPClient* getClientForUri(const std::string& uri);
-  LSPClient* getClientForLanguage(const std::string& languageId);
-  std::string getLanguageIdFromUri(const std::string& uri);
-  std::string getServerNameForLanguage(const std::string& languageId);
+  void startServer(const std::string& name, ServerInfo& info);
+  void superviseServers();
+  void serverExited(const std::string& name, ServerInfo& info);
+  void openDocument(const std::string& uri, DocumentState& document, DocumentServer& server, LSPClient& client);
+  void flushDocument(const std::string& uri, DocumentState& document);
+  void flushDueChanges();
+  void publishDiagnostics(const std::string& server, const std::string& uri,
+                          const std::vector<Diagnostic>& diagnostics);
+  void scheduleRequest(RequestKind kind, const std::string& uri, CapabilityFilter filter, RequestIssuer issue,
+                       std::function<void()> merge = nullptr);
+  void dispatchRequests();
+  std::vector<size_t> requestTargets(const DocumentState& document, CapabilityFilter filter, bool fanOut) const;
+  bool canDispatch(const RequestSlot& slot) const;
+  void deliverResponses();
+  void cancelInFlight(RequestSlot& slot);
+  bool finishRequest(RequestKind kind, uint64_t ticket, const std::string& server, bool checkVersion = true);
+  // Whether the request is the latest of its kind and still in flight
+  bool isCurrent(RequestKind kind, uint64_t ticket) const;
+  bool isOutdated(const DocumentState& document, int version) const;
+  // Whether an initialized server has the document open
+  bool hasReadyServer(const std::string& uri) const;
+  std::vector<std::string> serversForDocument(const std::string& uri, const std::string& languageId) const;
 };
 
 } // namespace lsp
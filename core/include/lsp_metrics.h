@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "lsp_json.h"
+
+namespace prodigeetor {
+namespace lsp {
+
+// A histogram of durations in microseconds, bucketed like an HDR histogram:
+// exact below 16 us, and above that in steps of a sixteenth of the power of
+// two below the value, so percentiles are within about 6%. Recording is a
+// few instructions and the 592 counters are only allocated once something
+// is recorded.
+class LatencyHistogram {
+public:
+  void record(uint64_t micros);
+  void merge(const LatencyHistogram &other);
+
+  uint64_t count() const { return m_count; }
+  uint64_t min() const { return m_count ? m_min : 0; }
+  uint64_t max() const { return m_max; }
+  uint64_t mean() const { return m_count ? m_sum / m_count : 0; }
+  // The highest value in the bucket holding the `percentile`th value (0-100).
+  uint64_t percentile(double percentile) const;
+
+  // {"count", "min", "mean", "p50", "p90", "p99", "max"}
+  void writeJSON(JSONWriter &writer) const;
+
+private:
+  static constexpr int kSubBucketBits = 4;
+  static constexpr uint64_t kMaxValue = (uint64_t{1} << 40) - 1; // about 12 days
+  static constexpr size_t kBuckets = (40 - kSubBucketBits + 1) << kSubBucketBits;
+
+  std::vector<uint64_t> m_counts;
+  uint64_t m_count = 0;
+  uint64_t m_sum = 0;
+  uint64_t m_min = UINT64_MAX;
+  uint64_t m_max = 0;
+
+  static size_t bucketOf(uint64_t micros);
+  static uint64_t bucketEnd(size_t bucket);
+};
+
+// Traffic of one method with one server. Requests are timed from the moment
+// they are sent:
+//   server  - until the response was read from the pipe (the server's work,
+//             plus both pipe trips)
+//   parse   - parsing the message on the I/O thread
+//   queue   - from parsed until processMessages() took it (the UI tick)
+//   handler - running the callbacks (decoding results, updating the editor)
+//   latency - until the callbacks returned; roughly the sum of the others
+// Notifications from the server are timed from when they were read, so only
+// parse, queue and handler apply.
+struct MethodMetrics {
+  uint64_t sent = 0;        // requests, notifications or replies to the server
+  uint64_t received = 0;    // responses, notifications or server requests
+  uint64_t errors = 0;      // error responses
+  uint64_t cancelled = 0;
+  int64_t inFlight = 0;     // sent, neither answered nor cancelled
+  uint64_t bytesSent = 0;   // including the header
+  uint64_t bytesReceived = 0;
+  LatencyHistogram latency;
+  LatencyHistogram server;
+  LatencyHistogram parse;
+  LatencyHistogram queue;
+  LatencyHistogram handler;
+
+  void merge(const MethodMetrics &other);
+};
+
+// Everything one client measured, by method.
+struct LSPMetrics {
+  std::map<std::string, MethodMetrics, std::less<>> methods;
+  // Messages the stdin pipe did not take at once, and how long they waited
+  // for the I/O thread to finish writing them
+  uint64_t deferredWrites = 0;
+  uint64_t writeWaitMicros = 0;
+
+  MethodMetrics &method(std::string_view name);
+  void merge(const LSPMetrics &other);
+  // {"pipe": {...}, "methods": {"<method>": {...}}}
+  void writeJSON(JSONWriter &writer) const;
+};
+
+} // namespace lsp
+} // namespace prodigeetor
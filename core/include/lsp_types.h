@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
 #include <vector>
 #include <optional>
@@ -84,6 +85,13 @@ struct CompletionItem {
   std::string insertText;
 };
 
+// Completion result. An incomplete list is only valid for the prefix it was
+// requested with; typing more requires a new request.
+struct CompletionList {
+  std::vector<CompletionItem> items;
+  bool isIncomplete = false;
+};
+
 // Hover result
 struct Hover {
   std::string contents;
@@ -130,6 +138,14 @@ struct DocumentSymbol {
   std::vector<DocumentSymbol> children;
 };
 
+// Workspace symbol, from SymbolInformation or WorkspaceSymbol
+struct WorkspaceSymbol {
+  std::string name;
+  std::string containerName;
+  SymbolKind kind;
+  LSPLocation location; // the range may be empty until resolved
+};
+
 // Text document identifier
 struct TextDocumentIdentifier {
   std::string uri;
@@ -167,6 +183,21 @@ struct ServerCapabilities {
   bool documentRangeFormattingProvider = false;
   bool renameProvider = false;
   int textDocumentSync = 0; // 0=None, 1=Full, 2=Incremental
+  // Semantic tokens: whole-document, delta and range requests, and the
+  // legend naming the token type and modifier indices
+  bool semanticTokensFull = false;
+  bool semanticTokensDelta = false;
+  bool semanticTokensRange = false;
+  std::vector<std::string> semanticTokenTypes;
+  std::vector<std::string> semanticTokenModifiers;
+};
+
+// Semantic tokens in the protocol's packed form: five integers per token
+// (line delta, start delta, length, type, modifier bits), with lines and
+// columns relative to the previous token and columns in UTF-16 units.
+struct SemanticTokens {
+  std::vector<uint32_t> data;
+  std::optional<LSPRange> range; // set when only this range was requested
 };
 
 // Initialize result
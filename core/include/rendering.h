@@ -1,5 +1,6 @@
 #pragma once
 
+#include <array>
 #include <string>
 #include <vector>
 
@@ -23,6 +24,11 @@ struct RenderStyle {
   uint32_t bg_color = 0x00000000;
   bool bold = false;
   bool italic = false;
+
+  bool operator==(const RenderStyle &other) const {
+    return fg_color == other.fg_color && bg_color == other.bg_color &&
+           bold == other.bold && italic == other.italic;
+  }
 };
 
 struct RenderSpan {
@@ -58,6 +64,34 @@ public:
   virtual LineLayout layout_line(const std::string &text, const std::vector<RenderSpan> &spans) = 0;
 
   virtual void draw_line(const LineLayout &layout, float x, float y) = 0;
+
+  // Hit-testing on a line from layout_line(), with x relative to where it is
+  // drawn and indices as UTF-8 byte offsets into its text. index_at_x()
+  // returns the grapheme boundary nearest to x, clamped to the line.
+  //
+  // The defaults sum the font's advances over lines of printable ASCII, from
+  // a table ascii_advances() fills once per font, and otherwise
+  // binary-search grapheme boundaries with measure_line(); renderers that
+  // keep shaped lines override them.
+  virtual size_t index_at_x(const LineLayout &layout, float x);
+  virtual float x_at_index(const LineLayout &layout, size_t index);
+
+protected:
+  // Fills `advances` with the advance of each printable ASCII character, ' '
+  // to '~', in the current font. Returns false when a line's width is not
+  // the sum of its characters' (kerning, no font loaded).
+  virtual bool ascii_advances(float * /*advances*/) { return false; }
+  // Call when the font changes, so the table is filled again.
+  void invalidate_ascii_advances() { m_ascii_advances_state = AsciiAdvances::Unknown; }
+
+private:
+  enum class AsciiAdvances { Unknown, Valid, Unavailable };
+
+  // The table, or null when the font cannot use it.
+  const float *ascii_advance_table();
+
+  AsciiAdvances m_ascii_advances_state = AsciiAdvances::Unknown;
+  std::array<float, 95> m_ascii_advances{};
 };
 
 class TextLayoutEngine {
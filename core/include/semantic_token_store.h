@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string_view>
+#include <vector>
+
+#include "text_buffer.h"
+
+namespace prodigeetor {
+
+// One semantic token, located by byte column within its line.
+struct SemanticToken {
+  uint32_t column = 0;
+  uint32_t length = 0;
+  uint32_t type = 0;      // index into the server's token type legend
+  uint32_t modifiers = 0; // bit i: modifier i of the legend
+};
+
+// The semantic tokens of one document, line by line. Edits shift them until
+// the server sends new ones, so they stay on the text they were computed for.
+//
+// Tokens live in one array in line order with an offset per line, so a line's
+// tokens are a contiguous slice. An edit within a line only touches that
+// line's tokens; one that adds or removes lines also moves the offsets after
+// it.
+class SemanticTokenStore {
+public:
+  // Replaces every token with the protocol's packed data (five integers per
+  // token, relative lines and UTF-16 columns). `buffer` is the text the data
+  // was computed for; columns are converted to bytes against it.
+  void set(const std::vector<uint32_t> &data, const TextBuffer &buffer);
+  // Replaces the tokens of lines [first_line, last_line] with a range result.
+  void set_lines(size_t first_line, size_t last_line, const std::vector<uint32_t> &data,
+                 const TextBuffer &buffer);
+  void clear();
+
+  bool empty() const { return m_tokens.empty(); }
+  size_t size() const { return m_tokens.size(); }
+
+  // Shifts tokens through an edit at byte `column` of `line` that replaced
+  // `removed` with `inserted`. Tokens overlapping the removed text are
+  // dropped; text typed inside a token extends it, and text typed at its
+  // start pushes it along.
+  void apply_edit(size_t line, size_t column, std::string_view removed, std::string_view inserted);
+
+  // Tokens of a line, in column order.
+  std::span<const SemanticToken> line(size_t line) const;
+
+private:
+  std::vector<SemanticToken> m_tokens; // line order, then column order
+  // m_offsets[i] is the first token of line i; lines past the last entry
+  // have no tokens.
+  std::vector<uint32_t> m_offsets;
+
+  size_t covered_lines() const { return m_offsets.empty() ? 0 : m_offsets.size() - 1; }
+  void cover(size_t lines);
+};
+
+} // namespace prodigeetor
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
 #include <string>
 #include <vector>
 
@@ -10,6 +12,14 @@ struct EditorSettings {
   std::vector<std::string> font_fallbacks = {"Menlo", "Fira Code", "monospace"};
   bool font_ligatures = true;
   float font_size = 14.0f;
+  // Syntax highlighting limits; see HighlightLimits. Zero disables a limit.
+  size_t syntax_max_file_size = 32 * 1024 * 1024;
+  size_t syntax_max_line_length = 10000;
+  uint32_t syntax_parse_budget_ms = 5;
+  // Large-file mode; see LargeFileThresholds. Zero disables a threshold.
+  size_t large_file_size = 16 * 1024 * 1024;
+  size_t large_file_map_size = 64 * 1024 * 1024;
+  size_t large_file_lsp_max_size = 4 * 1024 * 1024;
 };
 
 class SettingsLoader {
@@ -17,4 +27,9 @@ public:
   static EditorSettings load_from_file(const std::string &path);
 };
 
+// The editor's directory under the user cache directory ($XDG_CACHE_HOME,
+// ~/Library/Caches on macOS, ~/.cache otherwise), without a trailing slash.
+// It is not created.
+std::string user_cache_directory();
+
 } // namespace prodigeetor
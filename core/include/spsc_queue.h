@@ -0,0 +1,55 @@
+#pragma once
+
+#include <atomic>
+#include <utility>
+
+namespace prodigeetor {
+
+// Unbounded single-producer, single-consumer queue. push() and pop() never
+// lock or block; push() may only be called from one thread and pop() from
+// one (other) thread at a time. Each element costs one node allocation.
+template <typename T>
+class SPSCQueue {
+public:
+  SPSCQueue() : m_head(new Node), m_tail(m_head) {}
+  ~SPSCQueue() {
+    while (Node *node = m_head) {
+      m_head = node->next.load(std::memory_order_relaxed);
+      delete node;
+    }
+  }
+  SPSCQueue(const SPSCQueue &) = delete;
+  SPSCQueue &operator=(const SPSCQueue &) = delete;
+
+  void push(T value) {
+    Node *node = new Node;
+    node->value = std::move(value);
+    m_tail->next.store(node, std::memory_order_release);
+    m_tail = node;
+  }
+
+  bool pop(T &value) {
+    Node *next = m_head->next.load(std::memory_order_acquire);
+    if (!next) {
+      return false;
+    }
+    value = std::move(next->value);
+    delete m_head;
+    m_head = next; // the popped node becomes the new sentinel
+    return true;
+  }
+
+  // Consumer side only.
+  bool empty() const { return m_head->next.load(std::memory_order_acquire) == nullptr; }
+
+private:
+  struct Node {
+    T value{};
+    std::atomic<Node *> next{nullptr};
+  };
+
+  alignas(64) Node *m_head; // consumer: sentinel before the first element
+  alignas(64) Node *m_tail; // producer: last node
+};
+
+} // namespace prodigeetor
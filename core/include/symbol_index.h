@@ -0,0 +1,98 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace prodigeetor {
+
+struct WorkspaceSymbol {
+  std::string name;
+  std::string kind;
+  std::string path;
+  uint32_t line = 0;
+  uint32_t column = 0;
+  int score = 0;
+};
+
+// Workspace-wide definitions extracted with tree-sitter tags queries, so "go
+// to symbol" works before (or without) a language server.
+//
+// The index is persisted to a single file that is memory-mapped on open;
+// files whose mtime and size are unchanged are never reparsed, and files whose
+// content hash is unchanged are only re-stamped. Symbols of changed files live
+// in an in-memory overlay until the next save() folds them into the file.
+// While the refresh worker runs it watches the workspace for changed files
+// (inotify, FSEvents), so edits made outside the editor are picked up too.
+class SymbolIndex {
+public:
+  SymbolIndex();
+  ~SymbolIndex();
+  SymbolIndex(const SymbolIndex &) = delete;
+  SymbolIndex &operator=(const SymbolIndex &) = delete;
+
+  // Cache location for a workspace root, under the user cache directory.
+  static std::string default_index_path(const std::string &root_path);
+  // One index per workspace root, shared by every editor of the process. The
+  // first call opens the cached index and starts a background refresh.
+  static std::shared_ptr<SymbolIndex> shared(const std::string &root_path);
+
+  // Maps the index at `index_path` (if present and valid) for `root_path`.
+  void open(const std::string &root_path, const std::string &index_path);
+  // Rescans the workspace on a background thread, reparses changed files on
+  // a worker pool and saves the index when done. The thread then reindexes
+  // the files the workspace watcher or update_file() report as they come,
+  // saving them in batches, until the index is reopened or destroyed.
+  void refresh_async(size_t thread_count = 0);
+  // Has the refresh worker sweep the whole workspace again.
+  void rescan();
+  // Blocks until the first refresh is done.
+  void wait();
+  bool is_indexing() const;
+
+  // Queues a changed file for the refresh worker.
+  void update_file(const std::string &path);
+  void remove_file(const std::string &path);
+  // Writes the index from a copy taken under a shared lock, so queries go on
+  // meanwhile, and maps the new file in.
+  bool save();
+
+  // Fuzzy, case-insensitive subsequence match over symbol names, best first.
+  std::vector<WorkspaceSymbol> query(std::string_view pattern, size_t limit = 100) const;
+  size_t file_count() const;
+  size_t symbol_count() const;
+
+private:
+  struct State;
+
+  std::string m_root;
+  std::string m_index_path;
+  std::unique_ptr<State> m_state;
+  mutable std::shared_mutex m_mutex; // guards m_state, m_root and m_index_path
+  std::mutex m_save_mutex;           // one save() at a time
+  std::thread m_worker;
+  std::atomic<bool> m_indexing{false};
+  std::atomic<bool> m_cancel{false};
+  // m_cancel for the taggers' parsers, so stop() does not wait out a parse
+  alignas(std::atomic_ref<size_t>::required_alignment) size_t m_cancel_parse = 0;
+  std::mutex m_queue_mutex;           // guards m_queued and m_rescan
+  std::condition_variable m_queue_changed; // files queued, rescan, cancel or first refresh done
+  std::vector<std::string> m_queued;  // absolute paths from update_file() and the watcher
+  bool m_rescan = false;
+
+  void watch(size_t thread_count);
+  void stop();
+  // Reindexes the files at `paths`, or every file of the workspace when null.
+  void refresh(size_t thread_count, const std::vector<std::string> *paths);
+  std::string relative_path(const std::string &path) const;
+};
+
+} // namespace prodigeetor
@@ -1,9 +1,19 @@
 #pragma once
 
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
 #include <string>
+#include <string_view>
+#include <utility>
 #include <vector>
 
+#include "fold_map.h"
+#include "highlight_runs.h"
+#include "language_registry.h"
 #include "rendering.h"
+#include "text_buffer.h"
 #include "theme.h"
 
 namespace prodigeetor {
@@ -14,30 +24,147 @@ public:
   virtual std::vector<RenderSpan> highlight(const std::string &text) = 0;
 };
 
+// Bounds on the work spent highlighting one document (see EditorSettings).
+struct HighlightLimits {
+  // Zero disables a limit.
+  size_t max_file_size = 32 * 1024 * 1024; // larger documents are plain text
+  size_t max_line_length = 10000;          // bytes of each line that are highlighted
+  uint64_t parse_budget_micros = 5000;     // per parse slice
+};
+
+enum class HighlightDegradation {
+  None,
+  LongLines, // some lines are only highlighted up to max_line_length
+  PlainText  // over max_file_size, or the parse was cancelled
+};
+
 class TreeSitterHighlighter final : public SyntaxHighlighter {
 public:
-  enum class LanguageId {
-    JavaScript,
-    TypeScript,
-    TSX,
-    Swift,
-    CSharp,
-    HTML,
-    CSS,
-    SQL
-  };
-
   TreeSitterHighlighter();
   ~TreeSitterHighlighter() override;
-  void set_language(LanguageId language);
+  // Selects a language from the LanguageRegistry by name or alias, loading
+  // its grammar on first use. Returns false (and highlights nothing) for
+  // unknown languages and languages without a grammar.
+  bool set_language(std::string_view name);
+  const LanguageInfo *language() const;
   void set_theme(SyntaxTheme theme);
+  const SyntaxTheme &theme() const;
+  void set_limits(const HighlightLimits &limits);
+  const HighlightLimits &limits() const;
   std::vector<RenderSpan> highlight(const std::string &text) override;
 
+  // Retained document parse. set_text() parses from scratch; edit() applies a
+  // buffer edit to the retained text, the root tree and every injection
+  // layer, then reparses the root incrementally and only those layers whose
+  // ranges were touched. Only the edited bytes are passed, never the document.
+  void set_text(std::string text);
+  void edit(const Edit &edit);
+
+  // Parses run for at most parse_budget_micros. One that runs out is left
+  // pending (the previous spans, shifted by the edits, stay visible) and
+  // continue_parse() resumes it where it stopped, typically from an idle
+  // callback, returning true from the call that completes it. Edits made
+  // meanwhile leave it running on the text it started with; they are
+  // replayed onto its tree, which is then reparsed incrementally.
+  // Injection layers are parsed after the root with what is left of the
+  // budget, the same way, and one left unfinished is resumed first.
+  bool parse_pending() const;
+  bool continue_parse();
+  // Abandons the current parse; safe to call from any thread. The document
+  // stays plain text until the next set_text() or edit().
+  void cancel_parse();
+  HighlightDegradation degradation() const;
+
+  // Document highlight store: root spans followed by injection layer spans.
+  // Span columns are absolute UTF-8 byte offsets into the document. Built on
+  // first use after a change.
+  const std::vector<RenderSpan> &spans() const;
+  // The same store flattened into sorted, non-overlapping style runs. After
+  // edit() only the runs over changed windows are rebuilt.
+  const HighlightRuns &runs() const;
+  size_t injection_layer_count() const;
+
+  // Foldable regions of the root tree, sorted by start line with at most one
+  // range per line. Taken from folds.scm where the grammar ships one, otherwise
+  // from bracket-delimited nodes, elements and multi-line comments. Only the
+  // edited window is recomputed after edit().
+  const std::vector<FoldRange> &fold_ranges() const;
+
+  // Structural navigation over the root tree, walked with tree cursors in
+  // O(depth). expand_selection() grows [start, end) to the smallest enclosing
+  // named node; shrink_selection() narrows it to the first named node inside
+  // it. Both return false and leave the range untouched
+  // when there is nothing to move to.
+  bool expand_selection(size_t &start, size_t &end) const;
+  bool shrink_selection(size_t &start, size_t &end) const;
+  // Offset of the bracket paired with the one at `offset` (or, failing that,
+  // the one just before it).
+  bool matching_bracket(size_t offset, size_t &match) const;
+
 private:
-  LanguageId m_language = LanguageId::JavaScript;
+  struct ParseState;
+
+  const LanguageInfo *m_language = nullptr;
   SyntaxTheme m_theme;
+  HighlightLimits m_limits;
+  HighlightDegradation m_degradation = HighlightDegradation::None;
+  bool m_parse_pending = false;
+  uint32_t m_pending_start = 0; // window the pending parse may change
+  uint32_t m_pending_end = 0;
+  // Tree-sitter cancellation flag. The parser reads it as a plain size_t, so
+  // it is only written and read here through std::atomic_ref.
+  alignas(std::atomic_ref<size_t>::required_alignment) size_t m_cancel = 0;
   void *m_parser = nullptr;
   void *m_query = nullptr;
+  void *m_tree = nullptr;
+  std::string m_text;
+  std::vector<RenderSpan> m_root_spans; // sorted by start
+  mutable std::vector<RenderSpan> m_spans;
+  mutable bool m_spans_stale = false;
+  HighlightRuns m_runs;
+  std::vector<FoldRange> m_folds;
+  std::unique_ptr<ParseState> m_state;
+
+  void clear_tree();
+  bool run_parse();
+  void update_clipped();
+  void collect_root_spans();
+  void update_root_spans(std::vector<std::pair<uint32_t, uint32_t>> windows);
+  void update_injections(uint32_t window_start, uint32_t window_end);
+  void merge_spans();
+  void update_folds(uint32_t window_start, uint32_t window_end);
+};
+
+// A definition reported by a language's tags.scm query.
+struct SymbolTag {
+  std::string name;
+  std::string kind; // suffix of the @definition.* capture: "function", "class", ...
+  uint32_t line = 0;
+  uint32_t column = 0; // UTF-8 byte column of the name
+};
+
+// Extracts definition tags from whole documents. Compiled tags queries are
+// shared by all instances; each instance owns a parser and query cursor, so
+// use one per thread.
+class TreeSitterTagger {
+public:
+  TreeSitterTagger();
+  ~TreeSitterTagger();
+  TreeSitterTagger(const TreeSitterTagger &) = delete;
+  TreeSitterTagger &operator=(const TreeSitterTagger &) = delete;
+
+  // A parse gives up after `timeout_micros` (0 disables the limit), or as
+  // soon as another thread makes `*flag` non-zero; tags() then returns
+  // nothing for that document. The flag must outlive the tagger.
+  void set_timeout_micros(uint64_t timeout_micros);
+  void set_cancel_flag(const size_t *flag);
+
+  bool supports(const LanguageInfo &language) const;
+  std::vector<SymbolTag> tags(const LanguageInfo &language, std::string_view text);
+
+private:
+  void *m_parser = nullptr;
+  void *m_cursor = nullptr;
 };
 
 } // namespace prodigeetor
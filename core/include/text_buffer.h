@@ -1,6 +1,8 @@
 #pragma once
 
 #include <cstddef>
+#include <functional>
+#include <memory>
 #include <string>
 #include <string_view>
 #include <vector>
@@ -15,14 +17,27 @@ struct Edit {
   std::string removed;
 };
 
+// Gap buffer. A buffer loaded from a large file keeps the file memory-mapped
+// and reads the parts before and after the edited region straight from the
+// mapping; bytes are only copied into the gap buffer between the edits.
 class TextBuffer {
 public:
   TextBuffer();
   explicit TextBuffer(std::string initial_text);
 
+  // Replaces the contents with the file at `path`, memory-mapping it when it
+  // is at least `map_threshold` bytes (0 never maps).
+  bool load_file(const std::string &path, size_t map_threshold = 0);
+  bool is_mapped() const;
+
   size_t size() const;
   bool empty() const;
   std::string text() const;
+  std::string text_range(size_t start, size_t end) const;
+  // Visits [start, end) as consecutive pieces without building the whole
+  // string. Pieces are only valid during the call; the reversed part after the
+  // gap is passed through a small scratch block.
+  void for_each_chunk(size_t start, size_t end, const std::function<void(std::string_view)> &visit) const;
 
   void insert(size_t offset, std::string_view text);
   void erase(size_t offset, size_t length);
@@ -30,6 +45,7 @@ public:
 
   size_t line_count() const;
   size_t line_start(size_t line_index) const;
+  size_t line_at(size_t offset) const;
   std::string line_text(size_t line_index) const;
   size_t line_grapheme_count(size_t line_index) const;
 
@@ -37,15 +53,25 @@ public:
   size_t offset_at(const Position &pos) const;
 
 private:
+  struct MappedFile;
+
+  // Document order: mapped prefix, m_left, the gap, m_right_reversed, mapped tail.
   std::string m_left;
   std::string m_right_reversed;
+  std::shared_ptr<const MappedFile> m_mapped; // read-only, unedited
+  size_t m_mapped_prefix = 0;                 // mapped bytes before m_left
+  size_t m_mapped_offset = 0;                 // first mapped byte of the tail
   mutable std::vector<size_t> m_line_starts;
   mutable bool m_line_index_dirty = true;
 
+  std::string_view mapped_prefix() const;
+  std::string_view mapped_tail() const;
   void move_gap(size_t offset);
+  void take_after_gap(size_t length, std::string *removed);
   char char_at(size_t offset) const;
   std::string slice(size_t start, size_t end) const;
   void ensure_line_index() const;
+  void update_line_index(size_t offset, size_t removed_length, std::string_view inserted);
 };
 
 } // namespace prodigeetor
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 #include <string>
 
@@ -24,10 +25,14 @@ struct Selection {
   Position active;
 };
 
+// A diagnostic over document bytes [start, end). Severity follows LSP:
+// 1 error, 2 warning, 3 information, 4 hint.
 struct Diagnostic {
-  Range range;
+  size_t start = 0;
+  size_t end = 0;
   std::string message;
   std::string source;
+  std::string code;
   int severity = 0;
 };
 
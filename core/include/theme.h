@@ -12,6 +12,8 @@ public:
   static SyntaxTheme load_from_file(const std::string &path);
 
   RenderStyle style_for_capture(const std::string &capture) const;
+  // The capture's own style, or null when the theme falls back to the default.
+  const RenderStyle *find_style(const std::string &capture) const;
 
 private:
   RenderStyle m_default_style;
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <atomic>
+
+namespace prodigeetor {
+
+// A file descriptor that becomes readable when signal() is called from any
+// thread, for waking a poll()-based or GLib main loop. Signals are coalesced:
+// only the first signal() after a drain() touches the descriptor. Uses an
+// eventfd on Linux and a pipe elsewhere.
+class Wakeup {
+public:
+  Wakeup();
+  ~Wakeup();
+  Wakeup(const Wakeup &) = delete;
+  Wakeup &operator=(const Wakeup &) = delete;
+
+  int fd() const { return m_read_fd; }
+  void signal();
+  // Clears the readable state; call before handling the work it announced.
+  void drain();
+
+private:
+  int m_read_fd = -1;
+  int m_write_fd = -1;
+  std::atomic<bool> m_signaled{false};
+};
+
+} // namespace prodigeetor
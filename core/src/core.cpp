@@ -1,57 +1,46 @@
 #include "core.h"
+#include "grapheme.h"
+#include "language_registry.h"
+#include <algorithm>
 #include <iostream>
 #include <string>
+#include <tuple>
 #include <vector>
-#include <cstdlib>
-#include <unistd.h>
 
 namespace prodigeetor {
 
-// Helper function to find language server executable
-static std::string find_language_server(const std::string& command) {
-  // Try common locations
-  std::vector<std::string> search_paths;
-
-  // 1. Check if command is already absolute path
-  if (command[0] == '/' && access(command.c_str(), X_OK) == 0) {
-    std::cerr << "[LSP] Found language server: " << command << std::endl;
-    return command;
-  }
-
-  // 2. Get HOME directory
-  const char* home = getenv("HOME");
-  if (home) {
-    // NVM paths
-    search_paths.push_back(std::string(home) + "/.nvm/versions/node/v22.18.0/bin/" + command);
-    search_paths.push_back(std::string(home) + "/.nvm/current/bin/" + command);
-    // Global npm
-    search_paths.push_back(std::string(home) + "/.npm-global/bin/" + command);
-    // Homebrew
-    search_paths.push_back("/opt/homebrew/bin/" + command);
-    search_paths.push_back("/usr/local/bin/" + command);
-  }
-
-  // 3. System paths
-  search_paths.push_back("/usr/bin/" + command);
-
-  // Try each path
-  for (const auto& path : search_paths) {
-    if (access(path.c_str(), X_OK) == 0) {
-      std::cerr << "[LSP] Found language server: " << path << std::endl;
-      return path;
+// Viewport-only highlighting parses this many lines around the viewport, but
+// never more than kHighlightWindowBytes.
+static constexpr size_t kHighlightWindowMargin = 200;
+static constexpr size_t kHighlightWindowBytes = 1024 * 1024;
+// Range requests for semantic tokens cover this many lines around the viewport.
+static constexpr size_t kSemanticTokensMargin = 100;
+
+// Theme capture for a standard semantic token type the theme has no style
+// for under its own name.
+static const char *semantic_fallback_capture(const std::string &type) {
+  static const std::pair<const char *, const char *> captures[] = {
+    {"namespace", "type"},     {"class", "type"},        {"enum", "type"},
+    {"interface", "type"},     {"struct", "type"},       {"typeParameter", "type"},
+    {"parameter", "variable"}, {"enumMember", "constant"}, {"event", "property"},
+    {"method", "function"},    {"macro", "function"},    {"decorator", "function"},
+    {"modifier", "keyword"},   {"regexp", "string"},
+  };
+  for (const auto &[name, capture] : captures) {
+    if (type == name) {
+      return capture;
     }
   }
-
-  // Not found, return original command and let it fail with a clear error
-  std::cerr << "[LSP] WARNING: Could not find language server: " << command << std::endl;
-  std::cerr << "[LSP] Searched paths:" << std::endl;
-  for (const auto& path : search_paths) {
-    std::cerr << "[LSP]   - " << path << std::endl;
-  }
-  return command;
+  return nullptr;
 }
 
-Core::Core() : m_lsp_manager(std::make_unique<lsp::LSPManager>()) {}
+Core::Core() : m_lsp_manager(std::make_unique<lsp::LSPManager>()) {
+  m_lsp_manager->onDiagnostics([this](const std::string &uri, const std::vector<lsp::Diagnostic> &diagnostics) {
+    if (uri == m_lsp_uri) {
+      set_lsp_diagnostics(diagnostics);
+    }
+  });
+}
 
 Core::~Core() = default;
 
@@ -62,33 +51,25 @@ void Core::initialize() {
 
 void Core::initialize_lsp(const std::string& root_path) {
   std::cerr << "[LSP] Initializing LSP with root path: " << root_path << std::endl;
-
-  // Register TypeScript/JavaScript language server
-  lsp::LanguageServerConfig tsConfig;
-  tsConfig.command = find_language_server("typescript-language-server");
-  tsConfig.args = {"--stdio"};
-  tsConfig.extensions = {".ts", ".tsx", ".js", ".jsx"};
-  tsConfig.languageId = "typescript";
-  m_lsp_manager->registerLanguageServer("typescript", tsConfig);
-
-  // Register HTML language server
-  lsp::LanguageServerConfig htmlConfig;
-  htmlConfig.command = find_language_server("vscode-html-language-server");
-  htmlConfig.args = {"--stdio"};
-  htmlConfig.extensions = {".html", ".htm"};
-  htmlConfig.languageId = "html";
-  m_lsp_manager->registerLanguageServer("html", htmlConfig);
-
-  // Register CSS language server
-  lsp::LanguageServerConfig cssConfig;
-  cssConfig.command = find_language_server("vscode-css-language-server");
-  cssConfig.args = {"--stdio"};
-  cssConfig.extensions = {".css", ".scss", ".less"};
-  cssConfig.languageId = "css";
-  m_lsp_manager->registerLanguageServer("css", cssConfig);
-
-  // Initialize all servers
-  std::cerr << "[LSP] Starting language servers..." << std::endl;
+  index_workspace(root_path);
+
+  // Register the language servers declared in languages/languages.json.
+  // Each starts on the first document of its language, with its executable
+  // looked up then.
+  for (const auto& server : LanguageRegistry::instance().language_servers()) {
+    lsp::LanguageServerConfig config;
+    config.command = server.command;
+    config.args = server.args;
+    config.extensions = server.extensions;
+    config.languageId = server.language_id;
+    if (server.deadline_ms > 0) {
+      config.deadline = std::chrono::milliseconds(server.deadline_ms);
+    }
+    m_lsp_manager->registerLanguageServer(server.name, config);
+  }
+  m_lsp_manager->setCommandResolver([this](const std::string& command) {
+    return m_server_paths.resolve(command);
+  });
   m_lsp_manager->initializeServers("file://" + root_path);
 }
 
@@ -109,13 +90,265 @@ const UndoStack &Core::undo_stack() const {
 }
 
 void Core::insert(size_t offset, std::string_view text) {
+  size_t start_line = m_buffer.line_at(offset);
   Edit edit = m_buffer.replace(offset, 0, text);
   m_undo.push(edit);
+  apply_edit(edit, start_line);
 }
 
 void Core::erase(size_t offset, size_t length) {
+  size_t start_line = m_buffer.line_at(offset);
   Edit edit = m_buffer.replace(offset, length, "");
   m_undo.push(edit);
+  apply_edit(edit, start_line);
+}
+
+void Core::apply_edit(const Edit &edit, size_t start_line) {
+  size_t removed_lines = static_cast<size_t>(std::count(edit.removed.begin(), edit.removed.end(), '\n'));
+  size_t inserted_lines = static_cast<size_t>(std::count(edit.inserted.begin(), edit.inserted.end(), '\n'));
+  m_folds.apply_edit(start_line, start_line + removed_lines, start_line + inserted_lines);
+  m_diagnostics.apply_edit(edit.offset, edit.removed.size(), edit.inserted.size());
+  m_semantic_tokens.apply_edit(start_line, edit.offset - m_buffer.line_start(start_line), edit.removed, edit.inserted);
+  m_selection_history.clear();
+  if (m_lsp_open) {
+    m_lsp_manager->didChange(m_lsp_uri, lsp_change(edit, start_line));
+    m_semantic_stale = true;
+    request_semantic_tokens();
+  }
+
+  bool was_viewport_only = m_large_file.highlight_viewport_only;
+  update_large_file_status();
+  if (m_large_file.highlight_viewport_only) {
+    if (was_viewport_only) {
+      edit_highlight_window(edit);
+    } else {
+      m_syntax_highlighter.set_text(std::string());
+      m_highlight_window_valid = false;
+    }
+  } else if (was_viewport_only) {
+    m_syntax_highlighter.set_text(m_buffer.text());
+  } else {
+    m_syntax_highlighter.edit(edit);
+  }
+}
+
+// The edit as an LSP change: the range covers the removed text in the
+// document before the edit, in UTF-16 columns.
+lsp::TextDocumentContentChangeEvent Core::lsp_change(const Edit &edit, size_t start_line) const {
+  lsp::LSPPosition start{static_cast<int>(start_line),
+                         static_cast<int>(utf16_length(m_buffer.text_range(m_buffer.line_start(start_line), edit.offset)))};
+  lsp::LSPPosition end = start;
+  size_t last_newline = edit.removed.rfind('\n');
+  if (last_newline == std::string::npos) {
+    end.character += static_cast<int>(utf16_length(edit.removed));
+  } else {
+    end.line += static_cast<int>(std::count(edit.removed.begin(), edit.removed.end(), '\n'));
+    end.character = static_cast<int>(utf16_length(std::string_view(edit.removed).substr(last_newline + 1)));
+  }
+  lsp::TextDocumentContentChangeEvent change;
+  change.range = lsp::LSPRange{start, end};
+  change.text = edit.inserted;
+  return change;
+}
+
+// Byte offset of an LSP position (UTF-16 column) in the current buffer.
+size_t Core::lsp_offset(const lsp::LSPPosition &position) const {
+  if (position.line < 0) {
+    return 0;
+  }
+  size_t line = static_cast<size_t>(position.line);
+  if (line >= m_buffer.line_count()) {
+    return m_buffer.size();
+  }
+  size_t start = m_buffer.line_start(line);
+  std::string text = m_buffer.line_text(line);
+  size_t column = 0;
+  int units = 0;
+  while (column < text.size() && units < position.character && text[column] != '\n') {
+    unsigned char c = static_cast<unsigned char>(text[column]);
+    size_t length = c < 0x80 ? 1 : c < 0xE0 ? 2 : c < 0xF0 ? 3 : 4;
+    units += length == 4 ? 2 : 1;
+    column += length;
+  }
+  return start + std::min(column, text.size());
+}
+
+void Core::set_lsp_diagnostics(const std::vector<lsp::Diagnostic> &diagnostics) {
+  std::vector<Diagnostic> located;
+  located.reserve(diagnostics.size());
+  for (const auto &diagnostic : diagnostics) {
+    Diagnostic entry;
+    entry.start = lsp_offset(diagnostic.range.start);
+    entry.end = std::max(lsp_offset(diagnostic.range.end), entry.start);
+    entry.message = diagnostic.message;
+    entry.source = diagnostic.source;
+    entry.code = diagnostic.code;
+    entry.severity = static_cast<int>(diagnostic.severity);
+    located.push_back(std::move(entry));
+  }
+  m_diagnostics.set(std::move(located));
+}
+
+// Asks for tokens of the whole document, or of the viewport and a margin
+// around it when the server only serves ranges.
+void Core::request_semantic_tokens() {
+  if (!m_lsp_open) {
+    return;
+  }
+  size_t first = m_viewport_first > kSemanticTokensMargin ? m_viewport_first - kSemanticTokensMargin : 0;
+  size_t last = std::min(m_viewport_last + kSemanticTokensMargin, m_buffer.line_count() - 1);
+  std::string uri = m_lsp_uri;
+  bool requested = m_lsp_manager->semanticTokens(
+    uri, static_cast<int>(first), static_cast<int>(last),
+    [this, uri](const lsp::SemanticTokens &tokens, const lsp::ServerCapabilities &legend) {
+      if (uri == m_lsp_uri) {
+        set_lsp_semantic_tokens(tokens, legend);
+      }
+    });
+  if (requested) {
+    m_semantic_stale = false;
+    m_semantic_first = first;
+    m_semantic_last = last;
+  }
+}
+
+void Core::set_lsp_semantic_tokens(const lsp::SemanticTokens &tokens, const lsp::ServerCapabilities &legend) {
+  m_semantic_types = legend.semanticTokenTypes;
+  auto readonly = std::find(legend.semanticTokenModifiers.begin(), legend.semanticTokenModifiers.end(), "readonly");
+  size_t readonly_index = static_cast<size_t>(readonly - legend.semanticTokenModifiers.begin());
+  m_semantic_readonly = readonly_index < 32 ? 1u << readonly_index : 0;
+  if (!tokens.range) {
+    m_semantic_ranged = false;
+    m_semantic_tokens.set(tokens.data, m_buffer);
+    return;
+  }
+  // Range ends are exclusive; one at column 0 leaves out its line
+  size_t first = static_cast<size_t>(std::max(tokens.range->start.line, 0));
+  int end = tokens.range->end.line - (tokens.range->end.character == 0 ? 1 : 0);
+  m_semantic_ranged = true;
+  m_semantic_tokens.set_lines(first, static_cast<size_t>(std::max(end, tokens.range->start.line)), tokens.data,
+                              m_buffer);
+}
+
+void Core::clear_semantic_tokens() {
+  m_semantic_tokens.clear();
+  m_semantic_stale = true;
+  m_semantic_ranged = false;
+}
+
+// The theme's style for a token: "constant" for read-only variables and
+// properties, then the token type's own name, then the capture standard
+// types fall back to. Tokens the theme has no style for keep the syntax
+// highlighting under them.
+const RenderStyle *Core::semantic_style(const SemanticToken &token) const {
+  if (token.type >= m_semantic_types.size()) {
+    return nullptr;
+  }
+  const std::string &type = m_semantic_types[token.type];
+  const SyntaxTheme &theme = m_syntax_highlighter.theme();
+  if ((token.modifiers & m_semantic_readonly) && (type == "variable" || type == "property")) {
+    if (const RenderStyle *style = theme.find_style("constant")) {
+      return style;
+    }
+  }
+  if (const RenderStyle *style = theme.find_style(type)) {
+    return style;
+  }
+  const char *fallback = semantic_fallback_capture(type);
+  return fallback ? theme.find_style(fallback) : nullptr;
+}
+
+// Lays the semantic tokens in bytes [start, end) over `spans`, cutting the
+// syntax runs they cover. Both are sorted and non-overlapping, so the runs
+// are split in one pass.
+void Core::overlay_semantic_tokens(size_t start, size_t end, std::vector<RenderSpan> &spans) const {
+  if (m_semantic_tokens.empty() || start >= end) {
+    return;
+  }
+  std::vector<RenderSpan> semantic;
+  size_t last_line = m_buffer.line_at(end - 1);
+  for (size_t line = m_buffer.line_at(start); line <= last_line; ++line) {
+    size_t line_start = m_buffer.line_start(line);
+    for (const SemanticToken &token : m_semantic_tokens.line(line)) {
+      size_t token_start = std::max(line_start + token.column, start);
+      size_t token_end = std::min(line_start + token.column + token.length, end);
+      const RenderStyle *style = token_start < token_end ? semantic_style(token) : nullptr;
+      if (!style) {
+        continue;
+      }
+      RenderSpan span;
+      span.range.start.column = static_cast<uint32_t>(token_start - start);
+      span.range.end.column = static_cast<uint32_t>(token_end - start);
+      span.style = *style;
+      semantic.push_back(span);
+    }
+  }
+  if (semantic.empty()) {
+    return;
+  }
+
+  std::vector<RenderSpan> merged;
+  merged.reserve(spans.size() + semantic.size() * 2);
+  size_t next = 0;
+  for (const RenderSpan &run : spans) {
+    uint32_t from = run.range.start.column;
+    uint32_t to = run.range.end.column;
+    while (next < semantic.size() && semantic[next].range.end.column <= from) {
+      ++next;
+    }
+    for (size_t i = next; i < semantic.size() && semantic[i].range.start.column < to; ++i) {
+      if (semantic[i].range.start.column > from) {
+        RenderSpan piece = run;
+        piece.range.start.column = from;
+        piece.range.end.column = semantic[i].range.start.column;
+        merged.push_back(piece);
+      }
+      from = std::max(from, semantic[i].range.end.column);
+    }
+    if (from < to) {
+      RenderSpan piece = run;
+      piece.range.start.column = from;
+      merged.push_back(piece);
+    }
+  }
+  merged.insert(merged.end(), semantic.begin(), semantic.end());
+  std::sort(merged.begin(), merged.end(), [](const RenderSpan &a, const RenderSpan &b) {
+    return a.range.start.column < b.range.start.column;
+  });
+  spans.swap(merged);
+}
+
+void Core::update_large_file_status() {
+  m_large_file = evaluate_large_file(m_buffer.size(), m_buffer.is_mapped(), m_large_file_thresholds);
+}
+
+// Edits before the window shift it, edits inside it are applied to the
+// window's parse incrementally and edits straddling its start drop it.
+void Core::edit_highlight_window(const Edit &edit) {
+  if (!m_highlight_window_valid) {
+    return;
+  }
+  size_t removed_end = edit.offset + edit.removed.size();
+  if (edit.offset < m_highlight_start) {
+    if (removed_end <= m_highlight_start) {
+      m_highlight_start = m_highlight_start - edit.removed.size() + edit.inserted.size();
+      m_highlight_end = m_highlight_end - edit.removed.size() + edit.inserted.size();
+    } else {
+      m_highlight_window_valid = false;
+    }
+    return;
+  }
+  if (edit.offset > m_highlight_end) {
+    return;
+  }
+  if (removed_end > m_highlight_end) {
+    m_highlight_window_valid = false;
+    return;
+  }
+  Edit window_edit = edit;
+  window_edit.offset = edit.offset - m_highlight_start;
+  m_highlight_end = m_highlight_end - edit.removed.size() + edit.inserted.size();
+  m_syntax_highlighter.edit(window_edit);
 }
 
 size_t Core::delete_backward(size_t offset) {
@@ -143,6 +376,127 @@ size_t Core::delete_backward(size_t offset) {
 
 void Core::set_text(std::string text) {
   m_buffer = TextBuffer(std::move(text));
+  if (m_lsp_open) {
+    m_lsp_manager->didReplace(m_lsp_uri);
+  }
+  m_folds.unfold_all();
+  m_diagnostics.clear();
+  clear_semantic_tokens();
+  m_selection_history.clear();
+  update_large_file_status();
+  m_highlight_window_valid = false;
+  m_syntax_highlighter.set_text(m_large_file.highlight_viewport_only ? std::string() : m_buffer.text());
+}
+
+bool Core::load_file(const std::string &path) {
+  TextBuffer loaded;
+  if (!loaded.load_file(path, m_large_file_thresholds.map_size)) {
+    std::cerr << "[Core] ERROR: Failed to load " << path << std::endl;
+    return false;
+  }
+  m_buffer = std::move(loaded);
+  if (m_lsp_open) {
+    m_lsp_manager->didReplace(m_lsp_uri);
+  }
+  m_undo.clear();
+  m_folds.unfold_all();
+  m_diagnostics.clear();
+  clear_semantic_tokens();
+  m_selection_history.clear();
+  update_large_file_status();
+  m_highlight_window_valid = false;
+  m_syntax_highlighter.set_text(m_large_file.highlight_viewport_only ? std::string() : m_buffer.text());
+  if (m_large_file.large_file) {
+    std::cerr << "[Core] " << path << ": " << m_large_file.summary() << std::endl;
+  }
+  return true;
+}
+
+void Core::set_large_file_thresholds(const LargeFileThresholds &thresholds) {
+  m_large_file_thresholds = thresholds;
+  bool was_viewport_only = m_large_file.highlight_viewport_only;
+  update_large_file_status();
+  if (was_viewport_only != m_large_file.highlight_viewport_only) {
+    m_highlight_window_valid = false;
+    m_syntax_highlighter.set_text(m_large_file.highlight_viewport_only ? std::string() : m_buffer.text());
+  }
+}
+
+const LargeFileStatus &Core::large_file_status() const {
+  return m_large_file;
+}
+
+void Core::set_viewport(size_t first_line, size_t last_line) {
+  m_viewport_first = first_line;
+  m_viewport_last = last_line;
+  if (m_semantic_stale || (m_semantic_ranged && (first_line < m_semantic_first || last_line > m_semantic_last))) {
+    request_semantic_tokens();
+  }
+  if (!m_large_file.highlight_viewport_only) {
+    return;
+  }
+  size_t lines = m_buffer.line_count();
+  last_line = std::min(last_line, lines - 1);
+  first_line = std::min(first_line, last_line);
+  auto line_end = [&](size_t line) {
+    return line + 1 < lines ? m_buffer.line_start(line + 1) : m_buffer.size();
+  };
+
+  size_t visible_start = m_buffer.line_start(first_line);
+  size_t visible_end = std::min(line_end(last_line), visible_start + kHighlightWindowBytes / 2);
+  if (m_highlight_window_valid && visible_start >= m_highlight_start && visible_end <= m_highlight_end) {
+    return;
+  }
+
+  size_t window_start = m_buffer.line_start(first_line > kHighlightWindowMargin ? first_line - kHighlightWindowMargin : 0);
+  size_t window_end = line_end(std::min(lines - 1, last_line + kHighlightWindowMargin));
+  if (window_end - window_start > kHighlightWindowBytes) {
+    window_start = std::max(window_start, visible_start - std::min(visible_start, kHighlightWindowBytes / 4));
+    window_end = std::min(window_end, window_start + kHighlightWindowBytes);
+  }
+  m_highlight_start = window_start;
+  m_highlight_end = window_end;
+  m_highlight_window_valid = true;
+  m_syntax_highlighter.set_text(m_buffer.text_range(window_start, window_end));
+}
+
+std::vector<RenderSpan> Core::highlight_spans(size_t start, size_t end) const {
+  if (!m_large_file.highlight_viewport_only) {
+    std::vector<RenderSpan> spans = m_syntax_highlighter.runs().slice(start, end);
+    overlay_semantic_tokens(start, end, spans);
+    return spans;
+  }
+  size_t clipped_start = std::max(start, m_highlight_start);
+  size_t clipped_end = std::min(end, m_highlight_end);
+  if (!m_highlight_window_valid || clipped_start >= clipped_end) {
+    return {};
+  }
+  std::vector<RenderSpan> spans =
+    m_syntax_highlighter.runs().slice(clipped_start - m_highlight_start, clipped_end - m_highlight_start);
+  uint32_t shift = static_cast<uint32_t>(clipped_start - start);
+  for (auto &span : spans) {
+    span.range.start.column += shift;
+    span.range.end.column += shift;
+  }
+  overlay_semantic_tokens(start, end, spans);
+  return spans;
+}
+
+const SemanticTokenStore &Core::semantic_tokens() const {
+  return m_semantic_tokens;
+}
+
+// Translates a buffer range into the highlight window, if it lies inside it.
+bool Core::to_highlight_window(size_t &start, size_t &end) const {
+  if (!m_large_file.highlight_viewport_only) {
+    return true;
+  }
+  if (!m_highlight_window_valid || start < m_highlight_start || end > m_highlight_end) {
+    return false;
+  }
+  start -= m_highlight_start;
+  end -= m_highlight_start;
+  return true;
 }
 
 size_t Core::line_count() const {
@@ -165,6 +519,82 @@ size_t Core::offset_at(const Position &pos) const {
   return m_buffer.offset_at(pos);
 }
 
+const std::vector<FoldRange> &Core::fold_ranges() const {
+  static const std::vector<FoldRange> none;
+  return m_large_file.highlight_viewport_only ? none : m_syntax_highlighter.fold_ranges();
+}
+
+bool Core::toggle_fold(size_t line_index) {
+  if (m_folds.unfold(line_index)) {
+    return true;
+  }
+  const std::vector<FoldRange> &ranges = fold_ranges();
+  auto it = std::lower_bound(ranges.begin(), ranges.end(), line_index,
+                             [](const FoldRange &range, size_t line) { return range.start_line < line; });
+  if (it == ranges.end() || it->start_line != line_index) {
+    return false;
+  }
+  return m_folds.fold(*it);
+}
+
+bool Core::expand_selection(size_t &start, size_t &end) {
+  std::pair<size_t, size_t> current{start, end};
+  if (!m_selection_history.empty() && current != m_expanded_selection) {
+    m_selection_history.clear();
+  }
+  size_t window_start = start;
+  size_t window_end = end;
+  if (!to_highlight_window(window_start, window_end) ||
+      !m_syntax_highlighter.expand_selection(window_start, window_end)) {
+    return false;
+  }
+  size_t base = m_large_file.highlight_viewport_only ? m_highlight_start : 0;
+  start = window_start + base;
+  end = window_end + base;
+  m_selection_history.push_back(current);
+  m_expanded_selection = {start, end};
+  return true;
+}
+
+bool Core::shrink_selection(size_t &start, size_t &end) {
+  if (!m_selection_history.empty() && std::make_pair(start, end) == m_expanded_selection) {
+    std::tie(start, end) = m_selection_history.back();
+    m_selection_history.pop_back();
+    m_expanded_selection = {start, end};
+    return true;
+  }
+  m_selection_history.clear();
+  size_t window_start = start;
+  size_t window_end = end;
+  if (!to_highlight_window(window_start, window_end) ||
+      !m_syntax_highlighter.shrink_selection(window_start, window_end)) {
+    return false;
+  }
+  size_t base = m_large_file.highlight_viewport_only ? m_highlight_start : 0;
+  start = window_start + base;
+  end = window_end + base;
+  return true;
+}
+
+bool Core::matching_bracket(size_t offset, size_t &match) const {
+  size_t window_offset = offset;
+  size_t window_end = offset;
+  if (!to_highlight_window(window_offset, window_end) ||
+      !m_syntax_highlighter.matching_bracket(window_offset, match)) {
+    return false;
+  }
+  match += m_large_file.highlight_viewport_only ? m_highlight_start : 0;
+  return true;
+}
+
+FoldMap &Core::fold_map() {
+  return m_folds;
+}
+
+const FoldMap &Core::fold_map() const {
+  return m_folds;
+}
+
 lsp::LSPManager &Core::lsp_manager() {
   return *m_lsp_manager;
 }
@@ -182,20 +612,114 @@ const TreeSitterHighlighter &Core::syntax_highlighter() const {
 }
 
 void Core::open_file(const std::string& uri, const std::string& language_id) {
-  std::string text = m_buffer.text();
-  m_lsp_manager->didOpen(uri, language_id, text);
+  m_lsp_uri = uri;
+  m_diagnostics.clear();
+  clear_semantic_tokens();
+  m_lsp_language_id = language_id;
+  m_lsp_open = false;
+  if (!m_large_file.lsp_sync) {
+    std::cerr << "[LSP] Not syncing large file: " << uri << std::endl;
+    return;
+  }
+  m_lsp_manager->didOpen(uri, language_id, m_buffer);
+  m_lsp_open = true;
+}
+
+void Core::change_file(const std::string& uri) {
+  if (uri != m_lsp_uri) {
+    return;
+  }
+  if (!m_large_file.lsp_sync) {
+    if (m_lsp_open) {
+      std::cerr << "[LSP] Document grew past the sync limit, closing: " << uri << std::endl;
+      m_lsp_manager->didClose(uri);
+      m_lsp_open = false;
+    }
+    return;
+  }
+  // Edits to an open document were already queued by apply_edit()
+  if (!m_lsp_open) {
+    m_lsp_manager->didOpen(uri, m_lsp_language_id, m_buffer);
+    m_lsp_open = true;
+    m_semantic_stale = true;
+  }
 }
 
 void Core::close_file(const std::string& uri) {
+  if (uri == m_lsp_uri) {
+    if (m_lsp_open) {
+      m_lsp_manager->didClose(uri);
+    }
+    m_lsp_uri.clear();
+    m_diagnostics.clear();
+    clear_semantic_tokens();
+    m_lsp_open = false;
+    return;
+  }
   m_lsp_manager->didClose(uri);
 }
 
 void Core::save_file(const std::string& uri) {
   m_lsp_manager->didSave(uri);
+  if (m_symbol_index && uri.starts_with("file://")) {
+    m_symbol_index->update_file(uri.substr(7));
+  }
+}
+
+const DiagnosticStore &Core::diagnostics() const {
+  return m_diagnostics;
+}
+
+std::vector<Diagnostic> Core::diagnostics_in_lines(size_t first_line, size_t last_line) const {
+  if (m_diagnostics.empty() || first_line >= m_buffer.line_count()) {
+    return {};
+  }
+  size_t start = m_buffer.line_start(first_line);
+  size_t end = last_line + 1 < m_buffer.line_count() ? m_buffer.line_start(last_line + 1) : m_buffer.size() + 1;
+  return m_diagnostics.in_range(start, end);
+}
+
+void Core::index_workspace(const std::string& root_path) {
+  m_symbol_index = SymbolIndex::shared(root_path);
+}
+
+std::vector<WorkspaceSymbol> Core::find_symbols(std::string_view query, size_t limit) const {
+  if (!m_symbol_index) {
+    return {};
+  }
+  return m_symbol_index->query(query, limit);
+}
+
+std::shared_ptr<SymbolIndex> Core::symbol_index() const {
+  return m_symbol_index;
 }
 
 void Core::tick() {
   m_lsp_manager->processMessages();
+  // Servers that were still starting when the document changed
+  if (m_semantic_stale) {
+    request_semantic_tokens();
+  }
+}
+
+int Core::lsp_wakeup_fd() const {
+  return m_lsp_manager->wakeupFd();
+}
+
+int Core::next_tick_ms() const {
+  std::optional<std::chrono::steady_clock::time_point> deadline = m_lsp_manager->nextDeadline();
+  if (!deadline) {
+    return -1;
+  }
+  auto now = std::chrono::steady_clock::now();
+  if (*deadline <= now) {
+    return 0;
+  }
+  return static_cast<int>(std::chrono::ceil<std::chrono::milliseconds>(*deadline - now).count());
+}
+
+std::string Core::lsp_stats_json() const {
+  return m_lsp_manager->metricsJSON();
 }
 
 } // namespace prodigeetor
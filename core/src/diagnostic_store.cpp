@@ -0,0 +1,259 @@
+#include "diagnostic_store.h"
+
+#include <algorithm>
+
+namespace prodigeetor {
+
+void DiagnosticStore::set(std::vector<Diagnostic> diagnostics) {
+  std::stable_sort(diagnostics.begin(), diagnostics.end(), [](const Diagnostic &a, const Diagnostic &b) {
+    return a.start < b.start;
+  });
+  m_diagnostics = std::move(diagnostics);
+  m_counts.fill(0);
+  for (auto &diagnostic : m_diagnostics) {
+    diagnostic.end = std::max(diagnostic.end, diagnostic.start);
+    ++m_counts[diagnostic.severity >= 1 && diagnostic.severity <= 4 ? diagnostic.severity : 0];
+  }
+
+  size_t nodes = m_diagnostics.empty() ? 0 : 4 * m_diagnostics.size();
+  m_max_start.assign(nodes, 0);
+  m_max_end.assign(nodes, 0);
+  m_min_severity.assign(nodes, 0);
+  m_shift.assign(nodes, 0);
+  if (!m_diagnostics.empty()) {
+    build(1, 0, m_diagnostics.size());
+  }
+}
+
+void DiagnosticStore::clear() {
+  set({});
+}
+
+size_t DiagnosticStore::count(int severity) const {
+  return severity >= 1 && severity <= 4 ? m_counts[static_cast<size_t>(severity)] : 0;
+}
+
+void DiagnosticStore::build(size_t node, size_t low, size_t high) {
+  if (high - low == 1) {
+    const Diagnostic &diagnostic = m_diagnostics[low];
+    m_max_start[node] = static_cast<int64_t>(diagnostic.start);
+    m_max_end[node] = static_cast<int64_t>(diagnostic.end);
+    m_min_severity[node] = diagnostic.severity;
+    return;
+  }
+  size_t middle = low + (high - low) / 2;
+  build(2 * node, low, middle);
+  build(2 * node + 1, middle, high);
+  m_min_severity[node] = std::min(m_min_severity[2 * node], m_min_severity[2 * node + 1]);
+  pull(node);
+}
+
+// Aggregates of a node with no pending shift
+void DiagnosticStore::pull(size_t node) {
+  m_max_start[node] = std::max(m_max_start[2 * node], m_max_start[2 * node + 1]);
+  m_max_end[node] = std::max(m_max_end[2 * node], m_max_end[2 * node + 1]);
+}
+
+void DiagnosticStore::push(size_t node) {
+  int64_t delta = m_shift[node];
+  if (delta == 0) {
+    return;
+  }
+  for (size_t child : {2 * node, 2 * node + 1}) {
+    m_max_start[child] += delta;
+    m_max_end[child] += delta;
+    m_shift[child] += delta;
+  }
+  m_shift[node] = 0;
+}
+
+// Adds delta to the offsets of diagnostics [from, size())
+void DiagnosticStore::shift(size_t node, size_t low, size_t high, size_t from, int64_t delta) {
+  if (high <= from) {
+    return;
+  }
+  if (low >= from) {
+    m_max_start[node] += delta;
+    m_max_end[node] += delta;
+    m_shift[node] += delta;
+    return;
+  }
+  push(node);
+  size_t middle = low + (high - low) / 2;
+  shift(2 * node, low, middle, from, delta);
+  shift(2 * node + 1, middle, high, from, delta);
+  pull(node);
+}
+
+void DiagnosticStore::set_range(size_t node, size_t low, size_t high, size_t index, int64_t start, int64_t end) {
+  if (high - low == 1) {
+    m_max_start[node] = start;
+    m_max_end[node] = end;
+    m_shift[node] = 0;
+    return;
+  }
+  push(node);
+  size_t middle = low + (high - low) / 2;
+  if (index < middle) {
+    set_range(2 * node, low, middle, index, start, end);
+  } else {
+    set_range(2 * node + 1, middle, high, index, start, end);
+  }
+  pull(node);
+}
+
+size_t DiagnosticStore::lower_bound(int64_t offset) const {
+  size_t size = m_diagnostics.size();
+  if (size == 0 || m_max_start[1] < offset) {
+    return size;
+  }
+  // Starts are sorted, so a subtree's largest start is its last one
+  size_t node = 1;
+  size_t low = 0;
+  size_t high = size;
+  int64_t shift = 0;
+  while (high - low > 1) {
+    shift += m_shift[node];
+    size_t middle = low + (high - low) / 2;
+    if (m_max_start[2 * node] + shift >= offset) {
+      node = 2 * node;
+      high = middle;
+    } else {
+      node = 2 * node + 1;
+      low = middle;
+    }
+  }
+  return low;
+}
+
+// Indices below `limit` of diagnostics that end after `start` or begin at or
+// after it; with limit = lower_bound(end) these overlap [start, end).
+void DiagnosticStore::collect(size_t node, size_t low, size_t high, size_t limit, int64_t start, int64_t shift,
+                              std::vector<size_t> &indices) const {
+  if (low >= limit || (m_max_end[node] + shift <= start && m_max_start[node] + shift < start)) {
+    return;
+  }
+  if (high - low == 1) {
+    indices.push_back(low);
+    return;
+  }
+  shift += m_shift[node];
+  size_t middle = low + (high - low) / 2;
+  collect(2 * node, low, middle, limit, start, shift, indices);
+  collect(2 * node + 1, middle, high, limit, start, shift, indices);
+}
+
+size_t DiagnosticStore::first_at_least(size_t node, size_t low, size_t high, size_t from, int max_severity) const {
+  if (high <= from || m_min_severity[node] > max_severity) {
+    return m_diagnostics.size();
+  }
+  if (high - low == 1) {
+    return low;
+  }
+  size_t middle = low + (high - low) / 2;
+  size_t found = first_at_least(2 * node, low, middle, from, max_severity);
+  return found != m_diagnostics.size() ? found : first_at_least(2 * node + 1, middle, high, from, max_severity);
+}
+
+size_t DiagnosticStore::last_below(size_t node, size_t low, size_t high, size_t limit, int max_severity) const {
+  if (low >= limit || m_min_severity[node] > max_severity) {
+    return m_diagnostics.size();
+  }
+  if (high - low == 1) {
+    return low;
+  }
+  size_t middle = low + (high - low) / 2;
+  size_t found = last_below(2 * node + 1, middle, high, limit, max_severity);
+  return found != m_diagnostics.size() ? found : last_below(2 * node, low, middle, limit, max_severity);
+}
+
+Diagnostic DiagnosticStore::resolve(size_t index) const {
+  size_t node = 1;
+  size_t low = 0;
+  size_t high = m_diagnostics.size();
+  int64_t shift = 0;
+  while (high - low > 1) {
+    shift += m_shift[node];
+    size_t middle = low + (high - low) / 2;
+    if (index < middle) {
+      node = 2 * node;
+      high = middle;
+    } else {
+      node = 2 * node + 1;
+      low = middle;
+    }
+  }
+  Diagnostic diagnostic = m_diagnostics[index];
+  diagnostic.start = static_cast<size_t>(m_max_start[node] + shift);
+  diagnostic.end = static_cast<size_t>(m_max_end[node] + shift);
+  return diagnostic;
+}
+
+void DiagnosticStore::apply_edit(size_t offset, size_t removed_length, size_t inserted_length) {
+  size_t size = m_diagnostics.size();
+  if (size == 0) {
+    return;
+  }
+  int64_t edit_start = static_cast<int64_t>(offset);
+  int64_t removed_end = edit_start + static_cast<int64_t>(removed_length);
+  int64_t delta = static_cast<int64_t>(inserted_length) - static_cast<int64_t>(removed_length);
+
+  // Diagnostics starting at or after the removed text move as a whole
+  size_t first_after = lower_bound(removed_end);
+  std::vector<size_t> touched;
+  collect(1, 0, size, first_after, edit_start, 0, touched);
+  if (delta != 0) {
+    shift(1, 0, size, first_after, delta);
+  }
+
+  // The rest end inside or after the edit, or start inside the removed text
+  for (size_t index : touched) {
+    Diagnostic diagnostic = resolve(index);
+    int64_t start = static_cast<int64_t>(diagnostic.start);
+    int64_t end = static_cast<int64_t>(diagnostic.end);
+    start = std::min(start, edit_start);
+    end = end > removed_end ? end + delta : std::min(end, edit_start);
+    set_range(1, 0, size, index, start, end);
+  }
+}
+
+std::vector<Diagnostic> DiagnosticStore::in_range(size_t start, size_t end) const {
+  std::vector<Diagnostic> found;
+  if (m_diagnostics.empty() || start >= end) {
+    return found;
+  }
+  std::vector<size_t> indices;
+  size_t limit = lower_bound(static_cast<int64_t>(end));
+  collect(1, 0, m_diagnostics.size(), limit, static_cast<int64_t>(start), 0, indices);
+  found.reserve(indices.size());
+  for (size_t index : indices) {
+    found.push_back(resolve(index));
+  }
+  return found;
+}
+
+std::optional<Diagnostic> DiagnosticStore::next(size_t offset, int max_severity) const {
+  size_t size = m_diagnostics.size();
+  if (size == 0) {
+    return std::nullopt;
+  }
+  size_t index = first_at_least(1, 0, size, lower_bound(static_cast<int64_t>(offset) + 1), max_severity);
+  if (index == size) {
+    index = first_at_least(1, 0, size, 0, max_severity);
+  }
+  return index == size ? std::nullopt : std::optional<Diagnostic>(resolve(index));
+}
+
+std::optional<Diagnostic> DiagnosticStore::previous(size_t offset, int max_severity) const {
+  size_t size = m_diagnostics.size();
+  if (size == 0) {
+    return std::nullopt;
+  }
+  size_t index = last_below(1, 0, size, lower_bound(static_cast<int64_t>(offset)), max_severity);
+  if (index == size) {
+    index = last_below(1, 0, size, size, max_severity);
+  }
+  return index == size ? std::nullopt : std::optional<Diagnostic>(resolve(index));
+}
+
+} // namespace prodigeetor
@@ -0,0 +1,351 @@
+#include "directory_watcher.h"
+
+#include <iterator>
+#include <system_error>
+
+#ifdef __linux__
+#include <atomic>
+#include <cerrno>
+#include <iostream>
+#include <thread>
+#include <unordered_map>
+
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include "wakeup.h"
+#elif defined(__APPLE__)
+#include <CoreServices/CoreServices.h>
+#include <dispatch/dispatch.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#endif
+
+namespace prodigeetor {
+
+namespace {
+
+// Walks the tree below `directory`, descending into the directories for which
+// `enter` returns true, and appends its regular files to `files` when given.
+template <typename Enter>
+void walk_tree(const std::string &directory, const DirectoryWatcher::SkipDirectory &skip, Enter enter,
+               std::vector<std::string> *files) {
+  std::error_code error;
+  auto options = std::filesystem::directory_options::skip_permission_denied;
+  for (auto it = std::filesystem::recursive_directory_iterator(directory, options, error);
+       !error && it != std::filesystem::recursive_directory_iterator(); it.increment(error)) {
+    if (it->is_symlink(error)) {
+      continue;
+    }
+    if (it->is_directory(error)) {
+      if (skip(it->path()) || !enter(it->path().string())) {
+        it.disable_recursion_pending();
+      }
+    } else if (files && it->is_regular_file(error)) {
+      files->push_back(it->path().string());
+    }
+  }
+}
+
+} // namespace
+
+#ifdef __linux__
+
+namespace {
+
+constexpr uint32_t kWatchMask =
+    IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR | IN_DONT_FOLLOW | IN_EXCL_UNLINK;
+
+} // namespace
+
+// One inotify watch per directory. inotify only reports the direct children
+// of a watched directory, so directories created or moved in get watches of
+// their own as they appear.
+struct DirectoryWatcher::Impl {
+  SkipDirectory skip;
+  Callback callback;
+  int fd = -1;
+  Wakeup wakeup;
+  std::atomic<bool> stopping{false};
+  std::thread thread;
+  std::unordered_map<int, std::string> directories; // watch descriptor -> absolute path
+  bool out_of_watches = false;
+
+  ~Impl() {
+    if (fd >= 0) {
+      close(fd);
+    }
+  }
+
+  bool start(const std::string &root) {
+    fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0 || !add_watch(root)) {
+      return false;
+    }
+    walk_tree(root, skip, [this](const std::string &directory) { return add_watch(directory); }, nullptr);
+    if (out_of_watches) {
+      return false;
+    }
+    thread = std::thread([this]() { run(); });
+    return true;
+  }
+
+  void stop() {
+    stopping = true;
+    wakeup.signal();
+    if (thread.joinable()) {
+      thread.join();
+    }
+  }
+
+  bool add_watch(const std::string &directory) {
+    int wd = inotify_add_watch(fd, directory.c_str(), kWatchMask);
+    if (wd < 0) {
+      if (errno == ENOSPC && !out_of_watches) {
+        out_of_watches = true;
+        std::cerr << "[DirectoryWatcher] Out of inotify watches at " << directory
+                  << " (raise fs.inotify.max_user_watches)" << std::endl;
+      }
+      return false;
+    }
+    directories[wd] = directory;
+    return true;
+  }
+
+  // Watches a directory created or moved in, and lists the files it already
+  // holds: they may have been written before the watch was in place.
+  void add_tree(const std::string &directory, std::vector<std::string> &files) {
+    if (add_watch(directory)) {
+      walk_tree(directory, skip, [this](const std::string &path) { return add_watch(path); }, &files);
+    }
+  }
+
+  // Drops the watches of a directory moved away: they would keep reporting
+  // its files under the old path.
+  void remove_tree(const std::string &directory) {
+    for (auto it = directories.begin(); it != directories.end();) {
+      const std::string &path = it->second;
+      if (path.compare(0, directory.size(), directory) == 0 &&
+          (path.size() == directory.size() || path[directory.size()] == '/')) {
+        inotify_rm_watch(fd, it->first);
+        it = directories.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
+
+  void handle(const inotify_event &event, std::vector<std::string> &paths, bool &overflowed) {
+    if (event.mask & IN_Q_OVERFLOW) {
+      overflowed = true;
+      return;
+    }
+    auto it = directories.find(event.wd);
+    if (it == directories.end()) {
+      return;
+    }
+    if (event.mask & IN_IGNORED) {
+      directories.erase(it);
+      return;
+    }
+    if (event.len == 0) {
+      return;
+    }
+    std::string path = it->second + "/" + event.name;
+    if (!(event.mask & IN_ISDIR)) {
+      if (!(event.mask & IN_CREATE)) {
+        paths.push_back(std::move(path)); // a created file is reported once written
+      }
+      return;
+    }
+    if (skip(path)) {
+      return;
+    }
+    if (event.mask & (IN_CREATE | IN_MOVED_TO)) {
+      add_tree(path, paths);
+    } else if (event.mask & IN_MOVED_FROM) {
+      remove_tree(path);
+      paths.push_back(path + "/");
+    }
+    // A deleted directory's files were reported as they were deleted.
+  }
+
+  void run() {
+    alignas(inotify_event) char buffer[64 * 1024];
+    pollfd fds[2] = {{fd, POLLIN, 0}, {wakeup.fd(), POLLIN, 0}};
+    while (!stopping) {
+      if (poll(fds, 2, -1) < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        return;
+      }
+      if (stopping) {
+        return;
+      }
+      std::vector<std::string> paths;
+      bool overflowed = false;
+      ssize_t length;
+      while ((length = read(fd, buffer, sizeof(buffer))) > 0) {
+        for (char *next = buffer; next < buffer + length;) {
+          const auto *event = reinterpret_cast<const inotify_event *>(next);
+          next += sizeof(inotify_event) + event->len;
+          handle(*event, paths, overflowed);
+        }
+      }
+      if (!paths.empty() || overflowed) {
+        callback(std::move(paths), overflowed);
+      }
+    }
+  }
+};
+
+#elif defined(__APPLE__)
+
+// One FSEvents stream for the whole tree, with file-level events delivered on
+// a private serial queue.
+struct DirectoryWatcher::Impl {
+  SkipDirectory skip;
+  Callback callback;
+  std::string root;
+  std::string real_root; // FSEvents reports resolved paths
+  FSEventStreamRef stream = nullptr;
+  dispatch_queue_t queue = nullptr;
+
+  bool start(const std::string &root_path) {
+    root = root_path;
+    char resolved[PATH_MAX];
+    real_root = realpath(root.c_str(), resolved) ? resolved : root;
+
+    CFStringRef path = CFStringCreateWithCString(nullptr, real_root.c_str(), kCFStringEncodingUTF8);
+    CFArrayRef watched = CFArrayCreate(nullptr, reinterpret_cast<const void **>(&path), 1, &kCFTypeArrayCallBacks);
+    FSEventStreamContext context{0, this, nullptr, nullptr, nullptr};
+    stream = FSEventStreamCreate(nullptr, &Impl::on_events, &context, watched, kFSEventStreamEventIdSinceNow, 0.1,
+                                 kFSEventStreamCreateFlagFileEvents | kFSEventStreamCreateFlagNoDefer);
+    CFRelease(watched);
+    CFRelease(path);
+    if (!stream) {
+      return false;
+    }
+    queue = dispatch_queue_create("prodigeetor.directory-watcher", DISPATCH_QUEUE_SERIAL);
+    FSEventStreamSetDispatchQueue(stream, queue);
+    if (!FSEventStreamStart(stream)) {
+      stop();
+      return false;
+    }
+    return true;
+  }
+
+  void stop() {
+    if (stream) {
+      FSEventStreamStop(stream);
+      FSEventStreamInvalidate(stream);
+      FSEventStreamRelease(stream);
+      stream = nullptr;
+    }
+    if (queue) {
+      // Waits out a callback already running on the queue.
+      dispatch_sync_f(queue, nullptr, [](void *) {});
+      dispatch_release(queue);
+      queue = nullptr;
+    }
+  }
+
+  static void on_events(ConstFSEventStreamRef, void *info, size_t count, void *event_paths,
+                        const FSEventStreamEventFlags flags[], const FSEventStreamEventId[]) {
+    static_cast<Impl *>(info)->handle(count, static_cast<char **>(event_paths), flags);
+  }
+
+  // Whether a directory between the root and `path` is skipped, or `path`
+  // itself when it is a directory.
+  bool skipped(const std::string &path, bool directory) const {
+    std::filesystem::path relative = std::filesystem::path(path).lexically_relative(root);
+    std::filesystem::path current = root;
+    for (auto it = relative.begin(); it != relative.end(); ++it) {
+      current /= *it;
+      if ((directory || std::next(it) != relative.end()) && skip(current)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void handle(size_t count, char **event_paths, const FSEventStreamEventFlags flags[]) {
+    constexpr FSEventStreamEventFlags kDropped = kFSEventStreamEventFlagMustScanSubDirs |
+                                                 kFSEventStreamEventFlagUserDropped |
+                                                 kFSEventStreamEventFlagKernelDropped;
+    std::vector<std::string> paths;
+    bool overflowed = false;
+    for (size_t i = 0; i < count; ++i) {
+      if (flags[i] & kDropped) {
+        overflowed = true;
+        continue;
+      }
+      std::string path = event_paths[i];
+      if (path.compare(0, real_root.size(), real_root) != 0) {
+        continue;
+      }
+      path = root + path.substr(real_root.size());
+      bool directory = flags[i] & kFSEventStreamEventFlagItemIsDir;
+      if (path == root || skipped(path, directory)) {
+        continue;
+      }
+      if (!directory) {
+        paths.push_back(std::move(path));
+        continue;
+      }
+      struct stat info;
+      if (lstat(path.c_str(), &info) != 0 || !S_ISDIR(info.st_mode)) {
+        paths.push_back(path + "/");
+      } else if (flags[i] & (kFSEventStreamEventFlagItemCreated | kFSEventStreamEventFlagItemRenamed)) {
+        // Files moved in with their directory get no events of their own.
+        walk_tree(path, skip, [](const std::string &) { return true; }, &paths);
+      }
+    }
+    if (!paths.empty() || overflowed) {
+      callback(std::move(paths), overflowed);
+    }
+  }
+};
+
+#else
+
+struct DirectoryWatcher::Impl {
+  SkipDirectory skip;
+  Callback callback;
+
+  bool start(const std::string &) { return false; }
+  void stop() {}
+};
+
+#endif
+
+DirectoryWatcher::DirectoryWatcher() = default;
+
+DirectoryWatcher::~DirectoryWatcher() {
+  stop();
+}
+
+bool DirectoryWatcher::start(const std::string &root, SkipDirectory skip, Callback callback) {
+  stop();
+  m_impl = std::make_unique<Impl>();
+  m_impl->skip = std::move(skip);
+  m_impl->callback = std::move(callback);
+  if (!m_impl->start(root)) {
+    m_impl->stop();
+    m_impl.reset();
+    return false;
+  }
+  return true;
+}
+
+void DirectoryWatcher::stop() {
+  if (m_impl) {
+    m_impl->stop();
+    m_impl.reset();
+  }
+}
+
+} // namespace prodigeetor
@@ -0,0 +1,127 @@
+#include "fold_map.h"
+
+#include <algorithm>
+
+namespace prodigeetor {
+
+bool FoldMap::fold(const FoldRange &range) {
+  if (range.end_line <= range.start_line) {
+    return false;
+  }
+  auto first = std::lower_bound(m_folded.begin(), m_folded.end(), range.start_line,
+                                [](const FoldRange &fold, uint32_t line) { return fold.start_line < line; });
+  if (first != m_folded.begin()) {
+    auto previous = std::prev(first);
+    if (previous->end_line >= range.start_line) {
+      return false;
+    }
+  }
+  if (first != m_folded.end() && first->start_line == range.start_line && first->end_line >= range.end_line) {
+    return false;
+  }
+  auto last = first;
+  while (last != m_folded.end() && last->start_line <= range.end_line) {
+    ++last;
+  }
+  first = m_folded.erase(first, last);
+  m_folded.insert(first, range);
+  rebuild_index();
+  return true;
+}
+
+bool FoldMap::unfold(size_t buffer_line) {
+  auto it = std::upper_bound(m_folded.begin(), m_folded.end(), buffer_line,
+                             [](size_t line, const FoldRange &fold) { return line < fold.start_line; });
+  if (it == m_folded.begin()) {
+    return false;
+  }
+  --it;
+  if (buffer_line > it->end_line) {
+    return false;
+  }
+  m_folded.erase(it);
+  rebuild_index();
+  return true;
+}
+
+void FoldMap::unfold_all() {
+  m_folded.clear();
+  m_hidden_before.clear();
+}
+
+bool FoldMap::is_folded(size_t buffer_line) const {
+  auto it = std::lower_bound(m_folded.begin(), m_folded.end(), buffer_line,
+                             [](const FoldRange &fold, size_t line) { return fold.start_line < line; });
+  return it != m_folded.end() && it->start_line == buffer_line;
+}
+
+const std::vector<FoldRange> &FoldMap::folded() const {
+  return m_folded;
+}
+
+void FoldMap::apply_edit(size_t start_line, size_t old_end_line, size_t new_end_line) {
+  if (m_folded.empty()) {
+    return;
+  }
+  bool changed = false;
+  for (auto it = m_folded.begin(); it != m_folded.end();) {
+    // Splitting or joining the header line also moves the hidden lines.
+    bool touches_hidden = start_line <= it->end_line &&
+                          (old_end_line > it->start_line ||
+                           (start_line == it->start_line && new_end_line != old_end_line));
+    if (touches_hidden) {
+      it = m_folded.erase(it);
+      changed = true;
+      continue;
+    }
+    if (it->start_line > old_end_line && new_end_line != old_end_line) {
+      it->start_line = static_cast<uint32_t>(it->start_line - old_end_line + new_end_line);
+      it->end_line = static_cast<uint32_t>(it->end_line - old_end_line + new_end_line);
+      changed = true;
+    }
+    ++it;
+  }
+  if (changed) {
+    rebuild_index();
+  }
+}
+
+size_t FoldMap::visible_line_count(size_t buffer_line_count) const {
+  size_t hidden = m_hidden_before.empty() ? 0 : m_hidden_before.back();
+  return buffer_line_count > hidden ? buffer_line_count - hidden : 0;
+}
+
+size_t FoldMap::buffer_line(size_t visible_line) const {
+  // Fold i's header sits at visible line start_line - m_hidden_before[i].
+  size_t low = 0;
+  size_t high = m_folded.size();
+  while (low < high) {
+    size_t mid = (low + high) / 2;
+    if (m_folded[mid].start_line - m_hidden_before[mid] < visible_line) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return visible_line + (low == 0 ? 0 : m_hidden_before[low]);
+}
+
+size_t FoldMap::visible_line(size_t buffer_line) const {
+  auto it = std::lower_bound(m_folded.begin(), m_folded.end(), buffer_line,
+                             [](const FoldRange &fold, size_t line) { return fold.end_line < line; });
+  size_t index = static_cast<size_t>(it - m_folded.begin());
+  if (it != m_folded.end() && it->start_line < buffer_line) {
+    return it->start_line - m_hidden_before[index];
+  }
+  return buffer_line - (index == 0 ? 0 : m_hidden_before[index]);
+}
+
+void FoldMap::rebuild_index() {
+  m_hidden_before.resize(m_folded.size() + 1);
+  m_hidden_before[0] = 0;
+  for (size_t i = 0; i < m_folded.size(); ++i) {
+    m_hidden_before[i + 1] = m_hidden_before[i] + (m_folded[i].end_line - m_folded[i].start_line);
+  }
+}
+
+} // namespace prodigeetor
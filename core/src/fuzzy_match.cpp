@@ -0,0 +1,254 @@
+#include "fuzzy_match.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+namespace prodigeetor {
+
+namespace {
+
+// Candidates up to this length are matched on 64-bit position masks.
+constexpr size_t kMaskedLength = 64;
+
+bool is_word_start(std::string_view name, size_t index) {
+  if (index == 0) {
+    return true;
+  }
+  unsigned char previous = static_cast<unsigned char>(name[index - 1]);
+  unsigned char current = static_cast<unsigned char>(name[index]);
+  if (previous == '_' || previous == '-' || previous == '.' || previous == '$') {
+    return true;
+  }
+  return std::islower(previous) && std::isupper(current);
+}
+
+int score_match(int score, size_t candidate_size, size_t pattern_size) {
+  if (candidate_size == pattern_size) {
+    score += 20;
+  }
+  // Long candidates bottom out at 0 so they still count as matches
+  return std::max(score - static_cast<int>(candidate_size / 4), 0);
+}
+
+int bonus(size_t index, bool word_start, bool consecutive) {
+  int score = 1;
+  if (index == 0) {
+    score += 6;
+  }
+  if (word_start) {
+    score += 8;
+  }
+  if (consecutive) {
+    score += 4;
+  }
+  return score;
+}
+
+// Greedy leftmost match, for candidates too long for the masks.
+int scalar_score(std::string_view name, std::string_view pattern) {
+  int score = 0;
+  size_t matched = 0;
+  size_t last = std::string_view::npos;
+  for (size_t i = 0; i < name.size() && matched < pattern.size(); ++i) {
+    if (std::tolower(static_cast<unsigned char>(name[i])) != pattern[matched]) {
+      continue;
+    }
+    score += bonus(i, is_word_start(name, i), last != std::string_view::npos && last + 1 == i);
+    last = i;
+    ++matched;
+  }
+  if (matched < pattern.size()) {
+    return -1;
+  }
+  return score_match(score, name.size(), pattern.size());
+}
+
+// Lower-cased copy of a candidate of at most 64 bytes, zero padded, with
+// masks of its upper-case letters, lower-case letters and separators.
+struct Block {
+  alignas(16) unsigned char lower[kMaskedLength];
+  uint64_t upper = 0;
+  uint64_t lowercase = 0;
+  uint64_t separator = 0;
+};
+
+#if defined(__ARM_NEON) && defined(__aarch64__)
+uint64_t movemask(uint8x16_t lanes) {
+  static const uint8_t weights[16] = {1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128};
+  uint8x16_t bits = vandq_u8(lanes, vld1q_u8(weights));
+  return static_cast<uint64_t>(vaddv_u8(vget_low_u8(bits))) |
+         (static_cast<uint64_t>(vaddv_u8(vget_high_u8(bits))) << 8);
+}
+#endif
+
+void load_block(Block &block, std::string_view candidate) {
+  std::memset(block.lower, 0, sizeof(block.lower));
+  std::memcpy(block.lower, candidate.data(), candidate.size());
+  size_t blocks = (candidate.size() + 15) / 16;
+#if defined(__SSE2__)
+  for (size_t b = 0; b < blocks; ++b) {
+    __m128i chunk = _mm_load_si128(reinterpret_cast<const __m128i *>(block.lower + b * 16));
+    // Unsigned c - base < 26 is min(c - base, 25) == c - base
+    __m128i from_upper = _mm_sub_epi8(chunk, _mm_set1_epi8('A'));
+    __m128i upper = _mm_cmpeq_epi8(_mm_min_epu8(from_upper, _mm_set1_epi8(25)), from_upper);
+    __m128i from_lower = _mm_sub_epi8(chunk, _mm_set1_epi8('a'));
+    __m128i lower = _mm_cmpeq_epi8(_mm_min_epu8(from_lower, _mm_set1_epi8(25)), from_lower);
+    __m128i separator = _mm_or_si128(
+      _mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('_')), _mm_cmpeq_epi8(chunk, _mm_set1_epi8('-'))),
+      _mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('.')), _mm_cmpeq_epi8(chunk, _mm_set1_epi8('$'))));
+    _mm_store_si128(reinterpret_cast<__m128i *>(block.lower + b * 16),
+                    _mm_or_si128(chunk, _mm_and_si128(upper, _mm_set1_epi8(0x20))));
+    block.upper |= static_cast<uint64_t>(static_cast<unsigned>(_mm_movemask_epi8(upper))) << (b * 16);
+    block.lowercase |= static_cast<uint64_t>(static_cast<unsigned>(_mm_movemask_epi8(lower))) << (b * 16);
+    block.separator |= static_cast<uint64_t>(static_cast<unsigned>(_mm_movemask_epi8(separator))) << (b * 16);
+  }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+  for (size_t b = 0; b < blocks; ++b) {
+    uint8x16_t chunk = vld1q_u8(block.lower + b * 16);
+    uint8x16_t upper = vcltq_u8(vsubq_u8(chunk, vdupq_n_u8('A')), vdupq_n_u8(26));
+    uint8x16_t lower = vcltq_u8(vsubq_u8(chunk, vdupq_n_u8('a')), vdupq_n_u8(26));
+    uint8x16_t separator = vorrq_u8(vorrq_u8(vceqq_u8(chunk, vdupq_n_u8('_')), vceqq_u8(chunk, vdupq_n_u8('-'))),
+                                    vorrq_u8(vceqq_u8(chunk, vdupq_n_u8('.')), vceqq_u8(chunk, vdupq_n_u8('$'))));
+    vst1q_u8(block.lower + b * 16, vorrq_u8(chunk, vandq_u8(upper, vdupq_n_u8(0x20))));
+    block.upper |= movemask(upper) << (b * 16);
+    block.lowercase |= movemask(lower) << (b * 16);
+    block.separator |= movemask(separator) << (b * 16);
+  }
+#else
+  for (size_t i = 0; i < blocks * 16; ++i) {
+    unsigned char c = block.lower[i];
+    uint64_t bit = 1ull << i;
+    if (c >= 'A' && c <= 'Z') {
+      block.upper |= bit;
+      block.lower[i] = static_cast<unsigned char>(c | 0x20);
+    } else if (c >= 'a' && c <= 'z') {
+      block.lowercase |= bit;
+    } else if (c == '_' || c == '-' || c == '.' || c == '$') {
+      block.separator |= bit;
+    }
+  }
+#endif
+}
+
+// Positions of `c` in the lower-cased block.
+uint64_t occurrences(const Block &block, size_t blocks, unsigned char c) {
+  uint64_t mask = 0;
+#if defined(__SSE2__)
+  __m128i needle = _mm_set1_epi8(static_cast<char>(c));
+  for (size_t b = 0; b < blocks; ++b) {
+    __m128i chunk = _mm_load_si128(reinterpret_cast<const __m128i *>(block.lower + b * 16));
+    mask |= static_cast<uint64_t>(static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, needle)))) << (b * 16);
+  }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+  uint8x16_t needle = vdupq_n_u8(c);
+  for (size_t b = 0; b < blocks; ++b) {
+    mask |= movemask(vceqq_u8(vld1q_u8(block.lower + b * 16), needle)) << (b * 16);
+  }
+#else
+  for (size_t i = 0; i < blocks * 16; ++i) {
+    if (block.lower[i] == c) {
+      mask |= 1ull << i;
+    }
+  }
+#endif
+  return mask;
+}
+
+int highest_bit(uint64_t mask) {
+  return 63 - __builtin_clzll(mask);
+}
+
+int masked_score(std::string_view candidate, std::string_view pattern) {
+  Block block;
+  load_block(block, candidate);
+  size_t blocks = (candidate.size() + 15) / 16;
+  uint64_t valid = candidate.size() == kMaskedLength ? ~0ull : (1ull << candidate.size()) - 1;
+  uint64_t word_starts = 1 | (block.separator << 1) | ((block.lowercase << 1) & block.upper);
+
+  // feasible[j]: positions of pattern[j] from which pattern[j + 1..] can
+  // still be matched, i.e. below the last feasible position of pattern[j + 1].
+  uint64_t feasible[kMaskedLength];
+  uint64_t limit = valid;
+  for (size_t j = pattern.size(); j-- > 0;) {
+    feasible[j] = occurrences(block, blocks, static_cast<unsigned char>(pattern[j])) & limit;
+    if (feasible[j] == 0) {
+      return -1;
+    }
+    int last = highest_bit(feasible[j]);
+    limit = last == 0 ? 0 : (1ull << last) - 1;
+  }
+
+  int score = 0;
+  int previous = -1;
+  for (size_t j = 0; j < pattern.size(); ++j) {
+    uint64_t after = previous < 0 ? ~0ull : previous == 63 ? 0 : ~((1ull << (previous + 1)) - 1);
+    uint64_t candidates = feasible[j] & after;
+    uint64_t next = previous < 0 || previous == 63 ? 0 : (1ull << (previous + 1)) & candidates;
+    uint64_t starts = candidates & word_starts;
+    // Continue a run, else jump to the next word start, else the nearest match
+    uint64_t chosen;
+    if (next) {
+      chosen = next;
+    } else if (starts) {
+      chosen = starts & (~starts + 1);
+    } else {
+      chosen = candidates & (~candidates + 1);
+    }
+    int index = __builtin_ctzll(chosen);
+    score += bonus(static_cast<size_t>(index), (chosen & word_starts) != 0, index == previous + 1 && previous >= 0);
+    previous = index;
+  }
+  return score_match(score, candidate.size(), pattern.size());
+}
+
+} // namespace
+
+uint64_t fuzzy_char_mask(std::string_view text) {
+  uint64_t mask = 0;
+  for (unsigned char c : text) {
+    c = static_cast<unsigned char>(std::tolower(c));
+    if (c >= 'a' && c <= 'z') {
+      mask |= 1ull << (c - 'a');
+    } else if (c >= '0' && c <= '9') {
+      mask |= 1ull << (26 + c - '0');
+    } else if (c == '_') {
+      mask |= 1ull << 36;
+    }
+  }
+  return mask;
+}
+
+FuzzyPattern::FuzzyPattern(std::string_view pattern) : text(pattern), mask(fuzzy_char_mask(pattern)) {
+  for (char &c : text) {
+    c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+  }
+}
+
+int fuzzy_score(std::string_view candidate, const FuzzyPattern &pattern) {
+  if (pattern.text.empty()) {
+    return 0;
+  }
+  if (pattern.text.size() > candidate.size()) {
+    return -1;
+  }
+  if (candidate.size() <= kMaskedLength) {
+    return masked_score(candidate, pattern.text);
+  }
+  return scalar_score(candidate, pattern.text);
+}
+
+int fuzzy_score(std::string_view candidate, uint64_t candidate_mask, const FuzzyPattern &pattern) {
+  if ((candidate_mask & pattern.mask) != pattern.mask) {
+    return -1;
+  }
+  return fuzzy_score(candidate, pattern);
+}
+
+} // namespace prodigeetor
@@ -97,7 +97,7 @@ static std::vector<size_t> grapheme_boundaries_fallback(std::string_view text) {
   return boundaries;
 }
 
-static std::vector<size_t> grapheme_boundaries(std::string_view text) {
+std::vector<size_t> grapheme_boundaries(std::string_view text) {
 #ifdef PRODIGEETOR_USE_UTF8PROC
   return grapheme_boundaries_utf8proc(text);
 #else
@@ -120,4 +120,15 @@ size_t grapheme_byte_offset(std::string_view text, size_t grapheme_index) {
   return boundaries[grapheme_index];
 }
 
+size_t utf16_length(std::string_view text) {
+  size_t length = 0;
+  for (char c : text) {
+    unsigned char byte = static_cast<unsigned char>(c);
+    // One unit per lead byte, two for the surrogate pair of a 4-byte sequence
+    length += (byte & 0xC0) != 0x80;
+    length += byte >= 0xF0;
+  }
+  return length;
+}
+
 } // namespace prodigeetor
@@ -0,0 +1,201 @@
+#include "highlight_runs.h"
+
+#include <algorithm>
+#include <queue>
+
+namespace prodigeetor {
+
+// Appends a run, extending the last one instead when it is adjacent and of
+// the same style.
+static void append_run(std::vector<uint32_t> &starts, std::vector<uint32_t> &ends, std::vector<uint16_t> &style_ids,
+                       uint32_t start, uint32_t end, uint16_t id) {
+  if (!ends.empty() && ends.back() == start && style_ids.back() == id) {
+    ends.back() = end;
+    return;
+  }
+  starts.push_back(start);
+  ends.push_back(end);
+  style_ids.push_back(id);
+}
+
+// Replaces dst[first, last) with src, moving the tail only when the sizes differ.
+template <typename T>
+static void splice(std::vector<T> &dst, size_t first, size_t last, const std::vector<T> &src) {
+  size_t common = std::min(last - first, src.size());
+  std::copy(src.begin(), src.begin() + static_cast<std::ptrdiff_t>(common), dst.begin() + static_cast<std::ptrdiff_t>(first));
+  if (src.size() > common) {
+    dst.insert(dst.begin() + static_cast<std::ptrdiff_t>(first + common), src.begin() + static_cast<std::ptrdiff_t>(common), src.end());
+  } else {
+    dst.erase(dst.begin() + static_cast<std::ptrdiff_t>(first + common), dst.begin() + static_cast<std::ptrdiff_t>(last));
+  }
+}
+
+void HighlightRuns::build(const std::vector<RenderSpan> &spans) {
+  clear();
+  sweep(spans, 0, UINT32_MAX, m_starts, m_ends, m_style_ids);
+}
+
+void HighlightRuns::rebuild(uint32_t start, uint32_t end, const std::vector<RenderSpan> &spans) {
+  if (start >= end) {
+    return;
+  }
+  size_t first = static_cast<size_t>(std::upper_bound(m_ends.begin(), m_ends.end(), start) - m_ends.begin());
+  size_t last = static_cast<size_t>(std::lower_bound(m_starts.begin(), m_starts.end(), end) - m_starts.begin());
+
+  // Runs cut by the window's edges keep their outside parts.
+  std::vector<uint32_t> starts;
+  std::vector<uint32_t> ends;
+  std::vector<uint16_t> style_ids;
+  if (first < last && m_starts[first] < start) {
+    append_run(starts, ends, style_ids, m_starts[first], start, m_style_ids[first]);
+  }
+  sweep(spans, start, end, starts, ends, style_ids);
+  if (first < last && m_ends[last - 1] > end) {
+    append_run(starts, ends, style_ids, end, m_ends[last - 1], m_style_ids[last - 1]);
+  }
+
+  // Rejoin the neighbouring runs when the styles continue across the edges.
+  if (!starts.empty() && first > 0 && m_ends[first - 1] == starts.front() &&
+      m_style_ids[first - 1] == style_ids.front()) {
+    --first;
+    starts.front() = m_starts[first];
+  }
+  if (!starts.empty() && last < m_starts.size() && m_starts[last] == ends.back() &&
+      m_style_ids[last] == style_ids.back()) {
+    ends.back() = m_ends[last];
+    ++last;
+  }
+  splice(m_starts, first, last, starts);
+  splice(m_ends, first, last, ends);
+  splice(m_style_ids, first, last, style_ids);
+}
+
+void HighlightRuns::apply_edit(uint32_t start, uint32_t old_end, uint32_t new_end) {
+  auto map = [&](uint32_t &offset, bool is_end) {
+    if (offset >= old_end) {
+      offset = offset - old_end + new_end;
+    } else if (offset > start) {
+      offset = is_end ? new_end : start;
+    }
+  };
+  size_t first = static_cast<size_t>(std::upper_bound(m_ends.begin(), m_ends.end(), start) - m_ends.begin());
+  if (first > 0 && m_ends[first - 1] == start) {
+    --first; // a run ending at an insertion point grows over the inserted bytes
+  }
+  size_t kept = first;
+  for (size_t i = first; i < m_starts.size(); ++i) {
+    uint32_t run_start = m_starts[i];
+    uint32_t run_end = m_ends[i];
+    map(run_start, false);
+    map(run_end, true);
+    if (kept > 0) {
+      run_start = std::max(run_start, m_ends[kept - 1]);
+    }
+    if (run_start >= run_end) {
+      continue;
+    }
+    m_starts[kept] = run_start;
+    m_ends[kept] = run_end;
+    m_style_ids[kept] = m_style_ids[i];
+    ++kept;
+  }
+  m_starts.resize(kept);
+  m_ends.resize(kept);
+  m_style_ids.resize(kept);
+}
+
+void HighlightRuns::sweep(const std::vector<RenderSpan> &spans, uint32_t start, uint32_t end,
+                          std::vector<uint32_t> &starts, std::vector<uint32_t> &ends,
+                          std::vector<uint16_t> &style_ids) {
+  std::vector<uint32_t> order;
+  std::vector<uint32_t> boundaries;
+  order.reserve(spans.size());
+  boundaries.reserve(spans.size() * 2);
+  for (uint32_t i = 0; i < spans.size(); ++i) {
+    uint32_t span_start = spans[i].range.start.column;
+    uint32_t span_end = spans[i].range.end.column;
+    if (span_start >= span_end || span_start >= end || span_end <= start) {
+      continue;
+    }
+    order.push_back(i);
+    boundaries.push_back(std::max(span_start, start));
+    boundaries.push_back(std::min(span_end, end));
+  }
+  if (order.empty()) {
+    return;
+  }
+  std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+    return spans[a].range.start.column < spans[b].range.start.column;
+  });
+  std::sort(boundaries.begin(), boundaries.end());
+  boundaries.erase(std::unique(boundaries.begin(), boundaries.end()), boundaries.end());
+
+  // Sweep the elementary segments between boundaries, keeping the covering
+  // spans in a heap ordered by priority. Ended spans are dropped lazily.
+  auto lower_priority = [&](uint32_t a, uint32_t b) {
+    uint32_t width_a = spans[a].range.end.column - spans[a].range.start.column;
+    uint32_t width_b = spans[b].range.end.column - spans[b].range.start.column;
+    if (width_a != width_b) {
+      return width_a > width_b;
+    }
+    return a < b;
+  };
+  std::priority_queue<uint32_t, std::vector<uint32_t>, decltype(lower_priority)> active(lower_priority);
+
+  size_t next = 0;
+  for (size_t b = 0; b + 1 < boundaries.size(); ++b) {
+    uint32_t segment_start = boundaries[b];
+    uint32_t segment_end = boundaries[b + 1];
+    while (next < order.size() && spans[order[next]].range.start.column <= segment_start) {
+      active.push(order[next++]);
+    }
+    while (!active.empty() && spans[active.top()].range.end.column <= segment_start) {
+      active.pop();
+    }
+    if (active.empty()) {
+      continue;
+    }
+    append_run(starts, ends, style_ids, segment_start, segment_end, style_id(spans[active.top()].style));
+  }
+}
+
+void HighlightRuns::clear() {
+  m_starts.clear();
+  m_ends.clear();
+  m_style_ids.clear();
+  m_styles.clear();
+}
+
+size_t HighlightRuns::size() const {
+  return m_starts.size();
+}
+
+bool HighlightRuns::empty() const {
+  return m_starts.empty();
+}
+
+std::vector<RenderSpan> HighlightRuns::slice(size_t start, size_t end) const {
+  std::vector<RenderSpan> spans;
+  auto it = std::upper_bound(m_ends.begin(), m_ends.end(), start);
+  for (size_t i = static_cast<size_t>(it - m_ends.begin()); i < m_starts.size() && m_starts[i] < end; ++i) {
+    RenderSpan span;
+    span.range.start.column = static_cast<uint32_t>(std::max<size_t>(m_starts[i], start) - start);
+    span.range.end.column = static_cast<uint32_t>(std::min<size_t>(m_ends[i], end) - start);
+    span.style = m_styles[m_style_ids[i]];
+    spans.push_back(span);
+  }
+  return spans;
+}
+
+uint16_t HighlightRuns::style_id(const RenderStyle &style) {
+  // Themes have a few dozen styles at most, so a linear scan beats hashing.
+  for (size_t i = m_styles.size(); i > 0; --i) {
+    if (m_styles[i - 1] == style) {
+      return static_cast<uint16_t>(i - 1);
+    }
+  }
+  m_styles.push_back(style);
+  return static_cast<uint16_t>(m_styles.size() - 1);
+}
+
+} // namespace prodigeetor
@@ -0,0 +1,356 @@
+#include "language_registry.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <regex>
+#include <sstream>
+
+#ifdef PRODIGEETOR_GRAMMAR_MODULES
+#include <dlfcn.h>
+#endif
+
+#ifdef PRODIGEETOR_USE_TREE_SITTER
+#include <tree_sitter/api.h>
+
+#ifndef PRODIGEETOR_GRAMMAR_MODULES
+extern "C" const TSLanguage *tree_sitter_javascript();
+extern "C" const TSLanguage *tree_sitter_typescript();
+extern "C" const TSLanguage *tree_sitter_tsx();
+extern "C" const TSLanguage *tree_sitter_swift();
+extern "C" const TSLanguage *tree_sitter_c_sharp();
+extern "C" const TSLanguage *tree_sitter_html();
+extern "C" const TSLanguage *tree_sitter_css();
+extern "C" const TSLanguage *tree_sitter_sql();
+#endif
+#endif
+
+namespace prodigeetor {
+
+static std::string g_resource_base_path;
+
+static std::string read_file(const std::string &path) {
+  std::ifstream file(path);
+  if (!file.is_open()) {
+    return std::string();
+  }
+  std::stringstream buffer;
+  buffer << file.rdbuf();
+  return buffer.str();
+}
+
+static std::string to_lower(std::string_view text) {
+  std::string lower(text);
+  std::transform(lower.begin(), lower.end(), lower.begin(), [](unsigned char c) {
+    return static_cast<char>(std::tolower(c));
+  });
+  return lower;
+}
+
+// Splits the members of the JSON array `key` into top-level `{...}` objects.
+// The language data only nests arrays of strings inside flat objects.
+static std::vector<std::string> json_objects_in_array(const std::string &content, const std::string &key) {
+  std::vector<std::string> objects;
+  std::regex array_regex("\"" + key + "\"\\s*:\\s*\\[");
+  std::smatch match;
+  if (!std::regex_search(content, match, array_regex)) {
+    return objects;
+  }
+  size_t depth = 0;
+  size_t object_start = 0;
+  bool in_string = false;
+  for (size_t i = static_cast<size_t>(match.position(0) + match.length(0)); i < content.size(); ++i) {
+    char c = content[i];
+    if (in_string) {
+      if (c == '\\') {
+        ++i;
+      } else if (c == '"') {
+        in_string = false;
+      }
+      continue;
+    }
+    if (c == '"') {
+      in_string = true;
+    } else if (c == '{') {
+      if (depth++ == 0) {
+        object_start = i;
+      }
+    } else if (c == '}' && depth > 0) {
+      if (--depth == 0) {
+        objects.push_back(content.substr(object_start, i - object_start + 1));
+      }
+    } else if (c == ']' && depth == 0) {
+      break;
+    }
+  }
+  return objects;
+}
+
+static std::string json_string(const std::string &object, const std::string &key) {
+  std::regex string_regex("\"" + key + "\"\\s*:\\s*\"([^\"]*)\"");
+  std::smatch match;
+  if (std::regex_search(object, match, string_regex)) {
+    return match[1].str();
+  }
+  return std::string();
+}
+
+static std::vector<std::string> json_string_array(const std::string &object, const std::string &key) {
+  std::vector<std::string> values;
+  std::regex array_regex("\"" + key + "\"\\s*:\\s*\\[([^\\]]*)\\]");
+  std::smatch match;
+  if (!std::regex_search(object, match, array_regex)) {
+    return values;
+  }
+  std::string list = match[1].str();
+  std::regex item_regex(R"regex("([^"]+)")regex");
+  for (auto it = std::sregex_iterator(list.begin(), list.end(), item_regex); it != std::sregex_iterator(); ++it) {
+    values.push_back((*it)[1].str());
+  }
+  return values;
+}
+
+static int json_int(const std::string &object, const std::string &key, int fallback) {
+  std::regex int_regex("\"" + key + "\"\\s*:\\s*(-?[0-9]+)");
+  std::smatch match;
+  if (std::regex_search(object, match, int_regex)) {
+    return std::atoi(match[1].str().c_str());
+  }
+  return fallback;
+}
+
+LanguageRegistry &LanguageRegistry::instance() {
+  static LanguageRegistry registry;
+  return registry;
+}
+
+LanguageRegistry::LanguageRegistry() {
+  std::string path = resolve_path("languages/languages.json");
+  if (path.empty() || !load_from_file(path)) {
+    std::cerr << "[Languages] ERROR: No language definitions loaded" << std::endl;
+  }
+}
+
+void LanguageRegistry::set_resource_base_path(std::string path) {
+  g_resource_base_path = std::move(path);
+}
+
+std::string LanguageRegistry::resolve_path(const std::string &relative_path) {
+  // Try multiple locations in order of preference
+  std::vector<std::string> search_paths;
+
+  // 1. User-configured base path
+  if (!g_resource_base_path.empty()) {
+    search_paths.push_back(g_resource_base_path + "/" + relative_path);
+  }
+
+  // 2. Relative to current directory
+  search_paths.push_back(relative_path);
+
+  // 3. Common development locations
+  search_paths.push_back("/Users/josephizang/Projects/vibes/codeeditor/" + relative_path);
+
+  for (const auto &path : search_paths) {
+    if (std::filesystem::exists(path)) {
+      return path;
+    }
+  }
+
+  std::cerr << "[Languages] ERROR: Resource not found: " << relative_path << std::endl;
+  return std::string();
+}
+
+bool LanguageRegistry::load_from_file(const std::string &path) {
+  std::string content = read_file(path);
+  if (content.empty()) {
+    return false;
+  }
+  load_from_string(content);
+  return !m_languages.empty();
+}
+
+void LanguageRegistry::load_from_string(std::string_view content_view) {
+  std::string content(content_view);
+  m_languages.clear();
+  m_servers.clear();
+  m_by_name.clear();
+  m_by_extension.clear();
+
+  for (const auto &object : json_objects_in_array(content, "languages")) {
+    LanguageInfo language;
+    language.name = json_string(object, "name");
+    if (language.name.empty()) {
+      continue;
+    }
+    language.aliases = json_string_array(object, "aliases");
+    language.extensions = json_string_array(object, "extensions");
+    language.grammar = json_string(object, "grammar");
+    language.highlights = json_string_array(object, "highlights");
+    language.injections = json_string_array(object, "injections");
+    language.folds = json_string_array(object, "folds");
+    language.tags = json_string_array(object, "tags");
+    // One server name, or several in priority order
+    language.language_servers = json_string_array(object, "languageServer");
+    if (language.language_servers.empty()) {
+      std::string server = json_string(object, "languageServer");
+      if (!server.empty()) {
+        language.language_servers.push_back(std::move(server));
+      }
+    }
+
+    size_t index = m_languages.size();
+    m_by_name.emplace(to_lower(language.name), index);
+    for (const auto &alias : language.aliases) {
+      m_by_name.emplace(to_lower(alias), index);
+    }
+    for (const auto &extension : language.extensions) {
+      m_by_extension.emplace(to_lower(extension), index);
+    }
+    m_languages.push_back(std::move(language));
+  }
+
+  for (const auto &object : json_objects_in_array(content, "languageServers")) {
+    LanguageServerInfo server;
+    server.name = json_string(object, "name");
+    server.command = json_string(object, "command");
+    if (server.name.empty() || server.command.empty()) {
+      continue;
+    }
+    server.args = json_string_array(object, "args");
+    server.language_id = json_string(object, "languageId");
+    server.deadline_ms = json_int(object, "deadlineMs", 0);
+    for (const auto &language : m_languages) {
+      const auto &names = language.language_servers;
+      if (std::find(names.begin(), names.end(), server.name) != names.end()) {
+        server.extensions.insert(server.extensions.end(), language.extensions.begin(), language.extensions.end());
+      }
+    }
+    m_servers.push_back(std::move(server));
+  }
+}
+
+const std::vector<LanguageInfo> &LanguageRegistry::languages() const {
+  return m_languages;
+}
+
+const std::vector<LanguageServerInfo> &LanguageRegistry::language_servers() const {
+  return m_servers;
+}
+
+const LanguageInfo *LanguageRegistry::find(std::string_view name) const {
+  auto it = m_by_name.find(to_lower(name));
+  return it == m_by_name.end() ? nullptr : &m_languages[it->second];
+}
+
+const LanguageInfo *LanguageRegistry::for_path(std::string_view path) const {
+  size_t dot = path.find_last_of('.');
+  if (dot == std::string_view::npos || path.find('/', dot) != std::string_view::npos) {
+    return nullptr;
+  }
+  auto it = m_by_extension.find(to_lower(path.substr(dot)));
+  return it == m_by_extension.end() ? nullptr : &m_languages[it->second];
+}
+
+#ifdef PRODIGEETOR_GRAMMAR_MODULES
+// Grammar modules are named libtree-sitter-<grammar>, with '_' spelled '-'.
+static void *open_grammar_module(const std::string &grammar) {
+  std::string file_name = "libtree-sitter-" + grammar;
+  std::replace(file_name.begin(), file_name.end(), '_', '-');
+
+  std::vector<std::string> directories;
+  if (const char *env = getenv("PRODIGEETOR_GRAMMAR_PATH")) {
+    std::stringstream paths(env);
+    std::string directory;
+    while (std::getline(paths, directory, ':')) {
+      if (!directory.empty()) {
+        directories.push_back(directory);
+      }
+    }
+  }
+  if (!g_resource_base_path.empty()) {
+    directories.push_back(g_resource_base_path + "/grammars");
+  }
+#ifdef PRODIGEETOR_GRAMMAR_DIR
+  directories.push_back(PRODIGEETOR_GRAMMAR_DIR);
+#endif
+  directories.push_back("grammars");
+
+  for (const auto &directory : directories) {
+    for (const char *suffix : {".so", ".dylib"}) {
+      std::string path = directory + "/" + file_name + suffix;
+      if (!std::filesystem::exists(path)) {
+        continue;
+      }
+      if (void *handle = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL)) {
+        std::cerr << "[Languages] Loaded grammar " << path << std::endl;
+        return handle;
+      }
+      std::cerr << "[Languages] ERROR: " << dlerror() << std::endl;
+    }
+  }
+  return nullptr;
+}
+#endif
+
+const void *LanguageRegistry::grammar(const LanguageInfo &language) {
+  if (language.grammar.empty()) {
+    return nullptr;
+  }
+  std::lock_guard<std::mutex> lock(m_grammar_mutex);
+  auto it = m_grammars.find(language.grammar);
+  if (it != m_grammars.end()) {
+    return it->second;
+  }
+
+  const void *loaded = nullptr;
+#if defined(PRODIGEETOR_USE_TREE_SITTER) && defined(PRODIGEETOR_GRAMMAR_MODULES)
+  if (void *module = open_grammar_module(language.grammar)) {
+    using GrammarFunction = const TSLanguage *(*)();
+    std::string symbol = "tree_sitter_" + language.grammar;
+    if (auto function = reinterpret_cast<GrammarFunction>(dlsym(module, symbol.c_str()))) {
+      loaded = function();
+      m_modules.push_back(module);
+    } else {
+      std::cerr << "[Languages] ERROR: Missing " << symbol << " in grammar module" << std::endl;
+      dlclose(module);
+    }
+  }
+#elif defined(PRODIGEETOR_USE_TREE_SITTER)
+  static const std::unordered_map<std::string_view, const TSLanguage *(*)()> linked_grammars = {
+    {"javascript", tree_sitter_javascript},
+    {"typescript", tree_sitter_typescript},
+    {"tsx", tree_sitter_tsx},
+    {"swift", tree_sitter_swift},
+    {"c_sharp", tree_sitter_c_sharp},
+    {"html", tree_sitter_html},
+    {"css", tree_sitter_css},
+    {"sql", tree_sitter_sql},
+  };
+  auto linked = linked_grammars.find(language.grammar);
+  if (linked != linked_grammars.end()) {
+    loaded = linked->second();
+  }
+#endif
+  if (!loaded) {
+    std::cerr << "[Languages] ERROR: Grammar not available: " << language.grammar << std::endl;
+  }
+  m_grammars.emplace(language.grammar, loaded);
+  return loaded;
+}
+
+std::string LanguageRegistry::query_source(const std::vector<std::string> &files) {
+  std::string source;
+  for (const auto &relative_path : files) {
+    std::string resolved = resolve_path(relative_path);
+    if (!resolved.empty()) {
+      source += read_file(resolved);
+      source += "\n\n";
+    }
+  }
+  return source;
+}
+
+} // namespace prodigeetor
@@ -0,0 +1,110 @@
+#include "language_server_paths.h"
+
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <vector>
+#include <cstdlib>
+#include <unistd.h>
+
+#include "settings.h"
+
+namespace prodigeetor {
+
+namespace {
+
+bool is_executable(const std::string &path) {
+  return access(path.c_str(), X_OK) == 0;
+}
+
+std::vector<std::string> search_paths(const std::string &command) {
+  std::vector<std::string> paths;
+  if (const char *home = getenv("HOME")) {
+    // NVM paths
+    paths.push_back(std::string(home) + "/.nvm/versions/node/v22.18.0/bin/" + command);
+    paths.push_back(std::string(home) + "/.nvm/current/bin/" + command);
+    // Global npm
+    paths.push_back(std::string(home) + "/.npm-global/bin/" + command);
+    // Homebrew
+    paths.push_back("/opt/homebrew/bin/" + command);
+    paths.push_back("/usr/local/bin/" + command);
+  }
+  // System paths
+  paths.push_back("/usr/bin/" + command);
+  return paths;
+}
+
+} // namespace
+
+LanguageServerPaths::LanguageServerPaths()
+    : m_cache_path(user_cache_directory() + "/language-servers.cache") {}
+
+LanguageServerPaths::LanguageServerPaths(std::string cache_path) : m_cache_path(std::move(cache_path)) {}
+
+std::string LanguageServerPaths::resolve(const std::string &command) {
+  if (!command.empty() && command[0] == '/') {
+    return command;
+  }
+  load();
+  auto cached = m_paths.find(command);
+  if (cached != m_paths.end() && is_executable(cached->second)) {
+    return cached->second;
+  }
+
+  std::vector<std::string> paths = search_paths(command);
+  for (const auto &path : paths) {
+    if (is_executable(path)) {
+      std::cerr << "[LSP] Found language server: " << path << std::endl;
+      m_paths[command] = path;
+      save();
+      return path;
+    }
+  }
+
+  // Not found; let execvp search PATH and fail with a clear error
+  std::cerr << "[LSP] WARNING: Could not find language server: " << command << std::endl;
+  std::cerr << "[LSP] Searched paths:" << std::endl;
+  for (const auto &path : paths) {
+    std::cerr << "[LSP]   - " << path << std::endl;
+  }
+  if (cached != m_paths.end()) {
+    m_paths.erase(cached);
+    save();
+  }
+  return command;
+}
+
+// One "command<TAB>path" entry per line.
+void LanguageServerPaths::load() {
+  if (m_loaded) {
+    return;
+  }
+  m_loaded = true;
+  std::ifstream file(m_cache_path);
+  std::string line;
+  while (std::getline(file, line)) {
+    size_t tab = line.find('\t');
+    if (tab != std::string::npos && tab > 0 && tab + 1 < line.size()) {
+      m_paths[line.substr(0, tab)] = line.substr(tab + 1);
+    }
+  }
+}
+
+void LanguageServerPaths::save() const {
+  std::error_code error;
+  std::filesystem::create_directories(std::filesystem::path(m_cache_path).parent_path(), error);
+  // Written aside and renamed, so a concurrent run never reads half a file
+  std::string temporary = m_cache_path + ".tmp";
+  {
+    std::ofstream file(temporary, std::ios::trunc);
+    if (!file.is_open()) {
+      return;
+    }
+    for (const auto &[command, path] : m_paths) {
+      file << command << '\t' << path << '\n';
+    }
+  }
+  std::filesystem::rename(temporary, m_cache_path, error);
+}
+
+} // namespace prodigeetor
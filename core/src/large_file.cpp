@@ -0,0 +1,40 @@
+#include "large_file.h"
+
+#include <cstdio>
+
+namespace prodigeetor {
+
+static bool exceeds(size_t size, size_t threshold) {
+  return threshold != 0 && size > threshold;
+}
+
+LargeFileStatus evaluate_large_file(size_t size, bool buffer_mapped, const LargeFileThresholds &thresholds) {
+  LargeFileStatus status;
+  status.size = size;
+  status.buffer_mapped = buffer_mapped;
+  status.lsp_sync = !exceeds(size, thresholds.lsp_max_size);
+  status.highlight_viewport_only = exceeds(size, thresholds.large_file_size);
+  status.large_file = buffer_mapped || !status.lsp_sync || status.highlight_viewport_only;
+  return status;
+}
+
+std::string LargeFileStatus::summary() const {
+  if (!large_file) {
+    return std::string();
+  }
+  char size_text[32];
+  std::snprintf(size_text, sizeof(size_text), "%.1f MB", static_cast<double>(size) / (1024.0 * 1024.0));
+  std::string text = std::string("Large file (") + size_text + ")";
+  if (buffer_mapped) {
+    text += ", memory-mapped";
+  }
+  if (!lsp_sync) {
+    text += ", language server off";
+  }
+  if (highlight_viewport_only) {
+    text += ", highlighting visible lines only";
+  }
+  return text;
+}
+
+} // namespace prodigeetor
@@ -1,62 +1,346 @@
 #include "lsp_client.h"
+#include "lsp_framer.h"
+#include "spsc_queue.h"
+#include <algorithm>
+#include <charconv>
 #include <iostream>
 #include <sstream>
 #include <cstring>
 #include <fcntl.h>
 #include <unistd.h>
+#include <atomic>
+#include <thread>
+#include <utility>
+#include <sys/uio.h>
 #include <sys/wait.h>
 #include <poll.h>
+#include <signal.h>
 
 namespace prodigeetor {
 namespace lsp {
 
-// Simple JSON builder/parser helpers (minimal implementation)
-// In production, use a proper JSON library like nlohmann/json
-namespace json {
-
-std::string escape(const std::string& str) {
-  std::string result;
-  for (char c : str) {
-    switch (c) {
-      case '"': result += "\\\""; break;
-      case '\\': result += "\\\\"; break;
-      case '\n': result += "\\n"; break;
-      case '\r': result += "\\r"; break;
-      case '\t': result += "\\t"; break;
-      default: result += c;
-    }
-  }
-  return result;
+namespace {
+
+// Writes the "textDocument" member identifying `uri`.
+void writeTextDocument(JSONWriter& writer, const std::string& uri) {
+  writer.key("textDocument").beginObject().key("uri").value(uri).endObject();
 }
 
-std::string position(const LSPPosition& pos) {
-  return "{\"line\":" + std::to_string(pos.line) +
-         ",\"character\":" + std::to_string(pos.character) + "}";
+// Writes the members of TextDocumentPositionParams.
+void writeTextDocumentPosition(JSONWriter& writer, const std::string& uri, const LSPPosition& position) {
+  writeTextDocument(writer, uri);
+  writer.key("position");
+  writePosition(writer, position);
 }
 
-std::string range(const LSPRange& r) {
-  return "{\"start\":" + position(r.start) + ",\"end\":" + position(r.end) + "}";
+// Streams the buffer into a string value, escaping each chunk in place.
+void writeText(JSONWriter& writer, const TextBuffer& text) {
+  writer.reserve(writer.size() + text.size() + text.size() / 8 + 256);
+  writer.beginString();
+  text.for_each_chunk(0, text.size(), [&writer](std::string_view chunk) {
+    writer.stringPart(chunk);
+  });
+  writer.endString();
 }
 
-std::string textDocumentIdentifier(const std::string& uri) {
-  return "{\"uri\":\"" + escape(uri) + "\"}";
+std::vector<Diagnostic> readDiagnostics(const JSONValue& array) {
+  std::vector<Diagnostic> diagnostics;
+  diagnostics.reserve(array.size());
+  for (JSONValue item : array.items()) {
+    Diagnostic diagnostic;
+    diagnostic.range = readRange(item["range"]);
+    diagnostic.severity = static_cast<DiagnosticSeverity>(item["severity"].asInt(1));
+    JSONValue code = item["code"];
+    diagnostic.code = code.isString() ? code.asString() : std::string(code.isNumber() ? code.raw() : "");
+    diagnostic.source = item["source"].asString();
+    diagnostic.message = item["message"].asString();
+    diagnostics.push_back(std::move(diagnostic));
+  }
+  return diagnostics;
 }
 
-std::string textDocumentPositionParams(const std::string& uri, const LSPPosition& pos) {
-  return "{\"textDocument\":" + textDocumentIdentifier(uri) +
-         ",\"position\":" + position(pos) + "}";
+uint64_t microsBetween(std::chrono::steady_clock::time_point from, std::chrono::steady_clock::time_point to) {
+  if (to <= from) {
+    return 0;
+  }
+  return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(to - from).count());
 }
 
-} // namespace json
+} // anonymous namespace
 
+// A framed message, parsed on the I/O thread. Handled messages go back to the
+// I/O thread so their text and tape capacity are reused.
+struct InboundMessage {
+  std::string text;
+  JSONDocument document;
+  bool valid = false;
+  std::chrono::steady_clock::time_point readAt;
+  uint64_t parseMicros = 0;
+};
+
+// A message the pipe did not take at once; the I/O thread finishes it.
+struct OutboundMessage {
+  std::string header;
+  std::string body;
+  size_t written = 0;
+  std::chrono::steady_clock::time_point queuedAt;
+};
+
+// Each client's pipes are serviced by its own I/O thread. It reads and frames
+// everything the server sends as soon as it arrives, parses each message and
+// queues it for processMessages() on the UI thread, and finishes writes the
+// non-blocking stdin pipe could not take. The threads only share the queues,
+// the wakeups and a few atomics.
 struct LSPClient::Impl {
   pid_t pid = -1;
   int stdin_pipe[2] = {-1, -1};
   int stdout_pipe[2] = {-1, -1};
-  std::string buffer;
   bool running = false;
+  JSONWriter writer;       // reused for every outgoing message
+
+  std::thread ioThread;
+  Wakeup ioWakeup;                        // new output or stop request
+  Wakeup* notify = nullptr;               // signaled when messages are queued
+  std::atomic<bool> stopping{false};
+  std::atomic<bool> exited{false};        // the server closed its output
+  std::atomic<size_t> pendingOutput{0};   // queued messages not fully written
+  std::atomic<uint64_t> writeWaitMicros{0}; // their total time in the queue
+  SPSCQueue<std::unique_ptr<InboundMessage>> inbound;   // I/O -> UI
+  SPSCQueue<std::unique_ptr<InboundMessage>> recycled;  // UI -> I/O
+  SPSCQueue<std::unique_ptr<OutboundMessage>> outbound; // UI -> I/O
+
+  // I/O thread only
+  MessageFramer framer;
+  std::unique_ptr<OutboundMessage> writing;
+
+  void run();
+  bool readAvailable();
+  void queueMessage(std::string& body);
+  bool writePending();
 };
 
+namespace {
+
+size_t formatHeader(char* header, size_t size, size_t contentLength) {
+  static const char prefix[] = "Content-Length: ";
+  std::memcpy(header, prefix, sizeof(prefix) - 1);
+  char* end = std::to_chars(header + sizeof(prefix) - 1, header + size - 4, contentLength).ptr;
+  std::memcpy(end, "\r\n\r\n", 4);
+  return static_cast<size_t>(end + 4 - header);
+}
+
+// Writes header and body past `written` with writev until the pipe would
+// block. Returns true once everything is out (or the write failed for good).
+bool writeNonBlocking(int fd, std::string_view header, std::string_view body, size_t& written) {
+  size_t total = header.size() + body.size();
+  while (written < total) {
+    struct iovec parts[2];
+    int count = 0;
+    if (written < header.size()) {
+      parts[count++] = {const_cast<char*>(header.data()) + written, header.size() - written};
+      parts[count++] = {const_cast<char*>(body.data()), body.size()};
+    } else {
+      size_t offset = written - header.size();
+      parts[count++] = {const_cast<char*>(body.data()) + offset, body.size() - offset};
+    }
+    ssize_t n = writev(fd, parts, count);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        return false;
+      }
+      std::cerr << "Failed to write to LSP server: " << strerror(errno) << std::endl;
+      written = total;
+      return true;
+    }
+    written += static_cast<size_t>(n);
+  }
+  return true;
+}
+
+// A server gets this long to answer shutdown, and then each of exit, SIGTERM
+// and SIGKILL this long to take effect.
+constexpr std::chrono::milliseconds kShutdownTimeout{1000};
+constexpr std::chrono::milliseconds kExitTimeout{500};
+
+int millisUntil(std::chrono::steady_clock::time_point deadline) {
+  auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+  return static_cast<int>(std::max<std::chrono::milliseconds::rep>(0, left.count()));
+}
+
+// Waits until the server answers request `shutdownId` (framed by `framer`,
+// which may hold the start of the answer already), closes its output or the
+// deadline passes. Returns false if it closed its output.
+bool awaitShutdown(int fd, MessageFramer& framer, int shutdownId) {
+  auto deadline = std::chrono::steady_clock::now() + kShutdownTimeout;
+  JSONDocument document;
+  bool answered = false;
+  while (!answered) {
+    struct pollfd pollFd = {fd, POLLIN, 0};
+    int ready = poll(&pollFd, 1, millisUntil(deadline));
+    if (ready < 0 && errno == EINTR) {
+      continue;
+    }
+    if (ready <= 0) {
+      break;
+    }
+    bool open = framer.read(fd, [&](std::string& body) {
+      answered = answered || (document.parse(body) && !document.root()["method"].isValid() &&
+                              document.root()["id"].asInt() == shutdownId);
+    });
+    if (!open) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Finishes stopping a server on a thread of its own, so the UI thread never
+// waits on it: once the shutdown request `shutdownId` is answered (0 if it
+// was already), or not in time, sends exit and reaps the process, escalating
+// to SIGTERM and SIGKILL while it does not exit. A server that already closed
+// its output is killed at once. Takes ownership of the pipes.
+void stopServer(pid_t pid, int input, int output, MessageFramer framer, bool exited, int shutdownId) {
+  static constexpr int kSignals[] = {0, SIGTERM, SIGKILL};
+  size_t step = 2;
+  if (!exited && (shutdownId == 0 || awaitShutdown(output, framer, shutdownId))) {
+    static constexpr std::string_view kExit = R"({"jsonrpc":"2.0","method":"exit","params":null})";
+    char header[48];
+    std::string_view headerView(header, formatHeader(header, sizeof(header), kExit.size()));
+    auto deadline = std::chrono::steady_clock::now() + kExitTimeout;
+    size_t written = 0;
+    while (!writeNonBlocking(input, headerView, kExit, written)) {
+      struct pollfd pollFd = {input, POLLOUT, 0};
+      if (poll(&pollFd, 1, millisUntil(deadline)) == 0) {
+        break;
+      }
+    }
+    step = 0;
+  } else if (!exited) {
+    step = 1; // it closed its output while shutting down
+  }
+  close(input);
+  close(output);
+
+  for (; step < std::size(kSignals); ++step) {
+    if (kSignals[step] != 0) {
+      kill(pid, kSignals[step]);
+    }
+    auto deadline = std::chrono::steady_clock::now() + kExitTimeout;
+    while (true) {
+      int status;
+      pid_t reaped = waitpid(pid, &status, WNOHANG);
+      if (reaped == pid || (reaped < 0 && errno != EINTR)) {
+        return;
+      }
+      if (std::chrono::steady_clock::now() >= deadline) {
+        break;
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+  }
+  std::cerr << "[LSP] Server " << pid << " did not exit" << std::endl;
+}
+
+} // anonymous namespace
+
+void LSPClient::Impl::run() {
+  bool reading = true;
+  while (!stopping.load()) {
+    if (!writing) {
+      outbound.pop(writing);
+    }
+    struct pollfd fds[3];
+    nfds_t count = 0;
+    fds[count++] = {ioWakeup.fd(), POLLIN, 0};
+    nfds_t readIndex = reading ? count++ : 0;
+    if (reading) {
+      fds[readIndex] = {stdout_pipe[0], POLLIN, 0};
+    }
+    nfds_t writeIndex = writing ? count++ : 0;
+    if (writing) {
+      fds[writeIndex] = {stdin_pipe[1], POLLOUT, 0};
+    }
+
+    if (poll(fds, count, -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      std::cerr << "[LSP] poll failed: " << strerror(errno) << std::endl;
+      return;
+    }
+    if (fds[0].revents) {
+      ioWakeup.drain();
+    }
+    if (reading && fds[readIndex].revents) {
+      reading = readAvailable();
+      if (!reading) {
+        exited.store(true, std::memory_order_release);
+        if (notify) {
+          notify->signal();
+        }
+      }
+    }
+    if (writing && fds[writeIndex].revents) {
+      writePending();
+    }
+  }
+
+  // Give queued output (shutdown and exit, usually) a moment to go out
+  while (writing || outbound.pop(writing)) {
+    struct pollfd fd = {stdin_pipe[1], POLLOUT, 0};
+    if (poll(&fd, 1, 100) <= 0) {
+      break;
+    }
+    writePending();
+  }
+}
+
+// Reads everything available and queues each message as soon as it is
+// complete. Returns false once the server closed its end.
+bool LSPClient::Impl::readAvailable() {
+  return framer.read(stdout_pipe[0], [this](std::string& body) {
+    queueMessage(body);
+    if (notify) {
+      notify->signal();
+    }
+  });
+}
+
+// Takes the body's storage; the framer keeps the recycled string instead.
+void LSPClient::Impl::queueMessage(std::string& body) {
+  std::unique_ptr<InboundMessage> message;
+  if (!recycled.pop(message)) {
+    message = std::make_unique<InboundMessage>();
+  }
+  message->text.swap(body);
+  message->readAt = std::chrono::steady_clock::now();
+  message->valid = message->document.parse(message->text);
+  message->parseMicros = microsBetween(message->readAt, std::chrono::steady_clock::now());
+  if (!message->valid) {
+    std::cerr << "[LSP] Malformed message at byte " << message->document.errorOffset()
+              << ": " << message->document.error() << std::endl;
+  }
+  inbound.push(std::move(message));
+}
+
+// Continues the message being written; returns false while the pipe is full.
+bool LSPClient::Impl::writePending() {
+  while (writing) {
+    if (!writeNonBlocking(stdin_pipe[1], writing->header, writing->body, writing->written)) {
+      return false;
+    }
+    writeWaitMicros.fetch_add(microsBetween(writing->queuedAt, std::chrono::steady_clock::now()),
+                              std::memory_order_relaxed);
+    writing.reset();
+    pendingOutput.fetch_sub(1, std::memory_order_release);
+    outbound.pop(writing);
+  }
+  return true;
+}
+
 LSPClient::LSPClient() : m_impl(std::make_unique<Impl>()) {}
 
 LSPClient::~LSPClient() {
@@ -68,6 +352,9 @@ bool LSPClient::start(const std::string& command, const std::vector<std::string>
     return false;
   }
 
+  // A server that dies mid-write must surface as EPIPE, not kill the editor
+  signal(SIGPIPE, SIG_IGN);
+
   // Create pipes for stdin and stdout
   if (pipe(m_impl->stdin_pipe) < 0 || pipe(m_impl->stdout_pipe) < 0) {
     std::cerr << "Failed to create pipes: " << strerror(errno) << std::endl;
@@ -91,6 +378,9 @@ bool LSPClient::start(const std::string& command, const std::vector<std::string>
     dup2(m_impl->stdin_pipe[0], STDIN_FILENO);
     dup2(m_impl->stdout_pipe[1], STDOUT_FILENO);
 
+    // The editor ignores SIGPIPE; servers get the default back
+    signal(SIGPIPE, SIG_DFL);
+
     // Close unused pipe ends
     close(m_impl->stdin_pipe[0]);
     close(m_impl->stdin_pipe[1]);
@@ -117,11 +407,17 @@ bool LSPClient::start(const std::string& command, const std::vector<std::string>
   close(m_impl->stdin_pipe[0]);  // Close read end of stdin pipe
   close(m_impl->stdout_pipe[1]); // Close write end of stdout pipe
 
-  // Set stdout pipe to non-blocking
-  int flags = fcntl(m_impl->stdout_pipe[0], F_GETFL, 0);
-  fcntl(m_impl->stdout_pipe[0], F_SETFL, flags | O_NONBLOCK);
+  // Both pipes are non-blocking: the I/O thread reads until EAGAIN, and
+  // sendMessage() hands whatever stdin does not take to the I/O thread
+  for (int fd : {m_impl->stdout_pipe[0], m_impl->stdin_pipe[1]}) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+  }
 
   m_impl->running = true;
+  m_impl->stopping = false;
+  m_impl->exited = false;
+  m_impl->ioThread = std::thread([impl = m_impl.get()] { impl->run(); });
   return true;
 }
 
@@ -130,27 +426,47 @@ void LSPClient::shutdown() {
     return;
   }
 
-  // Send shutdown request
-  sendNotification("shutdown", "null");
-  sendNotification("exit", "null");
+  // Send shutdown request, unless the server is already gone. Its answer,
+  // exit and reaping the process are left to stopServer().
+  bool exited = m_impl->exited.load(std::memory_order_acquire);
+  int shutdownId = 0;
+  if (!exited) {
+    shutdownId = m_nextRequestId;
+    beginRequest("shutdown", nullptr, nullptr).null();
+    sendMessage();
+  }
 
-  // Close pipes
-  if (m_impl->stdin_pipe[1] >= 0) {
-    close(m_impl->stdin_pipe[1]);
-    m_impl->stdin_pipe[1] = -1;
+  m_impl->stopping = true;
+  m_impl->ioWakeup.signal();
+  if (m_impl->ioThread.joinable()) {
+    m_impl->ioThread.join();
   }
-  if (m_impl->stdout_pipe[0] >= 0) {
-    close(m_impl->stdout_pipe[0]);
-    m_impl->stdout_pipe[0] = -1;
+  m_impl->writing.reset();
+  std::unique_ptr<OutboundMessage> unsent;
+  while (m_impl->outbound.pop(unsent)) {
+  }
+  m_impl->pendingOutput = 0;
+
+  // Messages not handled yet are dropped; one may be the answer already
+  std::unique_ptr<InboundMessage> message;
+  while (m_impl->inbound.pop(message)) {
+    if (shutdownId != 0 && message->valid && !message->document.root()["method"].isValid() &&
+        message->document.root()["id"].asInt() == shutdownId) {
+      shutdownId = 0;
+    }
   }
 
-  // Wait for process to exit
-  if (m_impl->pid > 0) {
-    int status;
-    waitpid(m_impl->pid, &status, 0);
-    m_impl->pid = -1;
+  // Requests still in flight will never be answered
+  for (auto& [id, pending] : m_pending) {
+    --pending.metrics->inFlight;
   }
+  m_pending.clear();
 
+  std::thread(stopServer, m_impl->pid, m_impl->stdin_pipe[1], m_impl->stdout_pipe[0],
+              std::exchange(m_impl->framer, MessageFramer()), exited, shutdownId).detach();
+  m_impl->pid = -1;
+  m_impl->stdin_pipe[1] = -1;
+  m_impl->stdout_pipe[0] = -1;
   m_impl->running = false;
 }
 
@@ -158,34 +474,55 @@ bool LSPClient::is_running() const {
   return m_impl->running;
 }
 
+bool LSPClient::hasExited() const {
+  return m_impl->exited.load(std::memory_order_acquire);
+}
+
+LSPMetrics LSPClient::metrics() const {
+  LSPMetrics metrics = m_metrics;
+  metrics.writeWaitMicros = m_impl->writeWaitMicros.load(std::memory_order_relaxed);
+  return metrics;
+}
+
 void LSPClient::initialize(const std::string& rootUri, ResponseCallback onSuccess, ErrorCallback onError) {
-  std::string params = "{"
-    "\"processId\":" + std::to_string(getpid()) + ","
-    "\"rootUri\":\"" + json::escape(rootUri) + "\","
-    "\"capabilities\":{"
-      "\"textDocument\":{"
-        "\"completion\":{\"dynamicRegistration\":false},"
-        "\"hover\":{\"dynamicRegistration\":false},"
-        "\"definition\":{\"dynamicRegistration\":false},"
-        "\"references\":{\"dynamicRegistration\":false},"
-        "\"documentSymbol\":{\"dynamicRegistration\":false}"
-      "}"
-    "}"
-  "}";
-
-  sendRequest("initialize", params,
-    [this, onSuccess](const std::string& result) {
-      // Parse capabilities from result
-      // For now, enable all capabilities (simplified)
-      m_capabilities.completionProvider = true;
-      m_capabilities.hoverProvider = true;
-      m_capabilities.definitionProvider = true;
-      m_capabilities.referencesProvider = true;
-      m_capabilities.documentSymbolProvider = true;
-      m_capabilities.textDocumentSync = 2; // Incremental
+  JSONWriter& writer = beginRequest("initialize",
+    [this, onSuccess](const JSONValue& result) {
+      // Providers are either booleans or option objects
+      JSONValue capabilities = result["capabilities"];
+      auto provided = [&capabilities](std::string_view name) {
+        JSONValue value = capabilities[name];
+        return value.isObject() || value.asBool();
+      };
+      m_capabilities.completionProvider = provided("completionProvider");
+      m_capabilities.hoverProvider = provided("hoverProvider");
+      m_capabilities.definitionProvider = provided("definitionProvider");
+      m_capabilities.referencesProvider = provided("referencesProvider");
+      m_capabilities.documentSymbolProvider = provided("documentSymbolProvider");
+      m_capabilities.workspaceSymbolProvider = provided("workspaceSymbolProvider");
+      m_capabilities.documentFormattingProvider = provided("documentFormattingProvider");
+      m_capabilities.documentRangeFormattingProvider = provided("documentRangeFormattingProvider");
+      m_capabilities.renameProvider = provided("renameProvider");
+      JSONValue sync = capabilities["textDocumentSync"];
+      m_capabilities.textDocumentSync = static_cast<int>(sync.isObject() ? sync["change"].asInt() : sync.asInt());
+      // "full" is a boolean or {"delta": bool}; "range" a boolean or {}
+      if (JSONValue tokens = capabilities["semanticTokensProvider"]) {
+        JSONValue full = tokens["full"];
+        m_capabilities.semanticTokensFull = full.isObject() || full.asBool();
+        m_capabilities.semanticTokensDelta = full["delta"].asBool();
+        m_capabilities.semanticTokensRange = tokens["range"].isObject() || tokens["range"].asBool();
+        m_capabilities.semanticTokenTypes.clear();
+        m_capabilities.semanticTokenModifiers.clear();
+        for (JSONValue name : tokens["legend"]["tokenTypes"].items()) {
+          m_capabilities.semanticTokenTypes.push_back(name.asString());
+        }
+        for (JSONValue name : tokens["legend"]["tokenModifiers"].items()) {
+          m_capabilities.semanticTokenModifiers.push_back(name.asString());
+        }
+      }
 
       // Send initialized notification
-      sendNotification("initialized", "{}");
+      beginNotification("initialized").beginObject().endObject();
+      sendMessage();
 
       if (onSuccess) {
         onSuccess(result);
@@ -193,259 +530,423 @@ void LSPClient::initialize(const std::string& rootUri, ResponseCallback onSucces
     },
     onError
   );
+  writer.beginObject()
+    .key("processId").value(static_cast<int64_t>(getpid()))
+    .key("rootUri").value(rootUri)
+    .key("capabilities").raw("{"
+      "\"textDocument\":{"
+        "\"completion\":{\"dynamicRegistration\":false},"
+        "\"hover\":{\"dynamicRegistration\":false},"
+        "\"definition\":{\"dynamicRegistration\":false},"
+        "\"references\":{\"dynamicRegistration\":false},"
+        "\"documentSymbol\":{\"dynamicRegistration\":false},"
+        "\"semanticTokens\":{\"dynamicRegistration\":false,"
+          "\"requests\":{\"full\":{\"delta\":true},\"range\":true},"
+          "\"tokenTypes\":[\"namespace\",\"type\",\"class\",\"enum\",\"interface\",\"struct\","
+            "\"typeParameter\",\"parameter\",\"variable\",\"property\",\"enumMember\",\"event\","
+            "\"function\",\"method\",\"macro\",\"keyword\",\"modifier\",\"comment\",\"string\","
+            "\"number\",\"regexp\",\"operator\",\"decorator\"],"
+          "\"tokenModifiers\":[\"declaration\",\"definition\",\"readonly\",\"static\",\"deprecated\","
+            "\"abstract\",\"async\",\"modification\",\"documentation\",\"defaultLibrary\"],"
+          "\"formats\":[\"relative\"],"
+          "\"overlappingTokenSupport\":false,"
+          "\"multilineTokenSupport\":false}"
+      "},"
+      "\"workspace\":{\"symbol\":{\"dynamicRegistration\":false}}"
+    "}")
+    .endObject();
+  sendMessage();
 }
 
 void LSPClient::didOpen(const TextDocumentItem& document) {
-  std::string params = "{"
-    "\"textDocument\":{"
-      "\"uri\":\"" + json::escape(document.uri) + "\","
-      "\"languageId\":\"" + json::escape(document.languageId) + "\","
-      "\"version\":" + std::to_string(document.version) + ","
-      "\"text\":\"" + json::escape(document.text) + "\""
-    "}"
-  "}";
-  sendNotification("textDocument/didOpen", params);
+  JSONWriter& writer = beginNotification("textDocument/didOpen");
+  writer.beginObject().key("textDocument").beginObject()
+    .key("uri").value(document.uri)
+    .key("languageId").value(document.languageId)
+    .key("version").value(document.version)
+    .key("text").value(document.text)
+    .endObject().endObject();
+  sendMessage();
+}
+
+void LSPClient::didOpen(const std::string& uri, const std::string& languageId, int version,
+                        const TextBuffer& text) {
+  JSONWriter& writer = beginNotification("textDocument/didOpen");
+  writer.beginObject().key("textDocument").beginObject()
+    .key("uri").value(uri)
+    .key("languageId").value(languageId)
+    .key("version").value(version)
+    .key("text");
+  writeText(writer, text);
+  writer.endObject().endObject();
+  sendMessage();
 }
 
 void LSPClient::didChange(const std::string& uri, int version,
                           const std::vector<TextDocumentContentChangeEvent>& changes) {
-  std::string changesJson = "[";
-  for (size_t i = 0; i < changes.size(); ++i) {
-    if (i > 0) changesJson += ",";
-    changesJson += "{\"text\":\"" + json::escape(changes[i].text) + "\"}";
+  JSONWriter& writer = beginNotification("textDocument/didChange");
+  writer.beginObject()
+    .key("textDocument").beginObject().key("uri").value(uri).key("version").value(version).endObject()
+    .key("contentChanges").beginArray();
+  for (const auto& change : changes) {
+    writer.beginObject();
+    if (change.range) {
+      writer.key("range");
+      writeRange(writer, *change.range);
+    }
+    writer.key("text").value(change.text).endObject();
   }
-  changesJson += "]";
+  writer.endArray().endObject();
+  sendMessage();
+}
 
-  std::string params = "{"
-    "\"textDocument\":{"
-      "\"uri\":\"" + json::escape(uri) + "\","
-      "\"version\":" + std::to_string(version) +
-    "},"
-    "\"contentChanges\":" + changesJson +
-  "}";
-  sendNotification("textDocument/didChange", params);
+void LSPClient::didChange(const std::string& uri, int version, const TextBuffer& text) {
+  JSONWriter& writer = beginNotification("textDocument/didChange");
+  writer.beginObject()
+    .key("textDocument").beginObject().key("uri").value(uri).key("version").value(version).endObject()
+    .key("contentChanges").beginArray().beginObject().key("text");
+  writeText(writer, text);
+  writer.endObject().endArray().endObject();
+  sendMessage();
 }
 
 void LSPClient::didClose(const std::string& uri) {
-  std::string params = "{\"textDocument\":" + json::textDocumentIdentifier(uri) + "}";
-  sendNotification("textDocument/didClose", params);
+  JSONWriter& writer = beginNotification("textDocument/didClose");
+  writer.beginObject();
+  writeTextDocument(writer, uri);
+  writer.endObject();
+  sendMessage();
 }
 
 void LSPClient::didSave(const std::string& uri) {
-  std::string params = "{\"textDocument\":" + json::textDocumentIdentifier(uri) + "}";
-  sendNotification("textDocument/didSave", params);
+  JSONWriter& writer = beginNotification("textDocument/didSave");
+  writer.beginObject();
+  writeTextDocument(writer, uri);
+  writer.endObject();
+  sendMessage();
 }
 
-void LSPClient::completion(const std::string& uri, LSPPosition position,
-                           ResponseCallback onSuccess, ErrorCallback onError) {
-  std::string params = json::textDocumentPositionParams(uri, position);
-  sendRequest("textDocument/completion", params, onSuccess, onError);
+int LSPClient::completion(const std::string& uri, LSPPosition position,
+                          ResponseCallback onSuccess, ErrorCallback onError) {
+  int id = m_nextRequestId;
+  JSONWriter& writer = beginRequest("textDocument/completion", std::move(onSuccess), std::move(onError));
+  writer.beginObject();
+  writeTextDocumentPosition(writer, uri, position);
+  writer.endObject();
+  sendMessage();
+  return id;
 }
 
-void LSPClient::hover(const std::string& uri, LSPPosition position,
-                     ResponseCallback onSuccess, ErrorCallback onError) {
-  std::string params = json::textDocumentPositionParams(uri, position);
-  sendRequest("textDocument/hover", params, onSuccess, onError);
+int LSPClient::hover(const std::string& uri, LSPPosition position,
+                    ResponseCallback onSuccess, ErrorCallback onError) {
+  int id = m_nextRequestId;
+  JSONWriter& writer = beginRequest("textDocument/hover", std::move(onSuccess), std::move(onError));
+  writer.beginObject();
+  writeTextDocumentPosition(writer, uri, position);
+  writer.endObject();
+  sendMessage();
+  return id;
 }
 
-void LSPClient::gotoDefinition(const std::string& uri, LSPPosition position,
-                               ResponseCallback onSuccess, ErrorCallback onError) {
-  std::string params = json::textDocumentPositionParams(uri, position);
-  sendRequest("textDocument/definition", params, onSuccess, onError);
+int LSPClient::gotoDefinition(const std::string& uri, LSPPosition position,
+                              ResponseCallback onSuccess, ErrorCallback onError) {
+  int id = m_nextRequestId;
+  JSONWriter& writer = beginRequest("textDocument/definition", std::move(onSuccess), std::move(onError));
+  writer.beginObject();
+  writeTextDocumentPosition(writer, uri, position);
+  writer.endObject();
+  sendMessage();
+  return id;
 }
 
-void LSPClient::references(const std::string& uri, LSPPosition position,
-                          ResponseCallback onSuccess, ErrorCallback onError) {
-  std::string params = json::textDocumentPositionParams(uri, position) +
-                      ",\"context\":{\"includeDeclaration\":true}";
-  sendRequest("textDocument/references", params, onSuccess, onError);
+
+int LSPClient::documentSymbols(const std::string& uri,
+                              ResponseCallback onSuccess, ErrorCallback onError) {
+  int id = m_nextRequestId;
+  JSONWriter& writer = beginRequest("textDocument/documentSymbol", std::move(onSuccess), std::move(onError));
+  writer.beginObject();
+  writeTextDocument(writer, uri);
+  writer.endObject();
+  sendMessage();
+  return id;
 }
 
-void LSPClient::documentSymbols(const std::string& uri,
-                               ResponseCallback onSuccess, ErrorCallback onError) {
-  std::string params = "{\"textDocument\":" + json::textDocumentIdentifier(uri) + "}";
-  sendRequest("textDocument/documentSymbol", params, onSuccess, onError);
+int LSPClient::semanticTokensFull(const std::string& uri,
+                                  ResponseCallback onSuccess, ErrorCallback onError) {
+  int id = m_nextRequestId;
+  JSONWriter& writer = beginRequest("textDocument/semanticTokens/full", std::move(onSuccess), std::move(onError));
+  writer.beginObject();
+  writeTextDocument(writer, uri);
+  writer.endObject();
+  sendMessage();
+  return id;
 }
 
-void LSPClient::onNotification(MessageCallback callback) {
-  m_notificationCallback = std::move(callback);
+int LSPClient::semanticTokensDelta(const std::string& uri, const std::string& previousResultId,
+                                   ResponseCallback onSuccess, ErrorCallback onError) {
+  int id = m_nextRequestId;
+  JSONWriter& writer = beginRequest("textDocument/semanticTokens/full/delta", std::move(onSuccess), std::move(onError));
+  writer.beginObject();
+  writeTextDocument(writer, uri);
+  writer.key("previousResultId").value(previousResultId);
+  writer.endObject();
+  sendMessage();
+  return id;
 }
 
-void LSPClient::onDiagnostics(std::function<void(const std::string&, const std::vector<Diagnostic>&)> callback) {
-  m_diagnosticsCallback = std::move(callback);
+int LSPClient::semanticTokensRange(const std::string& uri, LSPRange range,
+                                   ResponseCallback onSuccess, ErrorCallback onError) {
+  int id = m_nextRequestId;
+  JSONWriter& writer = beginRequest("textDocument/semanticTokens/range", std::move(onSuccess), std::move(onError));
+  writer.beginObject();
+  writeTextDocument(writer, uri);
+  writer.key("range");
+  writeRange(writer, range);
+  writer.endObject();
+  sendMessage();
+  return id;
 }
 
-void LSPClient::processMessages() {
-  if (!m_impl->running) {
-    return;
+int LSPClient::references(const std::string& uri, LSPPosition position, PartialResultCallback onPartial,
+                          ResponseCallback onSuccess, ErrorCallback onError) {
+  int id = m_nextRequestId;
+  JSONWriter& writer = beginRequest("textDocument/references", std::move(onSuccess), std::move(onError));
+  writer.beginObject();
+  writeTextDocumentPosition(writer, uri, position);
+  writer.key("context").beginObject().key("includeDeclaration").value(true).endObject();
+  if (onPartial) {
+    m_partialCallbacks[id] = std::move(onPartial);
+    writer.key("partialResultToken").value(id);
   }
+  writer.endObject();
+  sendMessage();
+  return id;
+}
 
-  // Check if there's data to read
-  struct pollfd pfd;
-  pfd.fd = m_impl->stdout_pipe[0];
-  pfd.events = POLLIN;
+int LSPClient::workspaceSymbols(const std::string& query, PartialResultCallback onPartial,
+                                ResponseCallback onSuccess, ErrorCallback onError) {
+  int id = m_nextRequestId;
+  JSONWriter& writer = beginRequest("workspace/symbol", std::move(onSuccess), std::move(onError));
+  writer.beginObject().key("query").value(query);
+  if (onPartial) {
+    m_partialCallbacks[id] = std::move(onPartial);
+    writer.key("partialResultToken").value(id);
+  }
+  writer.endObject();
+  sendMessage();
+  return id;
+}
 
-  int ret = poll(&pfd, 1, 0);
-  if (ret <= 0) {
-    return;
+void LSPClient::cancelRequest(int id) {
+  m_responseCallbacks.erase(id);
+  m_errorCallbacks.erase(id);
+  m_partialCallbacks.erase(id);
+  if (auto it = m_pending.find(id); it != m_pending.end()) {
+    --it->second.metrics->inFlight;
+    ++it->second.metrics->cancelled;
+    m_pending.erase(it);
   }
+  beginNotification("$/cancelRequest").beginObject().key("id").value(id).endObject();
+  sendMessage();
+}
 
-  // Read available data
-  char buffer[4096];
-  ssize_t n = read(m_impl->stdout_pipe[0], buffer, sizeof(buffer));
-  if (n > 0) {
-    m_impl->buffer.append(buffer, n);
+void LSPClient::onNotification(MessageCallback callback) {
+  m_notificationCallback = std::move(callback);
+}
 
-    // Process complete messages
-    while (true) {
-      std::string message = readMessage();
-      if (message.empty()) {
-        break;
-      }
-      handleMessage(message);
+void LSPClient::onDiagnostics(std::function<void(const std::string&, const std::vector<Diagnostic>&)> callback) {
+  m_diagnosticsCallback = std::move(callback);
+}
+
+void LSPClient::setWakeup(Wakeup* wakeup) {
+  m_impl->notify = wakeup;
+}
+
+void LSPClient::processMessages() {
+  // Messages keep their capacity for reuse unless they were unusually large
+  static constexpr size_t kRecycleLimit = 1024 * 1024;
+  std::unique_ptr<InboundMessage> message;
+  while (m_impl->inbound.pop(message)) {
+    if (message->valid) {
+      handleMessage(message->document.root(), {message->readAt, message->parseMicros, message->text.size()});
     }
+    if (message->text.capacity() <= kRecycleLimit) {
+      m_impl->recycled.push(std::move(message));
+    }
+    message.reset();
   }
 }
 
-void LSPClient::sendRequest(const std::string& method, const std::string& params,
-                            ResponseCallback onSuccess, ErrorCallback onError) {
+JSONWriter& LSPClient::beginRequest(std::string_view method, ResponseCallback onSuccess, ErrorCallback onError) {
   int id = m_nextRequestId++;
-
-  std::string message = "{"
-    "\"jsonrpc\":\"2.0\","
-    "\"id\":" + std::to_string(id) + ","
-    "\"method\":\"" + method + "\","
-    "\"params\":" + params +
-  "}";
-
   if (onSuccess) {
-    m_responseCallbacks[id] = onSuccess;
+    m_responseCallbacks[id] = std::move(onSuccess);
   }
   if (onError) {
-    m_errorCallbacks[id] = onError;
+    m_errorCallbacks[id] = std::move(onError);
   }
 
-  writeMessage(message);
+  m_sending = &m_metrics.method(method);
+  m_sendingRequest = id;
+
+  JSONWriter& writer = m_impl->writer;
+  writer.clear();
+  writer.beginObject().key("jsonrpc").value("2.0").key("id").value(id).key("method").value(method).key("params");
+  return writer;
 }
 
-void LSPClient::sendNotification(const std::string& method, const std::string& params) {
-  std::string message = "{"
-    "\"jsonrpc\":\"2.0\","
-    "\"method\":\"" + method + "\","
-    "\"params\":" + params +
-  "}";
-  writeMessage(message);
+JSONWriter& LSPClient::beginNotification(std::string_view method) {
+  m_sending = &m_metrics.method(method);
+  m_sendingRequest = 0;
+
+  JSONWriter& writer = m_impl->writer;
+  writer.clear();
+  writer.beginObject().key("jsonrpc").value("2.0").key("method").value(method).key("params");
+  return writer;
 }
 
-void LSPClient::handleMessage(const std::string& message) {
-  // Simple JSON parsing (in production, use a proper JSON library)
-  // Check if it's a response or notification
+// Small messages are written straight to the pipe while nothing is queued
+// ahead of them. Large ones, and whatever the pipe does not take, are handed
+// to the I/O thread, so the caller never waits on the server.
+void LSPClient::sendMessage() {
+  static constexpr size_t kDirectWriteLimit = 64 * 1024;
+  JSONWriter& writer = m_impl->writer;
+  writer.endObject();
+  MethodMetrics* metrics = std::exchange(m_sending, nullptr);
+  int requestId = std::exchange(m_sendingRequest, 0);
+  if (!m_impl->running) {
+    writer.clear();
+    return;
+  }
 
-  // Look for "id" field
-  size_t idPos = message.find("\"id\":");
-  if (idPos != std::string::npos) {
-    // It's a response
-    size_t idStart = idPos + 5;
-    while (idStart < message.size() && (message[idStart] == ' ' || message[idStart] == '\t')) {
-      idStart++;
-    }
-    size_t idEnd = idStart;
-    while (idEnd < message.size() && message[idEnd] >= '0' && message[idEnd] <= '9') {
-      idEnd++;
+  char header[48];
+  std::string_view headerView(header, formatHeader(header, sizeof(header), writer.size()));
+  auto now = std::chrono::steady_clock::now();
+  if (metrics) {
+    ++metrics->sent;
+    metrics->bytesSent += headerView.size() + writer.size();
+    if (requestId != 0) {
+      ++metrics->inFlight;
+      m_pending[requestId] = {metrics, now};
     }
+  }
+  size_t written = 0;
+  if (writer.size() <= kDirectWriteLimit && m_impl->pendingOutput.load(std::memory_order_acquire) == 0 &&
+      writeNonBlocking(m_impl->stdin_pipe[1], headerView, writer.str(), written)) {
+    // Keeps the buffer for the next message unless a whole document went out
+    writer.clear();
+    return;
+  }
 
-    if (idEnd > idStart) {
-      int id = std::stoi(message.substr(idStart, idEnd - idStart));
+  auto message = std::make_unique<OutboundMessage>();
+  message->header.assign(headerView);
+  message->body = writer.take();
+  message->written = written;
+  message->queuedAt = now;
+  ++m_metrics.deferredWrites;
+  m_impl->pendingOutput.fetch_add(1, std::memory_order_release);
+  m_impl->outbound.push(std::move(message));
+  m_impl->ioWakeup.signal();
+  writer.clear();
+}
 
-      // Check if it's an error response
-      size_t errorPos = message.find("\"error\":");
-      if (errorPos != std::string::npos) {
-        auto it = m_errorCallbacks.find(id);
-        if (it != m_errorCallbacks.end()) {
-          it->second(0, "LSP Error");
-          m_errorCallbacks.erase(it);
-        }
-        m_responseCallbacks.erase(id);
-      } else {
-        auto it = m_responseCallbacks.find(id);
-        if (it != m_responseCallbacks.end()) {
-          it->second(message);
-          m_responseCallbacks.erase(it);
-        }
-        m_errorCallbacks.erase(id);
+void LSPClient::handleMessage(const JSONValue& root, const Arrival& arrival) {
+  JSONValue id = root["id"];
+  JSONValue method = root["method"];
+  auto start = std::chrono::steady_clock::now();
+  auto record = [&](MethodMetrics& metrics) {
+    ++metrics.received;
+    metrics.bytesReceived += arrival.bytes;
+    metrics.parse.record(arrival.parseMicros);
+    metrics.queue.record(microsBetween(arrival.readAt + std::chrono::microseconds(arrival.parseMicros), start));
+  };
+
+  if (method.isString()) {
+    std::string name = method.asString();
+    JSONValue params = root["params"];
+    MethodMetrics& metrics = m_metrics.method(name);
+    record(metrics);
+    if (id.isValid()) {
+      handleServerRequest(id, name, params);
+    } else if (name == "textDocument/publishDiagnostics" && m_diagnosticsCallback) {
+      m_diagnosticsCallback(params["uri"].asString(), readDiagnostics(params["diagnostics"]));
+    } else if (name == "$/progress" && params["token"].isNumber()) {
+      // A batch of a streamed result; copied since the callback may cancel
+      auto partial = m_partialCallbacks.find(static_cast<int>(params["token"].asInt()));
+      if (partial != m_partialCallbacks.end()) {
+        PartialResultCallback onPartial = partial->second;
+        onPartial(params["value"]);
       }
     }
-  } else {
-    // It's a notification
-    size_t methodPos = message.find("\"method\":");
-    if (methodPos != std::string::npos) {
-      size_t methodStart = message.find("\"", methodPos + 9);
-      if (methodStart != std::string::npos) {
-        size_t methodEnd = message.find("\"", methodStart + 1);
-        if (methodEnd != std::string::npos) {
-          std::string method = message.substr(methodStart + 1, methodEnd - methodStart - 1);
-
-          // Handle diagnostics specially
-          if (method == "textDocument/publishDiagnostics" && m_diagnosticsCallback) {
-            // Extract URI and diagnostics (simplified)
-            // In production, use proper JSON parsing
-            m_diagnosticsCallback("", {});
-          }
-
-          if (m_notificationCallback) {
-            m_notificationCallback(method, message);
-          }
-        }
-      }
+    if (m_notificationCallback) {
+      m_notificationCallback(name, params);
     }
+    metrics.handler.record(microsBetween(start, std::chrono::steady_clock::now()));
+    return;
   }
-}
 
-std::string LSPClient::readMessage() {
-  // LSP messages use Content-Length header
-  size_t headerEnd = m_impl->buffer.find("\r\n\r\n");
-  if (headerEnd == std::string::npos) {
-    return "";
+  // A response to one of our requests; ids are always integers.
+  if (!id.isNumber()) {
+    return;
   }
-
-  // Parse Content-Length
-  size_t lengthPos = m_impl->buffer.find("Content-Length: ");
-  if (lengthPos == std::string::npos || lengthPos > headerEnd) {
-    m_impl->buffer.clear();
-    return "";
+  int requestId = static_cast<int>(id.asInt());
+  // Answers to cancelled requests are not counted
+  auto pending = m_pending.find(requestId);
+  if (pending == m_pending.end()) {
+    return;
   }
-
-  size_t lengthStart = lengthPos + 16;
-  size_t lengthEnd = m_impl->buffer.find("\r\n", lengthStart);
-  if (lengthEnd == std::string::npos) {
-    return "";
+  MethodMetrics& metrics = *pending->second.metrics;
+  auto sentAt = pending->second.sentAt;
+  m_pending.erase(pending);
+  --metrics.inFlight;
+  record(metrics);
+  metrics.server.record(microsBetween(sentAt, arrival.readAt));
+
+  // Take the callbacks out first: they may send requests of their own.
+  ResponseCallback onSuccess;
+  ErrorCallback onError;
+  if (auto it = m_responseCallbacks.find(requestId); it != m_responseCallbacks.end()) {
+    onSuccess = std::move(it->second);
+    m_responseCallbacks.erase(it);
   }
-
-  int contentLength = std::stoi(m_impl->buffer.substr(lengthStart, lengthEnd - lengthStart));
-  size_t messageStart = headerEnd + 4;
-
-  if (m_impl->buffer.size() < messageStart + contentLength) {
-    return ""; // Not enough data yet
+  if (auto it = m_errorCallbacks.find(requestId); it != m_errorCallbacks.end()) {
+    onError = std::move(it->second);
+    m_errorCallbacks.erase(it);
   }
+  m_partialCallbacks.erase(requestId);
 
-  std::string message = m_impl->buffer.substr(messageStart, contentLength);
-  m_impl->buffer.erase(0, messageStart + contentLength);
-
-  return message;
-}
-
-void LSPClient::writeMessage(const std::string& message) {
-  if (!m_impl->running || m_impl->stdin_pipe[1] < 0) {
-    return;
+  JSONValue error = root["error"];
+  if (error.isObject()) {
+    ++metrics.errors;
+    if (onError) {
+      onError(static_cast<int>(error["code"].asInt()), error["message"].asString("LSP Error"));
+    }
+  } else if (onSuccess) {
+    onSuccess(root["result"]);
   }
+  auto end = std::chrono::steady_clock::now();
+  metrics.handler.record(microsBetween(start, end));
+  metrics.latency.record(microsBetween(sentAt, end));
+}
 
-  std::string header = "Content-Length: " + std::to_string(message.size()) + "\r\n\r\n";
-  std::string fullMessage = header + message;
-
-  ssize_t written = write(m_impl->stdin_pipe[1], fullMessage.c_str(), fullMessage.size());
-  if (written < 0) {
-    std::cerr << "Failed to write to LSP server: " << strerror(errno) << std::endl;
+// Requests from the server must be answered or some servers stall. None of
+// them is acted on yet, so each gets an empty result of the expected shape.
+void LSPClient::handleServerRequest(const JSONValue& id, std::string_view method, const JSONValue& params) {
+  m_sending = &m_metrics.method(method);
+  m_sendingRequest = 0;
+  JSONWriter& writer = m_impl->writer;
+  writer.clear();
+  writer.beginObject().key("jsonrpc").value("2.0").key("id").raw(id.raw()).key("result");
+  if (method == "workspace/configuration") {
+    writer.beginArray();
+    for (size_t i = 0; i < params["items"].size(); ++i) {
+      writer.null();
+    }
+    writer.endArray();
+  } else {
+    writer.null();
   }
+  sendMessage();
 }
 
 } // namespace lsp
@@ -0,0 +1,87 @@
+#include "lsp_completion.h"
+
+#include <algorithm>
+
+namespace prodigeetor {
+namespace lsp {
+
+void CompletionCache::store(CompletionList list, std::string prefix) {
+  m_items = std::move(list.items);
+  m_incomplete = list.isIncomplete;
+  m_requestPrefix = std::move(prefix);
+  m_entries.clear();
+  m_entries.reserve(m_items.size());
+  for (const CompletionItem& item : m_items) {
+    std::string_view key = item.filterText.empty() ? item.label : item.filterText;
+    m_entries.push_back({fuzzy_char_mask(key), key});
+  }
+  m_survivors.clear();
+  m_lastPrefix.clear();
+  m_filtered = false;
+}
+
+void CompletionCache::clear() {
+  store({}, {});
+}
+
+bool CompletionCache::covers(std::string_view prefix) const {
+  return !m_incomplete && prefix.substr(0, m_requestPrefix.size()) == m_requestPrefix;
+}
+
+std::vector<CompletionItem> CompletionCache::filter(std::string_view prefix, size_t limit) {
+  FuzzyPattern pattern(prefix);
+  m_matches.clear();
+  // A longer prefix can only match items the shorter one matched
+  bool narrowing = m_filtered && prefix.substr(0, m_lastPrefix.size()) == m_lastPrefix;
+  if (narrowing) {
+    size_t kept = 0;
+    for (uint32_t index : m_survivors) {
+      int score = fuzzy_score(m_entries[index].key, m_entries[index].mask, pattern);
+      if (score >= 0) {
+        m_survivors[kept++] = index;
+        m_matches.push_back({score, index});
+      }
+    }
+    m_survivors.resize(kept);
+  } else {
+    m_survivors.clear();
+    for (uint32_t index = 0; index < m_entries.size(); ++index) {
+      int score = fuzzy_score(m_entries[index].key, m_entries[index].mask, pattern);
+      if (score >= 0) {
+        m_survivors.push_back(index);
+        m_matches.push_back({score, index});
+      }
+    }
+  }
+  m_lastPrefix.assign(prefix);
+  m_filtered = true;
+
+  auto better = [this](const Match& a, const Match& b) {
+    if (a.score != b.score) {
+      return a.score > b.score;
+    }
+    const CompletionItem& left = m_items[a.index];
+    const CompletionItem& right = m_items[b.index];
+    const std::string& leftSort = left.sortText.empty() ? left.label : left.sortText;
+    const std::string& rightSort = right.sortText.empty() ? right.label : right.sortText;
+    if (leftSort != rightSort) {
+      return leftSort < rightSort;
+    }
+    return a.index < b.index;
+  };
+  if (m_matches.size() > limit) {
+    std::nth_element(m_matches.begin(), m_matches.begin() + static_cast<std::ptrdiff_t>(limit), m_matches.end(), better);
+    m_matches.resize(limit);
+  }
+  std::sort(m_matches.begin(), m_matches.end(), better);
+
+  std::vector<CompletionItem> items;
+  items.reserve(m_matches.size());
+  for (const Match& match : m_matches) {
+    items.push_back(m_items[match.index]);
+  }
+  return items;
+}
+
+} // namespace lsp
+} // namespace prodigeetor
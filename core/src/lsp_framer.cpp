@@ -0,0 +1,178 @@
+#include "lsp_framer.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <iostream>
+#include <unistd.h>
+
+namespace prodigeetor {
+namespace lsp {
+
+namespace {
+
+// Bodies beyond this are treated as a corrupt header.
+constexpr size_t kMaxContentLength = size_t(1) << 30;
+
+// Case-insensitive search for the last occurrence of `name` in `text`.
+size_t findLastField(std::string_view text, std::string_view name) {
+  if (text.size() < name.size()) {
+    return std::string_view::npos;
+  }
+  for (size_t i = text.size() - name.size() + 1; i-- > 0;) {
+    bool match = true;
+    for (size_t j = 0; j < name.size() && match; ++j) {
+      char c = text[i + j];
+      match = (c >= 'A' && c <= 'Z' ? static_cast<char>(c + 32) : c) == name[j];
+    }
+    if (match) {
+      return i;
+    }
+  }
+  return std::string_view::npos;
+}
+
+} // anonymous namespace
+
+MessageFramer::MessageFramer() : m_ring(new char[kRingSize]) {}
+
+void MessageFramer::reset() {
+  m_start = m_end = m_scanned = 0;
+  m_inBody = false;
+  m_bodyFilled = 0;
+  m_body.clear();
+}
+
+bool MessageFramer::read(int fd, const Handler &onMessage) {
+  for (;;) {
+    ssize_t n;
+    size_t remaining = m_body.size() - m_bodyFilled;
+    if (m_inBody && m_start == m_end && remaining >= kDirectReadMin) {
+      n = ::read(fd, m_body.data() + m_bodyFilled, remaining);
+      if (n > 0) {
+        m_bodyFilled += static_cast<size_t>(n);
+        if (m_bodyFilled == m_body.size()) {
+          finishBody(onMessage);
+        }
+        continue;
+      }
+    } else {
+      if (m_start == m_end) {
+        m_start = m_end = m_scanned = 0;
+      } else if (m_end == kRingSize) {
+        // Move the partial header (or small body tail) to the front
+        std::memmove(m_ring.get(), m_ring.get() + m_start, m_end - m_start);
+        m_scanned -= std::min(m_scanned, m_start);
+        m_end -= m_start;
+        m_start = 0;
+      }
+      n = ::read(fd, m_ring.get() + m_end, kRingSize - m_end);
+      if (n > 0) {
+        m_end += static_cast<size_t>(n);
+        consume(onMessage);
+        continue;
+      }
+    }
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    return n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+  }
+}
+
+void MessageFramer::feed(std::string_view bytes, const Handler &onMessage) {
+  while (!bytes.empty()) {
+    if (m_start == m_end) {
+      m_start = m_end = m_scanned = 0;
+    } else if (m_end == kRingSize) {
+      std::memmove(m_ring.get(), m_ring.get() + m_start, m_end - m_start);
+      m_scanned -= std::min(m_scanned, m_start);
+      m_end -= m_start;
+      m_start = 0;
+    }
+    size_t take = std::min(bytes.size(), kRingSize - m_end);
+    std::memcpy(m_ring.get() + m_end, bytes.data(), take);
+    m_end += take;
+    bytes.remove_prefix(take);
+    consume(onMessage);
+  }
+}
+
+// Frames as much of the ring as possible.
+void MessageFramer::consume(const Handler &onMessage) {
+  while (m_start < m_end) {
+    if (m_inBody) {
+      size_t take = std::min(m_end - m_start, m_body.size() - m_bodyFilled);
+      std::memcpy(m_body.data() + m_bodyFilled, m_ring.get() + m_start, take);
+      m_bodyFilled += take;
+      m_start += take;
+      if (m_bodyFilled == m_body.size()) {
+        finishBody(onMessage);
+      }
+      continue;
+    }
+
+    // Only the bytes that arrived since the last search are scanned
+    std::string_view pending(m_ring.get() + m_start, m_end - m_start);
+    size_t from = m_scanned > m_start + 3 ? m_scanned - m_start - 3 : 0;
+    size_t headerEnd = pending.find("\r\n\r\n", from);
+    if (headerEnd == std::string_view::npos) {
+      m_scanned = m_end;
+      if (m_start == 0 && m_end == kRingSize) {
+        // No header fits in the ring; keep the tail that may start one
+        std::cerr << "[LSP] Dropping " << kRingSize - 3 << " bytes without a message header" << std::endl;
+        m_skipped += kRingSize - 3;
+        m_start = kRingSize - 3;
+      }
+      return;
+    }
+
+    std::string_view block = pending.substr(0, headerEnd);
+    m_start += headerEnd + 4;
+    m_scanned = m_start;
+    if (!parseHeader(block)) {
+      std::cerr << "[LSP] Skipping " << headerEnd + 4 << " bytes without a usable Content-Length" << std::endl;
+      m_skipped += headerEnd + 4;
+    } else if (m_body.empty()) {
+      finishBody(onMessage);
+    }
+  }
+  if (m_start == m_end) {
+    m_start = m_end = m_scanned = 0;
+  }
+}
+
+// Reads Content-Length from a header block. Other fields are ignored, and so
+// is whatever precedes the last Content-Length, such as the tail of a broken
+// message.
+bool MessageFramer::parseHeader(std::string_view block) {
+  size_t field = findLastField(block, "content-length:");
+  if (field == std::string_view::npos) {
+    return false;
+  }
+  const char *digits = block.data() + field + 15;
+  const char *end = block.data() + block.size();
+  while (digits < end && *digits == ' ') {
+    ++digits;
+  }
+  size_t length = 0;
+  auto result = std::from_chars(digits, end, length);
+  if (result.ec != std::errc() || length > kMaxContentLength) {
+    return false;
+  }
+
+  m_body.resize(length);
+  m_bodyFilled = 0;
+  m_inBody = true;
+  return true;
+}
+
+void MessageFramer::finishBody(const Handler &onMessage) {
+  m_inBody = false;
+  onMessage(m_body);
+  m_bodyFilled = 0;
+}
+
+} // namespace lsp
+} // namespace prodigeetor
@@ -0,0 +1,654 @@
+#include "lsp_json.h"
+
+#include <charconv>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+namespace prodigeetor {
+namespace lsp {
+
+namespace {
+
+// Index of the next '"' or '\\' at or after pos, or a value >= size. String
+// bodies are most of an LSP payload, so they are scanned 16 bytes at a time.
+size_t scanString(const char *data, size_t pos, size_t size) {
+#if defined(__SSE2__)
+  const __m128i quote = _mm_set1_epi8('"');
+  const __m128i backslash = _mm_set1_epi8('\\');
+  while (pos + 16 <= size) {
+    __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + pos));
+    int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)));
+    if (mask != 0) {
+      return pos + static_cast<size_t>(__builtin_ctz(static_cast<unsigned>(mask)));
+    }
+    pos += 16;
+  }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+  const uint8x16_t quote = vdupq_n_u8('"');
+  const uint8x16_t backslash = vdupq_n_u8('\\');
+  while (pos + 16 <= size) {
+    uint8x16_t chunk = vld1q_u8(reinterpret_cast<const uint8_t *>(data + pos));
+    if (vmaxvq_u8(vorrq_u8(vceqq_u8(chunk, quote), vceqq_u8(chunk, backslash))) != 0) {
+      break;
+    }
+    pos += 16;
+  }
+#endif
+  while (pos < size && data[pos] != '"' && data[pos] != '\\') {
+    ++pos;
+  }
+  return pos;
+}
+
+// First byte at or after `pos` that a JSON string must escape.
+size_t scanEscape(const char *data, size_t pos, size_t size) {
+#if defined(__SSE2__)
+  const __m128i quote = _mm_set1_epi8('"');
+  const __m128i backslash = _mm_set1_epi8('\\');
+  const __m128i control = _mm_set1_epi8(0x1F);
+  while (pos + 16 <= size) {
+    __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + pos));
+    // Unsigned c <= 0x1F is max(c, 0x1F) == 0x1F
+    __m128i special = _mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash));
+    special = _mm_or_si128(special, _mm_cmpeq_epi8(_mm_max_epu8(chunk, control), control));
+    int mask = _mm_movemask_epi8(special);
+    if (mask != 0) {
+      return pos + static_cast<size_t>(__builtin_ctz(static_cast<unsigned>(mask)));
+    }
+    pos += 16;
+  }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+  const uint8x16_t quote = vdupq_n_u8('"');
+  const uint8x16_t backslash = vdupq_n_u8('\\');
+  const uint8x16_t control = vdupq_n_u8(0x20);
+  while (pos + 16 <= size) {
+    uint8x16_t chunk = vld1q_u8(reinterpret_cast<const uint8_t *>(data + pos));
+    uint8x16_t special = vorrq_u8(vceqq_u8(chunk, quote), vceqq_u8(chunk, backslash));
+    if (vmaxvq_u8(vorrq_u8(special, vcltq_u8(chunk, control))) != 0) {
+      break;
+    }
+    pos += 16;
+  }
+#endif
+  while (pos < size) {
+    unsigned char c = static_cast<unsigned char>(data[pos]);
+    if (c < 0x20 || c == '"' || c == '\\') {
+      break;
+    }
+    ++pos;
+  }
+  return pos;
+}
+
+bool isNumberChar(char c) {
+  return (c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E';
+}
+
+void appendUtf8(std::string &out, uint32_t codepoint) {
+  if (codepoint < 0x80) {
+    out.push_back(static_cast<char>(codepoint));
+  } else if (codepoint < 0x800) {
+    out.push_back(static_cast<char>(0xC0 | (codepoint >> 6)));
+    out.push_back(static_cast<char>(0x80 | (codepoint & 0x3F)));
+  } else if (codepoint < 0x10000) {
+    out.push_back(static_cast<char>(0xE0 | (codepoint >> 12)));
+    out.push_back(static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F)));
+    out.push_back(static_cast<char>(0x80 | (codepoint & 0x3F)));
+  } else {
+    out.push_back(static_cast<char>(0xF0 | (codepoint >> 18)));
+    out.push_back(static_cast<char>(0x80 | ((codepoint >> 12) & 0x3F)));
+    out.push_back(static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F)));
+    out.push_back(static_cast<char>(0x80 | (codepoint & 0x3F)));
+  }
+}
+
+bool parseHex4(std::string_view text, size_t pos, uint32_t &value) {
+  if (pos + 4 > text.size()) {
+    return false;
+  }
+  auto result = std::from_chars(text.data() + pos, text.data() + pos + 4, value, 16);
+  return result.ec == std::errc() && result.ptr == text.data() + pos + 4;
+}
+
+} // anonymous namespace
+
+bool JSONDocument::fail(size_t offset, const char *message) {
+  m_errorOffset = offset;
+  m_error = message;
+  m_nodes.clear();
+  return false;
+}
+
+bool JSONDocument::parse(std::string_view text) {
+  m_text = text;
+  m_nodes.clear();
+  m_stack.clear();
+  m_error = nullptr;
+  m_errorOffset = 0;
+  if (text.size() >= UINT32_MAX) {
+    return fail(0, "document too large");
+  }
+
+  const char *data = text.data();
+  const size_t size = text.size();
+  size_t pos = 0;
+  // LSP payloads average a node every 10-15 bytes
+  m_nodes.reserve(size / 8 + 1);
+
+  auto skipWhitespace = [&]() {
+    while (pos < size && (data[pos] == ' ' || data[pos] == '\n' || data[pos] == '\r' || data[pos] == '\t')) {
+      ++pos;
+    }
+  };
+  auto parseString = [&]() -> bool {
+    size_t quote = pos;
+    Node node;
+    node.type = JSONValue::Type::String;
+    node.start = static_cast<uint32_t>(quote + 1);
+    size_t end = quote + 1;
+    while (true) {
+      end = scanString(data, end, size);
+      if (end >= size) {
+        return fail(quote, "unterminated string");
+      }
+      if (data[end] == '"') {
+        break;
+      }
+      node.escaped = true;
+      end += 2;
+    }
+    node.length = static_cast<uint32_t>(end - node.start);
+    node.next = static_cast<uint32_t>(m_nodes.size() + 1);
+    m_nodes.push_back(node);
+    pos = end + 1;
+    return true;
+  };
+  auto parseKey = [&]() -> bool {
+    skipWhitespace();
+    if (pos >= size || data[pos] != '"') {
+      return fail(pos, "expected member name");
+    }
+    if (!parseString()) {
+      return false;
+    }
+    skipWhitespace();
+    if (pos >= size || data[pos] != ':') {
+      return fail(pos, "expected ':'");
+    }
+    ++pos;
+    return true;
+  };
+  auto parseLiteral = [&](std::string_view literal, JSONValue::Type type) -> bool {
+    if (text.substr(pos, literal.size()) != literal) {
+      return fail(pos, "invalid literal");
+    }
+    Node node;
+    node.type = type;
+    node.start = static_cast<uint32_t>(pos);
+    node.length = static_cast<uint32_t>(literal.size());
+    node.next = static_cast<uint32_t>(m_nodes.size() + 1);
+    m_nodes.push_back(node);
+    pos += literal.size();
+    return true;
+  };
+
+  while (true) {
+    skipWhitespace();
+    if (pos >= size) {
+      return fail(pos, "unexpected end of input");
+    }
+    char c = data[pos];
+    if (c == '{' || c == '[') {
+      Node node;
+      node.type = c == '{' ? JSONValue::Type::Object : JSONValue::Type::Array;
+      node.start = static_cast<uint32_t>(pos);
+      m_stack.push_back(static_cast<uint32_t>(m_nodes.size()));
+      m_nodes.push_back(node);
+      ++pos;
+      skipWhitespace();
+      char close = c == '{' ? '}' : ']';
+      if (pos < size && data[pos] == close) {
+        ++pos;
+        Node &empty = m_nodes[m_stack.back()];
+        empty.length = static_cast<uint32_t>(pos - empty.start);
+        empty.next = static_cast<uint32_t>(m_nodes.size());
+        m_stack.pop_back();
+      } else {
+        if (c == '{' && !parseKey()) {
+          return false;
+        }
+        continue;
+      }
+    } else if (c == '"') {
+      if (!parseString()) {
+        return false;
+      }
+    } else if (c == 't') {
+      if (!parseLiteral("true", JSONValue::Type::Bool)) {
+        return false;
+      }
+    } else if (c == 'f') {
+      if (!parseLiteral("false", JSONValue::Type::Bool)) {
+        return false;
+      }
+    } else if (c == 'n') {
+      if (!parseLiteral("null", JSONValue::Type::Null)) {
+        return false;
+      }
+    } else if (c == '-' || (c >= '0' && c <= '9')) {
+      Node node;
+      node.type = JSONValue::Type::Number;
+      node.start = static_cast<uint32_t>(pos);
+      while (pos < size && isNumberChar(data[pos])) {
+        ++pos;
+      }
+      node.length = static_cast<uint32_t>(pos - node.start);
+      node.next = static_cast<uint32_t>(m_nodes.size() + 1);
+      m_nodes.push_back(node);
+    } else {
+      return fail(pos, "unexpected character");
+    }
+
+    // A value is complete: consume the separator, or close as many
+    // containers as end here.
+    while (true) {
+      if (m_stack.empty()) {
+        skipWhitespace();
+        if (pos != size) {
+          return fail(pos, "trailing characters");
+        }
+        return true;
+      }
+      Node &parent = m_nodes[m_stack.back()];
+      skipWhitespace();
+      if (pos >= size) {
+        return fail(pos, "unexpected end of input");
+      }
+      char separator = data[pos++];
+      if (separator == ',') {
+        if (parent.type == JSONValue::Type::Object && !parseKey()) {
+          return false;
+        }
+        break;
+      }
+      if (separator != (parent.type == JSONValue::Type::Object ? '}' : ']')) {
+        return fail(pos - 1, "expected ',' or closing bracket");
+      }
+      parent.length = static_cast<uint32_t>(pos - parent.start);
+      parent.next = static_cast<uint32_t>(m_nodes.size());
+      m_stack.pop_back();
+    }
+  }
+}
+
+JSONValue JSONDocument::root() const {
+  if (m_error || m_nodes.empty()) {
+    return JSONValue();
+  }
+  return JSONValue(this, 0);
+}
+
+JSONValue::Type JSONValue::type() const {
+  return m_document ? m_document->m_nodes[m_index].type : Type::Invalid;
+}
+
+JSONValue JSONValue::operator[](std::string_view key) const {
+  if (!isObject()) {
+    return JSONValue();
+  }
+  const auto &nodes = m_document->m_nodes;
+  for (uint32_t i = m_index + 1; i < nodes[m_index].next; i = nodes[i + 1].next) {
+    if (m_document->m_text.substr(nodes[i].start, nodes[i].length) == key) {
+      return JSONValue(m_document, i + 1);
+    }
+  }
+  return JSONValue();
+}
+
+size_t JSONValue::size() const {
+  Type kind = type();
+  if (kind != Type::Array && kind != Type::Object) {
+    return 0;
+  }
+  const auto &nodes = m_document->m_nodes;
+  size_t count = 0;
+  for (uint32_t i = m_index + 1; i < nodes[m_index].next; i = nodes[i].next) {
+    ++count;
+  }
+  // Object members are key and value node pairs
+  return kind == Type::Object ? count / 2 : count;
+}
+
+JSONValue::Range<JSONValue::Iterator> JSONValue::items() const {
+  if (!isArray()) {
+    return {Iterator(nullptr, 0), Iterator(nullptr, 0)};
+  }
+  return {Iterator(m_document, m_index + 1), Iterator(m_document, m_document->m_nodes[m_index].next)};
+}
+
+JSONValue::Range<JSONValue::MemberIterator> JSONValue::members() const {
+  if (!isObject()) {
+    return {MemberIterator(nullptr, 0), MemberIterator(nullptr, 0)};
+  }
+  return {MemberIterator(m_document, m_index + 1), MemberIterator(m_document, m_document->m_nodes[m_index].next)};
+}
+
+JSONValue::Iterator &JSONValue::Iterator::operator++() {
+  m_index = m_document->m_nodes[m_index].next;
+  return *this;
+}
+
+JSONValue::Member JSONValue::MemberIterator::operator*() const {
+  const auto &key = m_document->m_nodes[m_index];
+  return Member{m_document->m_text.substr(key.start, key.length), JSONValue(m_document, m_index + 1)};
+}
+
+JSONValue::MemberIterator &JSONValue::MemberIterator::operator++() {
+  m_index = m_document->m_nodes[m_index + 1].next;
+  return *this;
+}
+
+bool JSONValue::asBool(bool fallback) const {
+  if (!isBool()) {
+    return fallback;
+  }
+  return m_document->m_text[m_document->m_nodes[m_index].start] == 't';
+}
+
+int64_t JSONValue::asInt(int64_t fallback) const {
+  if (!isNumber()) {
+    return fallback;
+  }
+  std::string_view text = raw();
+  int64_t value = 0;
+  auto result = std::from_chars(text.data(), text.data() + text.size(), value);
+  if (result.ec != std::errc()) {
+    return static_cast<int64_t>(asDouble(static_cast<double>(fallback)));
+  }
+  return value;
+}
+
+double JSONValue::asDouble(double fallback) const {
+  if (!isNumber()) {
+    return fallback;
+  }
+  std::string_view text = raw();
+  char buffer[64];
+  if (text.size() >= sizeof(buffer)) {
+    return fallback;
+  }
+  std::memcpy(buffer, text.data(), text.size());
+  buffer[text.size()] = '\0';
+  return std::strtod(buffer, nullptr);
+}
+
+bool JSONValue::hasEscapes() const {
+  return isString() && m_document->m_nodes[m_index].escaped;
+}
+
+std::string_view JSONValue::stringView() const {
+  if (!isString() || m_document->m_nodes[m_index].escaped) {
+    return std::string_view();
+  }
+  const auto &node = m_document->m_nodes[m_index];
+  return m_document->m_text.substr(node.start, node.length);
+}
+
+std::string JSONValue::asString(std::string_view fallback) const {
+  if (!isString()) {
+    return std::string(fallback);
+  }
+  const auto &node = m_document->m_nodes[m_index];
+  std::string_view body = m_document->m_text.substr(node.start, node.length);
+  if (!node.escaped) {
+    return std::string(body);
+  }
+
+  std::string out;
+  out.reserve(body.size());
+  size_t pos = 0;
+  while (pos < body.size()) {
+    size_t escape = body.find('\\', pos);
+    if (escape == std::string_view::npos) {
+      out.append(body.substr(pos));
+      break;
+    }
+    out.append(body.substr(pos, escape - pos));
+    if (escape + 1 >= body.size()) {
+      break;
+    }
+    char c = body[escape + 1];
+    pos = escape + 2;
+    switch (c) {
+      case 'n': out.push_back('\n'); break;
+      case 't': out.push_back('\t'); break;
+      case 'r': out.push_back('\r'); break;
+      case 'b': out.push_back('\b'); break;
+      case 'f': out.push_back('\f'); break;
+      case 'u': {
+        uint32_t codepoint = 0;
+        if (!parseHex4(body, pos, codepoint)) {
+          break;
+        }
+        pos += 4;
+        uint32_t low = 0;
+        if (codepoint >= 0xD800 && codepoint < 0xDC00 && body.substr(pos, 2) == "\\u" &&
+            parseHex4(body, pos + 2, low) && low >= 0xDC00 && low < 0xE000) {
+          codepoint = 0x10000 + ((codepoint - 0xD800) << 10) + (low - 0xDC00);
+          pos += 6;
+        }
+        appendUtf8(out, codepoint);
+        break;
+      }
+      default: out.push_back(c); break; // '"', '\\' and '/'
+    }
+  }
+  return out;
+}
+
+std::string_view JSONValue::raw() const {
+  if (!m_document) {
+    return std::string_view();
+  }
+  const auto &node = m_document->m_nodes[m_index];
+  if (node.type == Type::String) {
+    return m_document->m_text.substr(node.start - 1, node.length + 2);
+  }
+  return m_document->m_text.substr(node.start, node.length);
+}
+
+void appendEscaped(std::string &out, std::string_view text) {
+  static const char hex[] = "0123456789abcdef";
+  const char *data = text.data();
+  size_t size = text.size();
+  size_t run = 0;
+  for (size_t i = scanEscape(data, 0, size); i < size; i = scanEscape(data, i + 1, size)) {
+    out.append(data + run, i - run);
+    run = i + 1;
+    unsigned char c = static_cast<unsigned char>(data[i]);
+    switch (c) {
+      case '"': out.append("\\\""); break;
+      case '\\': out.append("\\\\"); break;
+      case '\n': out.append("\\n"); break;
+      case '\r': out.append("\\r"); break;
+      case '\t': out.append("\\t"); break;
+      case '\b': out.append("\\b"); break;
+      case '\f': out.append("\\f"); break;
+      default:
+        out.append("\\u00");
+        out.push_back(hex[c >> 4]);
+        out.push_back(hex[c & 0xF]);
+        break;
+    }
+  }
+  out.append(data + run, size - run);
+}
+
+void JSONWriter::clear(size_t keep_capacity) {
+  if (m_out.capacity() > keep_capacity) {
+    std::string().swap(m_out);
+  } else {
+    m_out.clear();
+  }
+  m_needsComma = false;
+}
+
+void JSONWriter::separate() {
+  if (m_needsComma) {
+    m_out.push_back(',');
+  }
+  m_needsComma = true;
+}
+
+JSONWriter &JSONWriter::beginObject() {
+  separate();
+  m_out.push_back('{');
+  m_needsComma = false;
+  return *this;
+}
+
+JSONWriter &JSONWriter::endObject() {
+  m_out.push_back('}');
+  m_needsComma = true;
+  return *this;
+}
+
+JSONWriter &JSONWriter::beginArray() {
+  separate();
+  m_out.push_back('[');
+  m_needsComma = false;
+  return *this;
+}
+
+JSONWriter &JSONWriter::endArray() {
+  m_out.push_back(']');
+  m_needsComma = true;
+  return *this;
+}
+
+JSONWriter &JSONWriter::key(std::string_view name) {
+  separate();
+  m_out.push_back('"');
+  m_out.append(name);
+  m_out.append("\":");
+  m_needsComma = false;
+  return *this;
+}
+
+JSONWriter &JSONWriter::value(std::string_view text) {
+  separate();
+  m_out.reserve(m_out.size() + text.size() + 2);
+  m_out.push_back('"');
+  appendEscaped(m_out, text);
+  m_out.push_back('"');
+  return *this;
+}
+
+JSONWriter &JSONWriter::value(int64_t number) {
+  separate();
+  char digits[24];
+  auto result = std::to_chars(digits, digits + sizeof(digits), number);
+  m_out.append(digits, static_cast<size_t>(result.ptr - digits));
+  return *this;
+}
+
+JSONWriter &JSONWriter::value(bool flag) {
+  separate();
+  m_out.append(flag ? "true" : "false");
+  return *this;
+}
+
+JSONWriter &JSONWriter::null() {
+  separate();
+  m_out.append("null");
+  return *this;
+}
+
+JSONWriter &JSONWriter::raw(std::string_view json) {
+  separate();
+  m_out.append(json);
+  return *this;
+}
+
+JSONWriter &JSONWriter::beginString() {
+  separate();
+  m_out.push_back('"');
+  return *this;
+}
+
+JSONWriter &JSONWriter::stringPart(std::string_view text) {
+  appendEscaped(m_out, text);
+  return *this;
+}
+
+JSONWriter &JSONWriter::endString() {
+  m_out.push_back('"');
+  return *this;
+}
+
+void writePosition(JSONWriter &writer, const LSPPosition &position) {
+  writer.beginObject()
+    .key("line").value(position.line)
+    .key("character").value(position.character)
+    .endObject();
+}
+
+void writeRange(JSONWriter &writer, const LSPRange &range) {
+  writer.beginObject().key("start");
+  writePosition(writer, range.start);
+  writer.key("end");
+  writePosition(writer, range.end);
+  writer.endObject();
+}
+
+LSPPosition readPosition(const JSONValue &value) {
+  return LSPPosition{static_cast<int>(value["line"].asInt()), static_cast<int>(value["character"].asInt())};
+}
+
+LSPRange readRange(const JSONValue &value) {
+  return LSPRange{readPosition(value["start"]), readPosition(value["end"])};
+}
+
+LSPLocation readLocation(const JSONValue &value) {
+  LSPLocation location;
+  if (JSONValue targetUri = value["targetUri"]) {
+    location.uri = targetUri.asString();
+    location.range = readRange(value["targetSelectionRange"]);
+  } else {
+    location.uri = value["uri"].asString();
+    location.range = readRange(value["range"]);
+  }
+  return location;
+}
+
+void readUIntArray(const JSONValue &value, std::vector<uint32_t> &out) {
+  if (!value.isArray()) {
+    return;
+  }
+  // Token arrays run to hundreds of thousands of numbers; parsing the digits
+  // here avoids walking a tape node per element.
+  std::string_view text = value.raw();
+  out.reserve(out.size() + text.size() / 3);
+  uint32_t number = 0;
+  bool digits = false;
+  for (char c : text) {
+    unsigned digit = static_cast<unsigned char>(c) - '0';
+    if (digit < 10) {
+      number = number * 10 + digit;
+      digits = true;
+    } else if (digits) {
+      out.push_back(number);
+      number = 0;
+      digits = false;
+    }
+  }
+}
+
+} // namespace lsp
+} // namespace prodigeetor
@@ -1,5 +1,10 @@
 #include "lsp_manager.h"
+#include "grapheme.h"
 #include <algorithm>
+#include <iterator>
+#include <map>
+#include <set>
+#include <tuple>
 #include <iostream>
 #include <sstream>
 #include <cctype>
@@ -7,135 +12,173 @@
 namespace prodigeetor {
 namespace lsp {
 
-// Simple JSON parsing helpers
+// Readers for response results, parsed once by LSPClient
 namespace {
 
-std::string extractStringValue(const std::string& json, const std::string& key, size_t start = 0) {
-  std::string searchKey = "\"" + key + "\"";
-  size_t pos = json.find(searchKey, start);
-  if (pos == std::string::npos) {
-    return "";
+// MarkupContent, MarkedString, a plain string or an array of those
+std::string readMarkup(const JSONValue& value) {
+  if (value.isString()) {
+    return value.asString();
   }
-
-  size_t colonPos = json.find(':', pos);
-  if (colonPos == std::string::npos) {
-    return "";
+  if (value.isObject()) {
+    return value["value"].asString();
   }
-
-  size_t valueStart = json.find('"', colonPos);
-  if (valueStart == std::string::npos) {
-    return "";
+  std::string text;
+  for (JSONValue part : value.items()) {
+    if (!text.empty()) {
+      text += "\n\n";
+    }
+    text += readMarkup(part);
   }
-  valueStart++;
+  return text;
+}
 
-  size_t valueEnd = valueStart;
-  while (valueEnd < json.size() && json[valueEnd] != '"') {
-    if (json[valueEnd] == '\\' && valueEnd + 1 < json.size()) {
-      valueEnd += 2;
-    } else {
-      valueEnd++;
+// CompletionItem[] or CompletionList
+CompletionList parseCompletionResponse(const JSONValue& result) {
+  JSONValue list = result.isArray() ? result : result["items"];
+  CompletionList completions;
+  completions.isIncomplete = result["isIncomplete"].asBool();
+  std::vector<CompletionItem>& items = completions.items;
+  items.reserve(list.size());
+  for (JSONValue entry : list.items()) {
+    CompletionItem item;
+    item.label = entry["label"].asString();
+    if (item.label.empty()) {
+      continue;
     }
+    item.kind = static_cast<CompletionItemKind>(entry["kind"].asInt(1));
+    item.detail = entry["detail"].asString();
+    item.documentation = readMarkup(entry["documentation"]);
+    item.sortText = entry["sortText"].asString();
+    item.filterText = entry["filterText"].asString();
+    item.insertText = entry["insertText"].asString();
+    if (item.insertText.empty()) {
+      item.insertText = entry["textEdit"]["newText"].asString(item.label);
+    }
+    items.push_back(std::move(item));
   }
+  return completions;
+}
 
-  if (valueEnd >= json.size()) {
-    return "";
+std::optional<Hover> parseHoverResponse(const JSONValue& result) {
+  if (!result.isObject()) {
+    return std::nullopt;
   }
-
-  return json.substr(valueStart, valueEnd - valueStart);
+  Hover hover;
+  hover.contents = readMarkup(result["contents"]);
+  if (JSONValue range = result["range"]) {
+    hover.range = readRange(range);
+  }
+  return hover;
 }
 
-int extractIntValue(const std::string& json, const std::string& key, size_t start = 0) {
-  std::string searchKey = "\"" + key + "\"";
-  size_t pos = json.find(searchKey, start);
-  if (pos == std::string::npos) {
-    return 0;
+// Location, Location[] or LocationLink[]
+std::vector<LSPLocation> parseLocationResponse(const JSONValue& result) {
+  std::vector<LSPLocation> locations;
+  if (result.isObject()) {
+    locations.push_back(readLocation(result));
   }
-
-  size_t colonPos = json.find(':', pos);
-  if (colonPos == std::string::npos) {
-    return 0;
+  for (JSONValue entry : result.items()) {
+    locations.push_back(readLocation(entry));
   }
+  return locations;
+}
 
-  size_t numStart = colonPos + 1;
-  while (numStart < json.size() && std::isspace(json[numStart])) {
-    numStart++;
+DocumentSymbol readDocumentSymbol(const JSONValue& value) {
+  DocumentSymbol symbol;
+  symbol.name = value["name"].asString();
+  symbol.detail = value["detail"].asString();
+  symbol.kind = static_cast<SymbolKind>(value["kind"].asInt(static_cast<int64_t>(SymbolKind::Variable)));
+  if (JSONValue location = value["location"]) {
+    // SymbolInformation: flat, with a location instead of ranges
+    symbol.range = readRange(location["range"]);
+    symbol.selectionRange = symbol.range;
+    return symbol;
   }
-
-  if (numStart >= json.size() || !std::isdigit(json[numStart])) {
-    return 0;
+  symbol.range = readRange(value["range"]);
+  symbol.selectionRange = readRange(value["selectionRange"]);
+  for (JSONValue child : value["children"].items()) {
+    symbol.children.push_back(readDocumentSymbol(child));
   }
-
-  return std::stoi(json.substr(numStart));
+  return symbol;
 }
 
-std::vector<CompletionItem> parseCompletionResponse(const std::string& jsonResponse) {
-  std::vector<CompletionItem> items;
-
-  // Find "items" array or direct array
-  size_t itemsPos = jsonResponse.find("\"items\"");
-  size_t arrayStart = 0;
-
-  if (itemsPos != std::string::npos) {
-    arrayStart = jsonResponse.find('[', itemsPos);
-  } else {
-    // Check if result is directly an array
-    arrayStart = jsonResponse.find("\"result\"");
-    if (arrayStart != std::string::npos) {
-      arrayStart = jsonResponse.find('[', arrayStart);
-    }
+// DocumentSymbol[] or SymbolInformation[]
+std::vector<DocumentSymbol> parseDocumentSymbolResponse(const JSONValue& result) {
+  std::vector<DocumentSymbol> symbols;
+  symbols.reserve(result.size());
+  for (JSONValue entry : result.items()) {
+    symbols.push_back(readDocumentSymbol(entry));
   }
+  return symbols;
+}
 
-  if (arrayStart == std::string::npos) {
-    return items;
+// SymbolInformation[] or WorkspaceSymbol[]
+std::vector<WorkspaceSymbol> parseWorkspaceSymbolResponse(const JSONValue& result) {
+  std::vector<WorkspaceSymbol> symbols;
+  symbols.reserve(result.size());
+  for (JSONValue entry : result.items()) {
+    WorkspaceSymbol symbol;
+    symbol.name = entry["name"].asString();
+    symbol.containerName = entry["containerName"].asString();
+    symbol.kind = static_cast<SymbolKind>(entry["kind"].asInt(static_cast<int64_t>(SymbolKind::Variable)));
+    symbol.location = readLocation(entry["location"]);
+    symbols.push_back(std::move(symbol));
   }
+  return symbols;
+}
 
-  // Parse each completion item
-  size_t pos = arrayStart + 1;
-  while (pos < jsonResponse.size()) {
-    size_t itemStart = jsonResponse.find('{', pos);
-    if (itemStart == std::string::npos) {
-      break;
-    }
-
-    size_t itemEnd = itemStart + 1;
-    int braceCount = 1;
-    while (itemEnd < jsonResponse.size() && braceCount > 0) {
-      if (jsonResponse[itemEnd] == '{') braceCount++;
-      else if (jsonResponse[itemEnd] == '}') braceCount--;
-      itemEnd++;
-    }
-
-    if (braceCount != 0) {
-      break;
-    }
-
-    std::string itemJson = jsonResponse.substr(itemStart, itemEnd - itemStart);
-
-    CompletionItem item;
-    item.label = extractStringValue(itemJson, "label");
-    item.detail = extractStringValue(itemJson, "detail");
-    item.documentation = extractStringValue(itemJson, "documentation");
-    item.insertText = extractStringValue(itemJson, "insertText");
-    if (item.insertText.empty()) {
-      item.insertText = item.label;
-    }
-    item.kind = static_cast<CompletionItemKind>(extractIntValue(itemJson, "kind"));
-
-    if (!item.label.empty()) {
-      items.push_back(item);
-    }
+// Applies SemanticTokensEdit[] to the data they were computed against. Edit
+// positions refer to the original array, so the result is built in one pass.
+void applySemanticTokensEdits(std::vector<uint32_t>& data, const JSONValue& edits) {
+  struct TokensEdit {
+    size_t start;
+    size_t deleteCount;
+    JSONValue data;
+  };
+  std::vector<TokensEdit> sorted;
+  sorted.reserve(edits.size());
+  for (JSONValue edit : edits.items()) {
+    sorted.push_back({static_cast<size_t>(edit["start"].asInt()), static_cast<size_t>(edit["deleteCount"].asInt()),
+                      edit["data"]});
+  }
+  std::stable_sort(sorted.begin(), sorted.end(),
+                   [](const TokensEdit& a, const TokensEdit& b) { return a.start < b.start; });
+
+  std::vector<uint32_t> updated;
+  updated.reserve(data.size());
+  size_t position = 0;
+  for (const TokensEdit& edit : sorted) {
+    size_t start = std::clamp(edit.start, position, data.size());
+    updated.insert(updated.end(), data.begin() + static_cast<ptrdiff_t>(position),
+                   data.begin() + static_cast<ptrdiff_t>(start));
+    readUIntArray(edit.data, updated);
+    position = std::min(start + edit.deleteCount, data.size());
+  }
+  updated.insert(updated.end(), data.begin() + static_cast<ptrdiff_t>(position), data.end());
+  data.swap(updated);
+}
 
-    pos = itemEnd;
+bool isWordByte(unsigned char c) {
+  return std::isalnum(c) || c == '_' || c == '$' || c >= 0x80;
+}
 
-    // Check if there's another item
-    size_t commaPos = jsonResponse.find(',', pos);
-    if (commaPos == std::string::npos || commaPos > jsonResponse.find(']', pos)) {
-      break;
-    }
-    pos = commaPos + 1;
+// The identifier characters before UTF-16 column `character` of `line`
+std::string wordPrefix(const std::string& line, int character) {
+  size_t cursor = 0;
+  int units = 0;
+  while (cursor < line.size() && units < character && line[cursor] != '\n') {
+    unsigned char c = static_cast<unsigned char>(line[cursor]);
+    size_t length = c < 0x80 ? 1 : c < 0xE0 ? 2 : c < 0xF0 ? 3 : 4;
+    units += length == 4 ? 2 : 1;
+    cursor += length;
   }
-
-  return items;
+  cursor = std::min(cursor, line.size());
+  size_t start = cursor;
+  while (start > 0 && isWordByte(static_cast<unsigned char>(line[start - 1]))) {
+    --start;
+  }
+  return line.substr(start, cursor - start);
 }
 
 } // anonymous namespace
@@ -146,267 +189,1114 @@ LSPManager::~LSPManager() {
   shutdown();
 }
 
+// Restart delays double from kRestartDelay up to kMaxRestartDelay. A server
+// that stayed up for kStableRun has its failure count reset.
+static constexpr std::chrono::milliseconds kRestartDelay{500};
+static constexpr std::chrono::milliseconds kMaxRestartDelay{30000};
+static constexpr std::chrono::seconds kStableRun{60};
+static constexpr int kMaxFailures = 5;
+
 void LSPManager::registerLanguageServer(const std::string& name, const LanguageServerConfig& config) {
   ServerInfo info;
-  info.client = std::make_unique<LSPClient>();
   info.config = config;
-  info.initialized = false;
+  if (m_servers.find(name) == m_servers.end()) {
+    m_serverOrder.push_back(name);
+  }
   m_servers[name] = std::move(info);
 }
 
 void LSPManager::initializeServers(const std::string& rootUri) {
   m_rootUri = rootUri;
+  m_serversEnabled = true;
+
+  // Documents opened before now start their servers
+  for (auto& [uri, document] : m_documents) {
+    for (const DocumentServer& entry : document.servers) {
+      auto server = m_servers.find(entry.name);
+      if (server != m_servers.end() && !server->second.client && !server->second.restartPending) {
+        startServer(server->first, server->second);
+      }
+    }
+  }
+}
 
-  for (auto& [name, info] : m_servers) {
-    if (info.client->start(info.config.command, info.config.args)) {
-      info.client->initialize(
-        rootUri,
-        [&info, name](const std::string& result) {
-          info.initialized = true;
-          std::cout << "LSP server '" << name << "' initialized successfully" << std::endl;
-        },
-        [name](int code, const std::string& message) {
-          std::cerr << "Failed to initialize LSP server '" << name << "': " << message << std::endl;
+void LSPManager::setCommandResolver(CommandResolver resolver) {
+  m_commandResolver = std::move(resolver);
+}
+
+// Spawns the server and sends initialize; the open documents follow once it
+// answers. Neither waits, so servers for several languages start together.
+void LSPManager::startServer(const std::string& name, ServerInfo& info) {
+  if (info.executable.empty()) {
+    info.executable = m_commandResolver ? m_commandResolver(info.config.command) : info.config.command;
+  }
+  info.restartPending = false;
+  info.initialized = false;
+  info.initializeFailed = false;
+  info.startedAt = std::chrono::steady_clock::now();
+  info.client = std::make_unique<LSPClient>();
+  info.client->setWakeup(&m_wakeup);
+  if (!info.client->start(info.executable, info.config.args)) {
+    std::cerr << "Failed to start LSP server: " << name << std::endl;
+    serverExited(name, info);
+    return;
+  }
+  std::cerr << "[LSP] Starting " << name << ": " << info.executable << std::endl;
+
+  info.client->initialize(
+    m_rootUri,
+    [this, name](const JSONValue&) {
+      ServerInfo& info = m_servers[name];
+      info.initialized = true;
+      std::cout << "LSP server '" << name << "' initialized successfully" << std::endl;
+      for (auto& [uri, document] : m_documents) {
+        for (DocumentServer& server : document.servers) {
+          if (server.name == name) {
+            openDocument(uri, document, server, *info.client);
+          }
         }
-      );
+      }
+    },
+    [this, name](int code, const std::string& message) {
+      std::cerr << "Failed to initialize LSP server '" << name << "': " << message << std::endl;
+      // Handled by superviseServers(), outside the client's own callback
+      m_servers[name].initializeFailed = true;
+      m_wakeup.signal();
+    }
+  );
+
+  info.client->onDiagnostics([this, name](const std::string& uri, const std::vector<Diagnostic>& diagnostics) {
+    publishDiagnostics(name, uri, diagnostics);
+  });
+}
+
+// Restarts servers whose backoff delay has passed.
+void LSPManager::superviseServers() {
+  auto now = std::chrono::steady_clock::now();
+  for (auto& [name, info] : m_servers) {
+    if (info.restartPending && now >= info.restartAt) {
+      startServer(name, info);
+    }
+  }
+}
+
+// Tears down a server that exited or could not start or initialize. It is
+// restarted after a backoff delay if documents are still open for it, and
+// otherwise on the next didOpen.
+void LSPManager::serverExited(const std::string& name, ServerInfo& info) {
+  if (info.client) {
+    info.client->shutdown();
+    info.pastMetrics.merge(info.client->metrics());
+    info.client.reset();
+  }
+  info.initialized = false;
+  info.initializeFailed = false;
+  info.inFlight = 0;
 
-      // Set up diagnostics callback
-      if (m_diagnosticsCallback) {
-        info.client->onDiagnostics(m_diagnosticsCallback);
+  // Requests in flight on it will never be answered; fanned-out ones are
+  // delivered with the other servers' answers
+  for (RequestSlot& slot : m_requests) {
+    std::erase_if(slot.inFlight, [&name](const InFlightRequest& request) { return request.server == name; });
+  }
+  bool documentsOpen = false;
+  for (auto& [uri, document] : m_documents) {
+    for (DocumentServer& server : document.servers) {
+      if (server.name != name) {
+        continue;
+      }
+      server.opened = false;
+      documentsOpen = true;
+      if (document.tokensServer == name) {
+        document.tokensResultId.clear();
+      }
+      if (m_completion.uri == uri) {
+        endCompletion();
       }
-    } else {
-      std::cerr << "Failed to start LSP server: " << name << std::endl;
     }
   }
+
+  auto now = std::chrono::steady_clock::now();
+  if (now - info.startedAt >= kStableRun) {
+    info.failures = 0;
+  }
+  if (++info.failures >= kMaxFailures) {
+    std::cerr << "[LSP] Server '" << name << "' failed " << info.failures << " times in a row; giving up" << std::endl;
+    info.gaveUp = true;
+    info.restartPending = false;
+    return;
+  }
+  if (!documentsOpen) {
+    info.restartPending = false;
+    return;
+  }
+  auto delay = std::min(kRestartDelay * (1 << (info.failures - 1)), kMaxRestartDelay);
+  std::cerr << "[LSP] Server '" << name << "' exited; restarting in " << delay.count() << " ms" << std::endl;
+  info.restartPending = true;
+  info.restartAt = now + delay;
 }
 
-void LSPManager::didOpen(const std::string& uri, const std::string& languageId, const std::string& text) {
-  LSPClient* client = getClientForLanguage(languageId);
-  if (!client) {
+void LSPManager::didOpen(const std::string& uri, const std::string& languageId, const TextBuffer& text) {
+  std::vector<std::string> servers = serversForDocument(uri, languageId);
+  if (servers.empty()) {
     return;
   }
 
-  TextDocumentItem doc;
-  doc.uri = uri;
-  doc.languageId = languageId;
-  doc.version = 1;
-  doc.text = text;
+  // Track which servers handle this document
+  DocumentState& document = m_documents[uri];
+  document = DocumentState();
+  for (std::string& name : servers) {
+    DocumentServer server;
+    server.name = std::move(name);
+    document.servers.push_back(std::move(server));
+  }
+  document.languageId = languageId;
+  document.text = &text;
+
+  for (DocumentServer& server : document.servers) {
+    ServerInfo& info = m_servers[server.name];
+    if (info.initialized) {
+      openDocument(uri, document, server, *info.client);
+    } else if (!info.client && !info.restartPending && !info.gaveUp && m_serversEnabled) {
+      startServer(server.name, info);
+    }
+  }
+}
 
-  client->didOpen(doc);
+// Sends the document's current text to one of its servers. Servers that
+// already have the document get the queued edits first; when none does, the
+// edits are part of the text and dropped, and the version moves on so
+// responses computed before them are recognised as outdated.
+void LSPManager::openDocument(const std::string& uri, DocumentState& document, DocumentServer& server,
+                              LSPClient& client) {
+  if (server.opened) {
+    return;
+  }
+  flushDocument(uri, document);
+  if (!document.pending.empty() || document.replaced) {
+    ++document.version;
+    document.pending.clear();
+    document.replaced = false;
+  }
+  if (document.text) {
+    client.didOpen(uri, document.languageId, document.version, *document.text);
+  }
+  server.opened = true;
+}
 
-  // Track which server handles this document
-  std::string serverName = getServerNameForLanguage(languageId);
-  if (!serverName.empty()) {
-    m_documentToServer[uri] = serverName;
+void LSPManager::didChange(const std::string& uri, const TextDocumentContentChangeEvent& change) {
+  auto it = m_documents.find(uri);
+  if (it == m_documents.end() || !change.range) {
+    return;
+  }
+  DocumentState& document = it->second;
+  auto now = std::chrono::steady_clock::now();
+  if (document.pending.empty() && !document.replaced) {
+    document.firstChange = now;
+  }
+  document.lastChange = now;
+
+  // Editing the word being completed keeps its session; anything else may
+  // change what the server would offer
+  const LSPRange& range = *change.range;
+  if (m_completion.active && m_completion.uri == uri &&
+      (range.start.line != m_completion.line || range.end.line != m_completion.line ||
+       range.start.character < m_completion.wordStart || change.text.find('\n') != std::string::npos)) {
+    endCompletion();
+  }
+  if (document.replaced) {
+    return;
   }
+
+  // The end of the inserted text in the document after the change
+  LSPPosition end = change.range->start;
+  size_t lastNewline = change.text.rfind('\n');
+  if (lastNewline == std::string::npos) {
+    end.character += static_cast<int>(utf16_length(change.text));
+  } else {
+    end.line += static_cast<int>(std::count(change.text.begin(), change.text.end(), '\n'));
+    end.character = static_cast<int>(utf16_length(std::string_view(change.text).substr(lastNewline + 1)));
+  }
+
+  // Typing extends the previous insertion instead of adding an event
+  bool insertion = range.start.line == range.end.line && range.start.character == range.end.character;
+  if (insertion && !document.pending.empty() &&
+      range.start.line == document.pendingEnd.line && range.start.character == document.pendingEnd.character) {
+    document.pending.back().text += change.text;
+    document.pendingEnd = end;
+    return;
+  }
+
+  // Past this many events the full text is cheaper for the server
+  static constexpr size_t kMaxPendingChanges = 256;
+  if (document.pending.size() >= kMaxPendingChanges) {
+    document.pending.clear();
+    document.replaced = true;
+    return;
+  }
+  document.pending.push_back(change);
+  document.pendingEnd = end;
 }
 
-void LSPManager::didChange(const std::string& uri, const std::string& text) {
-  LSPClient* client = getClientForUri(uri);
-  if (!client) {
+void LSPManager::didReplace(const std::string& uri) {
+  auto it = m_documents.find(uri);
+  if (it == m_documents.end()) {
     return;
   }
+  DocumentState& document = it->second;
+  auto now = std::chrono::steady_clock::now();
+  if (document.pending.empty() && !document.replaced) {
+    document.firstChange = now;
+  }
+  document.lastChange = now;
+  document.pending.clear();
+  document.replaced = true;
+  if (m_completion.uri == uri) {
+    endCompletion();
+  }
+}
 
-  TextDocumentContentChangeEvent change;
-  change.text = text;
+void LSPManager::flushChanges(const std::string& uri) {
+  auto it = m_documents.find(uri);
+  if (it != m_documents.end()) {
+    flushDocument(uri, it->second);
+  }
+}
 
-  std::vector<TextDocumentContentChangeEvent> changes = {change};
-  client->didChange(uri, 1, changes);
+void LSPManager::setChangeDebounce(std::chrono::milliseconds delay) {
+  m_changeDebounce = delay;
 }
 
-void LSPManager::didClose(const std::string& uri) {
-  LSPClient* client = getClientForUri(uri);
-  if (!client) {
+// Sends the queued changes to each server that has the document open, in the
+// form it asked for, as one new version. Nothing is sent before a server has
+// initialized, since its sync kind is not known yet.
+void LSPManager::flushDocument(const std::string& uri, DocumentState& document) {
+  if (document.pending.empty() && !document.replaced) {
+    return;
+  }
+  bool sent = false;
+  for (const DocumentServer& server : document.servers) {
+    auto info = m_servers.find(server.name);
+    if (!server.opened || info == m_servers.end() || !info->second.initialized) {
+      continue;
+    }
+    if (!sent) {
+      ++document.version;
+      sent = true;
+    }
+    LSPClient& client = *info->second.client;
+    int sync = client.capabilities().textDocumentSync;
+    if (sync == 2 && !document.replaced) {
+      client.didChange(uri, document.version, document.pending);
+    } else if (sync != 0 && document.text) {
+      client.didChange(uri, document.version, *document.text);
+    }
+  }
+  if (!sent) {
     return;
   }
+  document.pending.clear();
+  document.replaced = false;
+}
+
+// A document is due once edits pause for the debounce interval, or when it
+// has been waiting four intervals during continuous typing.
+void LSPManager::flushDueChanges() {
+  auto now = std::chrono::steady_clock::now();
+  for (auto& [uri, document] : m_documents) {
+    if (document.pending.empty() && !document.replaced) {
+      continue;
+    }
+    if (now - document.lastChange >= m_changeDebounce || now - document.firstChange >= 4 * m_changeDebounce) {
+      flushDocument(uri, document);
+    }
+  }
+}
 
-  client->didClose(uri);
-  m_documentToServer.erase(uri);
+void LSPManager::didClose(const std::string& uri) {
+  // Unsent edits are moot once the servers drop the document
+  auto document = m_documents.find(uri);
+  if (document == m_documents.end()) {
+    return;
+  }
+  for (const DocumentServer& server : document->second.servers) {
+    auto info = m_servers.find(server.name);
+    if (server.opened && info != m_servers.end() && info->second.initialized) {
+      info->second.client->didClose(uri);
+    }
+  }
+  m_documents.erase(document);
+  if (m_completion.uri == uri) {
+    endCompletion();
+  }
 }
 
 void LSPManager::didSave(const std::string& uri) {
-  LSPClient* client = getClientForUri(uri);
-  if (!client) {
+  auto document = m_documents.find(uri);
+  if (document == m_documents.end()) {
     return;
   }
 
-  client->didSave(uri);
+  flushDocument(uri, document->second);
+  for (const DocumentServer& server : document->second.servers) {
+    auto info = m_servers.find(server.name);
+    if (server.opened && info != m_servers.end() && info->second.initialized) {
+      info->second.client->didSave(uri);
+    }
+  }
 }
 
+// Completion runs as a session on the word being typed. The server's list is
+// cached and re-filtered locally as the word grows; the server is asked again
+// only for a new word, a prefix the list does not cover, or an incomplete
+// list. Keystrokes while a request is outstanding just update the prefix the
+// response will be filtered with.
 void LSPManager::completion(const std::string& uri, int line, int character,
                            std::function<void(const std::vector<CompletionItem>&)> callback) {
-  LSPClient* client = getClientForUri(uri);
-  if (!client) {
+  if (!hasReadyServer(uri)) {
     callback({});
     return;
   }
 
+  std::string prefix;
+  auto document = m_documents.find(uri);
+  if (document != m_documents.end() && document->second.text && line >= 0 &&
+      static_cast<size_t>(line) < document->second.text->line_count()) {
+    prefix = wordPrefix(document->second.text->line_text(static_cast<size_t>(line)), character);
+  }
+  int wordStart = character - static_cast<int>(utf16_length(prefix));
+
+  CompletionSession& session = m_completion;
+  bool sameWord = session.active && session.uri == uri && session.line == line && session.wordStart == wordStart;
+  if (sameWord && !m_completionCache.empty() && m_completionCache.covers(prefix)) {
+    callback(m_completionCache.filter(prefix, m_completionLimit));
+    return;
+  }
+  if (sameWord && session.waiting && prefix.compare(0, session.requestPrefix.size(), session.requestPrefix) == 0) {
+    session.prefix = prefix;
+    session.callback = std::move(callback);
+    return;
+  }
+
+  m_completionCache.clear();
+  session.active = true;
+  session.waiting = true;
+  session.uri = uri;
+  session.line = line;
+  session.wordStart = wordStart;
+  session.requestPrefix = prefix;
+  session.prefix = prefix;
+  session.callback = std::move(callback);
+
+  // Each server's list is kept by rank until all are in, then merged
   LSPPosition pos{line, character};
-  client->completion(
-    uri, pos,
-    [callback](const std::string& result) {
-      // Parse JSON response
-      std::vector<CompletionItem> items = parseCompletionResponse(result);
-      std::cerr << "[LSP] Parsed " << items.size() << " completion items" << std::endl;
-      callback(items);
-    },
-    [callback](int code, const std::string& message) {
-      std::cerr << "[LSP] Completion request failed: " << message << std::endl;
+  auto lists = std::make_shared<std::map<size_t, CompletionList>>();
+  scheduleRequest(RequestKind::Completion, uri,
+                  [](const ServerCapabilities& capabilities) { return capabilities.completionProvider; },
+                  [this, uri, pos, lists](const RequestTarget& target) {
+    return target.client.completion(
+      uri, pos,
+      [this, server = target.server, rank = target.rank, ticket = target.ticket, lists](const JSONValue& result) {
+        // Typing since the request only extends the session's word
+        if (finishRequest(RequestKind::Completion, ticket, server, false)) {
+          (*lists)[rank] = parseCompletionResponse(result);
+        }
+      },
+      [this, server = target.server, ticket = target.ticket](int code, const std::string& message) {
+        if (finishRequest(RequestKind::Completion, ticket, server, false)) {
+          std::cerr << "[LSP] Completion request to " << server << " failed: " << message << std::endl;
+        }
+      }
+    );
+  },
+  [this, lists]() {
+    if (!m_completion.waiting) {
+      return;
+    }
+    if (lists->empty()) {
+      auto callback = std::move(m_completion.callback);
+      endCompletion();
       callback({});
+      return;
     }
-  );
+    CompletionList merged;
+    for (auto& [rank, list] : *lists) {
+      merged.isIncomplete = merged.isIncomplete || list.isIncomplete;
+      std::move(list.items.begin(), list.items.end(), std::back_inserter(merged.items));
+    }
+    m_completion.waiting = false;
+    m_completionCache.store(std::move(merged), m_completion.requestPrefix);
+    std::vector<CompletionItem> items = m_completionCache.filter(m_completion.prefix, m_completionLimit);
+    auto callback = m_completion.callback; // may start a new session
+    callback(items);
+  });
+}
+
+void LSPManager::endCompletion() {
+  m_completion = CompletionSession();
+  m_completionCache.clear();
+}
+
+void LSPManager::setCompletionLimit(size_t limit) {
+  m_completionLimit = limit;
 }
 
 void LSPManager::hover(const std::string& uri, int line, int character,
                       std::function<void(const std::optional<Hover>&)> callback) {
-  LSPClient* client = getClientForUri(uri);
-  if (!client) {
+  if (!hasReadyServer(uri)) {
     callback(std::nullopt);
     return;
   }
 
   LSPPosition pos{line, character};
-  client->hover(
-    uri, pos,
-    [callback](const std::string& result) {
-      // Parse hover result (simplified)
-      std::optional<Hover> hover;
-      callback(hover);
-    },
-    [callback](int code, const std::string& message) {
+  auto hovers = std::make_shared<std::map<size_t, Hover>>();
+  scheduleRequest(RequestKind::Hover, uri,
+                  [](const ServerCapabilities& capabilities) { return capabilities.hoverProvider; },
+                  [this, uri, pos, hovers](const RequestTarget& target) {
+    return target.client.hover(
+      uri, pos,
+      [this, server = target.server, rank = target.rank, ticket = target.ticket, hovers](const JSONValue& result) {
+        std::optional<Hover> hover = parseHoverResponse(result);
+        if (finishRequest(RequestKind::Hover, ticket, server) && hover && !hover->contents.empty()) {
+          (*hovers)[rank] = std::move(*hover);
+        }
+      },
+      [this, server = target.server, ticket = target.ticket](int code, const std::string& message) {
+        finishRequest(RequestKind::Hover, ticket, server);
+      }
+    );
+  },
+  [hovers, callback]() {
+    // One section per server, the range from the first
+    if (hovers->empty()) {
       callback(std::nullopt);
+      return;
     }
-  );
+    Hover merged = std::move(hovers->begin()->second);
+    for (auto it = std::next(hovers->begin()); it != hovers->end(); ++it) {
+      merged.contents += "\n\n---\n\n" + it->second.contents;
+    }
+    callback(merged);
+  });
 }
 
 void LSPManager::gotoDefinition(const std::string& uri, int line, int character,
                                std::function<void(const std::vector<LSPLocation>&)> callback) {
-  LSPClient* client = getClientForUri(uri);
-  if (!client) {
+  if (!hasReadyServer(uri)) {
     callback({});
     return;
   }
 
   LSPPosition pos{line, character};
-  client->gotoDefinition(
-    uri, pos,
-    [callback](const std::string& result) {
-      // Parse definition result (simplified)
-      std::vector<LSPLocation> locations;
-      callback(locations);
-    },
-    [callback](int code, const std::string& message) {
-      callback({});
+  auto locations = std::make_shared<std::map<size_t, std::vector<LSPLocation>>>();
+  scheduleRequest(RequestKind::Definition, uri,
+                  [](const ServerCapabilities& capabilities) { return capabilities.definitionProvider; },
+                  [this, uri, pos, locations](const RequestTarget& target) {
+    return target.client.gotoDefinition(
+      uri, pos,
+      [this, server = target.server, rank = target.rank, ticket = target.ticket, locations](const JSONValue& result) {
+        if (finishRequest(RequestKind::Definition, ticket, server)) {
+          (*locations)[rank] = parseLocationResponse(result);
+        }
+      },
+      [this, server = target.server, ticket = target.ticket](int code, const std::string& message) {
+        finishRequest(RequestKind::Definition, ticket, server);
+      }
+    );
+  },
+  [locations, callback]() {
+    // Servers often agree; each location is listed once
+    std::vector<LSPLocation> merged;
+    for (const auto& [rank, list] : *locations) {
+      for (const LSPLocation& location : list) {
+        bool seen = std::any_of(merged.begin(), merged.end(), [&location](const LSPLocation& other) {
+          return other.uri == location.uri && other.range.start.line == location.range.start.line &&
+                 other.range.start.character == location.range.start.character &&
+                 other.range.end.line == location.range.end.line &&
+                 other.range.end.character == location.range.end.character;
+        });
+        if (!seen) {
+          merged.push_back(location);
+        }
+      }
     }
-  );
+    callback(merged);
+  });
 }
 
 void LSPManager::documentSymbols(const std::string& uri,
                                 std::function<void(const std::vector<DocumentSymbol>&)> callback) {
-  LSPClient* client = getClientForUri(uri);
-  if (!client) {
+  if (!hasReadyServer(uri)) {
     callback({});
     return;
   }
 
-  client->documentSymbols(
-    uri,
-    [callback](const std::string& result) {
-      // Parse symbols result (simplified)
-      std::vector<DocumentSymbol> symbols;
-      callback(symbols);
-    },
-    [callback](int code, const std::string& message) {
-      callback({});
+  scheduleRequest(RequestKind::DocumentSymbols, uri,
+                  [](const ServerCapabilities& capabilities) { return capabilities.documentSymbolProvider; },
+                  [this, uri, callback](const RequestTarget& target) {
+    return target.client.documentSymbols(
+      uri,
+      [this, server = target.server, ticket = target.ticket, callback](const JSONValue& result) {
+        if (finishRequest(RequestKind::DocumentSymbols, ticket, server)) {
+          callback(parseDocumentSymbolResponse(result));
+        }
+      },
+      [this, server = target.server, ticket = target.ticket, callback](int code, const std::string& message) {
+        if (finishRequest(RequestKind::DocumentSymbols, ticket, server)) {
+          callback({});
+        }
+      }
+    );
+  });
+}
+
+void LSPManager::references(const std::string& uri, int line, int character,
+                            std::function<void(const std::vector<LSPLocation>&, bool)> callback) {
+  if (!hasReadyServer(uri)) {
+    callback({}, true);
+    return;
+  }
+
+  // Batches and final results are passed on as they come, each location once
+  using LocationKey = std::tuple<std::string, int, int, int, int>;
+  auto seen = std::make_shared<std::set<LocationKey>>();
+  auto forward = [seen, callback](std::vector<LSPLocation> batch) {
+    std::erase_if(batch, [&seen](const LSPLocation& location) {
+      const LSPRange& range = location.range;
+      return !seen->emplace(location.uri, range.start.line, range.start.character, range.end.line,
+                            range.end.character).second;
+    });
+    if (!batch.empty()) {
+      callback(batch, false);
     }
-  );
+  };
+  LSPPosition pos{line, character};
+  scheduleRequest(RequestKind::References, uri,
+                  [](const ServerCapabilities& capabilities) { return capabilities.referencesProvider; },
+                  [this, uri, pos, forward](const RequestTarget& target) {
+    return target.client.references(
+      uri, pos,
+      [this, ticket = target.ticket, forward](const JSONValue& value) {
+        if (isCurrent(RequestKind::References, ticket)) {
+          forward(parseLocationResponse(value));
+        }
+      },
+      [this, server = target.server, ticket = target.ticket, forward](const JSONValue& result) {
+        if (finishRequest(RequestKind::References, ticket, server, false)) {
+          forward(parseLocationResponse(result));
+        }
+      },
+      [this, server = target.server, ticket = target.ticket](int code, const std::string& message) {
+        finishRequest(RequestKind::References, ticket, server, false);
+      }
+    );
+  },
+  [callback]() {
+    callback({}, true);
+  });
 }
 
-void LSPManager::onDiagnostics(std::function<void(const std::string&, const std::vector<Diagnostic>&)> callback) {
-  m_diagnosticsCallback = std::move(callback);
+void LSPManager::workspaceSymbols(const std::string& uri, const std::string& query,
+                                  std::function<void(const std::vector<WorkspaceSymbol>&, bool)> callback) {
+  if (!hasReadyServer(uri)) {
+    callback({}, true);
+    return;
+  }
 
-  // Register with all active clients
-  for (auto& [name, info] : m_servers) {
-    if (info.client) {
-      info.client->onDiagnostics(m_diagnosticsCallback);
+  auto forward = [callback](std::vector<WorkspaceSymbol> batch) {
+    if (!batch.empty()) {
+      callback(batch, false);
     }
+  };
+  scheduleRequest(RequestKind::WorkspaceSymbols, uri,
+                  [](const ServerCapabilities& capabilities) { return capabilities.workspaceSymbolProvider; },
+                  [this, query, forward](const RequestTarget& target) {
+    return target.client.workspaceSymbols(
+      query,
+      [this, ticket = target.ticket, forward](const JSONValue& value) {
+        if (isCurrent(RequestKind::WorkspaceSymbols, ticket)) {
+          forward(parseWorkspaceSymbolResponse(value));
+        }
+      },
+      [this, server = target.server, ticket = target.ticket, forward](const JSONValue& result) {
+        if (finishRequest(RequestKind::WorkspaceSymbols, ticket, server, false)) {
+          forward(parseWorkspaceSymbolResponse(result));
+        }
+      },
+      [this, server = target.server, ticket = target.ticket](int code, const std::string& message) {
+        finishRequest(RequestKind::WorkspaceSymbols, ticket, server, false);
+      }
+    );
+  },
+  [callback]() {
+    callback({}, true);
+  });
+}
+
+bool LSPManager::semanticTokens(const std::string& uri, int firstLine, int lastLine,
+                                std::function<void(const SemanticTokens&, const ServerCapabilities&)> callback) {
+  auto providesTokens = [](const ServerCapabilities& capabilities) {
+    return capabilities.semanticTokensFull || capabilities.semanticTokensRange;
+  };
+  auto document = m_documents.find(uri);
+  if (document == m_documents.end()) {
+    return false;
   }
+  bool provided = std::any_of(document->second.servers.begin(), document->second.servers.end(),
+                              [this, providesTokens](const DocumentServer& server) {
+    auto info = m_servers.find(server.name);
+    return server.opened && info != m_servers.end() && info->second.initialized &&
+           providesTokens(info->second.client->capabilities());
+  });
+  if (!provided) {
+    return false;
+  }
+
+  scheduleRequest(RequestKind::SemanticTokens, uri, providesTokens,
+                  [this, uri, firstLine, lastLine, callback](const RequestTarget& target) {
+    DocumentState& document = m_documents[uri];
+    LSPClient& client = target.client;
+    std::string server = target.server;
+    uint64_t ticket = target.ticket;
+    const ServerCapabilities& capabilities = client.capabilities();
+    // Deltas are against this server's last result
+    if (document.tokensServer != server) {
+      document.tokensServer = server;
+      document.tokensResultId.clear();
+    }
+    int version = document.version;
+    bool ranged = capabilities.semanticTokensRange &&
+                  (!capabilities.semanticTokensFull ||
+                   (!capabilities.semanticTokensDelta && document.text && document.text->line_count() > kRangeTokensLines));
+    LSPClient* owner = &client;
+
+    if (ranged) {
+      LSPRange range{{firstLine, 0}, {lastLine + 1, 0}};
+      return client.semanticTokensRange(uri, range,
+        [this, uri, range, version, server, ticket, owner, callback](const JSONValue& result) {
+          auto document = m_documents.find(uri);
+          if (!finishRequest(RequestKind::SemanticTokens, ticket, server, false) || document == m_documents.end() ||
+              isOutdated(document->second, version)) {
+            return;
+          }
+          SemanticTokens tokens;
+          tokens.range = range;
+          readUIntArray(result["data"], tokens.data);
+          callback(tokens, owner->capabilities());
+        },
+        [this, server, ticket](int code, const std::string& message) {
+          finishRequest(RequestKind::SemanticTokens, ticket, server, false);
+        });
+    }
+
+    // Whole-document results update the stored data even when they arrive
+    // too late to show, since the server diffs its next delta against them.
+    auto onSuccess = [this, uri, version, server, ticket, owner, callback](const JSONValue& result) {
+      bool wanted = finishRequest(RequestKind::SemanticTokens, ticket, server, false);
+      auto document = m_documents.find(uri);
+      if (document == m_documents.end() || document->second.tokensServer != server) {
+        return;
+      }
+      SemanticTokens& tokens = document->second.tokens;
+      if (JSONValue edits = result["edits"]) {
+        applySemanticTokensEdits(tokens.data, edits);
+      } else {
+        tokens.data.clear();
+        readUIntArray(result["data"], tokens.data);
+      }
+      tokens.range.reset();
+      document->second.tokensResultId = result["resultId"].asString();
+      if (wanted && !isOutdated(document->second, version)) {
+        callback(tokens, owner->capabilities());
+      }
+    };
+    auto onError = [this, uri, server, ticket](int code, const std::string& message) {
+      finishRequest(RequestKind::SemanticTokens, ticket, server, false);
+      // Start over from a whole-document result
+      auto document = m_documents.find(uri);
+      if (document != m_documents.end()) {
+        document->second.tokensResultId.clear();
+      }
+    };
+    if (capabilities.semanticTokensDelta && !document.tokensResultId.empty()) {
+      return client.semanticTokensDelta(uri, document.tokensResultId, onSuccess, onError);
+    }
+    return client.semanticTokensFull(uri, onSuccess, onError);
+  });
+  return true;
 }
 
-void LSPManager::processMessages() {
-  for (auto& [name, info] : m_servers) {
-    if (info.client && info.client->is_running()) {
-      info.client->processMessages();
+void LSPManager::setRequestDebounce(RequestKind kind, std::chrono::milliseconds delay) {
+  m_requestDebounce[static_cast<size_t>(kind)] = delay;
+}
+
+void LSPManager::setMaxRequestsPerServer(int limit) {
+  m_maxRequestsPerServer = std::max(limit, 1);
+}
+
+// Replaces whatever request of this kind is still waiting; its callback is
+// never called.
+void LSPManager::scheduleRequest(RequestKind kind, const std::string& uri, CapabilityFilter filter,
+                                 RequestIssuer issue, std::function<void()> merge) {
+  RequestSlot& slot = m_requests[static_cast<size_t>(kind)];
+  std::chrono::milliseconds debounce = m_requestDebounce[static_cast<size_t>(kind)];
+  slot.ticket = ++m_nextTicket;
+  slot.uri = uri;
+  slot.filter = filter;
+  slot.issue = std::move(issue);
+  slot.merge = std::move(merge);
+  slot.due = std::chrono::steady_clock::now() + debounce;
+  if (debounce.count() == 0) {
+    dispatchRequests();
+  }
+}
+
+// Sends the requests whose debounce interval has passed. The request of the
+// same kind still in flight is cancelled first. Servers at their limit are
+// left out while another target can take the request; when all are, it waits
+// for a later call.
+void LSPManager::dispatchRequests() {
+  auto now = std::chrono::steady_clock::now();
+  for (size_t kind = 0; kind < m_requests.size(); ++kind) {
+    RequestSlot& slot = m_requests[kind];
+    if (!slot.issue || now < slot.due) {
+      continue;
+    }
+    auto document = m_documents.find(slot.uri);
+    std::vector<size_t> targets;
+    if (document != m_documents.end()) {
+      targets = requestTargets(document->second, slot.filter, slot.merge != nullptr);
+    }
+    if (targets.empty()) {
+      slot.issue = nullptr;
+      slot.merge = nullptr;
+      continue;
+    }
+
+    cancelInFlight(slot);
+    std::erase_if(targets, [&](size_t rank) {
+      return m_servers[document->second.servers[rank].name].inFlight >= m_maxRequestsPerServer;
+    });
+    if (targets.empty()) {
+      continue;
+    }
+
+    // The request must see every edit made before it
+    flushDocument(slot.uri, document->second);
+    RequestIssuer issue = std::move(slot.issue);
+    slot.issue = nullptr;
+    slot.inFlightTicket = slot.ticket;
+    slot.inFlightUri = slot.uri;
+    slot.inFlightVersion = document->second.version;
+    slot.answered = false;
+    slot.deliver = std::move(slot.merge);
+    slot.merge = nullptr;
+    for (size_t rank : targets) {
+      const std::string& name = document->second.servers[rank].name;
+      ServerInfo& server = m_servers[name];
+      ++server.inFlight;
+      int id = issue({name, rank, *server.client, slot.ticket});
+      slot.inFlight.push_back({name, id, now + server.config.deadline});
     }
   }
 }
 
-void LSPManager::shutdown() {
-  for (auto& [name, info] : m_servers) {
-    if (info.client) {
-      info.client->shutdown();
+// The document's servers a request goes to, by rank: the initialized ones
+// that pass the filter, or only the first of them without fanOut. When none
+// advertises the feature the first ready server is asked anyway.
+std::vector<size_t> LSPManager::requestTargets(const DocumentState& document, CapabilityFilter filter,
+                                               bool fanOut) const {
+  std::vector<size_t> targets;
+  std::optional<size_t> primary;
+  for (size_t rank = 0; rank < document.servers.size(); ++rank) {
+    const DocumentServer& server = document.servers[rank];
+    auto info = m_servers.find(server.name);
+    if (!server.opened || info == m_servers.end() || !info->second.initialized) {
+      continue;
+    }
+    if (!primary) {
+      primary = rank;
+    }
+    if (!filter || filter(info->second.client->capabilities())) {
+      targets.push_back(rank);
+      if (!fanOut) {
+        break;
+      }
     }
   }
-  m_servers.clear();
-  m_documentToServer.clear();
+  if (targets.empty() && primary) {
+    targets.push_back(*primary);
+  }
+  return targets;
 }
 
-LSPClient* LSPManager::getClientForUri(const std::string& uri) {
-  auto it = m_documentToServer.find(uri);
-  if (it == m_documentToServer.end()) {
-    return nullptr;
+// Whether dispatchRequests() would do something with the waiting request:
+// send it, or drop it for want of a server. A request that waits for a busy
+// server is dispatched once a response frees one. The request of the same
+// kind in flight does not count, since it is cancelled first.
+bool LSPManager::canDispatch(const RequestSlot& slot) const {
+  auto document = m_documents.find(slot.uri);
+  if (document == m_documents.end()) {
+    return true;
   }
+  std::vector<size_t> targets = requestTargets(document->second, slot.filter, slot.merge != nullptr);
+  return targets.empty() || std::any_of(targets.begin(), targets.end(), [&](size_t rank) {
+    const std::string& name = document->second.servers[rank].name;
+    auto own = std::count_if(slot.inFlight.begin(), slot.inFlight.end(),
+                             [&name](const InFlightRequest& request) { return request.server == name; });
+    return m_servers.at(name).inFlight - own < m_maxRequestsPerServer;
+  });
+}
 
-  auto serverIt = m_servers.find(it->second);
-  if (serverIt == m_servers.end() || !serverIt->second.initialized) {
-    return nullptr;
+// Calls back with the merged responses of a fanned-out request once every
+// server has answered, or once one has and the others are past their
+// deadline; those are cancelled. Requests whose every response was dropped
+// are cleared without a callback.
+void LSPManager::deliverResponses() {
+  auto now = std::chrono::steady_clock::now();
+  for (RequestSlot& slot : m_requests) {
+    if (slot.inFlightTicket == 0) {
+      continue;
+    }
+    if (!slot.answered || !slot.deliver) {
+      if (slot.inFlight.empty()) {
+        cancelInFlight(slot);
+      }
+      continue;
+    }
+    bool waiting = std::any_of(slot.inFlight.begin(), slot.inFlight.end(),
+                               [now](const InFlightRequest& request) { return now < request.deadline; });
+    if (waiting) {
+      continue;
+    }
+    std::function<void()> deliver = std::move(slot.deliver);
+    cancelInFlight(slot);
+    deliver();
   }
+}
 
-  return serverIt->second.client.get();
+void LSPManager::cancelInFlight(RequestSlot& slot) {
+  for (const InFlightRequest& request : slot.inFlight) {
+    auto server = m_servers.find(request.server);
+    if (server != m_servers.end() && server->second.client) {
+      server->second.client->cancelRequest(request.id);
+      --server->second.inFlight;
+    }
+  }
+  slot.inFlight.clear();
+  slot.inFlightTicket = 0;
+  slot.answered = false;
+  slot.deliver = nullptr;
 }
 
-LSPClient* LSPManager::getClientForLanguage(const std::string& languageId) {
-  std::string serverName = getServerNameForLanguage(languageId);
-  if (serverName.empty()) {
-    return nullptr;
+// Called from a response callback. Frees the server slot and reports whether
+// the response is still wanted: not superseded by a newer request of its
+// kind, and (with checkVersion) computed against the document as it is now.
+bool LSPManager::finishRequest(RequestKind kind, uint64_t ticket, const std::string& server, bool checkVersion) {
+  RequestSlot& slot = m_requests[static_cast<size_t>(kind)];
+  if (slot.inFlightTicket != ticket) {
+    return false;
+  }
+  auto request = std::find_if(slot.inFlight.begin(), slot.inFlight.end(),
+                              [&server](const InFlightRequest& request) { return request.server == server; });
+  if (request == slot.inFlight.end()) {
+    return false;
+  }
+  slot.inFlight.erase(request);
+  auto info = m_servers.find(server);
+  if (info != m_servers.end()) {
+    --info->second.inFlight;
+  }
+  if (slot.ticket != ticket) {
+    return false;
   }
 
-  auto it = m_servers.find(serverName);
-  if (it == m_servers.end() || !it->second.initialized) {
-    return nullptr;
+  auto document = m_documents.find(slot.inFlightUri);
+  if (checkVersion && document != m_documents.end() && isOutdated(document->second, slot.inFlightVersion)) {
+    std::cerr << "[LSP] Dropping response for an outdated version of " << slot.inFlightUri << std::endl;
+    return false;
   }
+  slot.answered = true;
+  return true;
+}
 
-  return it->second.client.get();
+bool LSPManager::isCurrent(RequestKind kind, uint64_t ticket) const {
+  const RequestSlot& slot = m_requests[static_cast<size_t>(kind)];
+  return slot.ticket == ticket && slot.inFlightTicket == ticket;
 }
 
-std::string LSPManager::getLanguageIdFromUri(const std::string& uri) {
-  // Extract file extension
-  size_t dotPos = uri.find_last_of('.');
-  if (dotPos == std::string::npos) {
-    return "";
+// Whether the document has changed since `version` was sent, counting edits
+// still queued.
+bool LSPManager::isOutdated(const DocumentState& document, int version) const {
+  return document.version != version || !document.pending.empty() || document.replaced;
+}
+
+// A document's only server publishes straight through; with several, each
+// list replaces that server's previous one and listeners get them all, in
+// server order.
+void LSPManager::publishDiagnostics(const std::string& server, const std::string& uri,
+                                    const std::vector<Diagnostic>& diagnostics) {
+  auto document = m_documents.find(uri);
+  if (document == m_documents.end() || document->second.servers.size() < 2) {
+    for (const auto& callback : m_diagnosticsCallbacks) {
+      callback(uri, diagnostics);
+    }
+    return;
   }
+  std::vector<Diagnostic> merged;
+  for (DocumentServer& entry : document->second.servers) {
+    if (entry.name == server) {
+      entry.diagnostics = diagnostics;
+    }
+    merged.insert(merged.end(), entry.diagnostics.begin(), entry.diagnostics.end());
+  }
+  for (const auto& callback : m_diagnosticsCallbacks) {
+    callback(uri, merged);
+  }
+}
 
-  std::string ext = uri.substr(dotPos);
+void LSPManager::onDiagnostics(std::function<void(const std::string&, const std::vector<Diagnostic>&)> callback) {
+  m_diagnosticsCallbacks.push_back(std::move(callback));
+}
 
-  // Map extension to language ID
-  for (const auto& [name, info] : m_servers) {
-    for (const auto& configExt : info.config.extensions) {
-      if (ext == configExt) {
-        return info.config.languageId;
+void LSPManager::processMessages() {
+  m_wakeup.drain();
+  for (auto& [name, info] : m_servers) {
+    if (!info.client) {
+      continue;
+    }
+    // Read before handling messages: everything the server sent before
+    // exiting is queued by the time the flag is set
+    bool exited = info.client->hasExited();
+    info.client->processMessages();
+    if (exited || info.initializeFailed) {
+      serverExited(name, info);
+    }
+  }
+  deliverResponses();
+  superviseServers();
+  flushDueChanges();
+  dispatchRequests();
+}
+
+std::optional<std::chrono::steady_clock::time_point> LSPManager::nextDeadline() const {
+  std::optional<std::chrono::steady_clock::time_point> next;
+  auto consider = [&next](std::chrono::steady_clock::time_point due) {
+    if (!next || due < *next) {
+      next = due;
+    }
+  };
+
+  // Edits are only flushed to servers that have the document open
+  for (const auto& [uri, document] : m_documents) {
+    if (document.pending.empty() && !document.replaced) {
+      continue;
+    }
+    bool open = std::any_of(document.servers.begin(), document.servers.end(), [this](const DocumentServer& server) {
+      auto info = m_servers.find(server.name);
+      return server.opened && info != m_servers.end() && info->second.initialized;
+    });
+    if (open) {
+      consider(std::min(document.lastChange + m_changeDebounce, document.firstChange + 4 * m_changeDebounce));
+    }
+  }
+  for (const RequestSlot& slot : m_requests) {
+    if (slot.issue && canDispatch(slot)) {
+      consider(slot.due);
+    }
+    if (slot.answered && slot.deliver) {
+      // Delivered once the last server still out is past its deadline
+      auto last = std::chrono::steady_clock::time_point::min();
+      for (const InFlightRequest& request : slot.inFlight) {
+        last = std::max(last, request.deadline);
       }
+      consider(last);
+    }
+  }
+  for (const auto& [name, info] : m_servers) {
+    if (info.restartPending) {
+      consider(info.restartAt);
+    }
+  }
+  return next;
+}
+
+void LSPManager::shutdown() {
+  for (auto& [name, info] : m_servers) {
+    if (info.client) {
+      info.client->shutdown();
     }
   }
+  m_serversEnabled = false;
+  m_servers.clear();
+  m_serverOrder.clear();
+  m_documents.clear();
+  m_requests = {};
+  endCompletion();
+}
 
-  return "";
+LSPMetrics LSPManager::metrics(const std::string& server) const {
+  LSPMetrics metrics;
+  auto it = m_servers.find(server);
+  if (it != m_servers.end()) {
+    metrics = it->second.pastMetrics;
+    if (it->second.client) {
+      metrics.merge(it->second.client->metrics());
+    }
+  }
+  return metrics;
 }
 
-std::string LSPManager::getServerNameForLanguage(const std::string& languageId) {
+std::string LSPManager::metricsJSON() const {
+  std::vector<std::string> names;
   for (const auto& [name, info] : m_servers) {
-    if (info.config.languageId == languageId) {
-      return name;
+    names.push_back(name);
+  }
+  std::sort(names.begin(), names.end());
+
+  JSONWriter writer;
+  writer.beginObject().key("servers").beginObject();
+  for (const std::string& name : names) {
+    const ServerInfo& info = m_servers.at(name);
+    writer.key(name).beginObject()
+      .key("running").value(info.client != nullptr)
+      .key("initialized").value(info.initialized)
+      .key("failures").value(info.failures)
+      .key("metrics");
+    metrics(name).writeJSON(writer);
+    writer.endObject();
+  }
+  writer.endObject().endObject();
+  return writer.take();
+}
+
+bool LSPManager::hasReadyServer(const std::string& uri) const {
+  auto document = m_documents.find(uri);
+  if (document == m_documents.end()) {
+    return false;
+  }
+  return std::any_of(document->second.servers.begin(), document->second.servers.end(),
+                     [this](const DocumentServer& server) {
+    auto info = m_servers.find(server.name);
+    return server.opened && info != m_servers.end() && info->second.initialized;
+  });
+}
+
+// The servers registered for the document's language or its extension, in
+// registration order.
+std::vector<std::string> LSPManager::serversForDocument(const std::string& uri, const std::string& languageId) const {
+  size_t dotPos = uri.find_last_of('.');
+  std::string ext = dotPos == std::string::npos ? std::string() : uri.substr(dotPos);
+
+  std::vector<std::string> servers;
+  for (const std::string& name : m_serverOrder) {
+    const LanguageServerConfig& config = m_servers.at(name).config;
+    bool byExtension = !ext.empty() && std::find(config.extensions.begin(), config.extensions.end(), ext) !=
+                                           config.extensions.end();
+    if (config.languageId == languageId || byExtension) {
+      servers.push_back(name);
     }
   }
-  return "";
+  return servers;
 }
 
 } // namespace lsp
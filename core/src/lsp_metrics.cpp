@@ -0,0 +1,153 @@
+#include "lsp_metrics.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <utility>
+
+namespace prodigeetor {
+namespace lsp {
+
+// Values below 16 have a bucket each. Above, bucket 16 * (shift + 1) + k
+// holds the values whose top five bits are 16 + k after shifting right by
+// `shift`.
+size_t LatencyHistogram::bucketOf(uint64_t micros) {
+  constexpr uint64_t kSubBuckets = uint64_t{1} << kSubBucketBits;
+  if (micros < kSubBuckets) {
+    return static_cast<size_t>(micros);
+  }
+  int shift = std::bit_width(micros) - kSubBucketBits - 1;
+  uint64_t top = micros >> shift;
+  return static_cast<size_t>((static_cast<uint64_t>(shift + 1) << kSubBucketBits) + (top - kSubBuckets));
+}
+
+uint64_t LatencyHistogram::bucketEnd(size_t bucket) {
+  constexpr size_t kSubBuckets = size_t{1} << kSubBucketBits;
+  if (bucket < kSubBuckets) {
+    return bucket;
+  }
+  int shift = static_cast<int>(bucket >> kSubBucketBits) - 1;
+  uint64_t top = kSubBuckets + (bucket & (kSubBuckets - 1));
+  return ((top + 1) << shift) - 1;
+}
+
+void LatencyHistogram::record(uint64_t micros) {
+  micros = std::min(micros, kMaxValue);
+  if (m_counts.empty()) {
+    m_counts.resize(kBuckets);
+  }
+  ++m_counts[bucketOf(micros)];
+  ++m_count;
+  m_sum += micros;
+  m_min = std::min(m_min, micros);
+  m_max = std::max(m_max, micros);
+}
+
+void LatencyHistogram::merge(const LatencyHistogram &other) {
+  if (other.m_count == 0) {
+    return;
+  }
+  if (m_counts.empty()) {
+    m_counts.resize(kBuckets);
+  }
+  for (size_t i = 0; i < kBuckets; ++i) {
+    m_counts[i] += other.m_counts[i];
+  }
+  m_count += other.m_count;
+  m_sum += other.m_sum;
+  m_min = std::min(m_min, other.m_min);
+  m_max = std::max(m_max, other.m_max);
+}
+
+uint64_t LatencyHistogram::percentile(double percentile) const {
+  if (m_count == 0) {
+    return 0;
+  }
+  double clamped = std::clamp(percentile, 0.0, 100.0);
+  uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(clamped / 100.0 * static_cast<double>(m_count))));
+  uint64_t seen = 0;
+  for (size_t i = 0; i < kBuckets; ++i) {
+    seen += m_counts[i];
+    if (seen >= rank) {
+      return std::min(bucketEnd(i), m_max);
+    }
+  }
+  return m_max;
+}
+
+void LatencyHistogram::writeJSON(JSONWriter &writer) const {
+  writer.beginObject()
+    .key("count").value(static_cast<int64_t>(m_count))
+    .key("min").value(static_cast<int64_t>(min()))
+    .key("mean").value(static_cast<int64_t>(mean()))
+    .key("p50").value(static_cast<int64_t>(percentile(50)))
+    .key("p90").value(static_cast<int64_t>(percentile(90)))
+    .key("p99").value(static_cast<int64_t>(percentile(99)))
+    .key("max").value(static_cast<int64_t>(m_max))
+    .endObject();
+}
+
+void MethodMetrics::merge(const MethodMetrics &other) {
+  sent += other.sent;
+  received += other.received;
+  errors += other.errors;
+  cancelled += other.cancelled;
+  inFlight += other.inFlight;
+  bytesSent += other.bytesSent;
+  bytesReceived += other.bytesReceived;
+  latency.merge(other.latency);
+  server.merge(other.server);
+  parse.merge(other.parse);
+  queue.merge(other.queue);
+  handler.merge(other.handler);
+}
+
+MethodMetrics &LSPMetrics::method(std::string_view name) {
+  auto it = methods.find(name);
+  if (it == methods.end()) {
+    it = methods.emplace(std::string(name), MethodMetrics()).first;
+  }
+  return it->second;
+}
+
+void LSPMetrics::merge(const LSPMetrics &other) {
+  for (const auto &[name, metrics] : other.methods) {
+    method(name).merge(metrics);
+  }
+  deferredWrites += other.deferredWrites;
+  writeWaitMicros += other.writeWaitMicros;
+}
+
+void LSPMetrics::writeJSON(JSONWriter &writer) const {
+  writer.beginObject()
+    .key("pipe").beginObject()
+      .key("deferredWrites").value(static_cast<int64_t>(deferredWrites))
+      .key("writeWaitUs").value(static_cast<int64_t>(writeWaitMicros))
+    .endObject()
+    .key("methods").beginObject();
+  for (const auto &[name, metrics] : methods) {
+    writer.key(name).beginObject()
+      .key("sent").value(static_cast<int64_t>(metrics.sent))
+      .key("received").value(static_cast<int64_t>(metrics.received))
+      .key("errors").value(static_cast<int64_t>(metrics.errors))
+      .key("cancelled").value(static_cast<int64_t>(metrics.cancelled))
+      .key("inFlight").value(metrics.inFlight)
+      .key("bytesSent").value(static_cast<int64_t>(metrics.bytesSent))
+      .key("bytesReceived").value(static_cast<int64_t>(metrics.bytesReceived));
+    const std::pair<const char *, const LatencyHistogram *> histograms[] = {
+      {"latencyUs", &metrics.latency}, {"serverUs", &metrics.server}, {"parseUs", &metrics.parse},
+      {"queueUs", &metrics.queue}, {"handlerUs", &metrics.handler},
+    };
+    for (const auto &[key, histogram] : histograms) {
+      if (histogram->count() > 0) {
+        writer.key(key);
+        histogram->writeJSON(writer);
+      }
+    }
+    writer.endObject();
+  }
+  writer.endObject().endObject();
+}
+
+} // namespace lsp
+} // namespace prodigeetor
@@ -1,7 +1,87 @@
 #include "rendering.h"
 
+#include <algorithm>
+#include <string_view>
+
+#include "grapheme.h"
+
 namespace prodigeetor {
 
 // Rendering abstractions are implemented by platform-specific UI shells.
 
+namespace {
+
+constexpr char kFirstAscii = ' ';
+constexpr char kLastAscii = '~';
+
+// Tabs, control characters and anything beyond ASCII are not in the table.
+bool in_table(char c) {
+  return c >= kFirstAscii && c <= kLastAscii;
+}
+
+} // namespace
+
+const float *TextRendererAdapter::ascii_advance_table() {
+  if (m_ascii_advances_state == AsciiAdvances::Unknown) {
+    m_ascii_advances_state =
+        ascii_advances(m_ascii_advances.data()) ? AsciiAdvances::Valid : AsciiAdvances::Unavailable;
+  }
+  return m_ascii_advances_state == AsciiAdvances::Valid ? m_ascii_advances.data() : nullptr;
+}
+
+size_t TextRendererAdapter::index_at_x(const LineLayout &layout, float x) {
+  const std::string &text = layout.text;
+  if (x <= 0.0f || text.empty()) {
+    return 0;
+  }
+  if (const float *advances = ascii_advance_table();
+      advances && std::all_of(text.begin(), text.end(), in_table)) {
+    // The first character whose middle is past x starts at the nearest boundary
+    float left = 0.0f;
+    for (size_t i = 0; i < text.size(); ++i) {
+      float advance = advances[text[i] - kFirstAscii];
+      if (x < left + advance / 2.0f) {
+        return i;
+      }
+      left += advance;
+    }
+    return text.size();
+  }
+
+  // The first boundary at or past x, then whichever of it and the one
+  // before is nearer; O(log n) measurements.
+  std::vector<size_t> boundaries = grapheme_boundaries(text);
+  boundaries.push_back(text.size());
+  size_t low = 0;
+  size_t high = boundaries.size() - 1;
+  while (low < high) {
+    size_t mid = low + (high - low) / 2;
+    if (x_at_index(layout, boundaries[mid]) < x) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  if (low > 0 && x - x_at_index(layout, boundaries[low - 1]) < x_at_index(layout, boundaries[low]) - x) {
+    --low;
+  }
+  return boundaries[low];
+}
+
+float TextRendererAdapter::x_at_index(const LineLayout &layout, size_t index) {
+  index = std::min(index, layout.text.size());
+  if (index == 0) {
+    return 0.0f;
+  }
+  std::string_view prefix(layout.text.data(), index);
+  if (const float *advances = ascii_advance_table(); advances && std::all_of(prefix.begin(), prefix.end(), in_table)) {
+    float x = 0.0f;
+    for (char c : prefix) {
+      x += advances[c - kFirstAscii];
+    }
+    return x;
+  }
+  return measure_line(std::string(prefix)).width;
+}
+
 } // namespace prodigeetor
@@ -0,0 +1,215 @@
+#include "semantic_token_store.h"
+
+#include <algorithm>
+
+namespace prodigeetor {
+
+namespace {
+
+// Converts the UTF-16 columns of one line to byte columns. Tokens come in
+// column order, so the line is walked once; ASCII lines need no walk.
+class ColumnMapper {
+public:
+  void reset(std::string text) {
+    m_text = std::move(text);
+    if (!m_text.empty() && m_text.back() == '\n') {
+      m_text.pop_back();
+    }
+    m_ascii = std::all_of(m_text.begin(), m_text.end(), [](char c) { return static_cast<unsigned char>(c) < 0x80; });
+    m_byte = 0;
+    m_units = 0;
+  }
+
+  uint32_t to_bytes(uint32_t units) {
+    if (m_ascii) {
+      return static_cast<uint32_t>(std::min<size_t>(units, m_text.size()));
+    }
+    if (units < m_units) {
+      m_byte = 0;
+      m_units = 0;
+    }
+    while (m_byte < m_text.size() && m_units < units) {
+      unsigned char c = static_cast<unsigned char>(m_text[m_byte]);
+      size_t length = c < 0x80 ? 1 : c < 0xE0 ? 2 : c < 0xF0 ? 3 : 4;
+      m_units += length == 4 ? 2 : 1;
+      m_byte = std::min(m_byte + length, m_text.size());
+    }
+    return static_cast<uint32_t>(m_byte);
+  }
+
+private:
+  std::string m_text;
+  bool m_ascii = true;
+  size_t m_byte = 0;
+  uint32_t m_units = 0;
+};
+
+// Decodes the tokens of lines [first_line, last_line] from packed data into
+// `tokens`, with `offsets` holding each line's first token and one past the
+// end. Tokens outside those lines or past the buffer are skipped.
+void decode(const std::vector<uint32_t> &data, const TextBuffer &buffer, size_t first_line, size_t last_line,
+            std::vector<SemanticToken> &tokens, std::vector<uint32_t> &offsets) {
+  last_line = std::min(last_line, buffer.line_count() - 1);
+  tokens.clear();
+  offsets.assign(1, 0);
+  ColumnMapper mapper;
+  size_t line = 0;
+  uint32_t start = 0;
+  bool loaded = false;
+  for (size_t i = 0; i + 5 <= data.size(); i += 5) {
+    if (data[i] != 0) {
+      line += data[i];
+      start = data[i + 1];
+      loaded = false;
+    } else {
+      start += data[i + 1];
+    }
+    if (line < first_line) {
+      continue;
+    }
+    if (line > last_line) {
+      break;
+    }
+    if (!loaded) {
+      mapper.reset(buffer.line_text(line));
+      loaded = true;
+    }
+    while (offsets.size() <= line - first_line) {
+      offsets.push_back(static_cast<uint32_t>(tokens.size()));
+    }
+    SemanticToken token;
+    token.column = mapper.to_bytes(start);
+    uint32_t end = mapper.to_bytes(start + data[i + 2]);
+    if (end <= token.column) {
+      continue;
+    }
+    token.length = end - token.column;
+    token.type = data[i + 3];
+    token.modifiers = data[i + 4];
+    tokens.push_back(token);
+  }
+  while (offsets.size() <= last_line - first_line + 1) {
+    offsets.push_back(static_cast<uint32_t>(tokens.size()));
+  }
+}
+
+} // namespace
+
+void SemanticTokenStore::set(const std::vector<uint32_t> &data, const TextBuffer &buffer) {
+  decode(data, buffer, 0, buffer.line_count() - 1, m_tokens, m_offsets);
+}
+
+void SemanticTokenStore::set_lines(size_t first_line, size_t last_line, const std::vector<uint32_t> &data,
+                                   const TextBuffer &buffer) {
+  if (first_line > last_line || first_line >= buffer.line_count()) {
+    return;
+  }
+  last_line = std::min(last_line, buffer.line_count() - 1);
+  std::vector<SemanticToken> tokens;
+  std::vector<uint32_t> offsets;
+  decode(data, buffer, first_line, last_line, tokens, offsets);
+
+  cover(last_line + 1);
+  size_t begin = m_offsets[first_line];
+  size_t end = m_offsets[last_line + 1];
+  int64_t delta = static_cast<int64_t>(tokens.size()) - static_cast<int64_t>(end - begin);
+  m_tokens.erase(m_tokens.begin() + static_cast<ptrdiff_t>(begin), m_tokens.begin() + static_cast<ptrdiff_t>(end));
+  m_tokens.insert(m_tokens.begin() + static_cast<ptrdiff_t>(begin), tokens.begin(), tokens.end());
+  for (size_t i = first_line; i <= last_line; ++i) {
+    m_offsets[i] = static_cast<uint32_t>(begin + offsets[i - first_line]);
+  }
+  for (size_t i = last_line + 1; i < m_offsets.size(); ++i) {
+    m_offsets[i] = static_cast<uint32_t>(static_cast<int64_t>(m_offsets[i]) + delta);
+  }
+}
+
+void SemanticTokenStore::clear() {
+  m_tokens.clear();
+  m_offsets.clear();
+}
+
+// Extends the offsets with empty lines until `lines` lines are covered.
+void SemanticTokenStore::cover(size_t lines) {
+  if (m_offsets.empty()) {
+    m_offsets.push_back(0);
+  }
+  if (m_offsets.size() < lines + 1) {
+    m_offsets.resize(lines + 1, m_offsets.back());
+  }
+}
+
+void SemanticTokenStore::apply_edit(size_t line, size_t column, std::string_view removed, std::string_view inserted) {
+  if (line >= covered_lines()) {
+    return;
+  }
+  size_t removed_lines = static_cast<size_t>(std::count(removed.begin(), removed.end(), '\n'));
+  size_t inserted_lines = static_cast<size_t>(std::count(inserted.begin(), inserted.end(), '\n'));
+  size_t old_end_line = line + removed_lines;
+  size_t old_end_column = removed_lines == 0 ? column + removed.size() : removed.size() - removed.rfind('\n') - 1;
+  size_t new_end_column = inserted_lines == 0 ? column + inserted.size() : inserted.size() - inserted.rfind('\n') - 1;
+  bool typed_inline = removed.empty() && inserted_lines == 0;
+  cover(old_end_line + 1);
+
+  // The edited lines are rebuilt: tokens before the edit stay on the first
+  // line, tokens after it move to the last inserted line.
+  std::vector<SemanticToken> kept;
+  std::vector<SemanticToken> moved;
+  size_t begin = m_offsets[line];
+  size_t end = m_offsets[old_end_line + 1];
+  for (size_t i = begin; i < m_offsets[line + 1]; ++i) {
+    SemanticToken token = m_tokens[i];
+    size_t token_end = static_cast<size_t>(token.column) + token.length;
+    if (token_end <= column) {
+      kept.push_back(token);
+    } else if (token.column < column && typed_inline) {
+      token.length += static_cast<uint32_t>(inserted.size());
+      kept.push_back(token);
+    } else if (removed_lines == 0 && token.column >= old_end_column) {
+      token.column = static_cast<uint32_t>(token.column - old_end_column + new_end_column);
+      moved.push_back(token);
+    }
+  }
+  if (removed_lines > 0) {
+    for (size_t i = m_offsets[old_end_line]; i < end; ++i) {
+      SemanticToken token = m_tokens[i];
+      if (token.column >= old_end_column) {
+        token.column = static_cast<uint32_t>(token.column - old_end_column + new_end_column);
+        moved.push_back(token);
+      }
+    }
+  }
+
+  // Usually no token was dropped and the edited lines keep their slot
+  size_t replacement = kept.size() + moved.size();
+  int64_t delta = static_cast<int64_t>(replacement) - static_cast<int64_t>(end - begin);
+  size_t moved_start = begin + kept.size();
+  if (delta == 0) {
+    std::copy(kept.begin(), kept.end(), m_tokens.begin() + static_cast<ptrdiff_t>(begin));
+    std::copy(moved.begin(), moved.end(), m_tokens.begin() + static_cast<ptrdiff_t>(moved_start));
+    if (removed_lines == 0 && inserted_lines == 0) {
+      return;
+    }
+  } else {
+    m_tokens.erase(m_tokens.begin() + static_cast<ptrdiff_t>(begin), m_tokens.begin() + static_cast<ptrdiff_t>(end));
+    kept.insert(kept.end(), moved.begin(), moved.end());
+    m_tokens.insert(m_tokens.begin() + static_cast<ptrdiff_t>(begin), kept.begin(), kept.end());
+  }
+
+  // Lines line + 1 .. line + inserted_lines start where the moved tokens do
+  auto first_removed = m_offsets.begin() + static_cast<ptrdiff_t>(line + 1);
+  m_offsets.erase(first_removed, first_removed + static_cast<ptrdiff_t>(removed_lines));
+  m_offsets.insert(m_offsets.begin() + static_cast<ptrdiff_t>(line + 1), inserted_lines,
+                   static_cast<uint32_t>(moved_start));
+  for (size_t i = line + inserted_lines + 1; delta != 0 && i < m_offsets.size(); ++i) {
+    m_offsets[i] = static_cast<uint32_t>(static_cast<int64_t>(m_offsets[i]) + delta);
+  }
+}
+
+std::span<const SemanticToken> SemanticTokenStore::line(size_t line) const {
+  if (line >= covered_lines()) {
+    return {};
+  }
+  return std::span<const SemanticToken>(m_tokens.data() + m_offsets[line], m_offsets[line + 1] - m_offsets[line]);
+}
+
+} // namespace prodigeetor
@@ -1,5 +1,7 @@
 #include "settings.h"
 
+#include <cstdlib>
+#include <filesystem>
 #include <fstream>
 #include <regex>
 #include <sstream>
@@ -27,6 +29,12 @@ EditorSettings SettingsLoader::load_from_file(const std::string &path) {
   std::regex size_regex(R"regex("fontSize"\s*:\s*([0-9]+(\.[0-9]+)?)")regex");
   std::regex liga_regex(R"regex("fontLigatures"\s*:\s*(true|false))regex");
   std::regex fallback_regex(R"regex("fontFallbacks"\s*:\s*\[([^\]]*)\])regex");
+  std::regex max_file_regex(R"regex("syntaxMaxFileSize"\s*:\s*([0-9]+))regex");
+  std::regex max_line_regex(R"regex("syntaxMaxLineLength"\s*:\s*([0-9]+))regex");
+  std::regex budget_regex(R"regex("syntaxParseBudgetMs"\s*:\s*([0-9]+))regex");
+  std::regex large_file_regex(R"regex("largeFileSize"\s*:\s*([0-9]+))regex");
+  std::regex map_size_regex(R"regex("largeFileMapSize"\s*:\s*([0-9]+))regex");
+  std::regex lsp_max_regex(R"regex("largeFileLspMaxSize"\s*:\s*([0-9]+))regex");
 
   std::smatch match;
   if (std::regex_search(content, match, font_regex)) {
@@ -38,6 +46,24 @@ EditorSettings SettingsLoader::load_from_file(const std::string &path) {
   if (std::regex_search(content, match, liga_regex)) {
     settings.font_ligatures = (match[1].str() == "true");
   }
+  if (std::regex_search(content, match, max_file_regex)) {
+    settings.syntax_max_file_size = std::stoull(match[1].str());
+  }
+  if (std::regex_search(content, match, max_line_regex)) {
+    settings.syntax_max_line_length = std::stoull(match[1].str());
+  }
+  if (std::regex_search(content, match, budget_regex)) {
+    settings.syntax_parse_budget_ms = static_cast<uint32_t>(std::stoul(match[1].str()));
+  }
+  if (std::regex_search(content, match, large_file_regex)) {
+    settings.large_file_size = std::stoull(match[1].str());
+  }
+  if (std::regex_search(content, match, map_size_regex)) {
+    settings.large_file_map_size = std::stoull(match[1].str());
+  }
+  if (std::regex_search(content, match, lsp_max_regex)) {
+    settings.large_file_lsp_max_size = std::stoull(match[1].str());
+  }
   if (std::regex_search(content, match, fallback_regex)) {
     settings.font_fallbacks.clear();
     std::string list = match[1].str();
@@ -52,4 +78,20 @@ EditorSettings SettingsLoader::load_from_file(const std::string &path) {
   return settings;
 }
 
+std::string user_cache_directory() {
+  std::string cache_dir;
+  if (const char *xdg = getenv("XDG_CACHE_HOME"); xdg && *xdg) {
+    cache_dir = xdg;
+  } else if (const char *home = getenv("HOME"); home && *home) {
+#ifdef __APPLE__
+    cache_dir = std::string(home) + "/Library/Caches";
+#else
+    cache_dir = std::string(home) + "/.cache";
+#endif
+  } else {
+    cache_dir = std::filesystem::temp_directory_path().string();
+  }
+  return cache_dir + "/prodigeetor";
+}
+
 } // namespace prodigeetor
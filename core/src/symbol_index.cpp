@@ -0,0 +1,920 @@
+#include "symbol_index.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "directory_watcher.h"
+#include "fuzzy_match.h"
+#include "language_registry.h"
+#include "settings.h"
+#include "syntax_highlighter.h"
+
+namespace prodigeetor {
+
+namespace {
+
+// On-disk layout, native endianness:
+//   IndexHeader | FileRecord[file_count] | SymbolRecord[symbol_count] | strings
+// File records are sorted by path and own a contiguous run of symbols. Kind
+// names are interned at the start of the string table.
+constexpr char kIndexMagic[4] = {'P', 'S', 'Y', 'I'};
+constexpr uint32_t kIndexVersion = 1;
+// Bigger files are almost always generated or minified bundles.
+constexpr uint64_t kMaxIndexedFileSize = 4 * 1024 * 1024;
+// How often the refresh worker sweeps a workspace it cannot watch.
+constexpr std::chrono::seconds kSweepInterval{5};
+// A file whose parse takes longer is indexed without symbols.
+constexpr uint64_t kTagTimeoutMicros = 2'000'000;
+// How long updates after the first refresh collect in the overlay before the
+// index file is rewritten with them.
+constexpr std::chrono::seconds kSaveDelay{10};
+
+struct IndexHeader {
+  char magic[4];
+  uint32_t version;
+  uint32_t file_count;
+  uint32_t symbol_count;
+  uint64_t strings_size;
+};
+
+struct FileRecord {
+  uint64_t path_offset;
+  uint32_t path_length;
+  uint32_t first_symbol;
+  uint32_t symbol_count;
+  uint32_t reserved;
+  int64_t mtime;
+  uint64_t size;
+  uint64_t hash;
+};
+
+struct SymbolRecord {
+  uint64_t name_offset;
+  uint64_t mask;
+  uint32_t name_length;
+  uint32_t kind_offset;
+  uint32_t kind_length;
+  uint32_t file;
+  uint32_t line;
+  uint32_t column;
+};
+
+static_assert(std::is_trivially_copyable_v<IndexHeader>);
+static_assert(std::is_trivially_copyable_v<FileRecord>);
+static_assert(std::is_trivially_copyable_v<SymbolRecord>);
+
+uint64_t fnv1a(std::string_view data) {
+  uint64_t hash = 1469598103934665603ull;
+  for (unsigned char c : data) {
+    hash ^= c;
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+int64_t mtime_of(const struct stat &info) {
+#ifdef __APPLE__
+  return static_cast<int64_t>(info.st_mtimespec.tv_sec) * 1000000000 + info.st_mtimespec.tv_nsec;
+#else
+  return static_cast<int64_t>(info.st_mtim.tv_sec) * 1000000000 + info.st_mtim.tv_nsec;
+#endif
+}
+
+bool read_file(const std::string &path, std::string &content) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file.is_open()) {
+    return false;
+  }
+  std::stringstream buffer;
+  buffer << file.rdbuf();
+  content = buffer.str();
+  return true;
+}
+
+bool skip_directory(const std::filesystem::path &path) {
+  std::string name = path.filename().string();
+  return (!name.empty() && name[0] == '.') || name == "node_modules" || name == "bower_components";
+}
+
+// The memory-mapped index from the last save(). Records of files that have
+// since changed or disappeared are masked out through `live`.
+struct Snapshot {
+  void *data = nullptr;
+  size_t size = 0;
+  const IndexHeader *header = nullptr;
+  const FileRecord *files = nullptr;
+  const SymbolRecord *symbols = nullptr;
+  const char *strings = nullptr;
+  std::vector<uint8_t> live;
+
+  Snapshot() = default;
+  Snapshot(const Snapshot &) = delete;
+  Snapshot &operator=(const Snapshot &) = delete;
+  ~Snapshot() {
+    if (data) {
+      munmap(data, size);
+    }
+  }
+
+  std::string_view string(uint64_t offset, uint32_t length) const {
+    return std::string_view(strings + offset, length);
+  }
+
+  static std::unique_ptr<Snapshot> map(const std::string &path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return nullptr;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < sizeof(IndexHeader)) {
+      close(fd);
+      return nullptr;
+    }
+    size_t size = static_cast<size_t>(info.st_size);
+    void *data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+      return nullptr;
+    }
+
+    auto snapshot = std::make_unique<Snapshot>();
+    snapshot->data = data;
+    snapshot->size = size;
+    const char *bytes = static_cast<const char *>(data);
+    snapshot->header = reinterpret_cast<const IndexHeader *>(bytes);
+    const IndexHeader &header = *snapshot->header;
+    if (std::memcmp(header.magic, kIndexMagic, sizeof(kIndexMagic)) != 0 || header.version != kIndexVersion) {
+      return nullptr;
+    }
+    uint64_t files_bytes = static_cast<uint64_t>(header.file_count) * sizeof(FileRecord);
+    uint64_t symbols_bytes = static_cast<uint64_t>(header.symbol_count) * sizeof(SymbolRecord);
+    if (sizeof(IndexHeader) + files_bytes + symbols_bytes + header.strings_size != size) {
+      return nullptr;
+    }
+    snapshot->files = reinterpret_cast<const FileRecord *>(bytes + sizeof(IndexHeader));
+    snapshot->symbols = reinterpret_cast<const SymbolRecord *>(bytes + sizeof(IndexHeader) + files_bytes);
+    snapshot->strings = bytes + sizeof(IndexHeader) + files_bytes + symbols_bytes;
+
+    // Reject truncated or foreign files instead of reading out of bounds later.
+    for (uint32_t i = 0; i < header.file_count; ++i) {
+      const FileRecord &file = snapshot->files[i];
+      if (file.path_offset + file.path_length > header.strings_size ||
+          static_cast<uint64_t>(file.first_symbol) + file.symbol_count > header.symbol_count) {
+        return nullptr;
+      }
+    }
+    for (uint32_t i = 0; i < header.symbol_count; ++i) {
+      const SymbolRecord &symbol = snapshot->symbols[i];
+      if (symbol.name_offset + symbol.name_length > header.strings_size ||
+          static_cast<uint64_t>(symbol.kind_offset) + symbol.kind_length > header.strings_size ||
+          symbol.file >= header.file_count) {
+        return nullptr;
+      }
+    }
+    snapshot->live.assign(header.file_count, 1);
+    return snapshot;
+  }
+};
+
+struct OverlaySymbol {
+  std::string name;
+  std::string kind;
+  uint64_t mask = 0;
+  uint32_t line = 0;
+  uint32_t column = 0;
+};
+
+struct FileState {
+  int64_t mtime = 0;
+  uint64_t size = 0;
+  uint64_t hash = 0;
+  int64_t snapshot_file = -1; // record in the snapshot still holding this file's symbols
+  std::vector<OverlaySymbol> symbols; // used when snapshot_file < 0
+  uint64_t changed_at = 0; // State::generation of its last change
+};
+
+} // namespace
+
+struct SymbolIndex::State {
+  std::unique_ptr<Snapshot> snapshot;
+  std::unordered_map<std::string, FileState> files; // keyed by workspace-relative path
+  bool dirty = false;
+  uint64_t generation = 0; // bumped by every change, so save() can tell what moved meanwhile
+
+  void touch(FileState &file) {
+    file.changed_at = ++generation;
+    dirty = true;
+  }
+
+  void remove(std::unordered_map<std::string, FileState>::iterator it) {
+    supersede(it->second);
+    files.erase(it);
+    ++generation;
+    dirty = true;
+  }
+
+  void supersede(FileState &file) {
+    if (file.snapshot_file >= 0 && snapshot) {
+      snapshot->live[static_cast<size_t>(file.snapshot_file)] = 0;
+    }
+    file.snapshot_file = -1;
+  }
+};
+
+namespace {
+
+// Languages with a grammar and a tags query; the grammar itself is only loaded
+// once a worker tags the first file of that language.
+const LanguageInfo *indexed_language(const std::string &path) {
+  const LanguageInfo *language = LanguageRegistry::instance().for_path(path);
+  if (!language || language->grammar.empty() || language->tags.empty()) {
+    return nullptr;
+  }
+  return language;
+}
+
+struct ScannedFile {
+  std::string relative;
+  std::string absolute;
+  const LanguageInfo *language = nullptr;
+  int64_t mtime = 0;
+  uint64_t size = 0;
+};
+
+// Result of reading and tagging one file on a worker.
+struct IndexedFile {
+  bool ok = false;
+  bool unchanged = false; // same content hash as the indexed version
+  uint64_t hash = 0;
+  std::vector<OverlaySymbol> symbols;
+};
+
+IndexedFile index_file(TreeSitterTagger &tagger, const ScannedFile &file, std::optional<uint64_t> previous_hash) {
+  IndexedFile result;
+  std::string content;
+  if (!read_file(file.absolute, content)) {
+    return result;
+  }
+  result.ok = true;
+  result.hash = fnv1a(content);
+  if (previous_hash && *previous_hash == result.hash) {
+    result.unchanged = true;
+    return result;
+  }
+  for (auto &tag : tagger.tags(*file.language, content)) {
+    OverlaySymbol symbol;
+    symbol.mask = fuzzy_char_mask(tag.name);
+    symbol.name = std::move(tag.name);
+    symbol.kind = std::move(tag.kind);
+    symbol.line = tag.line;
+    symbol.column = tag.column;
+    result.symbols.push_back(std::move(symbol));
+  }
+  return result;
+}
+
+bool stat_file(const std::string &path, int64_t &mtime, uint64_t &size) {
+  struct stat info;
+  if (::stat(path.c_str(), &info) != 0 || !S_ISREG(info.st_mode)) {
+    return false;
+  }
+  mtime = mtime_of(info);
+  size = static_cast<uint64_t>(info.st_size);
+  return true;
+}
+
+} // namespace
+
+SymbolIndex::SymbolIndex() : m_state(std::make_unique<State>()) {}
+
+SymbolIndex::~SymbolIndex() {
+  stop();
+  save();
+}
+
+std::string SymbolIndex::default_index_path(const std::string &root_path) {
+  char name[64];
+  std::snprintf(name, sizeof(name), "symbols-%016llx.idx", static_cast<unsigned long long>(fnv1a(root_path)));
+  return user_cache_directory() + "/" + name;
+}
+
+std::shared_ptr<SymbolIndex> SymbolIndex::shared(const std::string &root_path) {
+  static std::mutex mutex;
+  static std::unordered_map<std::string, std::weak_ptr<SymbolIndex>> indexes;
+
+  std::lock_guard<std::mutex> lock(mutex);
+  std::shared_ptr<SymbolIndex> index = indexes[root_path].lock();
+  if (!index) {
+    index = std::make_shared<SymbolIndex>();
+    index->open(root_path, default_index_path(root_path));
+    index->refresh_async();
+    indexes[root_path] = index;
+  }
+  return index;
+}
+
+void SymbolIndex::open(const std::string &root_path, const std::string &index_path) {
+  stop();
+
+  std::lock_guard save_lock(m_save_mutex);
+  std::unique_lock lock(m_mutex);
+  m_root = root_path;
+  while (m_root.size() > 1 && m_root.back() == '/') {
+    m_root.pop_back();
+  }
+  m_index_path = index_path;
+  m_state = std::make_unique<State>();
+  m_state->snapshot = Snapshot::map(index_path);
+  if (!m_state->snapshot) {
+    return;
+  }
+  const Snapshot &snapshot = *m_state->snapshot;
+  for (uint32_t i = 0; i < snapshot.header->file_count; ++i) {
+    const FileRecord &record = snapshot.files[i];
+    FileState &file = m_state->files[std::string(snapshot.string(record.path_offset, record.path_length))];
+    file.mtime = record.mtime;
+    file.size = record.size;
+    file.hash = record.hash;
+    file.snapshot_file = i;
+  }
+  std::cerr << "[SymbolIndex] Loaded " << snapshot.header->symbol_count << " symbols from " << index_path << std::endl;
+}
+
+void SymbolIndex::refresh_async(size_t thread_count) {
+  stop();
+  if (m_root.empty()) {
+    return;
+  }
+  m_indexing = true;
+  m_worker = std::thread([this, thread_count]() { watch(thread_count); });
+}
+
+// The refresh worker: a full refresh, then the files queued by update_file()
+// and the directory watcher as they come. The workspace is only swept again
+// on rescan(), when the watcher dropped events, or every kSweepInterval where
+// it cannot be watched at all. Updates are saved in batches, kSaveDelay after
+// the first unsaved one, and when the worker stops.
+void SymbolIndex::watch(size_t thread_count) {
+  // Started first, so files changed during the full refresh are queued.
+  DirectoryWatcher watcher;
+  bool watching = watcher.start(m_root, skip_directory, [this](std::vector<std::string> paths, bool overflowed) {
+    {
+      std::lock_guard lock(m_queue_mutex);
+      m_rescan = m_rescan || overflowed;
+      m_queued.insert(m_queued.end(), std::make_move_iterator(paths.begin()), std::make_move_iterator(paths.end()));
+    }
+    m_queue_changed.notify_all();
+  });
+  if (!watching) {
+    std::cerr << "[SymbolIndex] Cannot watch " << m_root << ", sweeping it for changes instead" << std::endl;
+  }
+
+  refresh(thread_count, nullptr);
+  if (!m_cancel) {
+    save();
+  }
+  {
+    std::lock_guard lock(m_queue_mutex);
+    m_indexing = false;
+  }
+  m_queue_changed.notify_all();
+
+  using Clock = std::chrono::steady_clock;
+  auto next_sweep = Clock::now() + kSweepInterval;
+  auto save_at = Clock::time_point::max(); // max while nothing waits to be saved
+  while (true) {
+    std::vector<std::string> paths;
+    bool rescan = false;
+    {
+      std::unique_lock lock(m_queue_mutex);
+      auto ready = [this] { return m_cancel || m_rescan || !m_queued.empty(); };
+      auto wake_at = watching ? save_at : std::min(save_at, next_sweep);
+      if (wake_at == Clock::time_point::max()) {
+        m_queue_changed.wait(lock, ready);
+      } else {
+        m_queue_changed.wait_until(lock, wake_at, ready);
+      }
+      if (m_cancel) {
+        break;
+      }
+      if (!watching && Clock::now() >= next_sweep) {
+        m_rescan = true;
+      }
+      rescan = std::exchange(m_rescan, false);
+      paths.swap(m_queued);
+    }
+    if (rescan) {
+      refresh(thread_count, nullptr);
+      next_sweep = Clock::now() + kSweepInterval;
+    } else if (!paths.empty()) {
+      std::sort(paths.begin(), paths.end());
+      paths.erase(std::unique(paths.begin(), paths.end()), paths.end());
+      refresh(thread_count, &paths);
+    }
+    if (Clock::now() >= save_at) {
+      save();
+      save_at = Clock::time_point::max();
+    } else if (save_at == Clock::time_point::max() && (rescan || !paths.empty())) {
+      save_at = Clock::now() + kSaveDelay;
+    }
+  }
+  if (save_at != Clock::time_point::max()) {
+    save();
+  }
+}
+
+void SymbolIndex::stop() {
+  {
+    std::lock_guard lock(m_queue_mutex);
+    m_cancel = true;
+    std::atomic_ref<size_t>(m_cancel_parse).store(1);
+  }
+  m_queue_changed.notify_all();
+  if (m_worker.joinable()) {
+    m_worker.join();
+  }
+  std::lock_guard lock(m_queue_mutex);
+  m_queued.clear();
+  m_rescan = false;
+  m_indexing = false;
+  m_cancel = false;
+  std::atomic_ref<size_t>(m_cancel_parse).store(0);
+}
+
+void SymbolIndex::rescan() {
+  {
+    std::lock_guard lock(m_queue_mutex);
+    m_rescan = true;
+  }
+  m_queue_changed.notify_all();
+}
+
+void SymbolIndex::wait() {
+  std::unique_lock lock(m_queue_mutex);
+  m_queue_changed.wait(lock, [this] { return !m_indexing; });
+}
+
+bool SymbolIndex::is_indexing() const {
+  return m_indexing;
+}
+
+void SymbolIndex::refresh(size_t thread_count, const std::vector<std::string> *paths) {
+  std::vector<ScannedFile> scanned;
+  auto scan = [&](const std::string &path) {
+    ScannedFile file;
+    file.absolute = path;
+    file.language = indexed_language(file.absolute);
+    if (!file.language || !stat_file(file.absolute, file.mtime, file.size) || file.size > kMaxIndexedFileSize) {
+      return;
+    }
+    file.relative = relative_path(file.absolute);
+    scanned.push_back(std::move(file));
+  };
+  if (paths) {
+    for (const auto &path : *paths) {
+      if (!path.ends_with('/')) {
+        scan(path);
+      }
+    }
+  } else {
+    std::error_code error;
+    auto options = std::filesystem::directory_options::skip_permission_denied;
+    for (auto it = std::filesystem::recursive_directory_iterator(m_root, options, error);
+         !error && it != std::filesystem::recursive_directory_iterator(); it.increment(error)) {
+      if (m_cancel) {
+        return;
+      }
+      if (it->is_directory(error)) {
+        if (skip_directory(it->path())) {
+          it.disable_recursion_pending();
+        }
+        continue;
+      }
+      scan(it->path().string());
+    }
+  }
+
+  // Only files whose mtime or size moved need reading. Indexed files that
+  // were not found are gone: any in the workspace, or those of `paths`
+  // (including those below a directory of `paths`, marked by a trailing '/').
+  std::vector<size_t> jobs;
+  std::vector<std::optional<uint64_t>> previous_hashes(scanned.size());
+  std::vector<std::string> deleted;
+  {
+    std::shared_lock lock(m_mutex);
+    std::unordered_map<std::string_view, size_t> present;
+    for (size_t i = 0; i < scanned.size(); ++i) {
+      present.emplace(scanned[i].relative, i);
+      auto it = m_state->files.find(scanned[i].relative);
+      if (it == m_state->files.end()) {
+        jobs.push_back(i);
+      } else if (it->second.mtime != scanned[i].mtime || it->second.size != scanned[i].size) {
+        previous_hashes[i] = it->second.hash;
+        jobs.push_back(i);
+      }
+    }
+    if (paths) {
+      std::vector<std::string> directories;
+      for (const auto &path : *paths) {
+        std::string relative = relative_path(path);
+        if (relative.ends_with('/')) {
+          directories.push_back(std::move(relative));
+        } else if (!present.contains(relative) && m_state->files.contains(relative)) {
+          deleted.push_back(std::move(relative));
+        }
+      }
+      if (!directories.empty()) {
+        for (const auto &[path, file] : m_state->files) {
+          bool below = std::any_of(directories.begin(), directories.end(),
+                                   [&](const std::string &directory) { return path.starts_with(directory); });
+          if (below && !present.contains(path)) {
+            deleted.push_back(path);
+          }
+        }
+      }
+    } else {
+      for (const auto &[path, file] : m_state->files) {
+        if (!present.contains(path)) {
+          deleted.push_back(path);
+        }
+      }
+    }
+  }
+  if (jobs.empty() && deleted.empty()) {
+    return;
+  }
+
+  if (thread_count == 0) {
+    thread_count = std::max(1u, std::thread::hardware_concurrency() > 1 ? std::thread::hardware_concurrency() - 1 : 1u);
+  }
+  thread_count = std::min(thread_count, std::max<size_t>(jobs.size(), 1));
+
+  std::vector<IndexedFile> results(jobs.size());
+  std::atomic<size_t> next{0};
+  auto work = [&]() {
+    TreeSitterTagger tagger;
+    tagger.set_timeout_micros(kTagTimeoutMicros);
+    tagger.set_cancel_flag(&m_cancel_parse);
+    for (size_t job = next++; job < jobs.size() && !m_cancel; job = next++) {
+      size_t index = jobs[job];
+      results[job] = index_file(tagger, scanned[index], previous_hashes[index]);
+    }
+  };
+  std::vector<std::thread> workers;
+  for (size_t i = 1; i < thread_count; ++i) {
+    workers.emplace_back(work);
+  }
+  work();
+  for (auto &worker : workers) {
+    worker.join();
+  }
+  if (m_cancel) {
+    return;
+  }
+
+  {
+    std::unique_lock lock(m_mutex);
+    for (size_t job = 0; job < jobs.size(); ++job) {
+      const ScannedFile &scanned_file = scanned[jobs[job]];
+      IndexedFile &result = results[job];
+      if (!result.ok) {
+        continue;
+      }
+      FileState &file = m_state->files[scanned_file.relative];
+      if (file.mtime > scanned_file.mtime) {
+        continue; // reindexed from a later scan meanwhile
+      }
+      file.mtime = scanned_file.mtime;
+      file.size = scanned_file.size;
+      if (!result.unchanged) {
+        m_state->supersede(file);
+        file.hash = result.hash;
+        file.symbols = std::move(result.symbols);
+      }
+      m_state->touch(file);
+    }
+    for (const auto &path : deleted) {
+      auto it = m_state->files.find(path);
+      if (it != m_state->files.end()) {
+        m_state->remove(it);
+      }
+    }
+  }
+  if (m_indexing) {
+    std::cerr << "[SymbolIndex] Indexed " << jobs.size() << " of " << scanned.size() << " files" << std::endl;
+  }
+}
+
+void SymbolIndex::update_file(const std::string &path) {
+  {
+    std::shared_lock lock(m_mutex);
+    if (m_root.empty() || relative_path(path) == path) {
+      return;
+    }
+  }
+  {
+    std::lock_guard lock(m_queue_mutex);
+    m_queued.push_back(path);
+  }
+  m_queue_changed.notify_all();
+}
+
+void SymbolIndex::remove_file(const std::string &path) {
+  std::unique_lock lock(m_mutex);
+  auto it = m_state->files.find(relative_path(path));
+  if (it == m_state->files.end()) {
+    return;
+  }
+  m_state->remove(it);
+}
+
+bool SymbolIndex::save() {
+  std::lock_guard save_lock(m_save_mutex);
+
+  // The records and their text are copied out under a shared lock, so
+  // queries and updates only wait for the copy, not for the disk.
+  std::string index_path;
+  uint64_t generation = 0;
+  std::vector<std::string> paths;
+  std::string kinds;      // interned first so their offsets fit in 32 bits
+  std::string path_text;  // then the paths
+  std::string name_text;  // then the symbol names
+  std::vector<FileRecord> file_records;
+  std::vector<SymbolRecord> symbol_records;
+  {
+    std::shared_lock lock(m_mutex);
+    if (!m_state->dirty || m_index_path.empty()) {
+      return true;
+    }
+    index_path = m_index_path;
+    generation = m_state->generation;
+    paths.reserve(m_state->files.size());
+    for (const auto &[path, file] : m_state->files) {
+      paths.push_back(path);
+    }
+    std::sort(paths.begin(), paths.end());
+
+    std::unordered_map<std::string, uint32_t> kind_offsets;
+    auto intern_kind = [&](std::string_view kind) {
+      auto it = kind_offsets.find(std::string(kind));
+      if (it != kind_offsets.end()) {
+        return it->second;
+      }
+      uint32_t offset = static_cast<uint32_t>(kinds.size());
+      kinds.append(kind);
+      kind_offsets.emplace(std::string(kind), offset);
+      return offset;
+    };
+
+    const Snapshot *snapshot = m_state->snapshot.get();
+    file_records.reserve(paths.size());
+    for (const std::string &path : paths) {
+      const FileState &file = m_state->files.at(path);
+      FileRecord record{};
+      record.path_offset = path_text.size();
+      record.path_length = static_cast<uint32_t>(path.size());
+      record.first_symbol = static_cast<uint32_t>(symbol_records.size());
+      record.mtime = file.mtime;
+      record.size = file.size;
+      record.hash = file.hash;
+      path_text.append(path);
+      uint32_t file_index = static_cast<uint32_t>(file_records.size());
+      auto add_symbol = [&](std::string_view name, std::string_view kind, uint64_t mask, uint32_t line,
+                            uint32_t column) {
+        SymbolRecord symbol{};
+        symbol.name_offset = name_text.size();
+        symbol.mask = mask;
+        symbol.name_length = static_cast<uint32_t>(name.size());
+        symbol.kind_length = static_cast<uint32_t>(kind.size());
+        symbol.kind_offset = intern_kind(kind);
+        symbol.file = file_index;
+        symbol.line = line;
+        symbol.column = column;
+        symbol_records.push_back(symbol);
+        name_text.append(name);
+      };
+      if (file.snapshot_file >= 0 && snapshot) {
+        const FileRecord &old = snapshot->files[file.snapshot_file];
+        for (uint32_t i = old.first_symbol; i < old.first_symbol + old.symbol_count; ++i) {
+          const SymbolRecord &symbol = snapshot->symbols[i];
+          add_symbol(snapshot->string(symbol.name_offset, symbol.name_length),
+                     snapshot->string(symbol.kind_offset, symbol.kind_length), symbol.mask, symbol.line, symbol.column);
+        }
+      } else {
+        for (const auto &symbol : file.symbols) {
+          add_symbol(symbol.name, symbol.kind, symbol.mask, symbol.line, symbol.column);
+        }
+      }
+      record.symbol_count = static_cast<uint32_t>(symbol_records.size()) - record.first_symbol;
+      file_records.push_back(record);
+    }
+  }
+
+  for (auto &record : file_records) {
+    record.path_offset += kinds.size();
+  }
+  for (auto &symbol : symbol_records) {
+    symbol.name_offset += kinds.size() + path_text.size();
+  }
+
+  IndexHeader header{};
+  std::memcpy(header.magic, kIndexMagic, sizeof(kIndexMagic));
+  header.version = kIndexVersion;
+  header.file_count = static_cast<uint32_t>(file_records.size());
+  header.symbol_count = static_cast<uint32_t>(symbol_records.size());
+  header.strings_size = kinds.size() + path_text.size() + name_text.size();
+
+  std::error_code error;
+  std::filesystem::create_directories(std::filesystem::path(index_path).parent_path(), error);
+  std::string temp_path = index_path + ".tmp";
+  {
+    std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+    if (!out.is_open()) {
+      std::cerr << "[SymbolIndex] ERROR: Cannot write " << temp_path << std::endl;
+      return false;
+    }
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char *>(file_records.data()),
+              static_cast<std::streamsize>(file_records.size() * sizeof(FileRecord)));
+    out.write(reinterpret_cast<const char *>(symbol_records.data()),
+              static_cast<std::streamsize>(symbol_records.size() * sizeof(SymbolRecord)));
+    out.write(kinds.data(), static_cast<std::streamsize>(kinds.size()));
+    out.write(path_text.data(), static_cast<std::streamsize>(path_text.size()));
+    out.write(name_text.data(), static_cast<std::streamsize>(name_text.size()));
+    if (!out) {
+      std::cerr << "[SymbolIndex] ERROR: Failed writing " << temp_path << std::endl;
+      return false;
+    }
+  }
+  std::filesystem::rename(temp_path, index_path, error);
+  if (error) {
+    std::cerr << "[SymbolIndex] ERROR: Cannot replace " << index_path << ": " << error.message() << std::endl;
+    return false;
+  }
+
+  // Swap the overlay for the freshly written file. Files that changed while
+  // it was written keep their overlay and stay dirty; a file still in the old
+  // snapshot has the symbols that were written.
+  auto mapped = Snapshot::map(index_path);
+  if (!mapped) {
+    return false;
+  }
+  std::unique_lock lock(m_mutex);
+  for (uint32_t i = 0; i < paths.size(); ++i) {
+    auto it = m_state->files.find(paths[i]);
+    if (it == m_state->files.end()) {
+      mapped->live[i] = 0;
+      continue;
+    }
+    FileState &file = it->second;
+    if (file.snapshot_file < 0 && file.changed_at > generation) {
+      mapped->live[i] = 0;
+      continue;
+    }
+    file.snapshot_file = i;
+    file.symbols.clear();
+    file.symbols.shrink_to_fit();
+  }
+  m_state->snapshot = std::move(mapped);
+  m_state->dirty = m_state->generation != generation;
+  return true;
+}
+
+std::vector<WorkspaceSymbol> SymbolIndex::query(std::string_view pattern, size_t limit) const {
+  std::string compact;
+  for (unsigned char c : pattern) {
+    if (!std::isspace(c)) {
+      compact.push_back(static_cast<char>(c));
+    }
+  }
+  FuzzyPattern fuzzy(compact);
+  uint64_t pattern_mask = fuzzy.mask;
+
+  struct Candidate {
+    int score;
+    std::string_view name;
+    std::string_view kind;
+    std::string_view path;
+    uint32_t line;
+    uint32_t column;
+  };
+  // Better candidates sort first; the heap keeps the worst of the best on top.
+  auto better = [](const Candidate &a, const Candidate &b) {
+    if (a.score != b.score) {
+      return a.score > b.score;
+    }
+    if (a.name.size() != b.name.size()) {
+      return a.name.size() < b.name.size();
+    }
+    return a.name < b.name;
+  };
+  std::vector<Candidate> best;
+  if (limit == 0) {
+    return {};
+  }
+  best.reserve(limit + 1);
+  auto consider = [&](std::string_view name, uint64_t mask, std::string_view kind, std::string_view path,
+                      uint32_t line, uint32_t column) {
+    int score = fuzzy_score(name, mask, fuzzy);
+    if (score < 0) {
+      return;
+    }
+    Candidate candidate{score, name, kind, path, line, column};
+    if (best.size() == limit && !better(candidate, best.front())) {
+      return;
+    }
+    best.push_back(candidate);
+    std::push_heap(best.begin(), best.end(), better);
+    if (best.size() > limit) {
+      std::pop_heap(best.begin(), best.end(), better);
+      best.pop_back();
+    }
+  };
+
+  std::shared_lock lock(m_mutex);
+  if (const Snapshot *snapshot = m_state->snapshot.get()) {
+    for (uint32_t f = 0; f < snapshot->header->file_count; ++f) {
+      if (!snapshot->live[f]) {
+        continue;
+      }
+      const FileRecord &file = snapshot->files[f];
+      std::string_view path = snapshot->string(file.path_offset, file.path_length);
+      for (uint32_t i = file.first_symbol; i < file.first_symbol + file.symbol_count; ++i) {
+        const SymbolRecord &symbol = snapshot->symbols[i];
+        if ((symbol.mask & pattern_mask) != pattern_mask) {
+          continue;
+        }
+        consider(snapshot->string(symbol.name_offset, symbol.name_length), symbol.mask,
+                 snapshot->string(symbol.kind_offset, symbol.kind_length), path, symbol.line, symbol.column);
+      }
+    }
+  }
+  for (const auto &[path, file] : m_state->files) {
+    if (file.snapshot_file >= 0) {
+      continue;
+    }
+    for (const auto &symbol : file.symbols) {
+      consider(symbol.name, symbol.mask, symbol.kind, path, symbol.line, symbol.column);
+    }
+  }
+
+  std::sort(best.begin(), best.end(), better);
+  std::vector<WorkspaceSymbol> results;
+  results.reserve(best.size());
+  for (const auto &candidate : best) {
+    WorkspaceSymbol symbol;
+    symbol.name = std::string(candidate.name);
+    symbol.kind = std::string(candidate.kind);
+    symbol.path = m_root + "/" + std::string(candidate.path);
+    symbol.line = candidate.line;
+    symbol.column = candidate.column;
+    symbol.score = candidate.score;
+    results.push_back(std::move(symbol));
+  }
+  return results;
+}
+
+size_t SymbolIndex::file_count() const {
+  std::shared_lock lock(m_mutex);
+  return m_state->files.size();
+}
+
+size_t SymbolIndex::symbol_count() const {
+  std::shared_lock lock(m_mutex);
+  size_t count = 0;
+  for (const auto &[path, file] : m_state->files) {
+    if (file.snapshot_file >= 0 && m_state->snapshot) {
+      count += m_state->snapshot->files[file.snapshot_file].symbol_count;
+    } else {
+      count += file.symbols.size();
+    }
+  }
+  return count;
+}
+
+std::string SymbolIndex::relative_path(const std::string &path) const {
+  if (path.size() > m_root.size() + 1 && path.compare(0, m_root.size(), m_root) == 0 && path[m_root.size()] == '/') {
+    return path.substr(m_root.size() + 1);
+  }
+  return path;
+}
+
+} // namespace prodigeetor
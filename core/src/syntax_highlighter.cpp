@@ -1,171 +1,765 @@
 #include "syntax_highlighter.h"
+#include "language_registry.h"
 
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
 #include <cstring>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <mutex>
+#include <optional>
+#include <regex>
 #include <sstream>
 #include <string>
+#include <string_view>
+#include <unordered_map>
 
 #ifdef PRODIGEETOR_USE_TREE_SITTER
 #include <tree_sitter/api.h>
-
-extern "C" const TSLanguage *tree_sitter_javascript();
-extern "C" const TSLanguage *tree_sitter_typescript();
-extern "C" const TSLanguage *tree_sitter_tsx();
-extern "C" const TSLanguage *tree_sitter_swift();
-extern "C" const TSLanguage *tree_sitter_c_sharp();
-extern "C" const TSLanguage *tree_sitter_html();
-extern "C" const TSLanguage *tree_sitter_css();
-extern "C" const TSLanguage *tree_sitter_sql();
 #endif
 
 namespace prodigeetor {
 
-static std::string g_resource_base_path;
+#ifdef PRODIGEETOR_USE_TREE_SITTER
+// Grammars are loaded by the registry the first time a language is used.
+static const TSLanguage *grammar_for(const LanguageInfo &language) {
+  return static_cast<const TSLanguage *>(LanguageRegistry::instance().grammar(language));
+}
 
-static std::string read_file(const std::string &path) {
-  std::ifstream file(path);
-  if (!file.is_open()) {
-    return std::string();
+static TSQuery *compile_query(const LanguageInfo &language, const std::string &query_str) {
+  const TSLanguage *grammar = grammar_for(language);
+  if (!grammar || query_str.empty()) {
+    return nullptr;
   }
-  std::stringstream buffer;
-  buffer << file.rdbuf();
-  return buffer.str();
+  uint32_t error_offset = 0;
+  TSQueryError error_type = TSQueryErrorNone;
+  TSQuery *query = ts_query_new(grammar, query_str.c_str(),
+                                static_cast<uint32_t>(query_str.size()),
+                                &error_offset, &error_type);
+  if (error_type != TSQueryErrorNone) {
+    std::cerr << "[Highlighter] ERROR: Query parse failed at offset " << error_offset << ", error type: " << error_type << std::endl;
+    // Show some context around the error
+    if (error_offset < query_str.size()) {
+      size_t context_start = (error_offset > 50) ? error_offset - 50 : 0;
+      size_t context_end = std::min(static_cast<size_t>(error_offset) + 50, query_str.size());
+      std::cerr << "[Highlighter] Context: " << query_str.substr(context_start, context_end - context_start) << std::endl;
+    }
+    ts_query_delete(query);
+    return nullptr;
+  }
+  return query;
 }
 
-static std::string resolve_query_path(const std::string &relative_path) {
-  // Try multiple locations in order of preference
-  std::vector<std::string> search_paths;
+// Text predicates and directives attached to a single query pattern. Tree-sitter
+// only reports predicates; evaluating them is the client's job.
+struct QueryPattern {
+  struct TextPredicate {
+    uint32_t capture = 0;
+    bool negate = false;
+    bool is_regex = false;
+    std::string literal;
+    std::regex regex;
+  };
+
+  std::vector<TextPredicate> predicates;
+  std::unordered_map<std::string, std::string> properties; // #set! key value
+  // #offset! @capture start_row start_col end_row end_col; only column deltas
+  // on the same row are honoured, which covers trimming string delimiters.
+  uint32_t offset_capture = UINT32_MAX;
+  int32_t offset_start = 0;
+  int32_t offset_end = 0;
+};
+
+static std::vector<QueryPattern> parse_query_patterns(const TSQuery *query) {
+  std::vector<QueryPattern> patterns(ts_query_pattern_count(query));
+  for (uint32_t i = 0; i < patterns.size(); ++i) {
+    uint32_t step_count = 0;
+    const TSQueryPredicateStep *steps = ts_query_predicates_for_pattern(query, i, &step_count);
+    uint32_t begin = 0;
+    while (begin < step_count) {
+      uint32_t end = begin;
+      while (end < step_count && steps[end].type != TSQueryPredicateStepTypeDone) {
+        ++end;
+      }
+      uint32_t argc = end - begin;
+      if (argc > 0 && steps[begin].type == TSQueryPredicateStepTypeString) {
+        uint32_t length = 0;
+        std::string name(ts_query_string_value_for_id(query, steps[begin].value_id, &length));
+        auto string_arg = [&](uint32_t index) {
+          return std::string(ts_query_string_value_for_id(query, steps[begin + index].value_id, &length));
+        };
+        bool capture_then_string = argc == 3 && steps[begin + 1].type == TSQueryPredicateStepTypeCapture &&
+                                   steps[begin + 2].type == TSQueryPredicateStepTypeString;
 
-  // 1. User-configured base path
-  if (!g_resource_base_path.empty()) {
-    search_paths.push_back(g_resource_base_path + "/" + relative_path);
+        if ((name == "eq?" || name == "not-eq?" || name == "match?" || name == "not-match?") && capture_then_string) {
+          QueryPattern::TextPredicate predicate;
+          predicate.capture = steps[begin + 1].value_id;
+          predicate.negate = name.starts_with("not-");
+          predicate.is_regex = name.ends_with("match?");
+          predicate.literal = string_arg(2);
+          bool valid = true;
+          if (predicate.is_regex) {
+            try {
+              predicate.regex = std::regex(predicate.literal, std::regex::ECMAScript | std::regex::optimize);
+            } catch (const std::regex_error &) {
+              std::cerr << "[Highlighter] WARNING: Unsupported regex in query: " << predicate.literal << std::endl;
+              valid = false;
+            }
+          }
+          if (valid) {
+            patterns[i].predicates.push_back(std::move(predicate));
+          }
+        } else if (name == "set!" && argc >= 2 && steps[begin + 1].type == TSQueryPredicateStepTypeString) {
+          std::string value = argc >= 3 && steps[begin + 2].type == TSQueryPredicateStepTypeString ? string_arg(2) : "";
+          patterns[i].properties[string_arg(1)] = value;
+        } else if (name == "offset!" && argc == 6 && steps[begin + 1].type == TSQueryPredicateStepTypeCapture) {
+          if (string_arg(2) == "0" && string_arg(4) == "0") {
+            patterns[i].offset_capture = steps[begin + 1].value_id;
+            patterns[i].offset_start = std::atoi(string_arg(3).c_str());
+            patterns[i].offset_end = std::atoi(string_arg(5).c_str());
+          }
+        }
+      }
+      begin = end + 1;
+    }
   }
+  return patterns;
+}
 
-  // 2. Relative to current directory
-  search_paths.push_back(relative_path);
+static bool predicates_hold(const QueryPattern &pattern, const TSQueryMatch &match, std::string_view text) {
+  for (const auto &predicate : pattern.predicates) {
+    for (uint32_t i = 0; i < match.capture_count; ++i) {
+      if (match.captures[i].index != predicate.capture) {
+        continue;
+      }
+      uint32_t start = ts_node_start_byte(match.captures[i].node);
+      uint32_t end = ts_node_end_byte(match.captures[i].node);
+      std::string_view node_text = text.substr(start, end - start);
+      bool result = predicate.is_regex
+                      ? std::regex_search(node_text.begin(), node_text.end(), predicate.regex)
+                      : node_text == predicate.literal;
+      if (result == predicate.negate) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+static TSPoint point_at(const std::string &text, size_t offset) {
+  offset = std::min(offset, text.size());
+  TSPoint point{0, 0};
+  size_t line_start = 0;
+  const char *data = text.data();
+  while (const void *found = std::memchr(data + line_start, '\n', offset - line_start)) {
+    line_start = static_cast<size_t>(static_cast<const char *>(found) - data) + 1;
+    ++point.row;
+  }
+  point.column = static_cast<uint32_t>(offset - line_start);
+  return point;
+}
+
+static TSPoint advance_point(TSPoint point, std::string_view text) {
+  size_t last_newline = text.rfind('\n');
+  if (last_newline == std::string_view::npos) {
+    point.column += static_cast<uint32_t>(text.size());
+    return point;
+  }
+  point.row += static_cast<uint32_t>(std::count(text.begin(), text.end(), '\n'));
+  point.column = static_cast<uint32_t>(text.size() - last_newline - 1);
+  return point;
+}
+
+static TSInputEdit input_edit_for(const Edit &edit, const std::string &text) {
+  TSInputEdit input;
+  input.start_byte = static_cast<uint32_t>(edit.offset);
+  input.old_end_byte = static_cast<uint32_t>(edit.offset + edit.removed.size());
+  input.new_end_byte = static_cast<uint32_t>(edit.offset + edit.inserted.size());
+  input.start_point = point_at(text, edit.offset);
+  input.old_end_point = advance_point(input.start_point, edit.removed);
+  input.new_end_point = advance_point(input.start_point, edit.inserted);
+  return input;
+}
+
+// Maps a position that follows the edited region into post-edit coordinates.
+static void shift_position(uint32_t &byte, TSPoint &point, const TSInputEdit &edit) {
+  byte = byte - edit.old_end_byte + edit.new_end_byte;
+  if (point.row == edit.old_end_point.row) {
+    point.column = point.column - edit.old_end_point.column + edit.new_end_point.column;
+  }
+  point.row = point.row - edit.old_end_point.row + edit.new_end_point.row;
+}
+
+static void edit_range(TSRange &range, const TSInputEdit &edit) {
+  if (range.end_byte >= edit.old_end_byte) {
+    shift_position(range.end_byte, range.end_point, edit);
+  } else if (range.end_byte > edit.start_byte) {
+    range.end_byte = edit.new_end_byte;
+    range.end_point = edit.new_end_point;
+  }
+  if (range.start_byte >= edit.old_end_byte) {
+    shift_position(range.start_byte, range.start_point, edit);
+  } else if (range.start_byte > edit.start_byte) {
+    range.start_byte = edit.start_byte;
+    range.start_point = edit.start_point;
+  }
+}
 
-  // 3. Common development locations
-  search_paths.push_back("/Users/josephizang/Projects/vibes/codeeditor/" + relative_path);
+// Byte-only edit_range(), for span columns and byte windows.
+static void edit_byte_range(uint32_t &start, uint32_t &end, const TSInputEdit &edit) {
+  if (end >= edit.old_end_byte) {
+    end = end - edit.old_end_byte + edit.new_end_byte;
+  } else if (end > edit.start_byte) {
+    end = edit.new_end_byte;
+  }
+  if (start >= edit.old_end_byte) {
+    start = start - edit.old_end_byte + edit.new_end_byte;
+  } else if (start > edit.start_byte) {
+    start = edit.start_byte;
+  }
+}
 
-  for (const auto &path : search_paths) {
-    if (std::filesystem::exists(path)) {
-      std::cerr << "[Highlighter] Found query file: " << path << std::endl;
-      return path;
+static bool ranges_equal(const std::vector<TSRange> &a, const std::vector<TSRange> &b) {
+  if (a.size() != b.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < a.size(); ++i) {
+    if (a[i].start_byte != b[i].start_byte || a[i].end_byte != b[i].end_byte) {
+      return false;
     }
   }
+  return true;
+}
 
-  std::cerr << "[Highlighter] ERROR: Query file not found: " << relative_path << std::endl;
-  return std::string();
+static bool ranges_overlap(const std::vector<TSRange> &ranges, uint32_t start, uint32_t end) {
+  for (const auto &range : ranges) {
+    if (range.start_byte <= end && range.end_byte >= start) {
+      return true;
+    }
+  }
+  return false;
 }
 
-static std::string query_for_language(TreeSitterHighlighter::LanguageId language) {
-  std::vector<std::string> candidates;
-  std::string base_query;
+// Captures arrive ordered by position and, for the same node, by pattern
+// index. As in tree-sitter-highlight, the first pattern that captures a node
+// wins, so later captures of an identical range are skipped.
+static void collect_spans(TSQuery *query, const std::vector<QueryPattern> &patterns, TSNode root,
+                          uint32_t start_byte, uint32_t end_byte, std::string_view text,
+                          const SyntaxTheme &theme, std::vector<RenderSpan> &spans) {
+  size_t first = spans.size();
+  TSQueryCursor *cursor = ts_query_cursor_new();
+  ts_query_cursor_set_byte_range(cursor, start_byte, end_byte);
+  ts_query_cursor_exec(cursor, query, root);
 
-  switch (language) {
-    case TreeSitterHighlighter::LanguageId::JavaScript:
-      candidates = {
-        "third_party/tree-sitter-javascript/queries/highlights.scm"
-      };
-      break;
-    case TreeSitterHighlighter::LanguageId::TypeScript:
-    case TreeSitterHighlighter::LanguageId::TSX:
-      // TypeScript queries extend JavaScript, so we need to load both
-      {
-        std::string js_path = resolve_query_path("third_party/tree-sitter-javascript/queries/highlights.scm");
-        if (!js_path.empty()) {
-          base_query = read_file(js_path);
+  TSQueryMatch match;
+  uint32_t capture_index = 0;
+  while (ts_query_cursor_next_capture(cursor, &match, &capture_index)) {
+    if (!predicates_hold(patterns[match.pattern_index], match, text)) {
+      ts_query_cursor_remove_match(cursor, match.id);
+      continue;
+    }
+    TSQueryCapture capture = match.captures[capture_index];
+    uint32_t length = 0;
+    const char *name = ts_query_capture_name_for_id(query, capture.index, &length);
+    if (!name || length == 0 || name[0] == '_') {
+      continue;
+    }
+    uint32_t start = ts_node_start_byte(capture.node);
+    uint32_t end = ts_node_end_byte(capture.node);
+    if (spans.size() > first && spans.back().range.start.column == start && spans.back().range.end.column == end) {
+      continue;
+    }
+    RenderSpan span;
+    span.range.start = Position{0, start};
+    span.range.end = Position{0, end};
+    span.style = theme.style_for_capture(std::string(name, length));
+    spans.push_back(span);
+  }
+
+  ts_query_cursor_delete(cursor);
+}
+
+using ByteRanges = std::vector<std::pair<uint32_t, uint32_t>>;
+
+// Calls `visit(start, end)` for the parts of [from, end) outside the sorted
+// `clipped` ranges, so queries never touch the tails of very long lines.
+template <typename Visit>
+static void for_each_unclipped(const ByteRanges &clipped, uint32_t from, uint32_t end, Visit &&visit) {
+  auto it = std::upper_bound(clipped.begin(), clipped.end(), from, [](uint32_t offset, const auto &range) {
+    return offset < range.second;
+  });
+  for (; it != clipped.end() && from < end; ++it) {
+    if (it->first > from) {
+      visit(from, std::min(it->first, end));
+    }
+    from = std::max(from, it->second);
+  }
+  if (from < end) {
+    visit(from, end);
+  }
+}
+
+static void collect_unclipped_spans(TSQuery *query, const std::vector<QueryPattern> &patterns, TSNode root,
+                                    const ByteRanges &clipped, std::string_view text,
+                                    const SyntaxTheme &theme, std::vector<RenderSpan> &spans) {
+  for_each_unclipped(clipped, ts_node_start_byte(root), ts_node_end_byte(root), [&](uint32_t start, uint32_t end) {
+    collect_spans(query, patterns, root, start, end, text, theme, spans);
+  });
+}
+
+// Each unclipped part is queried on its own and reports again the nodes that
+// span several, so the spans are put back in order of their start.
+static void sort_by_start(std::vector<RenderSpan> &spans) {
+  auto starts_before = [](const RenderSpan &a, const RenderSpan &b) {
+    return a.range.start.column < b.range.start.column;
+  };
+  if (!std::is_sorted(spans.begin(), spans.end(), starts_before)) {
+    std::stable_sort(spans.begin(), spans.end(), starts_before);
+  }
+}
+
+// Sorts `ranges` and merges those that overlap or touch.
+static void coalesce(ByteRanges &ranges) {
+  std::sort(ranges.begin(), ranges.end());
+  size_t kept = 0;
+  for (const auto &range : ranges) {
+    if (kept > 0 && range.first <= ranges[kept - 1].second) {
+      ranges[kept - 1].second = std::max(ranges[kept - 1].second, range.second);
+    } else {
+      ranges[kept++] = range;
+    }
+  }
+  ranges.resize(kept);
+}
+
+// Captures that reach into the tail of a long line are cut at the limit.
+static void clip_spans(std::vector<RenderSpan> &spans, const ByteRanges &clipped) {
+  if (clipped.empty()) {
+    return;
+  }
+  auto last = std::remove_if(spans.begin(), spans.end(), [&](RenderSpan &span) {
+    uint32_t &start = span.range.start.column;
+    uint32_t &end = span.range.end.column;
+    auto it = std::upper_bound(clipped.begin(), clipped.end(), start, [](uint32_t offset, const auto &range) {
+      return offset < range.second;
+    });
+    if (it != clipped.end() && it->first < end) {
+      if (it->first <= start) {
+        start = it->second;
+      } else {
+        end = it->first;
+      }
+    }
+    return start >= end;
+  });
+  spans.erase(last, spans.end());
+}
+
+static bool is_bracket_pair(std::string_view open, std::string_view close) {
+  return (open == "{" && close == "}") || (open == "[" && close == "]") || (open == "(" && close == ")");
+}
+
+// Returns true and fills `fold` if the node is a foldable region. Delimited
+// regions keep their closing line visible.
+static bool fold_for_node(TSNode node, bool captured, FoldRange &fold) {
+  TSPoint start = ts_node_start_point(node);
+  TSPoint end = ts_node_end_point(node);
+  if (end.row <= start.row) {
+    return false;
+  }
+  std::string_view type = ts_node_type(node);
+  uint32_t child_count = ts_node_child_count(node);
+  bool delimited = false;
+  if (child_count >= 2) {
+    std::string_view first = ts_node_type(ts_node_child(node, 0));
+    std::string_view last = ts_node_type(ts_node_child(node, child_count - 1));
+    delimited = is_bracket_pair(first, last) || (first == "start_tag" && last == "end_tag") || last == "}";
+  }
+  bool comment = type.ends_with("comment");
+  if (!captured && !delimited && !comment) {
+    return false;
+  }
+  uint32_t end_line = (delimited || end.column == 0) ? end.row - 1 : end.row;
+  if (end_line <= start.row) {
+    return false;
+  }
+  fold.start_line = start.row;
+  fold.end_line = end_line;
+  fold.start_byte = ts_node_start_byte(node);
+  fold.end_byte = ts_node_end_byte(node);
+  return true;
+}
+
+static void collect_folds(TSNode root, uint32_t window_start, uint32_t window_end, std::vector<FoldRange> &folds) {
+  TSTreeCursor cursor = ts_tree_cursor_new(root);
+  bool descend = true;
+  while (true) {
+    if (descend) {
+      TSNode node = ts_tree_cursor_current_node(&cursor);
+      bool intersects = ts_node_start_byte(node) <= window_end && ts_node_end_byte(node) >= window_start;
+      // Single-line nodes cannot contain multi-line descendants.
+      if (intersects && ts_node_end_point(node).row > ts_node_start_point(node).row) {
+        FoldRange fold;
+        if (fold_for_node(node, false, fold)) {
+          folds.push_back(fold);
+        }
+        if (ts_tree_cursor_goto_first_child(&cursor)) {
+          continue;
         }
-        candidates = {
-          "third_party/tree-sitter-typescript/queries/highlights.scm"
-        };
       }
+    }
+    if (ts_tree_cursor_goto_next_sibling(&cursor)) {
+      descend = true;
+      continue;
+    }
+    if (!ts_tree_cursor_goto_parent(&cursor)) {
       break;
-    case TreeSitterHighlighter::LanguageId::Swift:
-      candidates = {
-        "third_party/tree-sitter-swift/queries/highlights.scm"
-      };
-      break;
-    case TreeSitterHighlighter::LanguageId::CSharp:
-      candidates = {
-        "third_party/tree-sitter-c-sharp/queries/highlights.scm"
-      };
-      break;
-    case TreeSitterHighlighter::LanguageId::HTML:
-      candidates = {
-        "third_party/tree-sitter-html/queries/highlights.scm"
-      };
-      break;
-    case TreeSitterHighlighter::LanguageId::CSS:
-      candidates = {
-        "third_party/tree-sitter-css/queries/highlights.scm"
-      };
-      break;
-    case TreeSitterHighlighter::LanguageId::SQL:
-      candidates = {
-        "third_party/tree-sitter-sql/queries/highlights.scm"
-      };
-      break;
+    }
+    descend = false;
   }
+  ts_tree_cursor_delete(&cursor);
+}
+
+static bool node_contains(TSNode node, uint32_t start, uint32_t end) {
+  return ts_node_start_byte(node) <= start && ts_node_end_byte(node) >= end;
+}
 
-  std::string extension_query;
-  for (const auto &relative_path : candidates) {
-    std::string resolved = resolve_query_path(relative_path);
-    if (!resolved.empty()) {
-      extension_query = read_file(resolved);
+// Moves a cursor positioned at the root down to the deepest node containing
+// [start, end]. Each level is a single child lookup, so this is O(depth).
+static bool descend_to_range(TSTreeCursor &cursor, uint32_t start, uint32_t end) {
+  if (!node_contains(ts_tree_cursor_current_node(&cursor), start, end)) {
+    return false;
+  }
+  while (ts_tree_cursor_goto_first_child_for_byte(&cursor, start) >= 0) {
+    // The first candidate may end exactly at `start`. A caret there prefers
+    // the token to its right, and a non-empty range can only be in a later
+    // sibling.
+    TSNode node = ts_tree_cursor_current_node(&cursor);
+    if (ts_node_end_byte(node) == start && ts_tree_cursor_goto_next_sibling(&cursor)) {
+      if (ts_node_start_byte(ts_tree_cursor_current_node(&cursor)) > start) {
+        ts_tree_cursor_goto_previous_sibling(&cursor);
+      }
+    }
+    if (!node_contains(ts_tree_cursor_current_node(&cursor), start, end)) {
+      ts_tree_cursor_goto_parent(&cursor);
       break;
     }
   }
+  return true;
+}
+
+static std::string_view closing_bracket_for(std::string_view open) {
+  if (open == "(") return ")";
+  if (open == "[") return "]";
+  if (open == "{") return "}";
+  return {};
+}
 
-  // Merge base and extension queries
-  if (!base_query.empty() && !extension_query.empty()) {
-    return base_query + "\n\n" + extension_query;
-  } else if (!extension_query.empty()) {
-    return extension_query;
-  } else if (!base_query.empty()) {
-    return base_query;
+static std::string_view opening_bracket_for(std::string_view close) {
+  if (close == ")") return "(";
+  if (close == "]") return "[";
+  if (close == "}") return "{";
+  return {};
+}
+
+// Positions the cursor on a bracket token starting at `offset`. The cursor is
+// left wherever the descent stopped when there is none.
+static bool descend_to_bracket(TSTreeCursor &cursor, uint32_t offset) {
+  if (!descend_to_range(cursor, offset, offset + 1)) {
+    return false;
   }
+  TSNode node = ts_tree_cursor_current_node(&cursor);
+  std::string_view type = ts_node_type(node);
+  return ts_node_start_byte(node) == offset && ts_node_end_byte(node) == offset + 1 &&
+         (!closing_bracket_for(type).empty() || !opening_bracket_for(type).empty());
+}
 
-  return std::string();
+// Walks the siblings after (forward) or before the bracket under the cursor,
+// counting nesting, until its partner is found.
+static bool scan_for_partner(TSTreeCursor &cursor, std::string_view own, std::string_view partner, bool forward,
+                             uint32_t &match) {
+  size_t depth = 0;
+  while (forward ? ts_tree_cursor_goto_next_sibling(&cursor) : ts_tree_cursor_goto_previous_sibling(&cursor)) {
+    TSNode node = ts_tree_cursor_current_node(&cursor);
+    std::string_view type = ts_node_type(node);
+    if (type == own) {
+      ++depth;
+    } else if (type == partner) {
+      if (depth == 0) {
+        match = ts_node_start_byte(node);
+        return true;
+      }
+      --depth;
+    }
+  }
+  return false;
 }
+#endif
 
+struct TreeSitterHighlighter::ParseState {
 #ifdef PRODIGEETOR_USE_TREE_SITTER
-static const TSLanguage *language_for_id(TreeSitterHighlighter::LanguageId language) {
-  switch (language) {
-    case TreeSitterHighlighter::LanguageId::JavaScript:
-      return tree_sitter_javascript();
-    case TreeSitterHighlighter::LanguageId::TypeScript:
-      return tree_sitter_typescript();
-    case TreeSitterHighlighter::LanguageId::TSX:
-      return tree_sitter_tsx();
-    case TreeSitterHighlighter::LanguageId::Swift:
-      return tree_sitter_swift();
-    case TreeSitterHighlighter::LanguageId::CSharp:
-      return tree_sitter_c_sharp();
-    case TreeSitterHighlighter::LanguageId::HTML:
-      return tree_sitter_html();
-    case TreeSitterHighlighter::LanguageId::CSS:
-      return tree_sitter_css();
-    case TreeSitterHighlighter::LanguageId::SQL:
-      return tree_sitter_sql();
+  struct Layer {
+    const LanguageInfo *language = nullptr;
+    std::vector<TSRange> ranges;
+    TSTree *tree = nullptr;
+    bool dirty = false;   // waiting to be reparsed
+    bool parsing = false; // its parse ran out of budget part-way
+    std::vector<TSInputEdit> replay; // edits made meanwhile, for its new tree
+    std::vector<RenderSpan> spans;
+  };
+
+  TSParser *parser = nullptr;
+  TSQuery *query = nullptr;
+  TSQuery *folds_query = nullptr;
+  std::vector<QueryPattern> patterns;
+  uint32_t content_capture = UINT32_MAX;
+  uint32_t language_capture = UINT32_MAX;
+  struct HighlightQuery {
+    TSQuery *query = nullptr;
+    std::vector<QueryPattern> patterns;
+  };
+
+  std::vector<QueryPattern> root_patterns; // predicates of the root highlights query
+  std::unordered_map<const LanguageInfo *, HighlightQuery> highlight_queries;
+  std::vector<Layer> layers; // ordered by first range
+  ByteRanges clipped;        // unhighlighted tails of lines over max_line_length
+  uint64_t budget_micros = 0;
+  // A root parse ran out of budget part-way. The text it reads, once the
+  // document has been edited, and the edits to replay onto its tree.
+  bool root_interrupted = false;
+  std::optional<std::string> root_snapshot;
+  std::vector<TSInputEdit> root_replay;
+  // The text an interrupted layer parse reads, once the document has been
+  // edited. The layer parser holds at most one such parse.
+  std::optional<std::string> layer_snapshot;
+  ByteRanges edited;            // bytes edited since the last root parse
+  ByteRanges stale;             // windows whose runs are out of date
+  bool stale_all = true;        // every run is
+  uint32_t root_span_width = 0; // widest root span, bounds searches by start
+
+  ParseState() : parser(ts_parser_new()) {}
+
+  ~ParseState() {
+    clear_layers();
+    set_query(nullptr);
+    set_folds_query(nullptr);
+    for (auto &[language, highlights] : highlight_queries) {
+      if (highlights.query) {
+        ts_query_delete(highlights.query);
+      }
+    }
+    ts_parser_delete(parser);
+  }
+
+  void clear_layers() {
+    for (auto &layer : layers) {
+      if (layer.tree) {
+        ts_tree_delete(layer.tree);
+      }
+      mark_stale(layer.spans);
+    }
+    layers.clear();
+    ts_parser_reset(parser);
+    layer_snapshot.reset();
+  }
+
+  void mark_stale(const std::vector<RenderSpan> &spans) {
+    if (spans.empty()) {
+      return;
+    }
+    uint32_t start = UINT32_MAX;
+    uint32_t end = 0;
+    for (const auto &span : spans) {
+      start = std::min(start, span.range.start.column);
+      end = std::max(end, span.range.end.column);
+    }
+    stale.emplace_back(start, end);
+  }
+
+  bool layers_pending() const {
+    return std::any_of(layers.begin(), layers.end(), [](const Layer &layer) { return layer.dirty; });
+  }
+
+  bool layer_interrupted() const {
+    return std::any_of(layers.begin(), layers.end(), [](const Layer &layer) { return layer.parsing; });
+  }
+
+  // Drops the progress of an interrupted layer parse, leaving its old tree
+  // edited to the current text as the base of the next one.
+  void abandon_layer_parse(Layer &layer) {
+    ts_parser_reset(parser);
+    ts_parser_set_included_ranges(parser, nullptr, 0);
+    layer_snapshot.reset();
+    for (const auto &edit : layer.replay) {
+      if (layer.tree) {
+        ts_tree_edit(layer.tree, &edit);
+      }
+    }
+    layer.replay.clear();
+    layer.parsing = false;
+  }
+
+  void set_query(TSQuery *injections) {
+    if (query) {
+      ts_query_delete(query);
+    }
+    query = injections;
+    patterns.clear();
+    content_capture = UINT32_MAX;
+    language_capture = UINT32_MAX;
+    if (!query) {
+      return;
+    }
+    patterns = parse_query_patterns(query);
+    for (uint32_t i = 0; i < ts_query_capture_count(query); ++i) {
+      uint32_t length = 0;
+      const char *capture_name = ts_query_capture_name_for_id(query, i, &length);
+      std::string_view name(capture_name, length);
+      if (name == "injection.content") {
+        content_capture = i;
+      } else if (name == "injection.language") {
+        language_capture = i;
+      }
+    }
+  }
+
+  void set_folds_query(TSQuery *folds) {
+    if (folds_query) {
+      ts_query_delete(folds_query);
+    }
+    folds_query = folds;
+  }
+
+  const HighlightQuery &highlights_for(const LanguageInfo *language) {
+    auto it = highlight_queries.find(language);
+    if (it != highlight_queries.end()) {
+      return it->second;
+    }
+    HighlightQuery &highlights = highlight_queries[language];
+    highlights.query = compile_query(*language, LanguageRegistry::query_source(language->highlights));
+    if (highlights.query) {
+      highlights.patterns = parse_query_patterns(highlights.query);
+    }
+    return highlights;
+  }
+
+  void apply_edit(const TSInputEdit &edit) {
+    for (auto &layer : layers) {
+      if (ranges_overlap(layer.ranges, edit.start_byte, edit.old_end_byte)) {
+        layer.dirty = true;
+      }
+      for (auto &range : layer.ranges) {
+        edit_range(range, edit);
+      }
+      if (layer.parsing) {
+        // The parse reads its old tree, so the edit waits for its result.
+        layer.replay.push_back(edit);
+      } else if (layer.tree) {
+        ts_tree_edit(layer.tree, &edit);
+      }
+      // A dirty layer's spans stay visible until it is reparsed.
+      for (auto &span : layer.spans) {
+        edit_byte_range(span.range.start.column, span.range.end.column, edit);
+      }
+    }
+  }
+
+  // Reparses dirty layers until the deadline, resuming an interrupted one
+  // first since the parser holds its progress. Returns false while any are
+  // left, which includes a cancelled parse.
+  bool parse_layers(const std::string &text, const SyntaxTheme &theme,
+                    std::chrono::steady_clock::time_point deadline) {
+    auto interrupted = std::find_if(layers.begin(), layers.end(), [](const Layer &layer) { return layer.parsing; });
+    if (interrupted != layers.end() && !parse_layer(*interrupted, text, theme, deadline)) {
+      return false;
+    }
+    for (auto &layer : layers) {
+      if (layer.dirty && !parse_layer(layer, text, theme, deadline)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  bool parse_layer(Layer &layer, const std::string &text, const SyntaxTheme &theme,
+                   std::chrono::steady_clock::time_point deadline) {
+    uint64_t timeout = 0;
+    if (budget_micros != 0) {
+      auto left = std::chrono::duration_cast<std::chrono::microseconds>(deadline - std::chrono::steady_clock::now());
+      if (left.count() <= 0) {
+        return false;
+      }
+      timeout = static_cast<uint64_t>(left.count());
+    }
+    if (!layer.parsing &&
+        (!ts_parser_set_language(parser, grammar_for(*layer.language)) ||
+         !ts_parser_set_included_ranges(parser, layer.ranges.data(), static_cast<uint32_t>(layer.ranges.size())))) {
+      // Unparseable ranges leave the region to the host language.
+      if (layer.tree) {
+        ts_tree_delete(layer.tree);
+        layer.tree = nullptr;
+      }
+      mark_stale(layer.spans);
+      layer.spans.clear();
+      layer.dirty = false;
+      return true;
+    }
+    const std::string &input = layer.parsing && layer_snapshot ? *layer_snapshot : text;
+    ts_parser_set_timeout_micros(parser, timeout);
+    TSTree *tree = ts_parser_parse_string(parser, layer.tree, input.c_str(), static_cast<uint32_t>(input.size()));
+    if (!tree) {
+      // Over budget: resumed on the next slice, meanwhile the old spans stay.
+      layer.parsing = true;
+      return false;
+    }
+    ts_parser_set_included_ranges(parser, nullptr, 0);
+    layer_snapshot.reset();
+    if (layer.tree) {
+      ts_tree_delete(layer.tree);
+    }
+    layer.tree = tree;
+    layer.parsing = false;
+    // Edits made during the parse leave the layer dirty for an incremental
+    // reparse covering just them.
+    for (const auto &edit : layer.replay) {
+      ts_tree_edit(tree, &edit);
+    }
+    layer.dirty = !layer.replay.empty();
+    layer.replay.clear();
+    highlight_layer(layer, text, theme);
+    return true;
+  }
+
+  void highlight_layer(Layer &layer, std::string_view text, const SyntaxTheme &theme) {
+    mark_stale(layer.spans);
+    layer.spans.clear();
+    const HighlightQuery &highlights = highlights_for(layer.language);
+    if (!layer.tree || !highlights.query) {
+      return;
+    }
+    collect_unclipped_spans(highlights.query, highlights.patterns, ts_tree_root_node(layer.tree), clipped, text,
+                            theme, layer.spans);
+    mark_stale(layer.spans);
   }
-  return tree_sitter_javascript();
-}
 #endif
+};
 
-TreeSitterHighlighter::TreeSitterHighlighter() {
+TreeSitterHighlighter::TreeSitterHighlighter() : m_state(std::make_unique<ParseState>()) {
 #ifdef PRODIGEETOR_USE_TREE_SITTER
+  // No grammar is loaded until set_language().
   TSParser *parser = ts_parser_new();
-  ts_parser_set_language(parser, tree_sitter_javascript());
+  ts_parser_set_cancellation_flag(parser, &m_cancel);
+  ts_parser_set_cancellation_flag(m_state->parser, &m_cancel);
   m_parser = parser;
-  set_language(LanguageId::JavaScript);
+  set_limits(m_limits);
 #endif
 }
 
 TreeSitterHighlighter::~TreeSitterHighlighter() {
 #ifdef PRODIGEETOR_USE_TREE_SITTER
+  clear_tree();
   if (m_query) {
     ts_query_delete(static_cast<TSQuery *>(m_query));
     m_query = nullptr;
@@ -177,116 +771,1016 @@ TreeSitterHighlighter::~TreeSitterHighlighter() {
 #endif
 }
 
-void TreeSitterHighlighter::set_language(LanguageId language) {
+bool TreeSitterHighlighter::set_language(std::string_view name) {
+  const LanguageInfo *language = LanguageRegistry::instance().find(name);
+  if (language == m_language) {
+    return language != nullptr;
+  }
   m_language = language;
 #ifdef PRODIGEETOR_USE_TREE_SITTER
   TSParser *parser = static_cast<TSParser *>(m_parser);
-  if (!parser) {
-    return;
+  clear_tree();
+  m_parse_pending = false;
+  if (parser) {
+    ts_parser_reset(parser);
   }
-  ts_parser_set_language(parser, language_for_id(language));
-
   if (m_query) {
     ts_query_delete(static_cast<TSQuery *>(m_query));
     m_query = nullptr;
   }
+  m_state->set_query(nullptr);
+  m_state->set_folds_query(nullptr);
+  m_state->root_patterns.clear();
 
-  std::string query_str = query_for_language(language);
-  if (query_str.empty()) {
-    std::cerr << "[Highlighter] ERROR: Empty query string for language" << std::endl;
-    return;
+  // Unknown languages and languages without a grammar are plain text.
+  const TSLanguage *grammar = language ? grammar_for(*language) : nullptr;
+  if (!parser || !grammar || !ts_parser_set_language(parser, grammar)) {
+    m_language = nullptr;
+    return false;
   }
 
-  std::cerr << "[Highlighter] Loading query (" << query_str.size() << " bytes)" << std::endl;
+  m_state->set_query(compile_query(*language, LanguageRegistry::query_source(language->injections)));
+  m_state->set_folds_query(compile_query(*language, LanguageRegistry::query_source(language->folds)));
 
-  uint32_t error_offset = 0;
-  TSQueryError error_type = TSQueryErrorNone;
-  TSQuery *query = ts_query_new(language_for_id(language), query_str.c_str(),
-                                static_cast<uint32_t>(query_str.size()),
-                                &error_offset, &error_type);
-  if (error_type != TSQueryErrorNone) {
-    std::cerr << "[Highlighter] ERROR: Query parse failed at offset " << error_offset << ", error type: " << error_type << std::endl;
-    // Show some context around the error
-    if (error_offset < query_str.size()) {
-      size_t context_start = (error_offset > 50) ? error_offset - 50 : 0;
-      size_t context_end = std::min(static_cast<size_t>(error_offset) + 50, query_str.size());
-      std::cerr << "[Highlighter] Context: " << query_str.substr(context_start, context_end - context_start) << std::endl;
-    }
-    ts_query_delete(query);
-    query = nullptr;
-  } else {
+  std::string query_str = LanguageRegistry::query_source(language->highlights);
+  std::cerr << "[Highlighter] Loading " << language->name << " query (" << query_str.size() << " bytes)" << std::endl;
+  TSQuery *query = compile_query(*language, query_str);
+  if (query) {
+    m_state->root_patterns = parse_query_patterns(query);
     std::cerr << "[Highlighter] Query loaded successfully, " << ts_query_capture_count(query) << " captures" << std::endl;
   }
   m_query = query;
+
+  if (!m_text.empty()) {
+    std::string text = std::move(m_text);
+    set_text(std::move(text));
+  }
+  return true;
 #else
-  (void)language;
+  return false;
 #endif
 }
 
+const LanguageInfo *TreeSitterHighlighter::language() const {
+  return m_language;
+}
+
+const SyntaxTheme &TreeSitterHighlighter::theme() const {
+  return m_theme;
+}
+
 void TreeSitterHighlighter::set_theme(SyntaxTheme theme) {
   m_theme = std::move(theme);
+#ifdef PRODIGEETOR_USE_TREE_SITTER
+  if (!m_tree) {
+    return;
+  }
+  collect_root_spans();
+  for (auto &layer : m_state->layers) {
+    m_state->highlight_layer(layer, m_text, m_theme);
+  }
+  m_state->stale_all = true;
+  merge_spans();
+#endif
 }
 
 std::vector<RenderSpan> TreeSitterHighlighter::highlight(const std::string &text) {
-  std::vector<RenderSpan> spans;
+  set_text(text);
+  return spans();
+}
 
+void TreeSitterHighlighter::set_limits(const HighlightLimits &limits) {
+  m_limits = limits;
 #ifdef PRODIGEETOR_USE_TREE_SITTER
+  m_state->budget_micros = limits.parse_budget_micros;
+#endif
+  if (!m_text.empty()) {
+    std::string text = std::move(m_text);
+    set_text(std::move(text));
+  }
+}
+
+const HighlightLimits &TreeSitterHighlighter::limits() const {
+  return m_limits;
+}
+
+void TreeSitterHighlighter::set_text(std::string text) {
+  m_text = std::move(text);
+  m_parse_pending = false;
+  m_degradation = HighlightDegradation::None;
+#ifdef PRODIGEETOR_USE_TREE_SITTER
+  clear_tree();
+  m_state->clipped.clear();
   TSParser *parser = static_cast<TSParser *>(m_parser);
-  TSQuery *query = static_cast<TSQuery *>(m_query);
   if (!parser) {
     std::cerr << "[Highlighter] ERROR: Parser is null, cannot highlight" << std::endl;
-    return spans;
+    return;
+  }
+  ts_parser_reset(parser);
+  std::atomic_ref<size_t>(m_cancel).store(0);
+  if (!m_language) {
+    return; // plain text
+  }
+  if (m_limits.max_file_size != 0 && m_text.size() > m_limits.max_file_size) {
+    std::cerr << "[Highlighter] " << m_text.size() << " bytes is over the size limit, highlighting disabled" << std::endl;
+    m_degradation = HighlightDegradation::PlainText;
+    return;
+  }
+
+  update_clipped();
+  m_pending_start = 0;
+  m_pending_end = UINT32_MAX;
+  m_parse_pending = true;
+  run_parse();
+#endif
+}
+
+void TreeSitterHighlighter::edit(const Edit &edit) {
+#ifdef PRODIGEETOR_USE_TREE_SITTER
+  ParseState &state = *m_state;
+  TSInputEdit input = input_edit_for(edit, m_text);
+  if (state.root_interrupted && !state.root_snapshot) {
+    // Restarting a pending parse on every keystroke could keep it from ever
+    // finishing, so it goes on over the text it started with.
+    state.root_snapshot = m_text;
+  }
+  if (state.layer_interrupted() && !state.layer_snapshot) {
+    state.layer_snapshot = m_text;
+  }
+#endif
+  m_text.replace(edit.offset, edit.removed.size(), edit.inserted);
+#ifdef PRODIGEETOR_USE_TREE_SITTER
+  TSParser *parser = static_cast<TSParser *>(m_parser);
+  TSTree *old_tree = static_cast<TSTree *>(m_tree);
+  if (!parser || (!old_tree && !m_parse_pending) ||
+      (m_limits.max_file_size != 0 && m_text.size() > m_limits.max_file_size)) {
+    set_text(std::move(m_text));
+    return;
+  }
+  std::atomic_ref<size_t>(m_cancel).store(0);
+
+  if (state.root_interrupted) {
+    // The parse reads its old tree, so the edit waits for its result.
+    state.root_replay.push_back(input);
+  } else if (old_tree) {
+    ts_tree_edit(old_tree, &input);
+  }
+  state.apply_edit(input);
+  int32_t line_delta = static_cast<int32_t>(input.new_end_point.row) - static_cast<int32_t>(input.old_end_point.row);
+  for (auto &fold : m_folds) {
+    if (fold.start_byte >= input.old_end_byte) {
+      fold.start_byte = fold.start_byte - input.old_end_byte + input.new_end_byte;
+      fold.start_line += line_delta;
+    }
+    if (fold.end_byte >= input.old_end_byte) {
+      fold.end_byte = fold.end_byte - input.old_end_byte + input.new_end_byte;
+      fold.end_line += line_delta;
+    }
+  }
+  state.root_span_width = 0;
+  size_t kept = 0;
+  for (auto &span : m_root_spans) {
+    edit_byte_range(span.range.start.column, span.range.end.column, input);
+    if (span.range.start.column < span.range.end.column) {
+      state.root_span_width = std::max(state.root_span_width, span.range.end.column - span.range.start.column);
+      m_root_spans[kept++] = span;
+    }
+  }
+  m_root_spans.resize(kept);
+  // Long lines are clipped per line, so editing one can move its clipped
+  // tail; then the edited lines are requeried and rebuilt whole.
+  size_t line_start = input.start_byte == 0 ? std::string::npos : m_text.rfind('\n', input.start_byte - 1);
+  size_t line_end = m_text.find('\n', input.new_end_byte);
+  line_start = line_start == std::string::npos ? 0 : line_start + 1;
+  line_end = line_end == std::string::npos ? m_text.size() : line_end;
+  std::pair<uint32_t, uint32_t> window(input.start_byte, input.new_end_byte);
+  if (m_limits.max_line_length != 0 &&
+      line_end - line_start + (input.old_end_byte - input.start_byte) > m_limits.max_line_length) {
+    window = {static_cast<uint32_t>(line_start), static_cast<uint32_t>(line_end)};
+  }
+  for (auto &range : state.edited) {
+    edit_byte_range(range.first, range.second, input);
+  }
+  state.edited.push_back(window);
+  if (state.edited.size() > 32) {
+    coalesce(state.edited);
+  }
+  m_runs.apply_edit(input.start_byte, input.old_end_byte, input.new_end_byte);
+  state.stale.push_back(window);
+
+  if (m_parse_pending) {
+    // Widen the window the pending parse may change.
+    if (m_pending_end != UINT32_MAX && m_pending_end >= input.old_end_byte) {
+      m_pending_end = m_pending_end - input.old_end_byte + input.new_end_byte;
+    }
+    m_pending_start = std::min(m_pending_start, input.start_byte);
+    m_pending_end = std::max(m_pending_end, input.new_end_byte);
+  } else {
+    m_pending_start = input.start_byte;
+    m_pending_end = input.new_end_byte;
+  }
+  m_parse_pending = true;
+  update_clipped();
+  run_parse();
+  if (state.root_interrupted) {
+    merge_spans(); // the previous spans, shifted by the edit
+  }
+#endif
+}
+
+bool TreeSitterHighlighter::parse_pending() const {
+#ifdef PRODIGEETOR_USE_TREE_SITTER
+  return m_parse_pending || m_state->layers_pending();
+#else
+  return m_parse_pending;
+#endif
+}
+
+bool TreeSitterHighlighter::continue_parse() {
+#ifdef PRODIGEETOR_USE_TREE_SITTER
+  return parse_pending() && run_parse();
+#else
+  return false;
+#endif
+}
+
+void TreeSitterHighlighter::cancel_parse() {
+  std::atomic_ref<size_t>(m_cancel).store(1);
+}
+
+HighlightDegradation TreeSitterHighlighter::degradation() const {
+  return m_degradation;
+}
+
+bool TreeSitterHighlighter::run_parse() {
+#ifdef PRODIGEETOR_USE_TREE_SITTER
+  ParseState &state = *m_state;
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(m_limits.parse_budget_micros);
+  auto cancelled = [&] {
+    if (std::atomic_ref<size_t>(m_cancel).load() == 0) {
+      return false;
+    }
+    ts_parser_reset(static_cast<TSParser *>(m_parser));
+    clear_tree();
+    m_parse_pending = false;
+    m_degradation = HighlightDegradation::PlainText;
+    return true;
+  };
+
+  if (m_parse_pending) {
+    TSParser *parser = static_cast<TSParser *>(m_parser);
+    TSTree *old_tree = static_cast<TSTree *>(m_tree);
+    const std::string &input = state.root_snapshot ? *state.root_snapshot : m_text;
+    ts_parser_set_timeout_micros(parser, m_limits.parse_budget_micros);
+    TSTree *tree = ts_parser_parse_string(parser, old_tree, input.c_str(), static_cast<uint32_t>(input.size()));
+    if (!tree) {
+      if (!cancelled()) {
+        state.root_interrupted = true;
+      }
+      return false;
+    }
+    state.root_interrupted = false;
+
+    // Spans and injection regions can only change where the text was edited
+    // or the root tree changed.
+    uint32_t window_start = m_pending_start;
+    uint32_t window_end = m_pending_end;
+    bool incremental = old_tree != nullptr;
+    ByteRanges windows = std::move(state.edited);
+    state.edited.clear();
+    if (old_tree) {
+      uint32_t changed_count = 0;
+      TSRange *changed = ts_tree_get_changed_ranges(old_tree, tree, &changed_count);
+      for (uint32_t i = 0; i < changed_count; ++i) {
+        for (const auto &input_edit : state.root_replay) {
+          edit_range(changed[i], input_edit);
+        }
+        window_start = std::min(window_start, changed[i].start_byte);
+        window_end = std::max(window_end, changed[i].end_byte);
+        windows.emplace_back(changed[i].start_byte, changed[i].end_byte);
+      }
+      free(changed);
+      ts_tree_delete(old_tree);
+    }
+    m_tree = tree;
+
+    // A tree of the text before the edits made meanwhile is highlighted with
+    // the edits applied to it, and stays the base of an incremental reparse
+    // of the current text, covering just those edits.
+    m_parse_pending = state.root_snapshot.has_value();
+    if (m_parse_pending) {
+      m_pending_start = UINT32_MAX;
+      m_pending_end = 0;
+      for (size_t i = 0; i < state.root_replay.size(); ++i) {
+        const TSInputEdit &input_edit = state.root_replay[i];
+        ts_tree_edit(tree, &input_edit);
+        TSRange edited{input_edit.start_point, input_edit.new_end_point, input_edit.start_byte, input_edit.new_end_byte};
+        for (size_t j = i + 1; j < state.root_replay.size(); ++j) {
+          edit_range(edited, state.root_replay[j]);
+        }
+        m_pending_start = std::min(m_pending_start, edited.start_byte);
+        m_pending_end = std::max(m_pending_end, edited.end_byte);
+        state.edited.emplace_back(edited.start_byte, edited.end_byte);
+      }
+      state.root_snapshot.reset();
+      state.root_replay.clear();
+    }
+
+    if (incremental) {
+      update_root_spans(std::move(windows));
+    } else {
+      collect_root_spans();
+    }
+    update_injections(window_start, window_end);
+    update_folds(window_start, window_end);
+  }
+
+  // Injection layers share what is left of the slice's budget.
+  bool layers_parsed = state.parse_layers(m_text, m_theme, deadline);
+  if (!layers_parsed && cancelled()) {
+    return false;
+  }
+  merge_spans();
+  return !m_parse_pending && layers_parsed;
+#else
+  return false;
+#endif
+}
+
+void TreeSitterHighlighter::update_clipped() {
+#ifdef PRODIGEETOR_USE_TREE_SITTER
+  ByteRanges &clipped = m_state->clipped;
+  clipped.clear();
+  size_t max_length = m_limits.max_line_length;
+  if (max_length != 0 && m_text.size() > max_length) {
+    const char *data = m_text.data();
+    size_t size = m_text.size();
+    size_t line_start = 0;
+    while (line_start < size) {
+      const void *newline = std::memchr(data + line_start, '\n', size - line_start);
+      size_t line_end = newline ? static_cast<size_t>(static_cast<const char *>(newline) - data) : size;
+      if (line_end - line_start > max_length) {
+        clipped.emplace_back(static_cast<uint32_t>(line_start + max_length), static_cast<uint32_t>(line_end));
+      }
+      line_start = line_end + 1;
+    }
+  }
+  m_degradation = clipped.empty() ? HighlightDegradation::None : HighlightDegradation::LongLines;
+#endif
+}
+
+const std::vector<RenderSpan> &TreeSitterHighlighter::spans() const {
+  if (m_spans_stale) {
+    m_spans = m_root_spans;
+#ifdef PRODIGEETOR_USE_TREE_SITTER
+    // Injected spans come last so they take precedence over the host language.
+    for (const auto &layer : m_state->layers) {
+      m_spans.insert(m_spans.end(), layer.spans.begin(), layer.spans.end());
+    }
+    clip_spans(m_spans, m_state->clipped);
+#endif
+    m_spans_stale = false;
+  }
+  return m_spans;
+}
+
+const HighlightRuns &TreeSitterHighlighter::runs() const {
+  return m_runs;
+}
+
+const std::vector<FoldRange> &TreeSitterHighlighter::fold_ranges() const {
+  return m_folds;
+}
+
+bool TreeSitterHighlighter::expand_selection(size_t &start, size_t &end) const {
+#ifdef PRODIGEETOR_USE_TREE_SITTER
+  if (!m_tree || start > end || end > m_text.size()) {
+    return false;
+  }
+  TSTreeCursor cursor = ts_tree_cursor_new(ts_tree_root_node(static_cast<TSTree *>(m_tree)));
+  bool found = false;
+  if (descend_to_range(cursor, static_cast<uint32_t>(start), static_cast<uint32_t>(end))) {
+    // Walk back up to the first named node that is larger than the selection.
+    do {
+      TSNode node = ts_tree_cursor_current_node(&cursor);
+      uint32_t node_start = ts_node_start_byte(node);
+      uint32_t node_end = ts_node_end_byte(node);
+      if (ts_node_is_named(node) && (node_start < start || node_end > end)) {
+        start = node_start;
+        end = node_end;
+        found = true;
+        break;
+      }
+    } while (ts_tree_cursor_goto_parent(&cursor));
+  }
+  ts_tree_cursor_delete(&cursor);
+  return found;
+#else
+  (void)start;
+  (void)end;
+  return false;
+#endif
+}
+
+bool TreeSitterHighlighter::shrink_selection(size_t &start, size_t &end) const {
+#ifdef PRODIGEETOR_USE_TREE_SITTER
+  if (!m_tree || start >= end || end > m_text.size()) {
+    return false;
+  }
+  TSTreeCursor cursor = ts_tree_cursor_new(ts_tree_root_node(static_cast<TSTree *>(m_tree)));
+  bool found = false;
+  if (descend_to_range(cursor, static_cast<uint32_t>(start), static_cast<uint32_t>(end))) {
+    // Take the first named child inside the selection, stepping through
+    // wrappers that span exactly the selection.
+    while (!found && ts_tree_cursor_goto_first_child_for_byte(&cursor, static_cast<uint32_t>(start)) >= 0) {
+      bool inside = false;
+      do {
+        TSNode node = ts_tree_cursor_current_node(&cursor);
+        uint32_t node_start = ts_node_start_byte(node);
+        uint32_t node_end = ts_node_end_byte(node);
+        if (node_start >= end || node_end > end) {
+          break;
+        }
+        if (node_start >= start && ts_node_is_named(node)) {
+          inside = true;
+          if (node_start > start || node_end < end) {
+            start = node_start;
+            end = node_end;
+            found = true;
+          }
+          break;
+        }
+      } while (ts_tree_cursor_goto_next_sibling(&cursor));
+      if (!inside) {
+        break;
+      }
+    }
+  }
+  ts_tree_cursor_delete(&cursor);
+  return found;
+#else
+  (void)start;
+  (void)end;
+  return false;
+#endif
+}
+
+bool TreeSitterHighlighter::matching_bracket(size_t offset, size_t &match) const {
+#ifdef PRODIGEETOR_USE_TREE_SITTER
+  if (!m_tree || offset > m_text.size()) {
+    return false;
+  }
+  TSNode root = ts_tree_root_node(static_cast<TSTree *>(m_tree));
+  TSTreeCursor cursor = ts_tree_cursor_new(root);
+  // Prefer the bracket after the caret, then the one before it.
+  bool on_bracket = offset < m_text.size() && descend_to_bracket(cursor, static_cast<uint32_t>(offset));
+  if (!on_bracket && offset > 0) {
+    ts_tree_cursor_reset(&cursor, root);
+    on_bracket = descend_to_bracket(cursor, static_cast<uint32_t>(offset - 1));
+  }
+  bool found = false;
+  if (on_bracket) {
+    std::string_view own = ts_node_type(ts_tree_cursor_current_node(&cursor));
+    std::string_view close = closing_bracket_for(own);
+    bool forward = !close.empty();
+    std::string_view partner = forward ? close : opening_bracket_for(own);
+    uint32_t partner_start = 0;
+    // The partner is almost always the last (or first) child of the same
+    // parent; only fall back to a sibling scan when it is not.
+    TSTreeCursor edge = ts_tree_cursor_copy(&cursor);
+    if (ts_tree_cursor_goto_parent(&edge) &&
+        (forward ? ts_tree_cursor_goto_last_child(&edge) : ts_tree_cursor_goto_first_child(&edge))) {
+      TSNode candidate = ts_tree_cursor_current_node(&edge);
+      if (ts_node_type(candidate) == partner && !ts_node_eq(candidate, ts_tree_cursor_current_node(&cursor))) {
+        partner_start = ts_node_start_byte(candidate);
+        found = true;
+      }
+    }
+    ts_tree_cursor_delete(&edge);
+    if (!found) {
+      found = scan_for_partner(cursor, own, partner, forward, partner_start);
+    }
+    if (found) {
+      match = partner_start;
+    }
   }
+  ts_tree_cursor_delete(&cursor);
+  return found;
+#else
+  (void)offset;
+  (void)match;
+  return false;
+#endif
+}
+
+size_t TreeSitterHighlighter::injection_layer_count() const {
+#ifdef PRODIGEETOR_USE_TREE_SITTER
+  return m_state->layers.size();
+#else
+  return 0;
+#endif
+}
+
+void TreeSitterHighlighter::clear_tree() {
+#ifdef PRODIGEETOR_USE_TREE_SITTER
+  if (m_tree) {
+    ts_tree_delete(static_cast<TSTree *>(m_tree));
+    m_tree = nullptr;
+  }
+  m_state->clear_layers();
+  m_state->root_interrupted = false;
+  m_state->root_snapshot.reset();
+  m_state->root_replay.clear();
+  m_state->edited.clear();
+  m_state->stale.clear();
+  m_state->stale_all = true;
+  m_state->root_span_width = 0;
+#endif
+  m_root_spans.clear();
+  m_spans.clear();
+  m_spans_stale = false;
+  m_runs.clear();
+  m_folds.clear();
+}
+
+void TreeSitterHighlighter::collect_root_spans() {
+  m_root_spans.clear();
+#ifdef PRODIGEETOR_USE_TREE_SITTER
+  TSQuery *query = static_cast<TSQuery *>(m_query);
   if (!query) {
     std::cerr << "[Highlighter] WARNING: Query is null, returning no spans (text will use default color)" << std::endl;
-    return spans;
+    return;
+  }
+  collect_unclipped_spans(query, m_state->root_patterns, ts_tree_root_node(static_cast<TSTree *>(m_tree)),
+                          m_state->clipped, m_text, m_theme, m_root_spans);
+  sort_by_start(m_root_spans);
+  m_state->root_span_width = 0;
+  for (const auto &span : m_root_spans) {
+    m_state->root_span_width = std::max(m_state->root_span_width, span.range.end.column - span.range.start.column);
+  }
+  m_state->stale_all = true;
+  std::cerr << "[Highlighter] Generated " << m_root_spans.size() << " spans" << std::endl;
+#endif
+}
+
+void TreeSitterHighlighter::update_root_spans(std::vector<std::pair<uint32_t, uint32_t>> windows) {
+#ifdef PRODIGEETOR_USE_TREE_SITTER
+  TSQuery *query = static_cast<TSQuery *>(m_query);
+  if (!query) {
+    return;
+  }
+  ParseState &state = *m_state;
+  TSNode root = ts_tree_root_node(static_cast<TSTree *>(m_tree));
+  uint32_t size = static_cast<uint32_t>(m_text.size());
+  // A byte wider, so spans that end or start right at an edit are requeried.
+  // An edge inside a clipped tail moves out to the bytes around it, where a
+  // node reaching into the tail from the highlighted part is found again.
+  auto inside_clip = [&](uint32_t offset) {
+    auto it = std::upper_bound(state.clipped.begin(), state.clipped.end(), offset,
+                               [](uint32_t value, const auto &range) { return value < range.second; });
+    return it != state.clipped.end() && it->first <= offset ? it : state.clipped.end();
+  };
+  for (auto &window : windows) {
+    window.first = window.first > 0 ? window.first - 1 : 0;
+    window.second = std::min(window.second + 1, size);
+    if (auto clip = inside_clip(window.first); clip != state.clipped.end()) {
+      window.first = clip->first - 1;
+    }
+    if (auto clip = inside_clip(window.second > 0 ? window.second - 1 : 0); clip != state.clipped.end()) {
+      window.second = std::min(clip->second + 1, size);
+    }
+  }
+  coalesce(windows);
+
+  auto starts_before = [](const RenderSpan &span, uint32_t offset) { return span.range.start.column < offset; };
+  // Back to front, so a splice leaves the spans of earlier windows in place.
+  for (auto window = windows.rbegin(); window != windows.rend(); ++window) {
+    auto [start, end] = *window;
+    if (start >= end) {
+      continue;
+    }
+    std::vector<RenderSpan> fresh;
+    for_each_unclipped(state.clipped, start, end, [&](uint32_t range_start, uint32_t range_end) {
+      collect_spans(query, state.root_patterns, root, range_start, range_end, m_text, m_theme, fresh);
+    });
+    sort_by_start(fresh);
+    uint32_t stale_start = start;
+    uint32_t stale_end = end;
+    for (const auto &span : fresh) {
+      state.root_span_width = std::max(state.root_span_width, span.range.end.column - span.range.start.column);
+      stale_start = std::min(stale_start, span.range.start.column);
+      stale_end = std::max(stale_end, span.range.end.column);
+    }
+
+    // Replace the old spans that intersect the window. None starts further
+    // before it than the widest span.
+    uint32_t search_from = start > state.root_span_width ? start - state.root_span_width : 0;
+    auto first = std::lower_bound(m_root_spans.begin(), m_root_spans.end(), search_from, starts_before);
+    auto last = std::lower_bound(first, m_root_spans.end(), end, starts_before);
+    auto kept = std::remove_if(first, last, [&](const RenderSpan &span) {
+      if (span.range.end.column <= start) {
+        return false;
+      }
+      stale_start = std::min(stale_start, span.range.start.column);
+      stale_end = std::max(stale_end, span.range.end.column);
+      return true;
+    });
+    size_t first_index = static_cast<size_t>(first - m_root_spans.begin());
+    size_t kept_index = static_cast<size_t>(kept - m_root_spans.begin());
+    size_t last_index = static_cast<size_t>(last - m_root_spans.begin());
+    size_t common = std::min(last_index - kept_index, fresh.size());
+    std::copy(fresh.begin(), fresh.begin() + static_cast<std::ptrdiff_t>(common), m_root_spans.begin() + static_cast<std::ptrdiff_t>(kept_index));
+    if (fresh.size() > common) {
+      m_root_spans.insert(m_root_spans.begin() + static_cast<std::ptrdiff_t>(kept_index + common),
+                          fresh.begin() + static_cast<std::ptrdiff_t>(common), fresh.end());
+    } else {
+      m_root_spans.erase(m_root_spans.begin() + static_cast<std::ptrdiff_t>(kept_index + common),
+                         m_root_spans.begin() + static_cast<std::ptrdiff_t>(last_index));
+    }
+    std::inplace_merge(m_root_spans.begin() + static_cast<std::ptrdiff_t>(first_index),
+                       m_root_spans.begin() + static_cast<std::ptrdiff_t>(kept_index),
+                       m_root_spans.begin() + static_cast<std::ptrdiff_t>(kept_index + fresh.size()),
+                       [](const RenderSpan &a, const RenderSpan &b) {
+                         return a.range.start.column < b.range.start.column;
+                       });
+    state.stale.emplace_back(stale_start, stale_end);
+  }
+#else
+  (void)windows;
+#endif
+}
+
+void TreeSitterHighlighter::update_injections(uint32_t window_start, uint32_t window_end) {
+#ifdef PRODIGEETOR_USE_TREE_SITTER
+  using Layer = ParseState::Layer;
+  ParseState &state = *m_state;
+  TSTree *tree = static_cast<TSTree *>(m_tree);
+  if (!tree || !state.query || state.content_capture == UINT32_MAX) {
+    state.clear_layers();
+    return;
   }
 
-  TSTree *tree = ts_parser_parse_string(parser, nullptr, text.c_str(), static_cast<uint32_t>(text.size()));
+  // Find the injection regions that intersect the changed window, outside
+  // the clipped tails of long lines.
+  std::vector<Layer> regions;
+  TSQueryCursor *cursor = ts_query_cursor_new();
+  for_each_unclipped(state.clipped, window_start, std::max(window_end, window_start + 1),
+                     [&](uint32_t range_start, uint32_t range_end) {
+    ts_query_cursor_set_byte_range(cursor, range_start, range_end);
+    ts_query_cursor_exec(cursor, state.query, ts_tree_root_node(tree));
+    TSQueryMatch match;
+    while (ts_query_cursor_next_match(cursor, &match)) {
+      const QueryPattern &pattern = state.patterns[match.pattern_index];
+      if (!predicates_hold(pattern, match, m_text)) {
+        continue;
+      }
+      auto property = pattern.properties.find("injection.language");
+      std::string language_name = property != pattern.properties.end() ? property->second : "";
+      Layer region;
+      for (uint32_t i = 0; i < match.capture_count; ++i) {
+        TSNode node = match.captures[i].node;
+        if (match.captures[i].index == state.language_capture) {
+          uint32_t start = ts_node_start_byte(node);
+          language_name = m_text.substr(start, ts_node_end_byte(node) - start);
+        } else if (match.captures[i].index == state.content_capture) {
+          TSRange range{ts_node_start_point(node), ts_node_end_point(node),
+                        ts_node_start_byte(node), ts_node_end_byte(node)};
+          if (pattern.offset_capture == state.content_capture) {
+            range.start_byte += pattern.offset_start;
+            range.start_point.column += pattern.offset_start;
+            range.end_byte += pattern.offset_end;
+            range.end_point.column += pattern.offset_end;
+          }
+          if (range.start_byte < range.end_byte) {
+            region.ranges.push_back(range);
+          }
+        }
+      }
+      region.language = LanguageRegistry::instance().find(language_name);
+      if (region.ranges.empty() || !region.language || !grammar_for(*region.language)) {
+        continue;
+      }
+      std::sort(region.ranges.begin(), region.ranges.end(), [](const TSRange &a, const TSRange &b) {
+        return a.start_byte < b.start_byte;
+      });
+      bool duplicate = std::any_of(regions.begin(), regions.end(), [&](const Layer &other) {
+        return other.language == region.language && ranges_equal(other.ranges, region.ranges);
+      });
+      if (!duplicate) {
+        regions.push_back(std::move(region));
+      }
+    }
+  });
+  ts_query_cursor_delete(cursor);
+
+  // Layers outside the window keep their trees and spans untouched, and
+  // dirty ones their place in the parse queue. The window covers every edit.
+  std::vector<Layer> layers;
+  std::vector<Layer> affected;
+  for (auto &layer : state.layers) {
+    if (ranges_overlap(layer.ranges, window_start, window_end)) {
+      affected.push_back(std::move(layer));
+    } else {
+      layers.push_back(std::move(layer));
+    }
+  }
+  state.layers.clear();
+
+  for (auto &region : regions) {
+    bool duplicate = std::any_of(layers.begin(), layers.end(), [&](const Layer &layer) {
+      return layer.language == region.language && ranges_equal(layer.ranges, region.ranges);
+    });
+    if (duplicate) {
+      continue;
+    }
+
+    // The region is parsed by parse_layers(), within the slice's budget.
+    region.dirty = true;
+    // Prefer an identical region (no reparse unless its text was edited), then
+    // any overlapping region of the same language, whose spans stay visible
+    // until the reparse. Its tree is no incremental base: tree-sitter reuses
+    // nodes of a tree parsed over other included ranges that a fresh parse
+    // would not produce.
+    auto same = std::find_if(affected.begin(), affected.end(), [&](const Layer &layer) {
+      return (layer.tree || layer.parsing) && layer.language == region.language &&
+             ranges_equal(layer.ranges, region.ranges);
+    });
+    if (same != affected.end()) {
+      region.dirty = same->dirty;
+      region.parsing = same->parsing;
+      region.replay = std::move(same->replay);
+      region.tree = same->tree;
+      region.spans = std::move(same->spans);
+      same->tree = nullptr;
+      same->parsing = false;
+    } else {
+      auto overlapping = std::find_if(affected.begin(), affected.end(), [&](const Layer &layer) {
+        return !layer.spans.empty() && layer.language == region.language &&
+               ranges_overlap(layer.ranges, region.ranges.front().start_byte, region.ranges.back().end_byte);
+      });
+      if (overlapping != affected.end()) {
+        region.spans = std::move(overlapping->spans);
+      }
+    }
+    layers.push_back(std::move(region));
+  }
+
+  for (auto &layer : affected) {
+    if (layer.parsing) {
+      state.abandon_layer_parse(layer);
+    }
+    state.mark_stale(layer.spans);
+    if (layer.tree) {
+      ts_tree_delete(layer.tree);
+    }
+  }
+
+  std::sort(layers.begin(), layers.end(), [](const Layer &a, const Layer &b) {
+    return a.ranges.front().start_byte < b.ranges.front().start_byte;
+  });
+  state.layers = std::move(layers);
+#else
+  (void)window_start;
+  (void)window_end;
+#endif
+}
+
+void TreeSitterHighlighter::update_folds(uint32_t window_start, uint32_t window_end) {
+#ifdef PRODIGEETOR_USE_TREE_SITTER
+  TSTree *tree = static_cast<TSTree *>(m_tree);
   if (!tree) {
-    std::cerr << "[Highlighter] ERROR: Failed to parse text" << std::endl;
-    return spans;
+    m_folds.clear();
+    return;
+  }
+
+  // Folds touching the window may have changed extent; everything else only
+  // moved, which edit() already accounted for.
+  std::vector<FoldRange> folds;
+  folds.reserve(m_folds.size());
+  for (const auto &fold : m_folds) {
+    if (fold.start_byte > window_end || fold.end_byte < window_start) {
+      folds.push_back(fold);
+    }
   }
 
   TSNode root = ts_tree_root_node(tree);
+  if (m_state->folds_query) {
+    TSQueryCursor *cursor = ts_query_cursor_new();
+    ts_query_cursor_set_byte_range(cursor, window_start, window_end);
+    ts_query_cursor_exec(cursor, m_state->folds_query, root);
+    TSQueryMatch match;
+    while (ts_query_cursor_next_match(cursor, &match)) {
+      for (uint32_t i = 0; i < match.capture_count; ++i) {
+        FoldRange fold;
+        if (fold_for_node(match.captures[i].node, true, fold)) {
+          folds.push_back(fold);
+        }
+      }
+    }
+    ts_query_cursor_delete(cursor);
+  } else {
+    collect_folds(root, window_start, window_end, folds);
+  }
 
-  TSQueryCursor *cursor = ts_query_cursor_new();
-  ts_query_cursor_exec(cursor, query, root);
+  // One fold per start line: the outermost one.
+  std::sort(folds.begin(), folds.end(), [](const FoldRange &a, const FoldRange &b) {
+    return a.start_line != b.start_line ? a.start_line < b.start_line : a.end_line > b.end_line;
+  });
+  folds.erase(std::unique(folds.begin(), folds.end(), [](const FoldRange &a, const FoldRange &b) {
+    return a.start_line == b.start_line;
+  }), folds.end());
+  m_folds = std::move(folds);
+#else
+  (void)window_start;
+  (void)window_end;
+#endif
+}
 
-  TSQueryMatch match;
-  uint32_t match_count = 0;
-  while (ts_query_cursor_next_match(cursor, &match)) {
-    match_count++;
-    for (uint32_t i = 0; i < match.capture_count; ++i) {
-      TSQueryCapture capture = match.captures[i];
-      TSNode node = capture.node;
-      uint32_t start = ts_node_start_byte(node);
-      uint32_t end = ts_node_end_byte(node);
+void TreeSitterHighlighter::merge_spans() {
+  m_spans_stale = true;
+#ifdef PRODIGEETOR_USE_TREE_SITTER
+  ParseState &state = *m_state;
+  if (state.stale_all) {
+    state.stale_all = false;
+    state.stale.clear();
+    m_runs.build(spans());
+    return;
+  }
 
-      uint32_t length = 0;
-      const char *name = ts_query_capture_name_for_id(query, capture.index, &length);
-      if (!name || length == 0) {
-        continue;
+  // Only the runs over windows whose spans changed are rebuilt, from the
+  // spans that intersect them.
+  coalesce(state.stale);
+  auto starts_before = [](const RenderSpan &span, uint32_t offset) { return span.range.start.column < offset; };
+  std::vector<RenderSpan> window_spans;
+  for (auto [start, end] : state.stale) {
+    window_spans.clear();
+    uint32_t search_from = start > state.root_span_width ? start - state.root_span_width : 0;
+    auto first = std::lower_bound(m_root_spans.begin(), m_root_spans.end(), search_from, starts_before);
+    for (auto it = first; it != m_root_spans.end() && it->range.start.column < end; ++it) {
+      if (it->range.end.column > start) {
+        window_spans.push_back(*it);
+      }
+    }
+    for (const auto &layer : state.layers) {
+      for (const auto &span : layer.spans) {
+        if (span.range.start.column < end && span.range.end.column > start) {
+          window_spans.push_back(span);
+        }
       }
-      std::string capture_name(name, length);
+    }
+    clip_spans(window_spans, state.clipped);
+    m_runs.rebuild(start, end, window_spans);
+  }
+  state.stale.clear();
+#else
+  m_runs.build(spans());
+#endif
+}
+
+#ifdef PRODIGEETOR_USE_TREE_SITTER
+namespace {
+
+struct TagQuery {
+  TSQuery *query = nullptr;
+  std::vector<QueryPattern> patterns;
+  uint32_t name_capture = UINT32_MAX;
+  std::vector<std::string> kinds; // per capture id; empty unless @definition.*
+};
 
-      RenderSpan span;
-      span.range.start = Position{0, start};
-      span.range.end = Position{0, end};
-      span.style = m_theme.style_for_capture(capture_name);
-      spans.push_back(span);
+// Tags queries are compiled once per language and kept for the life of the
+// process. Query cursors only read a TSQuery, so taggers on different threads
+// can share it.
+const TagQuery &tag_query_for(const LanguageInfo &language) {
+  static std::mutex mutex;
+  static std::unordered_map<const LanguageInfo *, std::unique_ptr<TagQuery>> queries;
+
+  std::lock_guard<std::mutex> lock(mutex);
+  auto &entry = queries[&language];
+  if (entry) {
+    return *entry;
+  }
+  entry = std::make_unique<TagQuery>();
+  entry->query = compile_query(language, LanguageRegistry::query_source(language.tags));
+  if (!entry->query) {
+    return *entry;
+  }
+  entry->patterns = parse_query_patterns(entry->query);
+  uint32_t capture_count = ts_query_capture_count(entry->query);
+  entry->kinds.resize(capture_count);
+  for (uint32_t i = 0; i < capture_count; ++i) {
+    uint32_t length = 0;
+    const char *capture_name = ts_query_capture_name_for_id(entry->query, i, &length);
+    std::string_view name(capture_name, length);
+    if (name == "name") {
+      entry->name_capture = i;
+    } else if (name.starts_with("definition.")) {
+      entry->kinds[i] = std::string(name.substr(std::strlen("definition.")));
     }
   }
+  return *entry;
+}
 
-  std::cerr << "[Highlighter] Generated " << spans.size() << " spans from " << match_count << " matches" << std::endl;
+} // namespace
+#endif
 
-  ts_query_cursor_delete(cursor);
+TreeSitterTagger::TreeSitterTagger() {
+#ifdef PRODIGEETOR_USE_TREE_SITTER
+  m_parser = ts_parser_new();
+  m_cursor = ts_query_cursor_new();
+#endif
+}
+
+TreeSitterTagger::~TreeSitterTagger() {
+#ifdef PRODIGEETOR_USE_TREE_SITTER
+  ts_query_cursor_delete(static_cast<TSQueryCursor *>(m_cursor));
+  ts_parser_delete(static_cast<TSParser *>(m_parser));
+#endif
+}
+
+void TreeSitterTagger::set_timeout_micros(uint64_t timeout_micros) {
+#ifdef PRODIGEETOR_USE_TREE_SITTER
+  ts_parser_set_timeout_micros(static_cast<TSParser *>(m_parser), timeout_micros);
+#else
+  (void)timeout_micros;
+#endif
+}
+
+void TreeSitterTagger::set_cancel_flag(const size_t *flag) {
+#ifdef PRODIGEETOR_USE_TREE_SITTER
+  ts_parser_set_cancellation_flag(static_cast<TSParser *>(m_parser), flag);
+#else
+  (void)flag;
+#endif
+}
+
+bool TreeSitterTagger::supports(const LanguageInfo &language) const {
+#ifdef PRODIGEETOR_USE_TREE_SITTER
+  return tag_query_for(language).query != nullptr;
+#else
+  (void)language;
+  return false;
+#endif
+}
+
+std::vector<SymbolTag> TreeSitterTagger::tags(const LanguageInfo &language, std::string_view text) {
+  std::vector<SymbolTag> tags;
+#ifdef PRODIGEETOR_USE_TREE_SITTER
+  const TagQuery &tag_query = tag_query_for(language);
+  if (!tag_query.query || tag_query.name_capture == UINT32_MAX) {
+    return tags;
+  }
+  auto *parser = static_cast<TSParser *>(m_parser);
+  const TSLanguage *grammar = grammar_for(language);
+  if (!grammar || !ts_parser_set_language(parser, grammar)) {
+    return tags;
+  }
+  TSTree *tree = ts_parser_parse_string(parser, nullptr, text.data(), static_cast<uint32_t>(text.size()));
+  if (!tree) {
+    // Timed out or cancelled: the next document must not resume this parse.
+    ts_parser_reset(parser);
+    return tags;
+  }
+
+  auto *cursor = static_cast<TSQueryCursor *>(m_cursor);
+  ts_query_cursor_exec(cursor, tag_query.query, ts_tree_root_node(tree));
+  TSQueryMatch match;
+  while (ts_query_cursor_next_match(cursor, &match)) {
+    if (!predicates_hold(tag_query.patterns[match.pattern_index], match, text)) {
+      continue;
+    }
+    const TSNode *name_node = nullptr;
+    const std::string *kind = nullptr;
+    for (uint32_t i = 0; i < match.capture_count; ++i) {
+      uint32_t index = match.captures[i].index;
+      if (index == tag_query.name_capture) {
+        name_node = &match.captures[i].node;
+      } else if (!tag_query.kinds[index].empty()) {
+        kind = &tag_query.kinds[index];
+      }
+    }
+    // References (@reference.*) are not indexed.
+    if (!name_node || !kind) {
+      continue;
+    }
+    uint32_t start = ts_node_start_byte(*name_node);
+    uint32_t end = ts_node_end_byte(*name_node);
+    TSPoint point = ts_node_start_point(*name_node);
+    if (!tags.empty() && tags.back().line == point.row && tags.back().column == point.column) {
+      continue;
+    }
+    SymbolTag tag;
+    tag.name = std::string(text.substr(start, end - start));
+    tag.kind = *kind;
+    tag.line = point.row;
+    tag.column = point.column;
+    tags.push_back(std::move(tag));
+  }
   ts_tree_delete(tree);
 #else
+  (void)language;
   (void)text;
 #endif
-
-  return spans;
+  return tags;
 }
 
 } // namespace prodigeetor
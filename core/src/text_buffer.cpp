@@ -3,16 +3,93 @@
 #include "grapheme.h"
 
 #include <algorithm>
+#include <cstring>
 #include <stdexcept>
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 namespace prodigeetor {
 
+// The mapping is private and read-only; the file must not be truncated while
+// it is open.
+struct TextBuffer::MappedFile {
+  const char *data = nullptr;
+  size_t size = 0;
+
+  ~MappedFile() {
+    if (data) {
+      munmap(const_cast<char *>(data), size);
+    }
+  }
+};
+
 TextBuffer::TextBuffer() = default;
 
 TextBuffer::TextBuffer(std::string initial_text) : m_left(std::move(initial_text)) {}
 
+bool TextBuffer::load_file(const std::string &path, size_t map_threshold) {
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat info {};
+  if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)) {
+    close(fd);
+    return false;
+  }
+  size_t file_size = static_cast<size_t>(info.st_size);
+
+  TextBuffer loaded;
+  if (map_threshold != 0 && file_size >= map_threshold) {
+    void *data = mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+      return false;
+    }
+    auto mapped = std::make_shared<MappedFile>();
+    mapped->data = static_cast<const char *>(data);
+    mapped->size = file_size;
+    loaded.m_mapped = std::move(mapped);
+  } else {
+    loaded.m_left.resize(file_size);
+    size_t done = 0;
+    while (done < file_size) {
+      ssize_t count = read(fd, loaded.m_left.data() + done, file_size - done);
+      if (count <= 0) {
+        break;
+      }
+      done += static_cast<size_t>(count);
+    }
+    close(fd);
+    loaded.m_left.resize(done);
+  }
+  *this = std::move(loaded);
+  return true;
+}
+
+bool TextBuffer::is_mapped() const {
+  return m_mapped != nullptr;
+}
+
+std::string_view TextBuffer::mapped_prefix() const {
+  if (!m_mapped) {
+    return std::string_view();
+  }
+  return std::string_view(m_mapped->data, m_mapped_prefix);
+}
+
+std::string_view TextBuffer::mapped_tail() const {
+  if (!m_mapped) {
+    return std::string_view();
+  }
+  return std::string_view(m_mapped->data + m_mapped_offset, m_mapped->size - m_mapped_offset);
+}
+
 size_t TextBuffer::size() const {
-  return m_left.size() + m_right_reversed.size();
+  return m_mapped_prefix + m_left.size() + m_right_reversed.size() + mapped_tail().size();
 }
 
 bool TextBuffer::empty() const {
@@ -22,33 +99,80 @@ bool TextBuffer::empty() const {
 std::string TextBuffer::text() const {
   std::string out;
   out.reserve(size());
+  out.append(mapped_prefix());
   out.append(m_left);
-  for (auto it = m_right_reversed.rbegin(); it != m_right_reversed.rend(); ++it) {
-    out.push_back(*it);
-  }
+  out.append(m_right_reversed.rbegin(), m_right_reversed.rend());
+  out.append(mapped_tail());
   return out;
 }
 
+std::string TextBuffer::text_range(size_t start, size_t end) const {
+  return slice(start, end);
+}
+
 void TextBuffer::move_gap(size_t offset) {
   if (offset > size()) {
     throw std::out_of_range("TextBuffer::move_gap offset out of range");
   }
 
-  while (m_left.size() > offset) {
-    m_right_reversed.push_back(m_left.back());
-    m_left.pop_back();
+  if (m_left.empty() && m_right_reversed.empty() && m_mapped_prefix == m_mapped_offset) {
+    // Nothing edited yet: the document is the mapping, so the gap can go
+    // anywhere in it without copying.
+    m_mapped_prefix = offset;
+    m_mapped_offset = offset;
+    return;
+  }
+  size_t in_memory_end = m_mapped_prefix + m_left.size() + m_right_reversed.size();
+  if (offset < m_mapped_prefix) {
+    // Copy the mapped bytes from the gap up to the edited region.
+    m_right_reversed.append(m_left.rbegin(), m_left.rend());
+    m_left.clear();
+    std::string_view copied = mapped_prefix().substr(offset);
+    m_right_reversed.append(copied.rbegin(), copied.rend());
+    m_mapped_prefix = offset;
+    return;
+  }
+  if (offset > in_memory_end) {
+    // Copy the mapped bytes from the edited region up to the gap.
+    m_left.append(m_right_reversed.rbegin(), m_right_reversed.rend());
+    m_right_reversed.clear();
+    size_t count = offset - in_memory_end;
+    m_left.append(mapped_tail().substr(0, count));
+    m_mapped_offset += count;
+    return;
   }
 
-  while (m_left.size() < offset) {
-    m_left.push_back(m_right_reversed.back());
-    m_right_reversed.pop_back();
+  size_t left_end = offset - m_mapped_prefix;
+  if (m_left.size() > left_end) {
+    size_t count = m_left.size() - left_end;
+    m_right_reversed.append(m_left.rbegin(), m_left.rbegin() + static_cast<std::ptrdiff_t>(count));
+    m_left.resize(left_end);
+  } else if (m_left.size() < left_end) {
+    size_t count = left_end - m_left.size();
+    m_left.append(m_right_reversed.rbegin(), m_right_reversed.rbegin() + static_cast<std::ptrdiff_t>(count));
+    m_right_reversed.resize(m_right_reversed.size() - count);
+  }
+}
+
+// Removes `length` bytes after the gap, appending them to `removed` in
+// document order.
+void TextBuffer::take_after_gap(size_t length, std::string *removed) {
+  size_t from_right = std::min(length, m_right_reversed.size());
+  if (removed) {
+    removed->append(m_right_reversed.rbegin(), m_right_reversed.rbegin() + static_cast<std::ptrdiff_t>(from_right));
+  }
+  m_right_reversed.resize(m_right_reversed.size() - from_right);
+  size_t from_mapped = std::min(length - from_right, mapped_tail().size());
+  if (removed) {
+    removed->append(mapped_tail().substr(0, from_mapped));
   }
+  m_mapped_offset += from_mapped;
 }
 
 void TextBuffer::insert(size_t offset, std::string_view text) {
   move_gap(offset);
   m_left.append(text);
-  m_line_index_dirty = true;
+  update_line_index(offset, 0, text);
 }
 
 void TextBuffer::erase(size_t offset, size_t length) {
@@ -56,45 +180,43 @@ void TextBuffer::erase(size_t offset, size_t length) {
     return;
   }
   move_gap(offset);
-  for (size_t i = 0; i < length; ++i) {
-    if (m_right_reversed.empty()) {
-      break;
-    }
-    m_right_reversed.pop_back();
-  }
-  m_line_index_dirty = true;
+  length = std::min(length, size() - offset);
+  take_after_gap(length, nullptr);
+  update_line_index(offset, length, std::string_view());
 }
 
 Edit TextBuffer::replace(size_t offset, size_t length, std::string_view text) {
   Edit edit;
   edit.offset = offset;
-  edit.removed.reserve(length);
 
   move_gap(offset);
-  for (size_t i = 0; i < length; ++i) {
-    if (m_right_reversed.empty()) {
-      break;
-    }
-    edit.removed.push_back(m_right_reversed.back());
-    m_right_reversed.pop_back();
-  }
-
-  std::reverse(edit.removed.begin(), edit.removed.end());
+  length = std::min(length, size() - offset);
+  edit.removed.reserve(length);
+  take_after_gap(length, &edit.removed);
   edit.inserted.assign(text);
   m_left.append(text);
-  m_line_index_dirty = true;
+  update_line_index(offset, length, text);
   return edit;
 }
 
 char TextBuffer::char_at(size_t offset) const {
-  if (offset < m_left.size()) {
-    return m_left[offset];
+  if (offset < m_mapped_prefix) {
+    return m_mapped->data[offset];
+  }
+  size_t left_index = offset - m_mapped_prefix;
+  if (left_index < m_left.size()) {
+    return m_left[left_index];
+  }
+  size_t right_index = left_index - m_left.size();
+  if (right_index < m_right_reversed.size()) {
+    return m_right_reversed[m_right_reversed.size() - right_index - 1];
   }
-  size_t right_index = offset - m_left.size();
-  if (right_index >= m_right_reversed.size()) {
+  std::string_view tail = mapped_tail();
+  size_t tail_index = right_index - m_right_reversed.size();
+  if (tail_index >= tail.size()) {
     throw std::out_of_range("TextBuffer::char_at offset out of range");
   }
-  return m_right_reversed[m_right_reversed.size() - right_index - 1];
+  return tail[tail_index];
 }
 
 size_t TextBuffer::line_count() const {
@@ -110,6 +232,12 @@ size_t TextBuffer::line_start(size_t line_index) const {
   return m_line_starts[line_index];
 }
 
+size_t TextBuffer::line_at(size_t offset) const {
+  ensure_line_index();
+  auto it = std::upper_bound(m_line_starts.begin(), m_line_starts.end(), offset);
+  return it == m_line_starts.begin() ? 0 : static_cast<size_t>(it - m_line_starts.begin() - 1);
+}
+
 std::string TextBuffer::line_text(size_t line_index) const {
   size_t start = line_start(line_index);
   if (start >= size()) {
@@ -170,29 +298,111 @@ std::string TextBuffer::slice(size_t start, size_t end) const {
   }
   std::string out;
   out.reserve(end - start);
-  for (size_t i = start; i < end; ++i) {
-    out.push_back(char_at(i));
+  size_t left_start = m_mapped_prefix;
+  size_t left_end = left_start + m_left.size();
+  size_t right_end = left_end + m_right_reversed.size();
+  if (start < left_start) {
+    out.append(mapped_prefix().substr(start, std::min(end, left_start) - start));
+  }
+  size_t left_from = std::max(start, left_start);
+  size_t left_stop = std::min(end, left_end);
+  if (left_from < left_stop) {
+    out.append(m_left, left_from - left_start, left_stop - left_from);
+  }
+  size_t right_start = std::max(start, left_end);
+  size_t right_stop = std::min(end, right_end);
+  if (right_start < right_stop) {
+    auto first = m_right_reversed.rbegin() + static_cast<std::ptrdiff_t>(right_start - left_end);
+    out.append(first, first + static_cast<std::ptrdiff_t>(right_stop - right_start));
+  }
+  size_t mapped_start = std::max(start, right_end);
+  if (mapped_start < end) {
+    out.append(mapped_tail().substr(mapped_start - right_end, end - mapped_start));
   }
   return out;
 }
 
+void TextBuffer::for_each_chunk(size_t start, size_t end,
+                                const std::function<void(std::string_view)> &visit) const {
+  end = std::min(end, size());
+  if (start >= end) {
+    return;
+  }
+  size_t left_start = m_mapped_prefix;
+  size_t left_end = left_start + m_left.size();
+  size_t right_end = left_end + m_right_reversed.size();
+  if (start < left_start) {
+    visit(mapped_prefix().substr(start, std::min(end, left_start) - start));
+  }
+  size_t left_from = std::max(start, left_start);
+  size_t left_stop = std::min(end, left_end);
+  if (left_from < left_stop) {
+    visit(std::string_view(m_left).substr(left_from - left_start, left_stop - left_from));
+  }
+  size_t right_start = std::max(start, left_end);
+  size_t right_stop = std::min(end, right_end);
+  if (right_start < right_stop) {
+    char block[16384];
+    auto first = m_right_reversed.rbegin() + static_cast<std::ptrdiff_t>(right_start - left_end);
+    for (size_t remaining = right_stop - right_start; remaining > 0;) {
+      size_t length = std::min(remaining, sizeof(block));
+      std::copy(first, first + static_cast<std::ptrdiff_t>(length), block);
+      visit(std::string_view(block, length));
+      first += static_cast<std::ptrdiff_t>(length);
+      remaining -= length;
+    }
+  }
+  size_t mapped_start = std::max(start, right_end);
+  if (mapped_start < end) {
+    visit(mapped_tail().substr(mapped_start - right_end, end - mapped_start));
+  }
+}
+
 void TextBuffer::ensure_line_index() const {
   if (!m_line_index_dirty) {
     return;
   }
   m_line_starts.clear();
   m_line_starts.push_back(0);
-  for (size_t i = 0; i < size(); ++i) {
-    if (char_at(i) == '\n') {
-      if (i + 1 <= size()) {
-        m_line_starts.push_back(i + 1);
-      }
+  auto scan = [this](std::string_view part, size_t base) {
+    size_t i = 0;
+    while (const void *found = std::memchr(part.data() + i, '\n', part.size() - i)) {
+      size_t at = static_cast<size_t>(static_cast<const char *>(found) - part.data());
+      m_line_starts.push_back(base + at + 1);
+      i = at + 1;
+    }
+  };
+  size_t left_end = m_mapped_prefix + m_left.size();
+  scan(mapped_prefix(), 0);
+  scan(m_left, m_mapped_prefix);
+  for (size_t k = 0; k < m_right_reversed.size(); ++k) {
+    if (m_right_reversed[m_right_reversed.size() - k - 1] == '\n') {
+      m_line_starts.push_back(left_end + k + 1);
     }
   }
-  if (m_line_starts.empty()) {
-    m_line_starts.push_back(0);
-  }
+  scan(mapped_tail(), left_end + m_right_reversed.size());
   m_line_index_dirty = false;
 }
 
+// Keeps a built line index current across an edit at `offset` instead of
+// rescanning the whole buffer.
+void TextBuffer::update_line_index(size_t offset, size_t removed_length, std::string_view inserted) {
+  if (m_line_index_dirty) {
+    return;
+  }
+  auto first = std::upper_bound(m_line_starts.begin(), m_line_starts.end(), offset);
+  auto last = std::upper_bound(first, m_line_starts.end(), offset + removed_length);
+  for (auto it = last; it != m_line_starts.end(); ++it) {
+    *it = *it - removed_length + inserted.size();
+  }
+  std::vector<size_t> added;
+  for (size_t i = 0; i < inserted.size(); ++i) {
+    if (inserted[i] == '\n') {
+      added.push_back(offset + i + 1);
+    }
+  }
+  first = m_line_starts.erase(first, last);
+  m_line_starts.insert(first, added.begin(), added.end());
+}
+
 } // namespace prodigeetor
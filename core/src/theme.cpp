@@ -67,4 +67,9 @@ RenderStyle SyntaxTheme::style_for_capture(const std::string &capture) const {
   return m_default_style;
 }
 
+const RenderStyle *SyntaxTheme::find_style(const std::string &capture) const {
+  auto it = m_capture_styles.find(capture);
+  return it == m_capture_styles.end() ? nullptr : &it->second;
+}
+
 } // namespace prodigeetor
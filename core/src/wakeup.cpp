@@ -0,0 +1,59 @@
+#include "wakeup.h"
+
+#include <cstdint>
+#include <fcntl.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+
+namespace prodigeetor {
+
+Wakeup::Wakeup() {
+#ifdef __linux__
+  m_read_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  m_write_fd = m_read_fd;
+#else
+  int fds[2];
+  if (pipe(fds) == 0) {
+    for (int fd : fds) {
+      fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+      fcntl(fd, F_SETFD, FD_CLOEXEC);
+    }
+    m_read_fd = fds[0];
+    m_write_fd = fds[1];
+  }
+#endif
+}
+
+Wakeup::~Wakeup() {
+  if (m_write_fd >= 0 && m_write_fd != m_read_fd) {
+    close(m_write_fd);
+  }
+  if (m_read_fd >= 0) {
+    close(m_read_fd);
+  }
+}
+
+void Wakeup::signal() {
+  if (m_signaled.exchange(true)) {
+    return;
+  }
+  uint64_t one = 1;
+  // A full pipe is already readable, so a failed write loses nothing
+  ssize_t written = write(m_write_fd, &one, sizeof(one));
+  (void)written;
+}
+
+void Wakeup::drain() {
+  m_signaled.store(false);
+  uint64_t count[16];
+  while (read(m_read_fd, count, sizeof(count)) > 0) {
+#ifdef __linux__
+    break; // an eventfd is reset by a single read
+#endif
+  }
+}
+
+} // namespace prodigeetor
@@ -0,0 +1,252 @@
+// Checks TreeSitterHighlighter's time-sliced parsing against the highlight a
+// fresh, unbudgeted highlighter produces for the same text. Run from anywhere:
+// languages and queries are resolved from PRODIGEETOR_SOURCE_DIR.
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <vector>
+
+#include "language_registry.h"
+#include "syntax_highlighter.h"
+
+#ifndef PRODIGEETOR_SOURCE_DIR
+#define PRODIGEETOR_SOURCE_DIR "."
+#endif
+
+using namespace prodigeetor;
+
+namespace {
+
+int g_failures = 0;
+
+#define EXPECT(condition)                                                                   \
+  do {                                                                                      \
+    if (!(condition)) {                                                                     \
+      std::cerr << __FILE__ << ":" << __LINE__ << ": expected " << #condition << std::endl; \
+      ++g_failures;                                                                         \
+    }                                                                                       \
+  } while (false)
+
+constexpr std::string_view kJavaScript =
+    "function f(a) {\n"
+    "  return a + 1; // hi\n"
+    "}\n"
+    "/* block\n"
+    "comment */ const s = `x${y}`; let z = [1, 2, 3];\n";
+
+constexpr std::string_view kHtml =
+    "<div class=\"a\"><script>let x = `a${b}`; function g(){ return 1 }</script>"
+    "<style>.c { color: red; }</style><p>text &amp; more</p></div>\n";
+
+std::string repeat(std::string_view unit, int count) {
+  std::string text;
+  for (int i = 0; i < count; ++i) {
+    text += unit;
+  }
+  return text;
+}
+
+// Spans as a sorted set: the store may list a span once per unclipped piece
+// that reported it.
+using SpanKey = std::tuple<uint32_t, uint32_t, uint32_t, uint32_t, bool, bool>;
+
+std::vector<SpanKey> span_keys(const std::vector<RenderSpan> &spans) {
+  std::vector<SpanKey> keys;
+  keys.reserve(spans.size());
+  for (const auto &span : spans) {
+    if (span.range.start.column < span.range.end.column) {
+      keys.emplace_back(span.range.start.column, span.range.end.column, span.style.fg_color, span.style.bg_color,
+                        span.style.bold, span.style.italic);
+    }
+  }
+  std::sort(keys.begin(), keys.end());
+  keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+  return keys;
+}
+
+bool same_runs(const HighlightRuns &a, const HighlightRuns &b) {
+  if (a.size() != b.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < a.size(); ++i) {
+    if (a.starts()[i] != b.starts()[i] || a.ends()[i] != b.ends()[i] ||
+        !(a.styles()[a.style_ids()[i]] == b.styles()[b.style_ids()[i]])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Runs slices until the parse completes, giving up after `max_slices`.
+bool finish(TreeSitterHighlighter &highlighter, int max_slices = 100000) {
+  for (int i = 0; i < max_slices && highlighter.parse_pending(); ++i) {
+    highlighter.continue_parse();
+  }
+  return !highlighter.parse_pending();
+}
+
+bool matches_fresh(const TreeSitterHighlighter &highlighter, std::string_view language, const std::string &text) {
+  TreeSitterHighlighter fresh;
+  HighlightLimits limits;
+  limits.parse_budget_micros = 0;
+  fresh.set_limits(limits);
+  fresh.set_language(language);
+  fresh.set_text(text);
+  return same_runs(highlighter.runs(), fresh.runs()) &&
+         span_keys(highlighter.spans()) == span_keys(fresh.spans());
+}
+
+// Random edits under a budget far below a slice's worth of parsing, so root
+// and layer parses are interrupted, resumed and overtaken by further edits.
+// Whenever the parse settles, the highlight must be what a fresh highlighter
+// makes of the same text.
+void test_edits_under_budget(std::string_view language, std::string_view unit) {
+  std::string text = repeat(unit, 40);
+  TreeSitterHighlighter highlighter;
+  HighlightLimits limits;
+  limits.parse_budget_micros = 50;
+  highlighter.set_limits(limits);
+  EXPECT(highlighter.set_language(language));
+  highlighter.set_text(text);
+  EXPECT(finish(highlighter));
+  EXPECT(matches_fresh(highlighter, language, text));
+
+  static constexpr std::string_view kInserts[] = {"a",  "(", ")",  "{",  "}",        "\"",        "'",
+                                                  "/*", "*/", "\n", "x1", "<script>", "</script>", "`",
+                                                  "${", "//", "let q=2;"};
+  std::mt19937 rng(7);
+  int checks = 0;
+  for (int step = 0; step < 200; ++step) {
+    Edit edit;
+    edit.offset = rng() % (text.size() + 1);
+    if (rng() % 3 == 0 && edit.offset < text.size()) {
+      edit.removed = text.substr(edit.offset, std::min<size_t>(1 + rng() % 4, text.size() - edit.offset));
+    } else {
+      edit.inserted = kInserts[rng() % std::size(kInserts)];
+    }
+    text.replace(edit.offset, edit.removed.size(), edit.inserted);
+    highlighter.edit(edit);
+    for (unsigned slices = rng() % 3; slices > 0 && highlighter.parse_pending(); --slices) {
+      highlighter.continue_parse();
+    }
+    if (highlighter.parse_pending() && rng() % 4 != 0) {
+      continue;
+    }
+    EXPECT(finish(highlighter));
+    ++checks;
+    if (!matches_fresh(highlighter, language, text)) {
+      std::cerr << language << ": highlight differs from a fresh parse after edit " << step << std::endl;
+      ++g_failures;
+      return;
+    }
+  }
+  EXPECT(checks > 0);
+}
+
+// Cancelling leaves plain text until the next edit, which highlights anew.
+void test_cancel_leaves_plain_text() {
+  std::string text = repeat(kJavaScript, 2000);
+  TreeSitterHighlighter highlighter;
+  HighlightLimits limits;
+  limits.parse_budget_micros = 50;
+  highlighter.set_limits(limits);
+  EXPECT(highlighter.set_language("javascript"));
+  highlighter.set_text(text);
+  EXPECT(highlighter.parse_pending());
+
+  highlighter.cancel_parse();
+  EXPECT(!highlighter.continue_parse());
+  EXPECT(!highlighter.parse_pending());
+  EXPECT(highlighter.degradation() == HighlightDegradation::PlainText);
+  EXPECT(highlighter.spans().empty());
+  EXPECT(highlighter.runs().empty());
+
+  Edit edit;
+  edit.offset = 0;
+  edit.inserted = "let q=2;\n";
+  text.insert(0, edit.inserted);
+  highlighter.edit(edit);
+  EXPECT(finish(highlighter));
+  EXPECT(highlighter.degradation() == HighlightDegradation::None);
+  EXPECT(matches_fresh(highlighter, "javascript", text));
+}
+
+// Edits before, inside and after the part a pending root parse has reached
+// are replayed onto its tree; the settled highlight is the fresh one.
+void test_resume_after_edit() {
+  std::string text = repeat(kJavaScript, 2000);
+  TreeSitterHighlighter highlighter;
+  HighlightLimits limits;
+  limits.parse_budget_micros = 50;
+  highlighter.set_limits(limits);
+  EXPECT(highlighter.set_language("javascript"));
+  highlighter.set_text(text);
+  EXPECT(!highlighter.continue_parse());
+  EXPECT(highlighter.parse_pending());
+
+  for (size_t offset : {size_t{3}, text.size() / 2, text.size() - 2}) {
+    Edit edit;
+    edit.offset = offset;
+    edit.inserted = "/*";
+    text.insert(offset, edit.inserted);
+    highlighter.edit(edit);
+    EXPECT(highlighter.parse_pending());
+  }
+  EXPECT(finish(highlighter));
+  EXPECT(matches_fresh(highlighter, "javascript", text));
+}
+
+// A layer parse longer than a slice carries over from slice to slice instead
+// of restarting, so it finishes, and edits to the layer meanwhile are replayed.
+void test_layer_budget_carry_over() {
+  std::string text = "<p>a</p><script>\n" + repeat(kJavaScript, 400) + "</script>\n<p>b</p>\n";
+  TreeSitterHighlighter highlighter;
+  HighlightLimits limits;
+  limits.parse_budget_micros = 200;
+  highlighter.set_limits(limits);
+  EXPECT(highlighter.set_language("html"));
+  highlighter.set_text(text);
+
+  // Run until only the script layer is left.
+  int slices = 0;
+  while (highlighter.parse_pending() && highlighter.injection_layer_count() == 0 && slices < 100000) {
+    highlighter.continue_parse();
+    ++slices;
+  }
+  EXPECT(highlighter.parse_pending());
+  EXPECT(highlighter.injection_layer_count() == 1);
+  EXPECT(!highlighter.continue_parse());
+  EXPECT(highlighter.parse_pending());
+
+  Edit edit;
+  edit.offset = text.find("<script>") + 9;
+  edit.inserted = "let q=2;";
+  text.insert(edit.offset, edit.inserted);
+  highlighter.edit(edit);
+  EXPECT(finish(highlighter));
+  EXPECT(highlighter.injection_layer_count() == 1);
+  EXPECT(matches_fresh(highlighter, "html", text));
+}
+
+} // namespace
+
+int main() {
+  LanguageRegistry::set_resource_base_path(PRODIGEETOR_SOURCE_DIR);
+
+  test_edits_under_budget("javascript", kJavaScript);
+  test_edits_under_budget("html", kHtml);
+  test_cancel_leaves_plain_text();
+  test_resume_after_edit();
+  test_layer_budget_carry_over();
+
+  if (g_failures != 0) {
+    std::cerr << g_failures << " failure(s)" << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,403 @@
+// Measures the LSP transport against prodigeetor_mock_lsp, so numbers are
+// reproducible without real language servers:
+//
+//   framing      MessageFramer and JSONDocument on an in-memory stream
+//   completion   sequential completion round trips through LSPClient
+//   hover        pipelined small requests, for message rate
+//   diagnostics  a publishDiagnostics flood at a fixed rate
+//   references   a large result, streamed as partial results and not
+//
+// Round trips report LSPClient's metrics: server time, parse time on the
+// I/O thread, queue time until processMessages() ran (the UI tick, see
+// --tick-ms) and handler time.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <poll.h>
+
+#include "lsp_client.h"
+#include "lsp_framer.h"
+#include "lsp_json.h"
+#include "lsp_metrics.h"
+#include "wakeup.h"
+
+#ifndef PRODIGEETOR_MOCK_LSP
+#define PRODIGEETOR_MOCK_LSP "prodigeetor_mock_lsp"
+#endif
+
+using namespace prodigeetor;
+using namespace prodigeetor::lsp;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+struct Options {
+  std::string mock = PRODIGEETOR_MOCK_LSP;
+  int items = 1000;        // completion list size
+  int requests = 200;      // per round-trip benchmark
+  int window = 32;         // pipelined requests in flight
+  int references = 20000;  // locations in the references result
+  int diagnostics = 1000;  // per publishDiagnostics
+  int rate = 100;          // publishDiagnostics per second
+  double seconds = 2.0;    // flood duration
+  int tickMs = 0;          // 0: handle messages as soon as they arrive
+  bool json = false;
+};
+
+void usage() {
+  std::fprintf(stderr,
+    "usage: prodigeetor_lsp_bench [--mock PATH] [--items N] [--requests N] [--window N]\n"
+    "                             [--references N] [--diagnostics N] [--rate PER_SECOND] [--seconds S]\n"
+    "                             [--tick-ms MS] [--json]\n");
+}
+
+double secondsSince(Clock::time_point start) {
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+double megabytes(double bytes) {
+  return bytes / (1024.0 * 1024.0);
+}
+
+// Runs the client's message loop until `done` returns true or `limit`
+// passes. Messages are handled as the wakeup fires, or every tickMs.
+bool pumpUntil(LSPClient& client, Wakeup& wakeup, int tickMs, const std::function<bool()>& done,
+               std::chrono::milliseconds limit = std::chrono::milliseconds(30000)) {
+  auto deadline = Clock::now() + limit;
+  while (!done()) {
+    if (Clock::now() >= deadline) {
+      return false;
+    }
+    if (tickMs > 0) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(tickMs));
+    } else {
+      struct pollfd ready = {wakeup.fd(), POLLIN, 0};
+      poll(&ready, 1, 100);
+    }
+    wakeup.drain();
+    client.processMessages();
+  }
+  return true;
+}
+
+bool startMock(LSPClient& client, Wakeup& wakeup, const Options& options, const std::vector<std::string>& args) {
+  client.setWakeup(&wakeup);
+  if (!client.start(options.mock, args)) {
+    return false;
+  }
+  bool ready = false;
+  bool failed = false;
+  client.initialize("file:///tmp/prodigeetor-bench",
+    [&ready](const JSONValue&) { ready = true; },
+    [&failed](int, const std::string&) { failed = true; });
+  if (!pumpUntil(client, wakeup, 0, [&] { return ready || failed; }, std::chrono::milliseconds(5000)) || failed) {
+    std::fprintf(stderr, "%s did not initialize\n", options.mock.c_str());
+    return false;
+  }
+  return true;
+}
+
+void printHeader() {
+  std::printf("%-28s %10s %10s %10s %10s %10s\n", "", "p50 us", "p90 us", "p99 us", "max us", "mean us");
+}
+
+void printHistogram(const char* name, const LatencyHistogram& histogram) {
+  std::printf("  %-26s %10llu %10llu %10llu %10llu %10llu\n", name,
+              static_cast<unsigned long long>(histogram.percentile(50)),
+              static_cast<unsigned long long>(histogram.percentile(90)),
+              static_cast<unsigned long long>(histogram.percentile(99)),
+              static_cast<unsigned long long>(histogram.max()),
+              static_cast<unsigned long long>(histogram.mean()));
+}
+
+void printStages(const MethodMetrics& metrics) {
+  printHeader();
+  if (metrics.latency.count() > 0) {
+    printHistogram("latency", metrics.latency);
+    printHistogram("server (and pipe)", metrics.server);
+  }
+  printHistogram("parse (I/O thread)", metrics.parse);
+  printHistogram("queue (until handled)", metrics.queue);
+  printHistogram("handler", metrics.handler);
+}
+
+void dumpMetrics(const Options& options, const LSPClient& client) {
+  if (options.json) {
+    JSONWriter writer;
+    client.metrics().writeJSON(writer);
+    std::printf("%s\n", writer.str().c_str());
+  }
+}
+
+// A response the size the mock sends for a completion request.
+std::string completionBody(int items) {
+  JSONWriter writer;
+  writer.beginObject().key("jsonrpc").value("2.0").key("id").value(1).key("result").beginObject()
+    .key("isIncomplete").value(false).key("items").beginArray();
+  for (int i = 0; i < items; ++i) {
+    std::string index = std::to_string(i);
+    writer.beginObject()
+      .key("label").value("mockItem" + index)
+      .key("kind").value(i % 25 + 1)
+      .key("detail").value("detail for mockItem" + index)
+      .key("sortText").value(index)
+      .endObject();
+  }
+  writer.endArray().endObject().endObject();
+  return writer.take();
+}
+
+void benchFraming(const Options& options) {
+  const std::string large = completionBody(options.items);
+  const std::string small =
+    "{\"jsonrpc\":\"2.0\",\"id\":7,\"result\":{\"contents\":{\"kind\":\"markdown\",\"value\":\"hover\"}}}";
+  struct Case {
+    const char* name;
+    const std::string* body;
+    int count;
+  };
+  const Case cases[] = {
+    {"small messages", &small, 200000},
+    {"completion lists", &large, std::max(20, 20000000 / static_cast<int>(large.size()))},
+  };
+
+  std::printf("framing and parsing (in memory)\n");
+  for (const Case& c : cases) {
+    std::string stream;
+    std::string header = "Content-Length: " + std::to_string(c.body->size()) + "\r\n\r\n";
+    stream.reserve((header.size() + c.body->size()) * static_cast<size_t>(c.count));
+    for (int i = 0; i < c.count; ++i) {
+      stream += header;
+      stream += *c.body;
+    }
+
+    // Fed in pipe-sized chunks, as the I/O thread reads them
+    MessageFramer framer;
+    std::vector<std::string> bodies;
+    bodies.reserve(static_cast<size_t>(c.count));
+    auto start = Clock::now();
+    for (size_t offset = 0; offset < stream.size(); offset += 64 * 1024) {
+      framer.feed(std::string_view(stream).substr(offset, 64 * 1024), [&bodies](std::string& body) {
+        bodies.emplace_back().swap(body);
+      });
+    }
+    double framing = secondsSince(start);
+
+    JSONDocument document;
+    size_t nodes = 0;
+    start = Clock::now();
+    for (const std::string& body : bodies) {
+      document.parse(body);
+      nodes += document.root().size();
+    }
+    double parsing = secondsSince(start);
+
+    double bytes = static_cast<double>(stream.size());
+    std::printf("  %-18s %7zu msgs %8.1f MB  frame %8.1f MB/s %7.2f us/msg  parse %8.1f MB/s %7.2f us/msg\n",
+                c.name, bodies.size(), megabytes(bytes),
+                megabytes(bytes) / framing, framing * 1e6 / static_cast<double>(bodies.size()),
+                megabytes(bytes) / parsing, parsing * 1e6 / static_cast<double>(bodies.size()));
+    if (nodes == 0) {
+      std::printf("  (no values parsed)\n");
+    }
+  }
+  std::printf("\n");
+}
+
+void benchCompletion(const Options& options) {
+  LSPClient client;
+  Wakeup wakeup;
+  if (!startMock(client, wakeup, options, {"--completion-items", std::to_string(options.items), "--diagnostics", "0"})) {
+    return;
+  }
+  int answered = 0;
+  auto start = Clock::now();
+  for (int i = 0; i < options.requests; ++i) {
+    bool done = false;
+    client.completion("file:///tmp/prodigeetor-bench/a.js", {0, 0},
+      [&](const JSONValue& result) { done = result["items"].size() > 0; ++answered; },
+      [&](int, const std::string&) { done = true; });
+    if (!pumpUntil(client, wakeup, options.tickMs, [&done] { return done; })) {
+      std::fprintf(stderr, "completion %d timed out\n", i);
+      break;
+    }
+  }
+  double elapsed = secondsSince(start);
+  LSPMetrics metrics = client.metrics();
+  const MethodMetrics& completion = metrics.method("textDocument/completion");
+  std::printf("completion: %d lists of %d items, one at a time\n", answered, options.items);
+  std::printf("  %.0f requests/s, %.1f MB/s received\n", answered / elapsed,
+              megabytes(static_cast<double>(completion.bytesReceived)) / elapsed);
+  printStages(completion);
+  std::printf("\n");
+  dumpMetrics(options, client);
+  client.shutdown();
+}
+
+void benchHover(const Options& options) {
+  LSPClient client;
+  Wakeup wakeup;
+  if (!startMock(client, wakeup, options, {"--diagnostics", "0"})) {
+    return;
+  }
+  int total = options.requests * 50;
+  int sent = 0;
+  int answered = 0;
+  std::function<void()> sendNext = [&] {
+    int line = sent++;
+    client.hover("file:///tmp/prodigeetor-bench/a.js", {line, 0},
+      [&](const JSONValue&) {
+        ++answered;
+        if (sent < total) {
+          sendNext();
+        }
+      },
+      nullptr);
+  };
+  auto start = Clock::now();
+  while (sent < std::min(options.window, total)) {
+    sendNext();
+  }
+  pumpUntil(client, wakeup, options.tickMs, [&] { return answered >= total; });
+  double elapsed = secondsSince(start);
+  LSPMetrics metrics = client.metrics();
+  const MethodMetrics& hover = metrics.method("textDocument/hover");
+  std::printf("hover: %d requests, %d in flight\n", answered, options.window);
+  std::printf("  %.0f requests/s, %.1f MB/s sent, %.1f MB/s received, %llu writes deferred\n",
+              answered / elapsed, megabytes(static_cast<double>(hover.bytesSent)) / elapsed,
+              megabytes(static_cast<double>(hover.bytesReceived)) / elapsed,
+              static_cast<unsigned long long>(metrics.deferredWrites));
+  printStages(hover);
+  std::printf("\n");
+  dumpMetrics(options, client);
+  client.shutdown();
+}
+
+void benchDiagnostics(const Options& options) {
+  LSPClient client;
+  Wakeup wakeup;
+  if (!startMock(client, wakeup, options, {"--diagnostics", std::to_string(options.diagnostics),
+                                           "--diagnostics-rate", std::to_string(options.rate)})) {
+    return;
+  }
+  size_t published = 0;
+  size_t diagnostics = 0;
+  client.onDiagnostics([&](const std::string&, const std::vector<lsp::Diagnostic>& list) {
+    ++published;
+    diagnostics += list.size();
+  });
+  TextDocumentItem document;
+  document.uri = "file:///tmp/prodigeetor-bench/a.js";
+  document.languageId = "javascript";
+  document.version = 1;
+  document.text = "let a = 1;\n";
+  client.didOpen(document);
+
+  auto start = Clock::now();
+  auto flood = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::duration<double>(options.seconds));
+  pumpUntil(client, wakeup, options.tickMs, [] { return false; }, flood);
+  double elapsed = secondsSince(start);
+  client.didClose(document.uri);
+
+  LSPMetrics metrics = client.metrics();
+  const MethodMetrics& publish = metrics.method("textDocument/publishDiagnostics");
+  std::printf("diagnostics: %zu publishes of %d at %d/s requested\n", published, options.diagnostics, options.rate);
+  std::printf("  %.0f publishes/s, %.0f diagnostics/s, %.1f MB/s received\n", published / elapsed,
+              diagnostics / elapsed, megabytes(static_cast<double>(publish.bytesReceived)) / elapsed);
+  printStages(publish);
+  std::printf("\n");
+  dumpMetrics(options, client);
+  client.shutdown();
+}
+
+// The mock spends a second finding the references. Streamed, they arrive in
+// batches of a thousand as it goes; otherwise all at the end.
+void benchReferences(const Options& options) {
+  static constexpr int kWorkMs = 1000;
+  LSPClient client;
+  Wakeup wakeup;
+  if (!startMock(client, wakeup, options, {"--references", std::to_string(options.references), "--partial-batch",
+                                           "1000", "--latency", std::to_string(kWorkMs), "--diagnostics", "0"})) {
+    return;
+  }
+  std::printf("references: %d locations, %d ms of server work\n", options.references, kWorkMs);
+  for (bool streamed : {true, false}) {
+    size_t received = 0;
+    double first = 0;
+    bool done = false;
+    auto start = Clock::now();
+    auto count = [&](const JSONValue& locations) {
+      if (received == 0 && locations.size() > 0) {
+        first = secondsSince(start);
+      }
+      received += locations.size();
+    };
+    LSPClient::PartialResultCallback onPartial;
+    if (streamed) {
+      onPartial = count;
+    }
+    client.references("file:///tmp/prodigeetor-bench/a.js", {0, 0}, onPartial,
+      [&](const JSONValue& result) { count(result); done = true; },
+      [&](int, const std::string&) { done = true; });
+    pumpUntil(client, wakeup, options.tickMs, [&done] { return done; });
+    std::printf("  %-8s first after %6.1f ms, all %zu after %6.1f ms\n", streamed ? "streamed" : "whole",
+                first * 1e3, received, secondsSince(start) * 1e3);
+  }
+  LSPMetrics metrics = client.metrics();
+  printStages(metrics.method("$/progress"));
+  std::printf("\n");
+  dumpMetrics(options, client);
+  client.shutdown();
+}
+
+} // anonymous namespace
+
+int main(int argc, char** argv) {
+  Options options;
+  for (int i = 1; i < argc; ++i) {
+    std::string_view arg = argv[i];
+    bool hasValue = i + 1 < argc;
+    if (arg == "--mock" && hasValue) {
+      options.mock = argv[++i];
+    } else if (arg == "--items" && hasValue) {
+      options.items = std::atoi(argv[++i]);
+    } else if (arg == "--requests" && hasValue) {
+      options.requests = std::atoi(argv[++i]);
+    } else if (arg == "--window" && hasValue) {
+      options.window = std::max(1, std::atoi(argv[++i]));
+    } else if (arg == "--references" && hasValue) {
+      options.references = std::atoi(argv[++i]);
+    } else if (arg == "--diagnostics" && hasValue) {
+      options.diagnostics = std::atoi(argv[++i]);
+    } else if (arg == "--rate" && hasValue) {
+      options.rate = std::atoi(argv[++i]);
+    } else if (arg == "--seconds" && hasValue) {
+      options.seconds = std::atof(argv[++i]);
+    } else if (arg == "--tick-ms" && hasValue) {
+      options.tickMs = std::atoi(argv[++i]);
+    } else if (arg == "--json") {
+      options.json = true;
+    } else {
+      usage();
+      return 2;
+    }
+  }
+
+  std::printf("mock server: %s, %s\n\n", options.mock.c_str(),
+              options.tickMs > 0 ? ("messages handled every " + std::to_string(options.tickMs) + " ms").c_str()
+                                 : "messages handled on wakeup");
+  benchFraming(options);
+  benchCompletion(options);
+  benchHover(options);
+  benchDiagnostics(options);
+  benchReferences(options);
+  return 0;
+}
@@ -0,0 +1,683 @@
+// A scriptable language server for exercising LSPClient and LSPManager
+// without installing real servers.
+//
+// By default it synthesizes answers: every completion request gets a list of
+// --completion-items items, every didOpen and didChange a publishDiagnostics
+// with --diagnostics entries, and --diagnostics-rate keeps publishing to each
+// open document that many times a second. --latency delays each response;
+// $/cancelRequest answers a delayed request with RequestCancelled at once.
+// References (--references locations) and workspace symbols
+// (--workspace-symbols) are streamed when the request has a
+// partialResultToken: $/progress batches of --partial-batch entries spread
+// over the latency, then an empty result.
+//
+// --replay FILE answers from a recorded session instead; --record FILE -- CMD
+// runs a real server as CMD, passing messages through, and writes the
+// session it saw to FILE. A session is one JSON object per line:
+//
+//   {"method": M, "delayMs": D, "result": R}   (or "error": E)
+//     answers the requests for method M in file order, after D ms; the last
+//     one repeats once they are used up
+//   {"after": M, "occurrence": N, "delayMs": D, "notification": {...}}
+//     sends the message D ms after the Nth client message for method M, or
+//     after each one when "occurrence" is missing
+//
+// Requests without a recorded answer get the synthesized one.
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "lsp_framer.h"
+#include "lsp_json.h"
+
+using namespace prodigeetor::lsp;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+struct Options {
+  size_t completionItems = 1000;
+  size_t diagnostics = 100;
+  double diagnosticsRate = 0;
+  int latencyMs = 0;
+  size_t references = 10;
+  size_t workspaceSymbols = 100;
+  size_t partialBatch = 500;
+  std::string replayPath;
+  std::string recordPath;
+  std::vector<std::string> recordCommand;
+};
+
+void usage() {
+  std::cerr << "usage: prodigeetor_mock_lsp [--completion-items N] [--diagnostics N]\n"
+               "                            [--diagnostics-rate PER_SECOND] [--latency MS]\n"
+               "                            [--references N] [--workspace-symbols N] [--partial-batch N]\n"
+               "                            [--replay FILE]\n"
+               "       prodigeetor_mock_lsp --record FILE -- COMMAND [ARGS...]\n";
+}
+
+void setNonBlocking(int fd) {
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+}
+
+// Writes everything, waiting while the pipe is full. A reader that went away
+// ends the process.
+void writeAll(int fd, std::string_view data) {
+  while (!data.empty()) {
+    ssize_t n = ::write(fd, data.data(), data.size());
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        struct pollfd waiting = {fd, POLLOUT, 0};
+        poll(&waiting, 1, -1);
+        continue;
+      }
+      std::exit(0);
+    }
+    data.remove_prefix(static_cast<size_t>(n));
+  }
+}
+
+void sendMessage(std::string_view body) {
+  std::string header = "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n";
+  writeAll(STDOUT_FILENO, header);
+  writeAll(STDOUT_FILENO, body);
+}
+
+int millisUntil(Clock::time_point due) {
+  auto now = Clock::now();
+  if (due <= now) {
+    return 0;
+  }
+  return static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(due - now).count()) + 1;
+}
+
+void writeRangeAt(JSONWriter& writer, int line, int start, int end) {
+  writeRange(writer, {{line, start}, {line, end}});
+}
+
+struct RecordedAnswer {
+  bool error = false;
+  std::string value; // the result or error, as JSON
+  int delayMs = 0;
+};
+
+struct RecordedNotification {
+  int occurrence = 0; // 0: after every trigger
+  int delayMs = 0;
+  std::string message;
+};
+
+class MockServer {
+public:
+  explicit MockServer(Options options) : m_options(std::move(options)) {}
+
+  bool loadSession(const std::string& path);
+  int run();
+
+private:
+  struct Scheduled {
+    std::string message;
+    int64_t requestId = -1; // responses, so they can be cancelled
+  };
+
+  Options m_options;
+  MessageFramer m_framer;
+  JSONDocument m_document;
+  JSONWriter m_writer;
+  bool m_exit = false;
+  std::multimap<Clock::time_point, Scheduled> m_scheduled; // ties keep their order
+  std::unordered_set<std::string> m_openDocuments;
+  Clock::time_point m_nextFlood;
+  std::string m_completionResult;
+
+  std::unordered_map<std::string, std::vector<RecordedAnswer>> m_answers;
+  std::unordered_map<std::string, size_t> m_answersUsed;
+  std::unordered_map<std::string, std::vector<RecordedNotification>> m_notifications;
+  std::unordered_map<std::string, int> m_occurrences;
+
+  void handle(const JSONValue& root);
+  void respond(const JSONValue& id, const std::string& method, const JSONValue& params);
+  void synthesize(const std::string& method, const JSONValue& params);
+  void writeResults(const std::string& method, const JSONValue& params, size_t begin, size_t end);
+  void stream(const JSONValue& id, const std::string& method, const JSONValue& params, int delayMs);
+  void cancel(int64_t id);
+  void publishDiagnostics(const std::string& uri);
+  void schedule(int delayMs, std::string message, int64_t requestId = -1);
+  void sendDue();
+  int timeout();
+};
+
+bool MockServer::loadSession(const std::string& path) {
+  std::ifstream file(path);
+  if (!file) {
+    std::cerr << "[Mock LSP] Cannot read " << path << std::endl;
+    return false;
+  }
+  std::string line;
+  JSONDocument document;
+  size_t lineNumber = 0;
+  while (std::getline(file, line)) {
+    ++lineNumber;
+    if (line.find_first_not_of(" \t\r") == std::string::npos) {
+      continue;
+    }
+    if (!document.parse(line) || !document.root().isObject()) {
+      std::cerr << "[Mock LSP] " << path << ":" << lineNumber << ": not a JSON object" << std::endl;
+      return false;
+    }
+    JSONValue entry = document.root();
+    int delayMs = static_cast<int>(entry["delayMs"].asInt());
+    if (JSONValue notification = entry["notification"]) {
+      RecordedNotification recorded;
+      recorded.occurrence = static_cast<int>(entry["occurrence"].asInt());
+      recorded.delayMs = delayMs;
+      recorded.message.assign(notification.raw());
+      m_notifications[entry["after"].asString("initialized")].push_back(std::move(recorded));
+    } else if (entry["method"].isString()) {
+      RecordedAnswer answer;
+      answer.delayMs = delayMs;
+      JSONValue error = entry["error"];
+      JSONValue result = entry["result"];
+      answer.error = error.isValid();
+      answer.value.assign(error ? error.raw() : result ? result.raw() : "null");
+      m_answers[entry["method"].asString()].push_back(std::move(answer));
+    } else {
+      std::cerr << "[Mock LSP] " << path << ":" << lineNumber << ": needs \"method\" or \"notification\"" << std::endl;
+      return false;
+    }
+  }
+  return true;
+}
+
+int MockServer::run() {
+  signal(SIGPIPE, SIG_IGN);
+  setNonBlocking(STDIN_FILENO);
+  m_nextFlood = Clock::now();
+  bool open = true;
+  while (open && !m_exit) {
+    struct pollfd input = {STDIN_FILENO, POLLIN, 0};
+    if (poll(&input, 1, timeout()) < 0 && errno != EINTR) {
+      return 1;
+    }
+    if (input.revents) {
+      open = m_framer.read(STDIN_FILENO, [this](std::string& message) {
+        if (m_document.parse(message)) {
+          handle(m_document.root());
+        } else {
+          std::cerr << "[Mock LSP] Malformed message: " << m_document.error() << std::endl;
+        }
+      });
+    }
+    sendDue();
+  }
+  return 0;
+}
+
+void MockServer::handle(const JSONValue& root) {
+  JSONValue id = root["id"];
+  std::string method = root["method"].asString();
+  if (method.empty()) {
+    return; // the client's reply to a request of ours
+  }
+  JSONValue params = root["params"];
+
+  if (id.isValid()) {
+    respond(id, method, params);
+  } else if (method == "textDocument/didOpen") {
+    std::string uri = params["textDocument"]["uri"].asString();
+    m_openDocuments.insert(uri);
+    publishDiagnostics(uri);
+  } else if (method == "textDocument/didChange") {
+    publishDiagnostics(params["textDocument"]["uri"].asString());
+  } else if (method == "textDocument/didClose") {
+    m_openDocuments.erase(params["textDocument"]["uri"].asString());
+  } else if (method == "$/cancelRequest") {
+    cancel(params["id"].asInt(-1));
+  } else if (method == "exit") {
+    m_exit = true;
+  }
+
+  // Recorded messages that follow this one
+  int occurrence = ++m_occurrences[method];
+  if (auto it = m_notifications.find(method); it != m_notifications.end()) {
+    for (const RecordedNotification& notification : it->second) {
+      if (notification.occurrence == 0 || notification.occurrence == occurrence) {
+        schedule(notification.delayMs, notification.message);
+      }
+    }
+  }
+}
+
+void MockServer::respond(const JSONValue& id, const std::string& method, const JSONValue& params) {
+  bool streamable = method == "textDocument/references" || method == "workspace/symbol";
+  if (streamable && params["partialResultToken"] && m_answers.find(method) == m_answers.end()) {
+    stream(id, method, params, m_options.latencyMs);
+    return;
+  }
+  m_writer.clear();
+  m_writer.beginObject().key("jsonrpc").value("2.0").key("id").raw(id.raw());
+  int delayMs = m_options.latencyMs;
+  if (auto answers = m_answers.find(method); answers != m_answers.end()) {
+    size_t& used = m_answersUsed[method];
+    const RecordedAnswer& answer = answers->second[std::min(used, answers->second.size() - 1)];
+    ++used;
+    m_writer.key(answer.error ? "error" : "result").raw(answer.value);
+    delayMs = answer.delayMs;
+  } else {
+    m_writer.key("result");
+    synthesize(method, params);
+  }
+  m_writer.endObject();
+  schedule(delayMs, m_writer.take(), id.asInt(-1));
+  m_writer.clear();
+}
+
+// Writes the result of a request for `method`.
+void MockServer::synthesize(const std::string& method, const JSONValue& params) {
+  JSONWriter& writer = m_writer;
+  std::string uri = params["textDocument"]["uri"].asString();
+  LSPPosition position = readPosition(params["position"]);
+
+  if (method == "initialize") {
+    writer.raw("{\"capabilities\":{"
+      "\"textDocumentSync\":2,"
+      "\"completionProvider\":{\"triggerCharacters\":[\".\"]},"
+      "\"hoverProvider\":true,"
+      "\"definitionProvider\":true,"
+      "\"referencesProvider\":true,"
+      "\"documentSymbolProvider\":true,"
+      "\"workspaceSymbolProvider\":true},"
+      "\"serverInfo\":{\"name\":\"prodigeetor-mock\"}}");
+  } else if (method == "textDocument/completion") {
+    if (m_completionResult.empty()) {
+      JSONWriter items;
+      items.beginObject().key("isIncomplete").value(false).key("items").beginArray();
+      for (size_t i = 0; i < m_options.completionItems; ++i) {
+        std::string index = std::to_string(i);
+        items.beginObject()
+          .key("label").value("mockItem" + index)
+          .key("kind").value(static_cast<int>(i % 25) + 1)
+          .key("detail").value("detail for mockItem" + index)
+          .key("sortText").value(std::string(8 - std::min<size_t>(8, index.size()), '0') + index)
+          .endObject();
+      }
+      items.endArray().endObject();
+      m_completionResult = items.take();
+    }
+    writer.raw(m_completionResult);
+  } else if (method == "textDocument/hover") {
+    writer.beginObject().key("contents").beginObject()
+      .key("kind").value("markdown")
+      .key("value").value("mock hover at " + std::to_string(position.line) + ":" + std::to_string(position.character))
+      .endObject().endObject();
+  } else if (method == "textDocument/definition") {
+    writer.beginObject().key("uri").value(uri).key("range");
+    writeRangeAt(writer, 0, 0, 1);
+    writer.endObject();
+  } else if (method == "textDocument/references") {
+    writeResults(method, params, 0, m_options.references);
+  } else if (method == "workspace/symbol") {
+    writeResults(method, params, 0, m_options.workspaceSymbols);
+  } else if (method == "textDocument/documentSymbol") {
+    writer.beginArray();
+    for (int i = 0; i < 100; ++i) {
+      writer.beginObject().key("name").value("symbol" + std::to_string(i)).key("kind").value(12).key("range");
+      writeRangeAt(writer, i, 0, 10);
+      writer.key("selectionRange");
+      writeRangeAt(writer, i, 0, 6);
+      writer.endObject();
+    }
+    writer.endArray();
+  } else {
+    writer.null();
+  }
+}
+
+// Entries [begin, end) of a references or workspace/symbol result, as an
+// array: locations down the requested document, or symbols a hundred to a
+// file.
+void MockServer::writeResults(const std::string& method, const JSONValue& params, size_t begin, size_t end) {
+  JSONWriter& writer = m_writer;
+  std::string uri = params["textDocument"]["uri"].asString();
+  writer.beginArray();
+  for (size_t i = begin; i < end; ++i) {
+    int line = static_cast<int>(i);
+    if (method == "workspace/symbol") {
+      writer.beginObject()
+        .key("name").value("workspaceSymbol" + std::to_string(i))
+        .key("kind").value(static_cast<int>(i % 26) + 1)
+        .key("containerName").value("mockModule" + std::to_string(i / 100))
+        .key("location").beginObject().key("uri").value("file:///mock/file" + std::to_string(i / 100) + ".js")
+        .key("range");
+      writeRangeAt(writer, line % 100, 0, 10);
+      writer.endObject().endObject();
+    } else {
+      writer.beginObject().key("uri").value(uri).key("range");
+      writeRangeAt(writer, line, 0, 1);
+      writer.endObject();
+    }
+  }
+  writer.endArray();
+}
+
+// Answers a request that asked for partial results: the batches go out as
+// $/progress spread evenly over `delayMs`, as a server finding them one after
+// another would send them, and the response itself is empty.
+void MockServer::stream(const JSONValue& id, const std::string& method, const JSONValue& params, int delayMs) {
+  size_t total = method == "workspace/symbol" ? m_options.workspaceSymbols : m_options.references;
+  size_t batchSize = std::max<size_t>(m_options.partialBatch, 1);
+  size_t batches = (total + batchSize - 1) / batchSize;
+  std::string token(params["partialResultToken"].raw());
+  for (size_t batch = 0; batch < batches; ++batch) {
+    m_writer.clear();
+    m_writer.beginObject().key("jsonrpc").value("2.0").key("method").value("$/progress")
+      .key("params").beginObject().key("token").raw(token).key("value");
+    writeResults(method, params, batch * batchSize, std::min(total, (batch + 1) * batchSize));
+    m_writer.endObject().endObject();
+    schedule(static_cast<int>(static_cast<size_t>(delayMs) * (batch + 1) / (batches + 1)), m_writer.take(),
+             id.asInt(-1));
+  }
+  m_writer.clear();
+  m_writer.beginObject().key("jsonrpc").value("2.0").key("id").raw(id.raw()).key("result").beginArray().endArray()
+    .endObject();
+  schedule(delayMs, m_writer.take(), id.asInt(-1));
+  m_writer.clear();
+}
+
+// Drops what is still scheduled for the request, batches included, and
+// answers it with RequestCancelled.
+void MockServer::cancel(int64_t id) {
+  bool pending = false;
+  for (auto it = m_scheduled.begin(); it != m_scheduled.end();) {
+    if (it->second.requestId == id) {
+      it = m_scheduled.erase(it);
+      pending = true;
+    } else {
+      ++it;
+    }
+  }
+  if (!pending) {
+    return;
+  }
+  m_writer.clear();
+  m_writer.beginObject().key("jsonrpc").value("2.0").key("id").value(id).key("error").beginObject()
+    .key("code").value(-32800).key("message").value("Request cancelled").endObject().endObject();
+  sendMessage(m_writer.str());
+}
+
+void MockServer::publishDiagnostics(const std::string& uri) {
+  if (m_options.diagnostics == 0 || !m_options.replayPath.empty()) {
+    return; // replays send what was recorded
+  }
+  JSONWriter& writer = m_writer;
+  writer.clear();
+  writer.beginObject().key("jsonrpc").value("2.0").key("method").value("textDocument/publishDiagnostics")
+    .key("params").beginObject().key("uri").value(uri).key("diagnostics").beginArray();
+  for (size_t i = 0; i < m_options.diagnostics; ++i) {
+    int line = static_cast<int>(i);
+    writer.beginObject().key("range");
+    writeRangeAt(writer, line, 0, 5);
+    writer.key("severity").value(static_cast<int>(i % 4) + 1)
+      .key("source").value("mock")
+      .key("message").value("mock diagnostic " + std::to_string(i))
+      .endObject();
+  }
+  writer.endArray().endObject().endObject();
+  sendMessage(writer.str());
+}
+
+void MockServer::schedule(int delayMs, std::string message, int64_t requestId) {
+  if (delayMs <= 0 && m_scheduled.empty()) {
+    sendMessage(message);
+    return;
+  }
+  Scheduled scheduled;
+  scheduled.message = std::move(message);
+  scheduled.requestId = requestId;
+  m_scheduled.emplace(Clock::now() + std::chrono::milliseconds(std::max(delayMs, 0)), std::move(scheduled));
+}
+
+void MockServer::sendDue() {
+  auto now = Clock::now();
+  while (!m_scheduled.empty() && m_scheduled.begin()->first <= now) {
+    sendMessage(m_scheduled.begin()->second.message);
+    m_scheduled.erase(m_scheduled.begin());
+  }
+  if (m_options.diagnosticsRate > 0 && now >= m_nextFlood) {
+    for (const std::string& uri : m_openDocuments) {
+      publishDiagnostics(uri);
+    }
+    auto interval = std::chrono::duration<double>(1.0 / m_options.diagnosticsRate);
+    m_nextFlood += std::chrono::duration_cast<Clock::duration>(interval);
+    if (m_nextFlood < now) {
+      m_nextFlood = now; // fell behind; skip rather than burst
+    }
+  }
+}
+
+int MockServer::timeout() {
+  int wait = -1;
+  if (!m_scheduled.empty()) {
+    wait = millisUntil(m_scheduled.begin()->first);
+  }
+  if (m_options.diagnosticsRate > 0 && !m_openDocuments.empty()) {
+    int flood = millisUntil(m_nextFlood);
+    wait = wait < 0 ? flood : std::min(wait, flood);
+  }
+  return wait;
+}
+
+// Passes messages between the client on stdin/stdout and the server run as
+// the command, writing what the server sent as a session for --replay.
+int record(const Options& options) {
+  std::ofstream session(options.recordPath);
+  if (!session) {
+    std::cerr << "[Mock LSP] Cannot write " << options.recordPath << std::endl;
+    return 1;
+  }
+  int toServer[2];
+  int fromServer[2];
+  if (pipe(toServer) < 0 || pipe(fromServer) < 0) {
+    std::cerr << "[Mock LSP] pipe failed: " << strerror(errno) << std::endl;
+    return 1;
+  }
+  pid_t pid = fork();
+  if (pid < 0) {
+    std::cerr << "[Mock LSP] fork failed: " << strerror(errno) << std::endl;
+    return 1;
+  }
+  if (pid == 0) {
+    dup2(toServer[0], STDIN_FILENO);
+    dup2(fromServer[1], STDOUT_FILENO);
+    close(toServer[0]);
+    close(toServer[1]);
+    close(fromServer[0]);
+    close(fromServer[1]);
+    std::vector<char*> argv;
+    for (const std::string& arg : options.recordCommand) {
+      argv.push_back(const_cast<char*>(arg.c_str()));
+    }
+    argv.push_back(nullptr);
+    execvp(argv[0], argv.data());
+    std::cerr << "[Mock LSP] Failed to exec " << argv[0] << ": " << strerror(errno) << std::endl;
+    _exit(1);
+  }
+  close(toServer[0]);
+  close(fromServer[1]);
+  signal(SIGPIPE, SIG_IGN);
+  setNonBlocking(STDIN_FILENO);
+  setNonBlocking(fromServer[0]);
+
+  struct Request {
+    std::string method;
+    Clock::time_point sentAt;
+  };
+  std::unordered_map<std::string, Request> requests; // by raw id
+  std::unordered_map<std::string, int> occurrences;
+  std::string lastMethod = "initialize";
+  int lastOccurrence = 1;
+  Clock::time_point lastAt = Clock::now();
+  auto elapsed = [](Clock::time_point since) {
+    return static_cast<int64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - since).count());
+  };
+
+  MessageFramer clientFramer;
+  MessageFramer serverFramer;
+  JSONDocument document;
+  JSONWriter line;
+  auto fromClient = [&](std::string& body) {
+    if (!document.parse(body)) {
+      return;
+    }
+    JSONValue root = document.root();
+    std::string method = root["method"].asString();
+    if (method.empty()) {
+      return;
+    }
+    if (JSONValue id = root["id"]) {
+      requests[std::string(id.raw())] = {method, Clock::now()};
+    }
+    lastMethod = method;
+    lastOccurrence = ++occurrences[method];
+    lastAt = Clock::now();
+  };
+  auto fromServerMessage = [&](std::string& body) {
+    if (!document.parse(body)) {
+      return;
+    }
+    JSONValue root = document.root();
+    JSONValue id = root["id"];
+    line.clear();
+    line.beginObject();
+    if (id.isValid() && !root["method"].isValid()) {
+      auto request = requests.find(std::string(id.raw()));
+      if (request == requests.end()) {
+        return;
+      }
+      line.key("method").value(request->second.method).key("delayMs").value(elapsed(request->second.sentAt));
+      if (JSONValue error = root["error"]) {
+        line.key("error").raw(error.raw());
+      } else {
+        line.key("result").raw(root["result"] ? root["result"].raw() : "null");
+      }
+      requests.erase(request);
+    } else {
+      line.key("after").value(lastMethod).key("occurrence").value(lastOccurrence)
+        .key("delayMs").value(elapsed(lastAt)).key("notification").raw(root.raw());
+    }
+    line.endObject();
+    session << line.str() << '\n';
+  };
+
+  char buffer[64 * 1024];
+  bool open = true;
+  while (open) {
+    struct pollfd fds[2] = {{STDIN_FILENO, POLLIN, 0}, {fromServer[0], POLLIN, 0}};
+    if (poll(fds, 2, -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      break;
+    }
+    const std::pair<int, int> routes[] = {{STDIN_FILENO, toServer[1]}, {fromServer[0], STDOUT_FILENO}};
+    for (int i = 0; i < 2 && open; ++i) {
+      if (!fds[i].revents) {
+        continue;
+      }
+      for (;;) {
+        ssize_t n = ::read(routes[i].first, buffer, sizeof(buffer));
+        if (n < 0 && errno == EINTR) {
+          continue;
+        }
+        if (n <= 0) {
+          open = n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+          break;
+        }
+        std::string_view bytes(buffer, static_cast<size_t>(n));
+        writeAll(routes[i].second, bytes);
+        if (i == 0) {
+          clientFramer.feed(bytes, fromClient);
+        } else {
+          serverFramer.feed(bytes, fromServerMessage);
+        }
+      }
+    }
+  }
+  session.flush();
+  close(toServer[1]);
+  close(fromServer[0]);
+  int status = 0;
+  waitpid(pid, &status, 0);
+  return 0;
+}
+
+} // anonymous namespace
+
+int main(int argc, char** argv) {
+  Options options;
+  for (int i = 1; i < argc; ++i) {
+    std::string_view arg = argv[i];
+    bool hasValue = i + 1 < argc;
+    if (arg == "--completion-items" && hasValue) {
+      options.completionItems = std::strtoul(argv[++i], nullptr, 10);
+    } else if (arg == "--diagnostics" && hasValue) {
+      options.diagnostics = std::strtoul(argv[++i], nullptr, 10);
+    } else if (arg == "--diagnostics-rate" && hasValue) {
+      options.diagnosticsRate = std::strtod(argv[++i], nullptr);
+    } else if (arg == "--latency" && hasValue) {
+      options.latencyMs = std::atoi(argv[++i]);
+    } else if (arg == "--references" && hasValue) {
+      options.references = std::strtoul(argv[++i], nullptr, 10);
+    } else if (arg == "--workspace-symbols" && hasValue) {
+      options.workspaceSymbols = std::strtoul(argv[++i], nullptr, 10);
+    } else if (arg == "--partial-batch" && hasValue) {
+      options.partialBatch = std::strtoul(argv[++i], nullptr, 10);
+    } else if (arg == "--replay" && hasValue) {
+      options.replayPath = argv[++i];
+    } else if (arg == "--record" && hasValue) {
+      options.recordPath = argv[++i];
+    } else if (arg == "--") {
+      options.recordCommand.assign(argv + i + 1, argv + argc);
+      break;
+    } else if (arg == "--stdio") {
+      // Passed by some clients; stdio is the only transport anyway
+    } else {
+      usage();
+      return 2;
+    }
+  }
+
+  if (!options.recordPath.empty()) {
+    if (options.recordCommand.empty()) {
+      usage();
+      return 2;
+    }
+    return record(options);
+  }
+  MockServer server(options);
+  if (!options.replayPath.empty() && !server.loadSession(options.replayPath)) {
+    return 1;
+  }
+  return server.run();
+}
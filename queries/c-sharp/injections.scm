@@ -0,0 +1,17 @@
+; SQL embedded in string literals, detected by a leading SQL keyword.
+
+((string_literal
+  (string_literal_content) @injection.content)
+ (#match? @injection.content "^\\s*(SELECT|select|INSERT|insert|UPDATE|update|DELETE|delete|WITH|with|MERGE|merge|CREATE|create|ALTER|alter|DROP|drop)\\s")
+ (#set! injection.language "sql"))
+
+((raw_string_literal
+  (raw_string_content) @injection.content)
+ (#match? @injection.content "^\\s*(SELECT|select|INSERT|insert|UPDATE|update|DELETE|delete|WITH|with|MERGE|merge|CREATE|create|ALTER|alter|DROP|drop)\\s")
+ (#set! injection.language "sql"))
+
+; Verbatim strings are a single token; trim the leading @" and trailing ".
+((verbatim_string_literal) @injection.content
+ (#match? @injection.content "^@\"\\s*(SELECT|select|INSERT|insert|UPDATE|update|DELETE|delete|WITH|with|MERGE|merge|CREATE|create|ALTER|alter|DROP|drop)\\s")
+ (#offset! @injection.content 0 2 0 -1)
+ (#set! injection.language "sql"))
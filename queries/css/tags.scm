@@ -0,0 +1,10 @@
+; Selectors and keyframes defined by a stylesheet.
+
+(class_selector
+  (class_name) @name) @definition.class
+
+(id_selector
+  (id_name) @name) @definition.id
+
+(keyframes_statement
+  (keyframes_name) @name) @definition.keyframes
@@ -0,0 +1,16 @@
+; Elements with an id are the navigation targets of an HTML document.
+
+(element
+  (start_tag
+    (attribute
+      (attribute_name) @_attribute
+      (quoted_attribute_value
+        (attribute_value) @name))
+    (#eq? @_attribute "id"))) @definition.element
+
+(element
+  (start_tag
+    (attribute
+      (attribute_name) @_attribute
+      (attribute_value) @name)
+    (#eq? @_attribute "id"))) @definition.element
@@ -0,0 +1,21 @@
+; Definitions for the workspace symbol index. The grammar has no name fields
+; on most statements; the first identifier is the defined object.
+
+(create_table_statement
+  .
+  (identifier) @name) @definition.table
+
+(create_function_statement
+  .
+  (identifier) @name) @definition.function
+
+(create_type_statement
+  .
+  (identifier) @name) @definition.type
+
+(create_domain_statement
+  .
+  (identifier) @name) @definition.type
+
+(create_index_statement
+  name: (identifier) @name) @definition.index
@@ -0,0 +1,22 @@
+; Parse the contents of tagged template literals using a language inferred
+; from the tag, e.g. sql`SELECT ...`, css`...`, html`...`.
+
+(call_expression
+  function: [
+    (identifier) @injection.language
+    (member_expression
+      property: (property_identifier) @injection.language)
+  ]
+  arguments: (template_string (string_fragment) @injection.content))
+
+; SQL in plain string literals, detected by a leading SQL keyword.
+
+((string
+  (string_fragment) @injection.content)
+ (#match? @injection.content "^\\s*(SELECT|select|INSERT|insert|UPDATE|update|DELETE|delete|WITH|with|CREATE|create|ALTER|alter|DROP|drop)\\s")
+ (#set! injection.language "sql"))
+
+((template_string
+  (string_fragment) @injection.content)
+ (#match? @injection.content "^\\s*(SELECT|select|INSERT|insert|UPDATE|update|DELETE|delete|WITH|with|CREATE|create|ALTER|alter|DROP|drop)\\s")
+ (#set! injection.language "sql"))
@@ -111,6 +111,11 @@ struct TSParser {
   TSRangeArray included_range_differences;
   unsigned included_range_difference_index;
   bool has_scanner_error;
+  // Where an interrupted parse stopped, so that resuming continues the same
+  // round over the stack versions instead of restarting it.
+  StackVersion resume_version;
+  uint32_t resume_position;
+  uint32_t resume_last_position;
 };
 
 typedef struct {
@@ -1857,6 +1862,9 @@ TSParser *ts_parser_new(void) {
   self->old_tree = NULL_SUBTREE;
   self->included_range_differences = (TSRangeArray) array_new();
   self->included_range_difference_index = 0;
+  self->resume_version = 0;
+  self->resume_position = 0;
+  self->resume_last_position = 0;
   ts_parser__set_cached_token(self, 0, NULL_SUBTREE, NULL_SUBTREE);
   return self;
 }
@@ -1987,6 +1995,9 @@ void ts_parser_reset(TSParser *self) {
   }
   self->accept_count = 0;
   self->has_scanner_error = false;
+  self->resume_version = 0;
+  self->resume_position = 0;
+  self->resume_last_position = 0;
 }
 
 TSTree *ts_parser_parse(
@@ -2003,12 +2014,17 @@ TSTree *ts_parser_parse(
   }
 
   ts_lexer_set_input(&self->lexer, input);
-  array_clear(&self->included_range_differences);
-  self->included_range_difference_index = 0;
 
+  uint32_t position = 0, last_position = 0, version_count = 0;
+  StackVersion first_version = 0;
   if (ts_parser_has_outstanding_parse(self)) {
     LOG("resume_parsing");
+    first_version = self->resume_version;
+    position = self->resume_position;
+    last_position = self->resume_last_position;
   } else {
+    array_clear(&self->included_range_differences);
+    self->included_range_difference_index = 0;
     ts_parser__external_scanner_create(self);
     if (self->has_scanner_error) goto exit;
 
@@ -2040,10 +2056,9 @@ TSTree *ts_parser_parse(
     self->end_clock = clock_null();
   }
 
-  uint32_t position = 0, last_position = 0, version_count = 0;
   do {
     for (
-      StackVersion version = 0;
+      StackVersion version = first_version;
       version_count = ts_stack_version_count(self->stack),
       version < version_count;
       version++
@@ -2061,6 +2076,9 @@ TSTree *ts_parser_parse(
 
         if (!ts_parser__advance(self, version, allow_node_reuse)) {
           if (self->has_scanner_error) goto exit;
+          self->resume_version = version;
+          self->resume_position = position;
+          self->resume_last_position = last_position;
           return NULL;
         }
 
@@ -2074,6 +2092,8 @@ TSTree *ts_parser_parse(
       }
     }
 
+    first_version = 0;
+
     // After advancing each version of the stack, re-sort the versions by their cost,
     // removing any versions that are no longer worth pursuing.
     unsigned min_error_cost = ts_parser__condense_stack(self);
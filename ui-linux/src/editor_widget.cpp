@@ -6,9 +6,11 @@
 #include <string_view>
 
 #include <gio/gio.h>
+#include <glib-unix.h>
 
 #include "grapheme.h"
 #include "core.h"
+#include "language_registry.h"
 #include "pango_renderer.h"
 #include "syntax_highlighter.h"
 #include "text_buffer.h"
@@ -18,10 +20,8 @@
 #include "lsp_types.h"
 
 struct EditorState {
-  prodigeetor::TextBuffer buffer;
-  std::unique_ptr<prodigeetor::Core> core;  // For LSP support
+  std::unique_ptr<prodigeetor::Core> core;  // Buffer, highlighting and LSP
   prodigeetor::PangoRenderer renderer;
-  prodigeetor::TreeSitterHighlighter highlighter;
   size_t cursor_offset = 0;
   size_t selection_anchor = 0;
   float line_height = 18.0f;
@@ -34,6 +34,8 @@ struct EditorState {
   std::string file_path;
   bool lsp_initialized = false;
   GFileMonitor *theme_monitor = nullptr;
+  guint parse_source = 0; // idle source resuming an over-budget parse
+  guint lsp_source = 0;   // CoreSource running tick() when LSP work is due
   prodigeetor::EditorSettings settings;
   std::string font_stack;
 };
@@ -44,16 +46,91 @@ static void editor_state_destroy(gpointer data) {
     g_object_unref(state->theme_monitor);
     state->theme_monitor = nullptr;
   }
+  if (state && state->parse_source != 0) {
+    g_source_remove(state->parse_source);
+    state->parse_source = 0;
+  }
+  if (state && state->lsp_source != 0) {
+    g_source_remove(state->lsp_source);
+    state->lsp_source = 0;
+  }
   delete static_cast<EditorState *>(data);
 }
 
+static gboolean editor_continue_parse(gpointer data) {
+  auto *state = static_cast<EditorState *>(data);
+  prodigeetor::TreeSitterHighlighter &highlighter = state->core->syntax_highlighter();
+  if (highlighter.continue_parse()) {
+    gtk_widget_queue_draw(state->widget);
+  }
+  if (highlighter.parse_pending()) {
+    return G_SOURCE_CONTINUE;
+  }
+  state->parse_source = 0;
+  return G_SOURCE_REMOVE;
+}
+
+// Parses that run out of their time budget are finished in idle slices so
+// input and drawing are never blocked by a large document.
+static void editor_schedule_parse(EditorState *state) {
+  if (state->parse_source == 0 && state->core->syntax_highlighter().parse_pending()) {
+    state->parse_source = g_idle_add_full(G_PRIORITY_DEFAULT_IDLE, editor_continue_parse, state, nullptr);
+  }
+}
+
+// Dispatches when LSP messages arrive and when the core's next timed work is
+// due (debounced edits and requests, restarts, response deadlines). The
+// deadline is asked for on every main loop iteration, so whatever an event
+// handler scheduled is picked up without polling, and an idle editor never
+// wakes up.
+struct CoreSource {
+  GSource source;
+  prodigeetor::Core *core;
+  gpointer fd_tag;
+};
+
+static gboolean core_source_prepare(GSource *source, gint *timeout) {
+  auto *core_source = reinterpret_cast<CoreSource *>(source);
+  *timeout = core_source->core->next_tick_ms();
+  return *timeout == 0;
+}
+
+static gboolean core_source_check(GSource *source) {
+  auto *core_source = reinterpret_cast<CoreSource *>(source);
+  return (g_source_query_unix_fd(source, core_source->fd_tag) & G_IO_IN) != 0 ||
+         core_source->core->next_tick_ms() == 0;
+}
+
+static gboolean core_source_dispatch(GSource *, GSourceFunc callback, gpointer data) {
+  return callback ? callback(data) : G_SOURCE_REMOVE;
+}
+
+static GSourceFuncs core_source_funcs = {
+  core_source_prepare, core_source_check, core_source_dispatch, nullptr, nullptr, nullptr,
+};
+
+static gboolean editor_lsp_tick(gpointer data) {
+  auto *state = static_cast<EditorState *>(data);
+  state->core->tick();
+  return G_SOURCE_CONTINUE;
+}
+
+static guint editor_attach_core_source(EditorState *state) {
+  GSource *source = g_source_new(&core_source_funcs, sizeof(CoreSource));
+  auto *core_source = reinterpret_cast<CoreSource *>(source);
+  core_source->core = state->core.get();
+  core_source->fd_tag = g_source_add_unix_fd(source, state->core->lsp_wakeup_fd(), G_IO_IN);
+  g_source_set_callback(source, editor_lsp_tick, state, nullptr);
+  guint id = g_source_attach(source, nullptr);
+  g_source_unref(source);
+  return id;
+}
+
 static void notify_lsp_text_changed(EditorState *state) {
   if (!state || !state->lsp_initialized || !state->core || state->file_path.empty()) {
     return;
   }
-  std::string uri = "file://" + state->file_path;
-  std::string text = state->buffer.text();
-  state->core->lsp_manager().didChange(uri, text);
+  state->core->change_file("file://" + state->file_path);
 }
 
 static void request_completion(EditorState *state) {
@@ -63,7 +140,7 @@ static void request_completion(EditorState *state) {
   }
 
   std::string uri = "file://" + state->file_path;
-  prodigeetor::Position pos = state->buffer.position_at(state->cursor_offset);
+  prodigeetor::Position pos = state->core->buffer().position_at(state->cursor_offset);
 
   std::cerr << "[Editor] Requesting completion at line " << pos.line << ", column " << pos.column << std::endl;
 
@@ -111,30 +188,39 @@ static void editor_draw(GtkDrawingArea *area, cairo_t *cr, int, int, gpointer da
     state->scroll_offset_y = static_cast<float>(gtk_adjustment_get_value(state->v_adjustment));
   }
 
-  size_t lines = state->buffer.line_count();
+  // Layout works in visible lines; folded lines are skipped through the fold map.
+  const prodigeetor::FoldMap &folds = state->core->fold_map();
+  size_t lines = folds.visible_line_count(state->core->buffer().line_count());
   float content_height = static_cast<float>(lines) * state->line_height + 16.0f;
   gtk_widget_set_size_request(state->widget, -1, static_cast<int>(content_height));
   size_t start_line = static_cast<size_t>(state->scroll_offset_y / state->line_height);
   float offset = state->scroll_offset_y - (start_line * state->line_height);
   float y = 8.0f - offset;
-  for (size_t i = start_line; i < lines && y < state->view_height; ++i) {
-    std::string line = state->buffer.line_text(i);
-    std::vector<prodigeetor::RenderSpan> spans = state->highlighter.highlight(line);
+  if (lines > 0) {
+    size_t last_visible = start_line + static_cast<size_t>(state->view_height / state->line_height) + 1;
+    state->core->set_viewport(folds.buffer_line(std::min(start_line, lines - 1)),
+                              folds.buffer_line(std::min(last_visible, lines - 1)));
+    editor_schedule_parse(state);
+  }
+  for (size_t v = start_line; v < lines && y < state->view_height; ++v) {
+    size_t i = folds.buffer_line(v);
+    std::string line = state->core->buffer().line_text(i);
+    size_t line_start = state->core->buffer().line_start(i);
+    std::vector<prodigeetor::RenderSpan> spans = state->core->highlight_spans(line_start, line_start + line.size());
+    prodigeetor::LineLayout layout = state->renderer.layout_line(line, spans);
 
     // Selection rendering
     size_t selection_start = std::min(state->cursor_offset, state->selection_anchor);
     size_t selection_end = std::max(state->cursor_offset, state->selection_anchor);
-    prodigeetor::Position sel_start_pos = state->buffer.position_at(selection_start);
-    prodigeetor::Position sel_end_pos = state->buffer.position_at(selection_end);
+    prodigeetor::Position sel_start_pos = state->core->buffer().position_at(selection_start);
+    prodigeetor::Position sel_end_pos = state->core->buffer().position_at(selection_end);
     if (selection_start != selection_end && i >= sel_start_pos.line && i <= sel_end_pos.line) {
-      size_t line_columns = state->buffer.line_grapheme_count(i);
+      size_t line_columns = state->core->buffer().line_grapheme_count(i);
       size_t start_col = (i == sel_start_pos.line) ? sel_start_pos.column : 0;
       size_t end_col = (i == sel_end_pos.line) ? sel_end_pos.column : line_columns;
 
-      std::string start_prefix = line.substr(0, prodigeetor::grapheme_byte_offset(line, start_col));
-      std::string end_prefix = line.substr(0, prodigeetor::grapheme_byte_offset(line, end_col));
-      float x_start = 8.0f + state->renderer.measure_line(start_prefix).width;
-      float x_end = 8.0f + state->renderer.measure_line(end_prefix).width;
+      float x_start = 8.0f + state->renderer.x_at_index(layout, prodigeetor::grapheme_byte_offset(line, start_col));
+      float x_end = 8.0f + state->renderer.x_at_index(layout, prodigeetor::grapheme_byte_offset(line, end_col));
       if (x_end < x_start) {
         std::swap(x_end, x_start);
       }
@@ -146,14 +232,16 @@ static void editor_draw(GtkDrawingArea *area, cairo_t *cr, int, int, gpointer da
       cairo_restore(cr);
     }
 
-    prodigeetor::LineLayout layout = state->renderer.layout_line(line, spans);
     state->renderer.draw_line(layout, 8.0f, y);
+    if (folds.is_folded(i)) {
+      prodigeetor::LineLayout marker = state->renderer.layout_line(" \u2026", {});
+      state->renderer.draw_line(marker, 8.0f + layout.metrics.width, y);
+    }
 
     // Caret rendering
-    prodigeetor::Position caret_pos = state->buffer.position_at(state->cursor_offset);
+    prodigeetor::Position caret_pos = state->core->buffer().position_at(state->cursor_offset);
     if (caret_pos.line == i) {
-      std::string caret_prefix = line.substr(0, prodigeetor::grapheme_byte_offset(line, caret_pos.column));
-      float x = 8.0f + state->renderer.measure_line(caret_prefix).width;
+      float x = 8.0f + state->renderer.x_at_index(layout, prodigeetor::grapheme_byte_offset(line, caret_pos.column));
       cairo_save(cr);
       cairo_set_source_rgb(cr, 1.0, 1.0, 1.0);
       cairo_rectangle(cr, x, y, 1.0, state->line_height);
@@ -178,45 +266,80 @@ static gboolean editor_key_pressed(GtkEventControllerKey *, guint keyval, guint,
     return TRUE;
   }
 
+  // Ctrl+Shift+[ folds the region starting on the caret line, Ctrl+Shift+] unfolds it
+  if (ctrl && (keyval == GDK_KEY_braceleft || keyval == GDK_KEY_braceright)) {
+    size_t caret_line = state->core->buffer().position_at(state->cursor_offset).line;
+    bool folded = state->core->fold_map().is_folded(caret_line);
+    if ((keyval == GDK_KEY_braceleft) != folded) {
+      state->core->toggle_fold(caret_line);
+    }
+    gtk_widget_queue_draw(state->widget);
+    return TRUE;
+  }
+
+  // Alt+Up/Alt+Down expand and shrink the selection along the syntax tree,
+  // Ctrl+M jumps to the matching bracket
+  bool alt = (state_mask & GDK_ALT_MASK) != 0;
+  if (alt && (keyval == GDK_KEY_Up || keyval == GDK_KEY_Down)) {
+    size_t start = std::min(state->cursor_offset, state->selection_anchor);
+    size_t end = std::max(state->cursor_offset, state->selection_anchor);
+    bool changed = keyval == GDK_KEY_Up ? state->core->expand_selection(start, end)
+                                        : state->core->shrink_selection(start, end);
+    if (changed) {
+      state->selection_anchor = start;
+      state->cursor_offset = end;
+      gtk_widget_queue_draw(state->widget);
+    }
+    return TRUE;
+  }
+  if (ctrl && keyval == GDK_KEY_m) {
+    size_t match = 0;
+    if (state->core->matching_bracket(state->cursor_offset, match)) {
+      state->cursor_offset = match;
+      state->selection_anchor = match;
+      gtk_widget_queue_draw(state->widget);
+    }
+    return TRUE;
+  }
+
   bool extend = (state_mask & GDK_SHIFT_MASK) != 0;
   if (!extend) {
     state->selection_anchor = state->cursor_offset;
   }
   if (keyval == GDK_KEY_BackSpace) {
-    prodigeetor::Core core;
-    core.set_text(state->buffer.text());
-    state->cursor_offset = core.delete_backward(state->cursor_offset);
-    state->buffer = core.buffer();
+    state->cursor_offset = state->core->delete_backward(state->cursor_offset);
+    editor_schedule_parse(state);
     notify_lsp_text_changed(state);
     gtk_widget_queue_draw(state->widget);
     return TRUE;
   }
   if (keyval == GDK_KEY_Left || keyval == GDK_KEY_Right) {
-    prodigeetor::Position pos = state->buffer.position_at(state->cursor_offset);
+    prodigeetor::Position pos = state->core->buffer().position_at(state->cursor_offset);
     if (keyval == GDK_KEY_Left) {
       if (pos.column > 0) {
         pos.column -= 1;
       } else if (pos.line > 0) {
         pos.line -= 1;
-        pos.column = static_cast<uint32_t>(state->buffer.line_grapheme_count(pos.line));
+        pos.column = static_cast<uint32_t>(state->core->buffer().line_grapheme_count(pos.line));
       }
     } else {
-      size_t line_cols = state->buffer.line_grapheme_count(pos.line);
+      size_t line_cols = state->core->buffer().line_grapheme_count(pos.line);
       if (pos.column < line_cols) {
         pos.column += 1;
-      } else if (pos.line + 1 < state->buffer.line_count()) {
+      } else if (pos.line + 1 < state->core->buffer().line_count()) {
         pos.line += 1;
         pos.column = 0;
       }
     }
-    state->cursor_offset = state->buffer.offset_at(pos);
+    state->cursor_offset = state->core->buffer().offset_at(pos);
     gtk_widget_queue_draw(state->widget);
     return TRUE;
   }
   if (keyval == GDK_KEY_Return || keyval == GDK_KEY_KP_Enter) {
     std::string insert = "\n";
-    state->buffer.insert(state->cursor_offset, insert);
+    state->core->insert(state->cursor_offset, insert);
     state->cursor_offset += insert.size();
+    editor_schedule_parse(state);
     notify_lsp_text_changed(state);
     gtk_widget_queue_draw(state->widget);
     return TRUE;
@@ -227,8 +350,9 @@ static gboolean editor_key_pressed(GtkEventControllerKey *, guint keyval, guint,
     char utf8[8] = {0};
     int len = g_unichar_to_utf8(unicode, utf8);
     if (len > 0) {
-      state->buffer.insert(state->cursor_offset, std::string_view(utf8, static_cast<size_t>(len)));
+      state->core->insert(state->cursor_offset, std::string_view(utf8, static_cast<size_t>(len)));
       state->cursor_offset += static_cast<size_t>(len);
+      editor_schedule_parse(state);
       notify_lsp_text_changed(state);
       gtk_widget_queue_draw(state->widget);
       return TRUE;
@@ -241,7 +365,8 @@ static float max_scroll_offset(const EditorState *state) {
   if (!state) {
     return 0.0f;
   }
-  float content_height = static_cast<float>(state->buffer.line_count()) * state->line_height + 16.0f;
+  size_t lines = state->core->fold_map().visible_line_count(state->core->buffer().line_count());
+  float content_height = static_cast<float>(lines) * state->line_height + 16.0f;
   if (content_height <= state->view_height) {
     return 0.0f;
   }
@@ -253,7 +378,7 @@ static void editor_reload_theme(EditorState *state) {
     return;
   }
   prodigeetor::SyntaxTheme theme = prodigeetor::SyntaxTheme::load_from_file(state->theme_path);
-  state->highlighter.set_theme(std::move(theme));
+  state->core->syntax_highlighter().set_theme(std::move(theme));
 }
 
 static void editor_theme_changed(GFileMonitor *, GFile *, GFile *, GFileMonitorEvent event_type, gpointer data) {
@@ -267,55 +392,9 @@ static void editor_theme_changed(GFileMonitor *, GFile *, GFile *, GFileMonitorE
   }
 }
 
-static prodigeetor::TreeSitterHighlighter::LanguageId language_for_path(const std::string &path) {
-  std::string lower = path;
-  std::transform(lower.begin(), lower.end(), lower.begin(), [](unsigned char c) {
-    return static_cast<char>(std::tolower(c));
-  });
-  if (lower.size() >= 4 && lower.ends_with(".tsx")) {
-    return prodigeetor::TreeSitterHighlighter::LanguageId::TSX;
-  }
-  if (lower.size() >= 3 && lower.ends_with(".ts")) {
-    return prodigeetor::TreeSitterHighlighter::LanguageId::TypeScript;
-  }
-  if (lower.size() >= 3 && (lower.ends_with(".js") || lower.ends_with(".jsx"))) {
-    return prodigeetor::TreeSitterHighlighter::LanguageId::JavaScript;
-  }
-  if (lower.size() >= 6 && lower.ends_with(".swift")) {
-    return prodigeetor::TreeSitterHighlighter::LanguageId::Swift;
-  }
-  if (lower.size() >= 3 && lower.ends_with(".cs")) {
-    return prodigeetor::TreeSitterHighlighter::LanguageId::CSharp;
-  }
-  if (lower.size() >= 5 && (lower.ends_with(".html") || lower.ends_with(".htm"))) {
-    return prodigeetor::TreeSitterHighlighter::LanguageId::HTML;
-  }
-  if (lower.size() >= 4 && lower.ends_with(".css")) {
-    return prodigeetor::TreeSitterHighlighter::LanguageId::CSS;
-  }
-  if (lower.size() >= 4 && lower.ends_with(".sql")) {
-    return prodigeetor::TreeSitterHighlighter::LanguageId::SQL;
-  }
-  return prodigeetor::TreeSitterHighlighter::LanguageId::JavaScript;
-}
-
 static std::string detect_language_id(const std::string &path) {
-  std::string lower = path;
-  std::transform(lower.begin(), lower.end(), lower.begin(), [](unsigned char c) {
-    return static_cast<char>(std::tolower(c));
-  });
-  if (lower.ends_with(".ts")) return "typescript";
-  if (lower.ends_with(".tsx")) return "typescriptreact";
-  if (lower.ends_with(".js")) return "javascript";
-  if (lower.ends_with(".jsx")) return "javascriptreact";
-  if (lower.ends_with(".html") || lower.ends_with(".htm")) return "html";
-  if (lower.ends_with(".css")) return "css";
-  if (lower.ends_with(".scss")) return "scss";
-  if (lower.ends_with(".less")) return "less";
-  if (lower.ends_with(".swift")) return "swift";
-  if (lower.ends_with(".cs")) return "csharp";
-  if (lower.ends_with(".sql")) return "sql";
-  return "plaintext";
+  const prodigeetor::LanguageInfo *language = prodigeetor::LanguageRegistry::instance().for_path(path);
+  return language ? language->name : "plaintext";
 }
 
 static void editor_set_cursor_from_point(EditorState *state, double x, double y, bool extend) {
@@ -326,24 +405,22 @@ static void editor_set_cursor_from_point(EditorState *state, double x, double y,
     state->selection_anchor = state->cursor_offset;
   }
   double content_y = y + state->scroll_offset_y;
-  size_t line = static_cast<size_t>((content_y - 8.0) / state->line_height);
-  if (line >= state->buffer.line_count()) {
-    line = state->buffer.line_count() > 0 ? state->buffer.line_count() - 1 : 0;
-  }
-  std::string line_text = state->buffer.line_text(line);
-  size_t column = 0;
-  float target = static_cast<float>(x - 8.0);
-  for (size_t i = 0; i <= line_text.size(); ++i) {
-    std::string prefix = line_text.substr(0, i);
-    float width = state->renderer.measure_line(prefix).width;
-    if (width >= target) {
-      column = prodigeetor::grapheme_count(prefix);
-      break;
-    }
-    column = prodigeetor::grapheme_count(line_text);
-  }
+  const prodigeetor::FoldMap &folds = state->core->fold_map();
+  size_t visible_lines = folds.visible_line_count(state->core->buffer().line_count());
+  size_t visible = static_cast<size_t>(std::max(0.0, content_y - 8.0) / state->line_height);
+  if (visible >= visible_lines) {
+    visible = visible_lines > 0 ? visible_lines - 1 : 0;
+  }
+  size_t line = folds.buffer_line(visible);
+  std::string line_text = state->core->buffer().line_text(line);
+  // Same spans as editor_draw(), so the line's drawn layout is reused
+  size_t line_start = state->core->buffer().line_start(line);
+  prodigeetor::LineLayout layout = state->renderer.layout_line(
+    line_text, state->core->highlight_spans(line_start, line_start + line_text.size()));
+  size_t index = state->renderer.index_at_x(layout, static_cast<float>(x - 8.0));
+  size_t column = prodigeetor::grapheme_count(std::string_view(line_text).substr(0, index));
   prodigeetor::Position pos{static_cast<uint32_t>(line), static_cast<uint32_t>(column)};
-  state->cursor_offset = state->buffer.offset_at(pos);
+  state->cursor_offset = state->core->buffer().offset_at(pos);
   gtk_widget_queue_draw(state->widget);
 }
 
@@ -372,8 +449,17 @@ GtkWidget *prodigeetor_editor_widget_new(void) {
     state->font_stack.append(", ");
     state->font_stack.append(fallback);
   }
+  prodigeetor::HighlightLimits limits;
+  limits.max_file_size = state->settings.syntax_max_file_size;
+  limits.max_line_length = state->settings.syntax_max_line_length;
+  limits.parse_budget_micros = static_cast<uint64_t>(state->settings.syntax_parse_budget_ms) * 1000;
+  state->core->syntax_highlighter().set_limits(limits);
+  prodigeetor::LargeFileThresholds thresholds;
+  thresholds.large_file_size = state->settings.large_file_size;
+  thresholds.map_size = state->settings.large_file_map_size;
+  thresholds.lsp_max_size = state->settings.large_file_lsp_max_size;
+  state->core->set_large_file_thresholds(thresholds);
   editor_reload_theme(state);
-  state->highlighter.set_language(prodigeetor::TreeSitterHighlighter::LanguageId::JavaScript);
   g_object_set_data_full(G_OBJECT(area), "editor-state", state, editor_state_destroy);
   gtk_drawing_area_set_draw_func(GTK_DRAWING_AREA(area), editor_draw, state, nullptr);
   gtk_widget_set_focusable(area, TRUE);
@@ -431,16 +517,37 @@ void prodigeetor_editor_widget_set_text(GtkWidget *widget, const char *text) {
   if (!state) {
     return;
   }
-  state->buffer = prodigeetor::TextBuffer(text ? text : "");
+  state->core->set_text(text ? text : "");
+  editor_schedule_parse(state);
   gtk_widget_queue_draw(widget);
 }
 
+gboolean prodigeetor_editor_widget_load_file(GtkWidget *widget, const char *path) {
+  auto *state = static_cast<EditorState *>(g_object_get_data(G_OBJECT(widget), "editor-state"));
+  if (!state || !path || !state->core->load_file(path)) {
+    return FALSE;
+  }
+  state->cursor_offset = 0;
+  state->selection_anchor = 0;
+  editor_schedule_parse(state);
+  gtk_widget_queue_draw(widget);
+  return TRUE;
+}
+
+char *prodigeetor_editor_widget_get_status(GtkWidget *widget) {
+  auto *state = static_cast<EditorState *>(g_object_get_data(G_OBJECT(widget), "editor-state"));
+  if (!state) {
+    return g_strdup("");
+  }
+  return g_strdup(state->core->large_file_status().summary().c_str());
+}
+
 char *prodigeetor_editor_widget_get_text(GtkWidget *widget) {
   auto *state = static_cast<EditorState *>(g_object_get_data(G_OBJECT(widget), "editor-state"));
   if (!state) {
     return g_strdup("");
   }
-  std::string text = state->buffer.text();
+  std::string text = state->core->buffer().text();
   return g_strdup(text.c_str());
 }
 
@@ -450,7 +557,8 @@ void prodigeetor_editor_widget_set_file_path(GtkWidget *widget, const char *path
     return;
   }
   state->file_path = path;
-  state->highlighter.set_language(language_for_path(path));
+  state->core->syntax_highlighter().set_language(detect_language_id(path));
+  editor_schedule_parse(state);
 
   // Initialize LSP if not already initialized
   if (!state->lsp_initialized && state->core) {
@@ -462,11 +570,11 @@ void prodigeetor_editor_widget_set_file_path(GtkWidget *widget, const char *path
     }
     state->core->initialize_lsp(workspace_path);
     state->lsp_initialized = true;
+    state->lsp_source = editor_attach_core_source(state);
 
     // Notify LSP about opened file
     std::string uri = "file://" + std::string(path);
     std::string language_id = detect_language_id(path);
-    std::string text = state->buffer.text();
     state->core->open_file(uri, language_id);
   }
 
@@ -502,10 +610,3 @@ void prodigeetor_editor_widget_attach_scroll(GtkWidget *widget, GtkAdjustment *v
   state->viewport = viewport;
 }
 
-void prodigeetor_editor_widget_tick(GtkWidget *widget) {
-  auto *state = static_cast<EditorState *>(g_object_get_data(G_OBJECT(widget), "editor-state"));
-  if (!state || !state->core) {
-    return;
-  }
-  state->core->tick();
-}
@@ -6,10 +6,13 @@ G_BEGIN_DECLS
 
 GtkWidget *prodigeetor_editor_widget_new(void);
 void prodigeetor_editor_widget_set_text(GtkWidget *widget, const char *text);
+// Loads a file through the core (large files are memory-mapped).
+gboolean prodigeetor_editor_widget_load_file(GtkWidget *widget, const char *path);
+// Large-file mode summary, empty when no feature is throttled.
+char *prodigeetor_editor_widget_get_status(GtkWidget *widget);
 char *prodigeetor_editor_widget_get_text(GtkWidget *widget);
 void prodigeetor_editor_widget_set_file_path(GtkWidget *widget, const char *path);
 void prodigeetor_editor_widget_set_theme_path(GtkWidget *widget, const char *path);
 void prodigeetor_editor_widget_attach_scroll(GtkWidget *widget, GtkAdjustment *vadj, GtkWidget *viewport);
-void prodigeetor_editor_widget_tick(GtkWidget *widget);
 
 G_END_DECLS
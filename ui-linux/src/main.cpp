@@ -63,14 +63,6 @@ static gboolean on_key_pressed(GtkEventControllerKey *, guint keyval, guint, Gdk
   return FALSE;
 }
 
-static gboolean lsp_tick_timer(gpointer user_data) {
-  auto *data = static_cast<AppData *>(user_data);
-  if (data && data->split_container) {
-    prodigeetor_split_container_tick_all_editors(data->split_container);
-  }
-  return G_SOURCE_CONTINUE;
-}
-
 static void on_activate(GApplication *app, gpointer) {
   auto *data = new AppData();
 
@@ -94,9 +86,6 @@ static void on_activate(GApplication *app, gpointer) {
     delete static_cast<AppData *>(ptr);
   });
 
-  // Setup LSP tick timer (60fps)
-  g_timeout_add(16, lsp_tick_timer, data);
-
   gtk_window_present(window);
 }
 
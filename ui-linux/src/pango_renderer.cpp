@@ -1,10 +1,60 @@
+#include <algorithm>
+
 #include <pango/pangocairo.h>
 
 #include "pango_renderer.h"
 
+#include "grapheme.h"
+
 namespace prodigeetor {
 
+namespace {
+
+uint64_t fnv1a(uint64_t hash, const void *data, size_t size) {
+  const auto *bytes = static_cast<const unsigned char *>(data);
+  for (size_t i = 0; i < size; ++i) {
+    hash ^= bytes[i];
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+uint64_t layout_hash(const std::string &text, const std::vector<RenderSpan> &spans, bool styled) {
+  uint64_t hash = fnv1a(1469598103934665603ull, text.data(), text.size());
+  hash = fnv1a(hash, &styled, sizeof(styled));
+  if (!styled) {
+    return hash;
+  }
+  for (const auto &span : spans) {
+    uint32_t fields[] = {span.range.start.column, span.range.end.column, span.style.fg_color};
+    hash = fnv1a(hash, fields, sizeof(fields));
+  }
+  return hash;
+}
+
+// Layouts only carry span ranges and foreground colors, so spans that
+// differ elsewhere share one.
+bool same_spans(const std::vector<RenderSpan> &a, const std::vector<RenderSpan> &b) {
+  if (a.size() != b.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < a.size(); ++i) {
+    if (a[i].range.start.column != b[i].range.start.column || a[i].range.end.column != b[i].range.end.column ||
+        a[i].style.fg_color != b[i].style.fg_color) {
+      return false;
+    }
+  }
+  return true;
+}
+
+} // namespace
+
 PangoRenderer::~PangoRenderer() {
+  clear_layout_cache();
+  if (m_pango_context) {
+    g_object_unref(m_pango_context);
+    m_pango_context = nullptr;
+  }
   if (m_font_desc) {
     pango_font_description_free(m_font_desc);
     m_font_desc = nullptr;
@@ -13,9 +63,21 @@ PangoRenderer::~PangoRenderer() {
 
 void PangoRenderer::set_context(cairo_t *context) {
   m_context = context;
+  if (!m_context) {
+    return;
+  }
+  if (!m_pango_context) {
+    m_pango_context = pango_font_map_create_context(pango_cairo_font_map_get_default());
+  }
+  // Only a change of font options or transform bumps the context's serial,
+  // which makes the cached layouts shape again when next used.
+  pango_cairo_update_context(m_context, m_pango_context);
 }
 
 void PangoRenderer::set_font(const std::string &family, float size_points) {
+  if (m_font_desc && family == m_family && size_points == m_size_points) {
+    return;
+  }
   m_family = family;
   m_size_points = size_points;
   if (m_font_desc) {
@@ -24,23 +86,106 @@ void PangoRenderer::set_font(const std::string &family, float size_points) {
   m_font_desc = pango_font_description_new();
   pango_font_description_set_family(m_font_desc, m_family.c_str());
   pango_font_description_set_absolute_size(m_font_desc, m_size_points * PANGO_SCALE);
+  clear_layout_cache();
 }
 
 void PangoRenderer::set_ligatures(bool enabled) {
+  if (enabled == m_ligatures) {
+    return;
+  }
   m_ligatures = enabled;
+  clear_layout_cache();
 }
 
-LayoutMetrics PangoRenderer::measure_line(const std::string &text) {
-  LayoutMetrics metrics;
-  if (!m_context) {
-    return metrics;
+void PangoRenderer::set_layout_cache_capacity(size_t capacity) {
+  // The layout just added is never evicted
+  m_layout_capacity = std::max<size_t>(capacity, 1);
+  while (m_layouts.size() > m_layout_capacity) {
+    CachedLayout &oldest = m_layouts.back();
+    auto [first, last] = m_layout_index.equal_range(oldest.hash);
+    for (auto it = first; it != last; ++it) {
+      if (&*it->second == &oldest) {
+        m_layout_index.erase(it);
+        break;
+      }
+    }
+    g_object_unref(oldest.layout);
+    m_layouts.pop_back();
   }
-  if (!m_font_desc) {
-    set_font(m_family, m_size_points);
+}
+
+void PangoRenderer::clear_layout_cache() {
+  for (auto &entry : m_layouts) {
+    g_object_unref(entry.layout);
   }
-  PangoLayout *layout = pango_cairo_create_layout(m_context);
+  m_layouts.clear();
+  m_layout_index.clear();
+}
+
+PangoLayout *PangoRenderer::create_layout(const std::string &text, const std::vector<RenderSpan> &spans,
+                                          bool styled) {
+  PangoLayout *layout = pango_layout_new(m_pango_context);
   pango_layout_set_font_description(layout, m_font_desc);
   pango_layout_set_text(layout, text.c_str(), static_cast<int>(text.size()));
+  if (!styled || (spans.empty() && !m_ligatures)) {
+    return layout;
+  }
+
+  PangoAttrList *attrs = pango_attr_list_new();
+  if (m_ligatures) {
+    PangoAttribute *liga_attr = pango_attr_font_features_new("liga=1");
+    pango_attr_list_insert(attrs, liga_attr);
+  }
+  for (const auto &span : spans) {
+    uint32_t color = span.style.fg_color;
+    guint16 r = static_cast<guint16>(((color >> 16) & 0xFF) * 257);
+    guint16 g = static_cast<guint16>(((color >> 8) & 0xFF) * 257);
+    guint16 b = static_cast<guint16>((color & 0xFF) * 257);
+    auto *attr = pango_attr_foreground_new(r, g, b);
+    attr->start_index = static_cast<guint>(span.range.start.column);
+    attr->end_index = static_cast<guint>(span.range.end.column);
+    pango_attr_list_insert(attrs, attr);
+  }
+  pango_layout_set_attributes(layout, attrs);
+  pango_attr_list_unref(attrs);
+  return layout;
+}
+
+PangoRenderer::CachedLayout &PangoRenderer::cached_layout(const std::string &text, const std::vector<RenderSpan> &spans,
+                                                         bool styled) {
+  if (!m_font_desc) {
+    set_font(m_family, m_size_points);
+  }
+  uint64_t hash = layout_hash(text, spans, styled);
+  auto [first, last] = m_layout_index.equal_range(hash);
+  for (auto it = first; it != last; ++it) {
+    CachedLayout &entry = *it->second;
+    if (entry.styled == styled && entry.text == text && (!styled || same_spans(entry.spans, spans))) {
+      m_layouts.splice(m_layouts.begin(), m_layouts, it->second);
+      return entry;
+    }
+  }
+
+  CachedLayout entry;
+  entry.hash = hash;
+  entry.text = text;
+  if (styled) {
+    entry.spans = spans;
+  }
+  entry.styled = styled;
+  entry.layout = create_layout(text, spans, styled);
+  m_layouts.push_front(std::move(entry));
+  m_layout_index.emplace(hash, m_layouts.begin());
+  set_layout_cache_capacity(m_layout_capacity);
+  return m_layouts.front();
+}
+
+LayoutMetrics PangoRenderer::measure_line(const std::string &text) {
+  LayoutMetrics metrics;
+  if (!m_pango_context) {
+    return metrics;
+  }
+  PangoLayout *layout = cached_layout(text, {}, false).layout;
 
   PangoRectangle ink_rect;
   PangoRectangle logical_rect;
@@ -49,8 +194,6 @@ LayoutMetrics PangoRenderer::measure_line(const std::string &text) {
   metrics.width = static_cast<float>(logical_rect.width);
   metrics.height = static_cast<float>(logical_rect.height);
   metrics.baseline = static_cast<float>(pango_layout_get_baseline(layout)) / PANGO_SCALE;
-
-  g_object_unref(layout);
   return metrics;
 }
 
@@ -58,7 +201,17 @@ LineLayout PangoRenderer::layout_line(const std::string &text, const std::vector
   LineLayout layout;
   layout.text = text;
   layout.spans = spans;
-  layout.metrics = measure_line(text);
+  if (!m_pango_context) {
+    return layout;
+  }
+  // Measured on the layout draw_line() shows, so a line is shaped once
+  PangoLayout *pango_layout = cached_layout(text, spans, true).layout;
+  PangoRectangle ink_rect;
+  PangoRectangle logical_rect;
+  pango_layout_get_pixel_extents(pango_layout, &ink_rect, &logical_rect);
+  layout.metrics.width = static_cast<float>(logical_rect.width);
+  layout.metrics.height = static_cast<float>(logical_rect.height);
+  layout.metrics.baseline = static_cast<float>(pango_layout_get_baseline(pango_layout)) / PANGO_SCALE;
   return layout;
 }
 
@@ -66,47 +219,43 @@ void PangoRenderer::draw_line(const LineLayout &layout, float x, float y) {
   if (!m_context) {
     return;
   }
-  if (!m_font_desc) {
-    set_font(m_family, m_size_points);
-  }
-  PangoLayout *pango_layout = pango_cairo_create_layout(m_context);
-  pango_layout_set_font_description(pango_layout, m_font_desc);
-  pango_layout_set_text(pango_layout, layout.text.c_str(), static_cast<int>(layout.text.size()));
-
-  if (!layout.spans.empty()) {
-    PangoAttrList *attrs = pango_attr_list_new();
-    if (m_ligatures) {
-      PangoAttribute *liga_attr = pango_attr_font_features_new("liga=1");
-      pango_attr_list_insert(attrs, liga_attr);
-    }
-    for (const auto &span : layout.spans) {
-      uint32_t color = span.style.fg_color;
-      guint16 r = static_cast<guint16>(((color >> 16) & 0xFF) * 257);
-      guint16 g = static_cast<guint16>(((color >> 8) & 0xFF) * 257);
-      guint16 b = static_cast<guint16>((color & 0xFF) * 257);
-      auto *attr = pango_attr_foreground_new(r, g, b);
-      attr->start_index = static_cast<guint>(span.range.start.column);
-      attr->end_index = static_cast<guint>(span.range.end.column);
-      pango_attr_list_insert(attrs, attr);
-    }
-    pango_layout_set_attributes(pango_layout, attrs);
-    pango_attr_list_unref(attrs);
-  } else {
-    if (m_ligatures) {
-      PangoAttrList *attrs = pango_attr_list_new();
-      PangoAttribute *liga_attr = pango_attr_font_features_new("liga=1");
-      pango_attr_list_insert(attrs, liga_attr);
-      pango_layout_set_attributes(pango_layout, attrs);
-      pango_attr_list_unref(attrs);
-    }
-  }
+  PangoLayout *pango_layout = cached_layout(layout.text, layout.spans, true).layout;
 
   cairo_save(m_context);
   cairo_move_to(m_context, x, y);
   pango_cairo_show_layout(m_context, pango_layout);
   cairo_restore(m_context);
+}
 
-  g_object_unref(pango_layout);
+size_t PangoRenderer::index_at_x(const LineLayout &layout, float x) {
+  if (!m_pango_context || x <= 0.0f || layout.text.empty()) {
+    return 0;
+  }
+  CachedLayout &entry = cached_layout(layout.text, layout.spans, true);
+  int index = 0;
+  int trailing = 0;
+  pango_layout_xy_to_index(entry.layout, static_cast<int>(x * PANGO_SCALE), 0, &index, &trailing);
+
+  // Pango reports the grapheme under x and whether x is past its middle
+  if (!entry.grapheme_boundaries) {
+    entry.grapheme_boundaries = grapheme_boundaries(layout.text);
+  }
+  const std::vector<size_t> &boundaries = *entry.grapheme_boundaries;
+  auto next = std::upper_bound(boundaries.begin(), boundaries.end(), static_cast<size_t>(index));
+  if (trailing > 0) {
+    return next == boundaries.end() ? layout.text.size() : *next;
+  }
+  return next == boundaries.begin() ? 0 : *std::prev(next);
+}
+
+float PangoRenderer::x_at_index(const LineLayout &layout, size_t index) {
+  if (!m_pango_context || index == 0) {
+    return 0.0f;
+  }
+  PangoLayout *pango_layout = cached_layout(layout.text, layout.spans, true).layout;
+  PangoRectangle pos;
+  pango_layout_index_to_pos(pango_layout, static_cast<int>(std::min(index, layout.text.size())), &pos);
+  return static_cast<float>(pos.x) / PANGO_SCALE;
 }
 
 } // namespace prodigeetor
@@ -1,9 +1,20 @@
 #pragma once
 
+#include <cstdint>
+#include <list>
+#include <optional>
+#include <unordered_map>
+
+#include <pango/pangocairo.h>
+
 #include "rendering.h"
 
 namespace prodigeetor {
 
+// Shaped layouts are kept in an LRU cache keyed by line text, style spans
+// and whether they are styled, so redrawing or scrolling over unchanged lines
+// does not shape them again. Edits and theme changes give lines new keys;
+// font and ligature changes drop the cache.
 class PangoRenderer final : public TextRendererAdapter {
 public:
   void set_font(const std::string &family, float size_points) override;
@@ -11,16 +22,42 @@ public:
   LayoutMetrics measure_line(const std::string &text) override;
   LineLayout layout_line(const std::string &text, const std::vector<RenderSpan> &spans) override;
   void draw_line(const LineLayout &layout, float x, float y) override;
+  // Answered from the line's cached layout, without shaping prefixes
+  size_t index_at_x(const LineLayout &layout, float x) override;
+  float x_at_index(const LineLayout &layout, size_t index) override;
 
   void set_context(cairo_t *context);
+  void set_layout_cache_capacity(size_t capacity);
   ~PangoRenderer() override;
 
 private:
-  cairo_t *m_context = nullptr;
+  struct CachedLayout {
+    uint64_t hash = 0;
+    std::string text;
+    std::vector<RenderSpan> spans;
+    bool styled = false;
+    PangoLayout *layout = nullptr;
+    // Filled by the first hit-test, so dragging over the line reuses them
+    std::optional<std::vector<size_t>> grapheme_boundaries;
+  };
+
+  // Returns the shaped layout of the text, from the cache when it is there;
+  // styled layouts carry the spans' colors and the ligature setting.
+  CachedLayout &cached_layout(const std::string &text, const std::vector<RenderSpan> &spans, bool styled);
+  PangoLayout *create_layout(const std::string &text, const std::vector<RenderSpan> &spans, bool styled);
+  void clear_layout_cache();
+
+  cairo_t *m_context = nullptr;            // valid while drawing
+  // Shared by the cached layouts; measuring and hit-testing only need this,
+  // so they also work outside a draw
+  PangoContext *m_pango_context = nullptr;
   PangoFontDescription *m_font_desc = nullptr;
   std::string m_family = "Monospace";
   float m_size_points = 14.0f;
   bool m_ligatures = true;
+  std::list<CachedLayout> m_layouts; // most recently used first
+  std::unordered_multimap<uint64_t, std::list<CachedLayout>::iterator> m_layout_index;
+  size_t m_layout_capacity = 1024;
 };
 
 } // namespace prodigeetor
@@ -184,17 +184,10 @@ void prodigeetor_tab_container_open_file(GtkWidget *container, const char *file_
   tab->editor = prodigeetor_editor_widget_new();
 
   // Load file content
-  GError *error = nullptr;
-  char *contents = nullptr;
-  gsize length = 0;
-
-  if (g_file_get_contents(file_path, &contents, &length, &error)) {
-    prodigeetor_editor_widget_set_text(tab->editor, contents);
+  if (prodigeetor_editor_widget_load_file(tab->editor, file_path)) {
     prodigeetor_editor_widget_set_file_path(tab->editor, file_path);
-    g_free(contents);
   } else {
-    g_warning("Failed to load file: %s", error ? error->message : "unknown error");
-    if (error) g_error_free(error);
+    g_warning("Failed to load file: %s", file_path);
   }
 
   // Create scroll window
@@ -215,6 +208,13 @@ void prodigeetor_tab_container_open_file(GtkWidget *container, const char *file_
   GtkWidget *label = create_tab_label(tab->display_name.c_str(), page_num, state);
   tab->label = label;
 
+  // Large-file mode is reported on the tab
+  char *status = prodigeetor_editor_widget_get_status(tab->editor);
+  if (status[0] != '\0') {
+    gtk_widget_set_tooltip_text(label, status);
+  }
+  g_free(status);
+
   // Add to notebook
   gtk_notebook_append_page(GTK_NOTEBOOK(state->notebook), tab->scroll_window, label);
   gtk_notebook_set_tab_reorderable(GTK_NOTEBOOK(state->notebook), tab->scroll_window, TRUE);
@@ -352,16 +352,3 @@ void prodigeetor_tab_container_set_title_callback(GtkWidget *container,
   state->title_callback = callback;
   state->title_callback_data = user_data;
 }
-
-void prodigeetor_tab_container_tick_all_editors(GtkWidget *container) {
-  auto *state = static_cast<TabContainerState *>(
-    g_object_get_data(G_OBJECT(container), "tab-container-state"));
-
-  if (!state) return;
-
-  for (const auto &tab : state->tabs) {
-    if (tab->editor) {
-      prodigeetor_editor_widget_tick(tab->editor);
-    }
-  }
-}
@@ -13,9 +13,19 @@ NS_ASSUME_NONNULL_BEGIN
 - (void)saveFile:(NSString *)uri;
 - (void)didChangeFile:(NSString *)uri;
 - (void)setText:(NSString *)text;
+- (BOOL)loadFileAtPath:(NSString *)path;
 - (NSString *)getText;
+// Raw UTF-8 bytes; the range need not fall on character boundaries.
+- (NSData *)textBytesFromOffset:(NSInteger)start toOffset:(NSInteger)end;
+- (void)setLargeFileSize:(NSInteger)largeFileSize mapSize:(NSInteger)mapSize lspMaxSize:(NSInteger)lspMaxSize;
+- (BOOL)highlightsViewportOnly;
+- (NSString *)largeFileSummary;
 - (NSInteger)lineCount;
 - (NSString *)lineTextAt:(NSInteger)lineIndex;
+- (NSInteger)visibleLineCount;
+- (NSInteger)bufferLineForVisibleLine:(NSInteger)visibleLine;
+- (BOOL)isFoldedAtLine:(NSInteger)lineIndex;
+- (BOOL)toggleFoldAtLine:(NSInteger)lineIndex;
 - (NSInteger)lineGraphemeCount:(NSInteger)lineIndex;
 - (NSInteger)insertText:(NSString *)text atOffset:(NSInteger)offset;
 - (NSInteger)deleteBackwardFromOffset:(NSInteger)offset;
@@ -70,8 +70,7 @@
     return;
   }
   std::string uriStr = std::string([uri UTF8String]);
-  std::string text = _core->buffer().text();
-  _core->lsp_manager().didChange(uriStr, text);
+  _core->change_file(uriStr);
 }
 
 - (void)setText:(NSString *)text {
@@ -85,6 +84,46 @@
   _core->set_text(std::move(value));
 }
 
+- (BOOL)loadFileAtPath:(NSString *)path {
+  if (!_core || !path) {
+    return NO;
+  }
+  return _core->load_file(std::string([path UTF8String])) ? YES : NO;
+}
+
+- (NSData *)textBytesFromOffset:(NSInteger)start toOffset:(NSInteger)end {
+  if (!_core) {
+    return [NSData data];
+  }
+  std::string text = _core->buffer().text_range(static_cast<size_t>(start), static_cast<size_t>(end));
+  return [NSData dataWithBytes:text.data() length:text.size()];
+}
+
+- (void)setLargeFileSize:(NSInteger)largeFileSize mapSize:(NSInteger)mapSize lspMaxSize:(NSInteger)lspMaxSize {
+  if (!_core) {
+    return;
+  }
+  prodigeetor::LargeFileThresholds thresholds;
+  thresholds.large_file_size = static_cast<size_t>(largeFileSize);
+  thresholds.map_size = static_cast<size_t>(mapSize);
+  thresholds.lsp_max_size = static_cast<size_t>(lspMaxSize);
+  _core->set_large_file_thresholds(thresholds);
+}
+
+- (BOOL)highlightsViewportOnly {
+  if (!_core) {
+    return NO;
+  }
+  return _core->large_file_status().highlight_viewport_only ? YES : NO;
+}
+
+- (NSString *)largeFileSummary {
+  if (!_core) {
+    return @"";
+  }
+  return [NSString stringWithUTF8String:_core->large_file_status().summary().c_str()];
+}
+
 - (NSString *)getText {
   if (!_core) {
     return @"";
@@ -108,6 +147,34 @@
   return [NSString stringWithUTF8String:line.c_str()];
 }
 
+- (NSInteger)visibleLineCount {
+  if (!_core) {
+    return 0;
+  }
+  return static_cast<NSInteger>(_core->fold_map().visible_line_count(_core->line_count()));
+}
+
+- (NSInteger)bufferLineForVisibleLine:(NSInteger)visibleLine {
+  if (!_core) {
+    return visibleLine;
+  }
+  return static_cast<NSInteger>(_core->fold_map().buffer_line(static_cast<size_t>(visibleLine)));
+}
+
+- (BOOL)isFoldedAtLine:(NSInteger)lineIndex {
+  if (!_core) {
+    return NO;
+  }
+  return _core->fold_map().is_folded(static_cast<size_t>(lineIndex)) ? YES : NO;
+}
+
+- (BOOL)toggleFoldAtLine:(NSInteger)lineIndex {
+  if (!_core) {
+    return NO;
+  }
+  return _core->toggle_fold(static_cast<size_t>(lineIndex)) ? YES : NO;
+}
+
 - (NSInteger)lineGraphemeCount:(NSInteger)lineIndex {
   if (!_core) {
     return 0;
@@ -19,6 +19,9 @@ public:
 
   ~CoreTextRenderer() override;
 
+protected:
+  bool ascii_advances(float *advances) override;
+
 private:
   CTFontRef m_font = nullptr;
   CGContextRef m_context = nullptr;
@@ -40,6 +40,7 @@ void CoreTextRenderer::set_context(CGContextRef context) {
 }
 
 void CoreTextRenderer::set_font(const std::string &family, float size_points) {
+  invalidate_ascii_advances();
   if (m_font) {
     CFRelease(m_font);
     m_font = nullptr;
@@ -58,6 +59,7 @@ void CoreTextRenderer::set_font_stack(const std::vector<std::string> &families,
     set_font("Menlo", size_points);
     return;
   }
+  invalidate_ascii_advances();
   for (const auto &family : families) {
     if (m_font) {
       CFRelease(m_font);
@@ -117,6 +119,32 @@ LayoutMetrics CoreTextRenderer::measure_line(const std::string &text) {
   return metrics;
 }
 
+// Monospaced fonts do not kern, so their lines are the sum of their glyphs'
+// advances; ligatures keep the cells they replace.
+bool CoreTextRenderer::ascii_advances(float *advances) {
+  if (!m_font) {
+    set_font("Menlo", 14.0f);
+  }
+  if ((CTFontGetSymbolicTraits(m_font) & kCTFontTraitMonoSpace) == 0) {
+    return false;
+  }
+  constexpr CFIndex count = '~' - ' ' + 1;
+  UniChar characters[count];
+  for (CFIndex i = 0; i < count; ++i) {
+    characters[i] = static_cast<UniChar>(' ' + i);
+  }
+  CGGlyph glyphs[count];
+  if (!CTFontGetGlyphsForCharacters(m_font, characters, glyphs, count)) {
+    return false; // some drawn from a fallback font
+  }
+  CGSize sizes[count];
+  CTFontGetAdvancesForGlyphs(m_font, kCTFontOrientationHorizontal, glyphs, sizes, count);
+  for (CFIndex i = 0; i < count; ++i) {
+    advances[i] = static_cast<float>(sizes[i].width);
+  }
+  return true;
+}
+
 LineLayout CoreTextRenderer::layout_line(const std::string &text, const std::vector<RenderSpan> &spans) {
   LineLayout layout;
   layout.text = text;
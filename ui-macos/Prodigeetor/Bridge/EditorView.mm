@@ -1,10 +1,14 @@
 #import "EditorView.h"
 #import "CoreBridge.h"
 
+#include <algorithm>
 #include <string>
+#include <string_view>
 #include <vector>
 
 #include "CoreTextRenderer.h"
+#include "grapheme.h"
+#include "language_registry.h"
 #include "settings.h"
 #include "syntax_highlighter.h"
 #include "theme.h"
@@ -27,6 +31,29 @@ static std::string resolveResourcePath(NSString *relativePath) {
   return std::string([relativePath UTF8String]);
 }
 
+// Viewport-only highlighting parses this many lines around the visible ones,
+// but never more than kHighlightWindowBytes.
+static const NSInteger kHighlightWindowMargin = 200;
+static const NSInteger kHighlightWindowBytes = 1024 * 1024;
+
+// Runs of a highlighted window [windowStart, windowEnd) that intersect document
+// bytes [start, end), with columns relative to start.
+static std::vector<prodigeetor::RenderSpan> windowSpans(const prodigeetor::HighlightRuns &runs, size_t windowStart,
+                                                        size_t windowEnd, size_t start, size_t end) {
+  size_t clippedStart = std::max(start, windowStart);
+  size_t clippedEnd = std::min(end, windowEnd);
+  if (clippedStart >= clippedEnd) {
+    return {};
+  }
+  std::vector<prodigeetor::RenderSpan> spans = runs.slice(clippedStart - windowStart, clippedEnd - windowStart);
+  uint32_t shift = static_cast<uint32_t>(clippedStart - start);
+  for (auto &span : spans) {
+    span.range.start.column += shift;
+    span.range.end.column += shift;
+  }
+  return spans;
+}
+
 @interface EditorView ()
 @property (nonatomic, strong) CoreBridge *coreBridge;
 @end
@@ -52,6 +79,12 @@ static std::string resolveResourcePath(NSString *relativePath) {
   BOOL _caretVisible;
   prodigeetor::EditorSettings _settings;
   BOOL _lspInitialized;
+  std::string _highlightedText;
+  // Document bytes held by _highlighter; the whole document unless the core
+  // is in viewport-only (large-file) mode.
+  NSInteger _highlightStart;
+  NSInteger _highlightEnd;
+  BOOL _highlightWindowValid;
 }
 
 - (instancetype)initWithFrame:(NSRect)frameRect coreBridge:(CoreBridge *)coreBridge {
@@ -61,6 +94,14 @@ static std::string resolveResourcePath(NSString *relativePath) {
     std::string settingsPath = resolveResourcePath(@"settings/default.json");
     _settings = prodigeetor::SettingsLoader::load_from_file(settingsPath);
     _fontFamily = [NSString stringWithUTF8String:_settings.font_family.c_str()];
+    prodigeetor::HighlightLimits limits;
+    limits.max_file_size = _settings.syntax_max_file_size;
+    limits.max_line_length = _settings.syntax_max_line_length;
+    limits.parse_budget_micros = static_cast<uint64_t>(_settings.syntax_parse_budget_ms) * 1000;
+    _highlighter.set_limits(limits);
+    [_coreBridge setLargeFileSize:static_cast<NSInteger>(_settings.large_file_size)
+                          mapSize:static_cast<NSInteger>(_settings.large_file_map_size)
+                       lspMaxSize:static_cast<NSInteger>(_settings.large_file_lsp_max_size)];
     _fontSize = 14.0;
     _cursorOffset = 0;
     _selectionAnchor = 0;
@@ -76,7 +117,6 @@ static std::string resolveResourcePath(NSString *relativePath) {
 
     _themePath = @"themes/default.json";
     [self reloadThemeIfNeeded:YES];
-    _highlighter.set_language(prodigeetor::TreeSitterHighlighter::LanguageId::JavaScript);
 
     std::vector<std::string> families;
     families.push_back(_settings.font_family);
@@ -147,9 +187,18 @@ static std::string resolveResourcePath(NSString *relativePath) {
     _caretVisible = !_caretVisible;
     _lastBlink = now;
   }
+  // A parse that ran out of its time budget is finished one slice per frame.
+  if (_highlighter.parse_pending()) {
+    _highlighter.continue_parse();
+  }
   [self setNeedsDisplay:YES];
 }
 
+- (void)documentDidChange {
+  _highlightWindowValid = NO;
+  [self notifyLSPTextChanged];
+}
+
 - (void)notifyLSPTextChanged {
   if (!_lspInitialized || !_filePath || _filePath.length == 0) {
     return;
@@ -179,26 +228,13 @@ static std::string resolveResourcePath(NSString *relativePath) {
   if (!_filePath) {
     return;
   }
-  NSString *lower = _filePath.lowercaseString;
-  if ([lower hasSuffix:@".ts"]) {
-    _highlighter.set_language(prodigeetor::TreeSitterHighlighter::LanguageId::TypeScript);
-  } else if ([lower hasSuffix:@".tsx"]) {
-    _highlighter.set_language(prodigeetor::TreeSitterHighlighter::LanguageId::TSX);
-  } else if ([lower hasSuffix:@".js"] || [lower hasSuffix:@".jsx"]) {
-    _highlighter.set_language(prodigeetor::TreeSitterHighlighter::LanguageId::JavaScript);
-  } else if ([lower hasSuffix:@".swift"]) {
-    _highlighter.set_language(prodigeetor::TreeSitterHighlighter::LanguageId::Swift);
-  } else if ([lower hasSuffix:@".cs"]) {
-    _highlighter.set_language(prodigeetor::TreeSitterHighlighter::LanguageId::CSharp);
-  } else if ([lower hasSuffix:@".html"] || [lower hasSuffix:@".htm"]) {
-    _highlighter.set_language(prodigeetor::TreeSitterHighlighter::LanguageId::HTML);
-  } else if ([lower hasSuffix:@".css"]) {
-    _highlighter.set_language(prodigeetor::TreeSitterHighlighter::LanguageId::CSS);
-  } else if ([lower hasSuffix:@".sql"]) {
-    _highlighter.set_language(prodigeetor::TreeSitterHighlighter::LanguageId::SQL);
-  } else {
-    _highlighter.set_language(prodigeetor::TreeSitterHighlighter::LanguageId::JavaScript);
-  }
+  const prodigeetor::LanguageInfo *language = prodigeetor::LanguageRegistry::instance().for_path(_filePath.UTF8String);
+  _highlighter.set_language(language ? language->name : "");
+  _highlightWindowValid = NO;
+  _highlightedText.clear();
+  // Large-file mode is reported as the view's tooltip
+  NSString *summary = [self.coreBridge largeFileSummary];
+  self.toolTip = summary.length > 0 ? summary : nil;
   [self setNeedsDisplay:YES];
 }
 
@@ -278,23 +314,10 @@ static std::string resolveResourcePath(NSString *relativePath) {
   if (localX <= 0) {
     return 0;
   }
-  __block NSInteger column = 0;
-  __block NSInteger graphemeIndex = 0;
-  [line enumerateSubstringsInRange:NSMakeRange(0, line.length)
-                           options:NSStringEnumerationByComposedCharacterSequences
-                        usingBlock:^(__unused NSString *substring, NSRange substringRange, __unused NSRange enclosingRange, BOOL *stop) {
-    graphemeIndex += 1;
-    NSString *prefix = [line substringWithRange:NSMakeRange(0, NSMaxRange(substringRange))];
-    std::string prefixUtf8 = std::string([prefix UTF8String]);
-    prodigeetor::LayoutMetrics metrics = _renderer.measure_line(prefixUtf8);
-    if (metrics.width >= localX) {
-      column = graphemeIndex - 1;
-      *stop = YES;
-    } else {
-      column = graphemeIndex;
-    }
-  }];
-  return column;
+  prodigeetor::LineLayout layout;
+  layout.text = std::string([line UTF8String]);
+  size_t index = _renderer.index_at_x(layout, static_cast<float>(localX));
+  return static_cast<NSInteger>(prodigeetor::grapheme_count(std::string_view(layout.text).substr(0, index)));
 }
 
 - (void)updateSelectionWithCursor:(BOOL)extendSelection {
@@ -305,7 +328,7 @@ static std::string resolveResourcePath(NSString *relativePath) {
 }
 
 - (CGFloat)maxScrollOffset {
-  NSInteger lineCount = [self.coreBridge lineCount];
+  NSInteger lineCount = [self.coreBridge visibleLineCount];
   CGFloat contentHeight = lineCount * _lineHeight + 16.0;
   CGFloat viewHeight = self.bounds.size.height;
   if (contentHeight <= viewHeight) {
@@ -320,7 +343,7 @@ static std::string resolveResourcePath(NSString *relativePath) {
   if (lineIndex < 0) {
     lineIndex = 0;
   }
-  NSInteger lineCount = [self.coreBridge lineCount];
+  NSInteger lineCount = [self.coreBridge visibleLineCount];
   if (lineCount == 0) {
     _cursorOffset = 0;
     [self updateSelectionWithCursor:extendSelection];
@@ -329,6 +352,7 @@ static std::string resolveResourcePath(NSString *relativePath) {
   if (lineIndex >= lineCount) {
     lineIndex = lineCount - 1;
   }
+  lineIndex = [self.coreBridge bufferLineForVisibleLine:lineIndex];
   NSString *line = [self.coreBridge lineTextAt:lineIndex];
   NSInteger column = [self columnForX:point.x inLine:line];
   _cursorOffset = [self.coreBridge offsetAtLine:lineIndex column:column];
@@ -441,6 +465,19 @@ static std::string resolveResourcePath(NSString *relativePath) {
       [self reloadThemeIfNeeded:YES];
       return;
     }
+    // Cmd+Option+[ folds the region starting on the caret line, Cmd+Option+] unfolds it
+    if ((event.modifierFlags & NSEventModifierFlagOption) == NSEventModifierFlagOption) {
+      NSString *key = event.charactersIgnoringModifiers;
+      BOOL foldKey = [key isEqualToString:@"["];
+      if (foldKey || [key isEqualToString:@"]"]) {
+        NSInteger caretLine = [[self.coreBridge positionAtOffset:_cursorOffset][0] integerValue];
+        if (foldKey != [self.coreBridge isFoldedAtLine:caretLine]) {
+          [self.coreBridge toggleFoldAtLine:caretLine];
+        }
+        [self setNeedsDisplay:YES];
+        return;
+      }
+    }
   }
   switch (event.keyCode) {
     case 123: // left arrow
@@ -458,12 +495,12 @@ static std::string resolveResourcePath(NSString *relativePath) {
     case 36: // return/enter
     case 76: // numpad enter
       _cursorOffset = [self.coreBridge insertText:@"\n" atOffset:_cursorOffset];
-      [self notifyLSPTextChanged];
+      [self documentDidChange];
       [self updateSelectionWithCursor:NO];
       return;
     case 51: // delete/backspace
       _cursorOffset = [self.coreBridge deleteBackwardFromOffset:_cursorOffset];
-      [self notifyLSPTextChanged];
+      [self documentDidChange];
       [self updateSelectionWithCursor:NO];
       return;
     default:
@@ -472,7 +509,7 @@ static std::string resolveResourcePath(NSString *relativePath) {
   NSString *characters = event.characters;
   if (characters.length > 0) {
     _cursorOffset = [self.coreBridge insertText:characters atOffset:_cursorOffset];
-    [self notifyLSPTextChanged];
+    [self documentDidChange];
     [self updateSelectionWithCursor:NO];
     return;
   }
@@ -533,6 +570,35 @@ static std::string resolveResourcePath(NSString *relativePath) {
   NSRectFill(caret);
 }
 
+// Large-file mode: highlight a window of lines around the viewport, rebuilt
+// only once the visible lines leave it or the document is edited.
+- (void)updateHighlightWindowFromLine:(NSInteger)firstLine toLine:(NSInteger)lastLine {
+  NSInteger lines = [self.coreBridge lineCount];
+  auto lineEnd = ^NSInteger(NSInteger line) {
+    if (line + 1 < lines) {
+      return [self.coreBridge offsetAtLine:line + 1 column:0];
+    }
+    return [self.coreBridge offsetAtLine:line column:[self.coreBridge lineGraphemeCount:line]];
+  };
+  NSInteger visibleStart = [self.coreBridge offsetAtLine:firstLine column:0];
+  NSInteger visibleEnd = MIN(lineEnd(lastLine), visibleStart + kHighlightWindowBytes / 2);
+  if (_highlightWindowValid && visibleStart >= _highlightStart && visibleEnd <= _highlightEnd) {
+    return;
+  }
+  NSInteger windowStart = [self.coreBridge offsetAtLine:MAX(firstLine - kHighlightWindowMargin, 0) column:0];
+  NSInteger windowEnd = lineEnd(MIN(lastLine + kHighlightWindowMargin, lines - 1));
+  if (windowEnd - windowStart > kHighlightWindowBytes) {
+    windowStart = MAX(windowStart, visibleStart - kHighlightWindowBytes / 4);
+    windowEnd = MIN(windowEnd, windowStart + kHighlightWindowBytes);
+  }
+  _highlightStart = windowStart;
+  _highlightEnd = windowEnd;
+  _highlightWindowValid = YES;
+  _highlightedText.clear();
+  NSData *windowText = [self.coreBridge textBytesFromOffset:windowStart toOffset:windowEnd];
+  _highlighter.set_text(std::string(static_cast<const char *>(windowText.bytes), windowText.length));
+}
+
 - (void)drawRect:(NSRect)dirtyRect {
   [super drawRect:dirtyRect];
 
@@ -550,22 +616,38 @@ static std::string resolveResourcePath(NSString *relativePath) {
   _lineHeight = metrics.height > 0 ? metrics.height : _lineHeight;
   _baseline = metrics.baseline > 0 ? metrics.baseline : _baseline;
 
-  NSInteger lineCount = [self.coreBridge lineCount];
+  // Layout works in visible lines; folded lines are skipped by the core's fold map.
+  NSInteger lineCount = [self.coreBridge visibleLineCount];
   CGFloat contentHeight = lineCount * _lineHeight + 16.0;
   if (self.frame.size.height != contentHeight) {
     self.frame = NSMakeRect(self.frame.origin.x, self.frame.origin.y, self.frame.size.width, contentHeight);
   }
 
   _scrollOffsetY = self.bounds.origin.y;
-  // Highlight the entire document once to get all syntax spans
-  NSString *fullText = [self.coreBridge getText];
-  std::string documentText = std::string([fullText UTF8String]);
-  std::vector<prodigeetor::RenderSpan> allSpans = _highlighter.highlight(documentText);
-
   NSInteger startLine = (NSInteger)floor(_scrollOffsetY / _lineHeight);
+  if ([self.coreBridge highlightsViewportOnly]) {
+    NSInteger lastLine = startLine + (NSInteger)ceil(self.bounds.size.height / _lineHeight);
+    [self updateHighlightWindowFromLine:[self.coreBridge bufferLineForVisibleLine:startLine]
+                                 toLine:[self.coreBridge bufferLineForVisibleLine:MIN(lastLine, MAX(lineCount - 1, 0))]];
+  } else {
+    // Reparse only when the text changed; an unchanged document keeps its
+    // highlights (or its pending, budgeted parse).
+    NSString *fullText = [self.coreBridge getText];
+    std::string documentText = std::string([fullText UTF8String]);
+    if (!_highlightWindowValid || _highlightStart != 0 || documentText != _highlightedText) {
+      _highlightStart = 0;
+      _highlightEnd = static_cast<NSInteger>(documentText.size());
+      _highlightWindowValid = YES;
+      _highlightedText = documentText;
+      _highlighter.set_text(std::move(documentText));
+    }
+  }
+  const prodigeetor::HighlightRuns &runs = _highlighter.runs();
+
   CGFloat offset = _scrollOffsetY - (startLine * _lineHeight);
   CGFloat y = 8.0 - offset;
-  for (NSInteger i = startLine; i < lineCount && y < self.bounds.size.height; i++) {
+  for (NSInteger v = startLine; v < lineCount && y < self.bounds.size.height; v++) {
+    NSInteger i = [self.coreBridge bufferLineForVisibleLine:v];
     NSString *line = [self.coreBridge lineTextAt:i];
     std::string lineText = std::string([line UTF8String]);
 
@@ -573,25 +655,17 @@ static std::string resolveResourcePath(NSString *relativePath) {
     NSInteger lineStartOffset = [self.coreBridge offsetAtLine:i column:0];
     NSInteger lineEndOffset = [self.coreBridge offsetAtLine:i column:[self.coreBridge lineGraphemeCount:i]];
 
-    // Filter spans that apply to this line
-    std::vector<prodigeetor::RenderSpan> lineSpans;
-    for (const auto &span : allSpans) {
-      // Check if this span overlaps with the current line
-      if (span.range.start.column < (uint32_t)lineEndOffset && span.range.end.column > (uint32_t)lineStartOffset) {
-        prodigeetor::RenderSpan lineSpan = span;
-        // Adjust span positions to be relative to the line start
-        lineSpan.range.start.column = (span.range.start.column > (uint32_t)lineStartOffset)
-            ? span.range.start.column - lineStartOffset
-            : 0;
-        lineSpan.range.end.column = (span.range.end.column < (uint32_t)lineEndOffset)
-            ? span.range.end.column - lineStartOffset
-            : lineEndOffset - lineStartOffset;
-        lineSpans.push_back(lineSpan);
-      }
-    }
+    // Runs are sorted and non-overlapping, so this is a binary search
+    std::vector<prodigeetor::RenderSpan> lineSpans =
+        windowSpans(runs, static_cast<size_t>(_highlightStart), static_cast<size_t>(_highlightEnd),
+                    static_cast<size_t>(lineStartOffset), static_cast<size_t>(lineEndOffset));
 
     prodigeetor::LineLayout layout = _renderer.layout_line(lineText, lineSpans);
     _renderer.draw_line(layout, 8.0f, static_cast<float>(y));
+    if ([self.coreBridge isFoldedAtLine:i]) {
+      prodigeetor::LineLayout marker = _renderer.layout_line(" \u2026", {});
+      _renderer.draw_line(marker, 8.0f + layout.metrics.width, static_cast<float>(y));
+    }
 
     [self drawSelectionForLine:i lineText:line y:y];
     [self drawCaretForLine:i lineText:line y:y];
@@ -54,8 +54,10 @@ final class EditorViewController: NSViewController {
 
   /// Load content from a file path
   func loadFile(at path: String) throws {
-    let content = try String(contentsOfFile: path, encoding: .utf8)
-    coreBridge.setText(content)
+    // The core reads the file itself so large files can be memory-mapped
+    guard coreBridge.loadFile(atPath: path) else {
+      throw EditorError.loadFailed(path)
+    }
     currentFilePath = path
     displayName = (path as NSString).lastPathComponent
     isDirty = false
@@ -212,11 +214,14 @@ final class EditorViewController: NSViewController {
 
 enum EditorError: Error {
   case noFilePath
+  case loadFailed(String)
 
   var localizedDescription: String {
     switch self {
     case .noFilePath:
       return "No file path specified"
+    case .loadFailed(let path):
+      return "Could not read \(path)"
     }
   }
 }